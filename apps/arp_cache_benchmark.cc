@@ -0,0 +1,198 @@
+#include "arp_message.hh"
+#include "neighbor_table.hh"
+#include "network_interface.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_neighbors = 100'000;
+constexpr size_t num_lookups = 1 << 22;
+constexpr size_t num_ticks = 1000;
+constexpr size_t cache_time = 30'000;
+constexpr size_t datagrams_per_tick = 256;
+
+//! Where lookup results end up, so the compiler can't discard the lookups
+volatile uint64_t sink = 0;
+
+//! The ARP cache as the original NetworkInterface kept it: a std::map, aged entry by entry on every tick
+class MapCache {
+    struct Entry {
+        size_t caching_time;
+        EthernetAddress MAC_address;
+    };
+    map<uint32_t, Entry> _cache{};
+
+  public:
+    void insert(const uint32_t ip, const EthernetAddress &address) { _cache[ip] = {0, address}; }
+
+    const EthernetAddress *find(const uint32_t ip) const {
+        const auto it = _cache.find(ip);
+        return it == _cache.end() ? nullptr : &it->second.MAC_address;
+    }
+
+    void tick(const size_t ms_since_last_tick) {
+        queue<uint32_t> deleted_ips;
+        for (auto &[ip, entry] : _cache) {
+            entry.caching_time += ms_since_last_tick;
+            if (entry.caching_time >= cache_time) {
+                deleted_ips.push(ip);
+            }
+        }
+        while (not deleted_ips.empty()) {
+            _cache.erase(deleted_ips.front());
+            deleted_ips.pop();
+        }
+    }
+
+    size_t size() const { return _cache.size(); }
+};
+
+//! The same operations on a NeighborTable
+class TableCache {
+    NeighborTable _table{};
+    uint64_t _now = 0;
+
+  public:
+    void insert(const uint32_t ip, const EthernetAddress &address) {
+        NeighborTable::Neighbor &neighbor = _table.insert(ip);
+        neighbor.ethernet_address = address;
+        _table.set_expiry(neighbor, _now + cache_time);
+    }
+
+    const EthernetAddress *find(const uint32_t ip) const {
+        const NeighborTable::Neighbor *neighbor = _table.find(ip);
+        return neighbor ? &neighbor->ethernet_address.value() : nullptr;
+    }
+
+    void tick(const size_t ms_since_last_tick) {
+        _now += ms_since_last_tick;
+        _table.expire(_now);
+    }
+
+    size_t size() const { return _table.size(); }
+};
+
+EthernetAddress ethernet_address(const uint32_t id) {
+    return {0x02, 0, uint8_t(id >> 24), uint8_t(id >> 16), uint8_t(id >> 8), uint8_t(id)};
+}
+
+double elapsed_ns(const high_resolution_clock::time_point start) {
+    return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+}
+
+template <typename Cache>
+void benchmark(const string &name, const vector<uint32_t> &ips, const vector<uint32_t> &lookups) {
+    Cache cache;
+    auto start = high_resolution_clock::now();
+    for (const uint32_t ip : ips) {
+        cache.insert(ip, ethernet_address(ip));
+    }
+    const double insert_ns = elapsed_ns(start) / ips.size();
+
+    start = high_resolution_clock::now();
+    uint64_t sum = 0;
+    for (const uint32_t ip : lookups) {
+        const EthernetAddress *address = cache.find(ip);
+        sum += address ? address->back() : 0;
+    }
+    const double lookup_ns = elapsed_ns(start) / lookups.size();
+    sink = sum;
+
+    start = high_resolution_clock::now();
+    for (size_t i = 0; i < num_ticks; i++) {
+        cache.tick(1);
+    }
+    const double tick_ns = elapsed_ns(start) / num_ticks;
+
+    start = high_resolution_clock::now();
+    cache.tick(cache_time);
+    const double expire_ms = elapsed_ns(start) / 1e6;
+    if (cache.size() != 0) {
+        throw runtime_error(name + ": entries survived past their cache time");
+    }
+
+    cout << "  " << left << setw(14) << name << right << setw(10) << insert_ns << " ns/insert" << setw(10)
+         << lookup_ns << " ns/lookup" << setw(14) << tick_ns << " ns/tick" << setw(10) << expire_ms
+         << " ms to expire all\n";
+}
+
+//! Send datagrams to random neighbors of a NetworkInterface that knows them all, ticking every so often
+double interface_datagrams_per_second(const vector<uint32_t> &ips, const vector<uint32_t> &lookups) {
+    const Address own_ip{"10.0.0.1"};
+    NetworkInterface interface{ethernet_address(0), own_ip};
+    for (const uint32_t ip : ips) {
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = ethernet_address(ip);
+        arp.sender_ip_address = ip;
+        arp.target_ethernet_address = ethernet_address(0);
+        arp.target_ip_address = own_ip.ipv4_numeric();
+        EthernetFrame frame;
+        frame.header() = {ethernet_address(0), ethernet_address(ip), EthernetHeader::TYPE_ARP};
+        frame.payload() = arp.serialize();
+        interface.recv_frame(frame);
+    }
+
+    InternetDatagram dgram;
+    dgram.header().len = dgram.header().hlen * 4;
+    size_t sent = 0;
+    const auto start = high_resolution_clock::now();
+    for (size_t i = 0; i < lookups.size(); i++) {
+        interface.send_datagram(dgram, Address::from_ipv4_numeric(lookups[i]));
+        if (i % datagrams_per_tick == datagrams_per_tick - 1) {
+            interface.tick(1);
+            auto &frames = interface.frames_out();
+            for (; not frames.empty(); frames.pop()) {
+                sent += frames.front().header().type == EthernetHeader::TYPE_IPv4;
+            }
+        }
+    }
+    const double ns = elapsed_ns(start);
+    if (sent != lookups.size() - lookups.size() % datagrams_per_tick) {
+        throw runtime_error("NetworkInterface did not send every datagram straight away");
+    }
+    return lookups.size() * 1e9 / ns;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        vector<uint32_t> ips;
+        ips.reserve(num_neighbors);
+        for (uint32_t i = 0; i < num_neighbors; i++) {
+            ips.push_back(0x0a000000 + 2 + i);  // 10.0.0.2 onwards, as on one big subnet
+        }
+        shuffle(ips.begin(), ips.end(), rd);
+
+        vector<uint32_t> lookups(num_lookups);
+        for (auto &ip : lookups) {
+            ip = ips[rd() % ips.size()];
+        }
+
+        cout << fixed << setprecision(1);
+        cout << "ARP cache with " << num_neighbors << " neighbors:\n";
+        benchmark<MapCache>("std::map", ips, lookups);
+        benchmark<TableCache>("NeighborTable", ips, lookups);
+
+        cout << setprecision(0) << "NetworkInterface::send_datagram to random neighbors, ticking every "
+             << datagrams_per_tick << " datagrams: " << interface_datagrams_per_second(ips, lookups)
+             << " datagrams/s\n";
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t bytes_per_trial = 256 * 1024 * 1024;
+
+constexpr InternetChecksum::Kernel all_kernels[] = {
+    InternetChecksum::Kernel::Scalar, InternetChecksum::Kernel::SSE2, InternetChecksum::Kernel::AVX2};
+
+//! The original byte-at-a-time algorithm, kept as the reference and as the baseline to beat
+uint16_t bytewise_checksum(const string &data) {
+    uint32_t sum = 0;
+    bool parity = false;
+    for (const char ch : data) {
+        uint16_t val = uint8_t(ch);
+        if (not parity) {
+            val <<= 8;
+        }
+        sum += val;
+        parity = !parity;
+    }
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    return ~sum;
+}
+
+uint16_t kernel_checksum(const string &data) {
+    InternetChecksum check;
+    check.add(data);
+    return check.value();
+}
+
+double gigabits_per_second(const string &data, uint16_t (*const checksum)(const string &)) {
+    const size_t iterations = max(size_t(1), bytes_per_trial / data.size());
+    uint16_t sink = 0;
+
+    // call through a volatile pointer so the compiler can't inline and hoist the checksum out of the loop
+    uint16_t (*volatile checksum_function)(const string &) = checksum;
+
+    const auto first_time = high_resolution_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink ^= checksum_function(data);
+    }
+    const auto final_time = high_resolution_clock::now();
+
+    if (sink == 0x1234 and iterations == 0) {
+        cout << sink;
+    }
+
+    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+    return iterations * data.size() * 8.0 / double(duration);
+}
+
+//! Check that every kernel matches the reference, including when the input is split at odd offsets
+void check_kernels(const string &data) {
+    const uint16_t expected = bytewise_checksum(data);
+    for (const auto k : all_kernels) {
+        if (not InternetChecksum::supported(k)) {
+            continue;
+        }
+        InternetChecksum::set_kernel(k);
+        for (size_t split = 0; split <= min(data.size(), size_t(67)); split++) {
+            InternetChecksum check;
+            check.add(string_view(data).substr(0, split));
+            check.add(string_view(data).substr(split));
+            if (check.value() != expected) {
+                throw runtime_error(as_string(k) + " kernel disagrees with the reference (size " +
+                                    to_string(data.size()) + ", split at " + to_string(split) + ")");
+            }
+        }
+    }
+}
+
+void benchmark(const size_t size) {
+    string data(size, 0);
+    for (auto &ch : data) {
+        ch = rand();
+    }
+
+    check_kernels(data);
+
+    cout << setw(6) << size << " bytes: bytewise " << setw(7) << gigabits_per_second(data, bytewise_checksum);
+    for (const auto k : all_kernels) {
+        if (not InternetChecksum::supported(k)) {
+            continue;
+        }
+        InternetChecksum::set_kernel(k);
+        cout << "  " << as_string(k) << " " << setw(7) << gigabits_per_second(data, kernel_checksum);
+    }
+    cout << "  (Gbit/s)\n";
+}
+
+int main() {
+    try {
+        const auto default_kernel = InternetChecksum::kernel();
+        cout << fixed << setprecision(2);
+        cout << "InternetChecksum throughput (default kernel: " << as_string(default_kernel) << ")\n";
+        for (size_t size = 64; size <= 64 * 1024; size *= 4) {
+            benchmark(size);
+        }
+        InternetChecksum::set_kernel(default_kernel);
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -111,11 +111,12 @@ class NetworkInterfaceAdapter : public TCPOverIPv4Adapter {
         send_pending();
     }
     void tick(const size_t ms_since_last_tick) {
+        TCPOverIPv4Adapter::tick(ms_since_last_tick);
         _interface.tick(ms_since_last_tick);
         send_pending();
     }
     NetworkInterface &interface() { return _interface; }
-    queue<EthernetFrame> frames_out() { return _interface.frames_out(); }
+    EgressQueue &frames_out() { return _interface.frames_out(); }
 
     operator FileDescriptor &() { return _data_socket_pair.first; }
     FileDescriptor &frame_fd() { return _data_socket_pair.second; }
@@ -188,6 +189,9 @@ void program_body(bool is_client, const string &bounce_host, const string &bounc
     TCPSocketLab7 sock =
         is_client ? TCPSocketLab7{{"192.168.0.50"}, {"192.168.0.1"}} : TCPSocketLab7{{"172.16.0.100"}, {"172.16.0.1"}};
 
+    /* let the neighbors on both sides learn the router's Ethernet addresses */
+    router.announce();
+
     atomic<bool> exit_flag {};
 
     /* set up the network */
@@ -253,6 +257,7 @@ void program_body(bool is_client, const string &bounce_host, const string &bounc
                 }
                 router.interface(host_side).tick(50);
                 router.interface(internet_side).tick(50);
+                router.tick(50);
                 if (exit_flag) {
                     return;
                 }
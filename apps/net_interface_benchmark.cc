@@ -0,0 +1,99 @@
+#include "arp_message.hh"
+#include "network_interface.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_frames = 1 << 22;
+constexpr size_t frames_per_drain = 64;
+
+const EthernetAddress own_ethernet_address = {0x02, 0, 0, 0, 0, 1};
+const EthernetAddress neighbor_ethernet_address = {0x02, 0, 0, 0, 0, 2};
+
+//! Where frame sizes end up, so the compiler can't discard the work
+volatile uint64_t sink = 0;
+
+//! A small datagram, so that the per-frame overhead shows
+InternetDatagram make_datagram(const size_t payload_size) {
+    InternetDatagram dgram;
+    dgram.header().src = Address{"10.0.0.1"}.ipv4_numeric();
+    dgram.header().dst = Address{"10.0.0.2"}.ipv4_numeric();
+    dgram.payload() = string(payload_size, 'x');
+    dgram.header().len = dgram.header().hlen * 4 + payload_size;
+    return dgram;
+}
+
+//! Frames per second through `send` (which queues one frame), popping (and maybe serializing) them in batches
+template <typename Send>
+double frames_per_second(EgressQueue &frames, const bool serialize, const Send &send) {
+    uint64_t bytes = 0;
+    const auto start = high_resolution_clock::now();
+    for (size_t i = 0; i < num_frames; i += frames_per_drain) {
+        for (size_t j = 0; j < frames_per_drain; j++) {
+            send();
+        }
+        for (; not frames.empty(); frames.pop()) {
+            bytes += serialize ? frames.front().serialize().size() : 1;
+        }
+    }
+    const auto ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+    sink = bytes;
+    return num_frames * 1e9 / double(ns);
+}
+
+int main() {
+    try {
+        const Address next_hop{"10.0.0.2"};
+        NetworkInterface interface{own_ethernet_address, Address{"10.0.0.1"}};
+
+        // teach the interface its neighbor's Ethernet address
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = neighbor_ethernet_address;
+        arp.sender_ip_address = next_hop.ipv4_numeric();
+        arp.target_ethernet_address = own_ethernet_address;
+        arp.target_ip_address = Address{"10.0.0.1"}.ipv4_numeric();
+        EthernetFrame arp_frame;
+        arp_frame.header() = {own_ethernet_address, neighbor_ethernet_address, EthernetHeader::TYPE_ARP};
+        arp_frame.payload() = arp.serialize();
+        interface.recv_frame(arp_frame);
+
+        cout << fixed << setprecision(0);
+        for (const size_t payload_size : {0, 64, 1400}) {
+            const InternetDatagram dgram = make_datagram(payload_size);
+            cout << "Datagrams with " << payload_size << "-byte payloads:\n";
+            for (const bool serialize : {false, true}) {
+                // a frame built field by field, as NetworkInterface used to
+                EgressQueue queue;
+                const double field_by_field = frames_per_second(queue, serialize, [&] {
+                    EthernetFrame frame;
+                    frame.header().type = EthernetHeader::TYPE_IPv4;
+                    frame.header().src = own_ethernet_address;
+                    frame.header().dst = neighbor_ethernet_address;
+                    frame.payload() = dgram.serialize();
+                    queue.push(move(frame));
+                });
+                const double templated = frames_per_second(
+                    interface.frames_out(), serialize, [&] { interface.send_datagram(dgram, next_hop); });
+
+                const string what = serialize ? ", serialized:" : ":";
+                cout << "  " << left << setw(42) << "header built field by field" + what << right << setw(10)
+                     << field_by_field << " frames/s\n";
+                cout << "  " << left << setw(42) << "send_datagram()" + what << right << setw(10) << templated
+                     << " frames/s\n";
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,17 @@
 #include "arp_message.hh"
+#include "icmp_message.hh"
 #include "router.hh"
+#include "tcp_segment.hh"
 #include "util.hh"
 
+#include <algorithm>
+#include <deque>
+#include <iomanip>
 #include <iostream>
 #include <list>
+#include <sstream>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -35,12 +42,14 @@ EthernetAddress random_router_ethernet_address() {
 
 uint32_t ip(const string &str) { return Address{str}.ipv4_numeric(); }
 
-template <typename T>
-void clear(T &queue1, T &queue2) {
-    while (not queue1.empty()) {
-        queue1.pop();
-        queue2.pop();
+//! Take every frame waiting in an interface's egress queue
+vector<EthernetFrame> take_frames(EgressQueue &frames) {
+    vector<EthernetFrame> ret;
+    while (not frames.empty()) {
+        ret.push_back(move(frames.front()));
+        frames.pop();
     }
+    return ret;
 }
 
 string summary(const EthernetFrame &frame) {
@@ -119,6 +128,26 @@ class Host {
         return dgram;
     }
 
+    InternetDatagram send_tcp_to(const Address &destination, const uint16_t sport, const uint16_t dport) {
+        InternetDatagram dgram;
+        dgram.header().src = _my_address.ipv4_numeric();
+        dgram.header().dst = destination.ipv4_numeric();
+        dgram.header().proto = IPv4Header::PROTO_TCP;
+        TCPSegment seg;
+        seg.header().sport = sport;
+        seg.header().dport = dport;
+        seg.payload() = string("flow payload");
+        dgram.header().len = dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
+        dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+
+        _interface.send_datagram(dgram, _next_hop);
+
+        cerr << "Host " << _name << " trying to send TCP datagram (with next hop = " << _next_hop.ip()
+             << "): " << dgram.header().summary() << " ports " << sport << " -> " << dport << "\n";
+
+        return dgram;
+    }
+
     const Address &address() { return _my_address; }
 
     AsyncNetworkInterface &interface() { return _interface; }
@@ -127,6 +156,16 @@ class Host {
 
     const string &name() { return _name; }
 
+    //! Take every datagram received so far, without checking them against expectations
+    vector<InternetDatagram> take_received() {
+        vector<InternetDatagram> ret;
+        while (not _interface.datagrams_out().empty()) {
+            ret.push_back(move(_interface.datagrams_out().front()));
+            _interface.datagrams_out().pop();
+        }
+        return ret;
+    }
+
     void check() {
         while (not _interface.datagrams_out().empty()) {
             const auto &dgram_received = _interface.datagrams_out().front();
@@ -151,7 +190,7 @@ class Network {
   private:
     Router _router{};
 
-    size_t default_id, eth0_id, eth1_id, eth2_id, uun3_id, hs4_id, mit5_id;
+    size_t default_id, eth0_id, eth1_id, eth2_id, uun3_id, hs4_id, mit5_id, isp6_id, isp7_id;
 
     std::unordered_map<string, Host> _hosts{};
 
@@ -159,13 +198,10 @@ class Network {
                          AsyncNetworkInterface &x,
                          const string &y_name,
                          AsyncNetworkInterface &y) {
-        auto x_frames = x.frames_out(), y_frames = y.frames_out();
+        const auto x_frames = take_frames(x.frames_out()), y_frames = take_frames(y.frames_out());
 
         deliver(x_name, x_frames, y_name, y);
         deliver(y_name, y_frames, x_name, x);
-
-        clear(x_frames, x.frames_out());
-        clear(y_frames, y.frames_out());
     }
 
     void exchange_frames(const string &x_name,
@@ -174,7 +210,8 @@ class Network {
                          AsyncNetworkInterface &y,
                          const string &z_name,
                          AsyncNetworkInterface &z) {
-        auto x_frames = x.frames_out(), y_frames = y.frames_out(), z_frames = z.frames_out();
+        const auto x_frames = take_frames(x.frames_out()), y_frames = take_frames(y.frames_out()),
+                   z_frames = take_frames(z.frames_out());
 
         deliver(x_name, x_frames, y_name, y);
         deliver(x_name, x_frames, z_name, z);
@@ -184,23 +221,16 @@ class Network {
 
         deliver(z_name, z_frames, x_name, x);
         deliver(z_name, z_frames, y_name, y);
-
-        clear(x_frames, x.frames_out());
-        clear(y_frames, y.frames_out());
-        clear(z_frames, z.frames_out());
     }
 
     void deliver(const string &src_name,
-                 const queue<EthernetFrame> &src,
+                 const vector<EthernetFrame> &src,
                  const string &dst_name,
                  AsyncNetworkInterface &dst) {
-        queue<EthernetFrame> to_send = src;
-        while (not to_send.empty()) {
-            to_send.front().payload() = to_send.front().payload().concatenate();
-            cerr << "Transferring frame from " << src_name << " to " << dst_name << ": " << summary(to_send.front())
-                 << "\n";
-            dst.recv_frame(move(to_send.front()));
-            to_send.pop();
+        for (EthernetFrame frame : src) {
+            frame.payload() = frame.payload().concatenate();
+            cerr << "Transferring frame from " << src_name << " to " << dst_name << ": " << summary(frame) << "\n";
+            dst.recv_frame(move(frame));
         }
     }
 
@@ -212,7 +242,9 @@ class Network {
         , eth2_id(_router.add_interface({random_router_ethernet_address(), {"192.168.0.1"}}))
         , uun3_id(_router.add_interface({random_router_ethernet_address(), {"198.178.229.1"}}))
         , hs4_id(_router.add_interface({random_router_ethernet_address(), {"143.195.0.2"}}))
-        , mit5_id(_router.add_interface({random_router_ethernet_address(), {"128.30.76.255"}})) {
+        , mit5_id(_router.add_interface({random_router_ethernet_address(), {"128.30.76.255"}}))
+        , isp6_id(_router.add_interface({random_router_ethernet_address(), {"100.64.0.1"}}))
+        , isp7_id(_router.add_interface({random_router_ethernet_address(), {"100.64.1.1"}})) {
         _hosts.insert({"applesauce", {"applesauce", {"10.0.0.2"}, {"10.0.0.1"}}});
         _hosts.insert({"default_router", {"default_router", {"171.67.76.1"}, {"0"}}});
         ;
@@ -220,6 +252,8 @@ class Network {
         _hosts.insert({"hs_router", {"hs_router", {"143.195.0.1"}, {"0"}}});
         _hosts.insert({"dm42", {"dm42", {"198.178.229.42"}, {"198.178.229.1"}}});
         _hosts.insert({"dm43", {"dm43", {"198.178.229.43"}, {"198.178.229.1"}}});
+        _hosts.insert({"isp_a", {"isp_a", {"100.64.0.2"}, {"100.64.0.1"}}});
+        _hosts.insert({"isp_b", {"isp_b", {"100.64.1.2"}, {"100.64.1.1"}}});
 
         _router.add_route(ip("0.0.0.0"), 0, host("default_router").address(), default_id);
         _router.add_route(ip("10.0.0.0"), 8, {}, eth0_id);
@@ -230,6 +264,9 @@ class Network {
         _router.add_route(ip("143.195.128.0"), 18, host("hs_router").address(), hs4_id);
         _router.add_route(ip("143.195.192.0"), 19, host("hs_router").address(), hs4_id);
         _router.add_route(ip("128.30.76.255"), 16, Address{"128.30.0.1"}, mit5_id);
+        // two equal-cost uplinks to the same network
+        _router.add_route(ip("8.0.0.0"), 8, {{host("isp_a").address(), isp6_id}, {host("isp_b").address(), isp7_id}});
+        _router.announce();
     }
 
     void simulate_physical_connections() {
@@ -244,13 +281,23 @@ class Network {
                         host("dm42").interface(),
                         "dm43",
                         host("dm43").interface());
+        exchange_frames("router.isp6", _router.interface(isp6_id), "isp_a", host("isp_a").interface());
+        exchange_frames("router.isp7", _router.interface(isp7_id), "isp_b", host("isp_b").interface());
     }
 
-    void simulate() {
+    //! Let the traffic flow, without checking where it went
+    void run() {
         for (unsigned int i = 0; i < 256; i++) {
             _router.route();
             simulate_physical_connections();
         }
+    }
+
+    //! Let time pass for the router (which refills its ICMP rate limit)
+    void tick(const size_t ms) { _router.tick(ms); }
+
+    void simulate() {
+        run();
 
         for (auto &host : _hosts) {
             host.second.check();
@@ -269,6 +316,152 @@ class Network {
     }
 };
 
+//! Results of sending through a congested link
+struct BottleneckResult {
+    EgressQueue::Stats queue{};
+    uint64_t bulk_delivered = 0;
+    uint64_t sparse_delivered = 0;
+    uint64_t sparse_total_delay = 0;
+    uint64_t sparse_max_delay = 0;
+
+    double sparse_mean_delay() const { return sparse_delivered ? double(sparse_total_delay) / sparse_delivered : 0; }
+};
+
+//! \brief Several bulk flows and one sparse flow (think of an interactive session) share a slow link
+//! \details The router's egress link sends one frame per millisecond. Each bulk flow adjusts its
+//! window as TCP would (one more datagram per window delivered, and half the window after a loss, which
+//! the receiver reports on the next arrival), so the flows keep the link's queue as full as its
+//! discipline allows. The sparse flow sends a small datagram every 10 ms.
+BottleneckResult simulate_bottleneck(const EgressQueue::Discipline discipline) {
+    constexpr size_t num_bulk_flows = 4, duration = 20000, one_way_delay = 10, sparse_period = 10;
+    constexpr uint32_t client_ip = 0x0a000002, server_ip = 0xac100102;  // 10.0.0.2+, 172.16.1.2
+    constexpr size_t sparse_flow = num_bulk_flows;
+
+    Router router;
+    const size_t in = router.add_interface({random_router_ethernet_address(), {"10.0.0.1"}});
+    const size_t out = router.add_interface({random_router_ethernet_address(), {"172.16.0.1"}});
+    router.add_route(ip("172.16.0.0"), 16, Address{"172.16.0.2"}, out);
+
+    EgressQueue::Config config;
+    config.discipline = discipline;
+    config.limit = 1000;
+    router.interface(out).set_queue_discipline(config);
+
+    // learn the gateway's Ethernet address
+    const EthernetAddress gateway_ethernet_address = random_host_ethernet_address();
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REQUEST;
+    arp.sender_ethernet_address = gateway_ethernet_address;
+    arp.sender_ip_address = ip("172.16.0.2");
+    arp.target_ip_address = ip("172.16.0.1");
+    EthernetFrame arp_frame;
+    arp_frame.header() = {ETHERNET_BROADCAST, gateway_ethernet_address, EthernetHeader::TYPE_ARP};
+    arp_frame.payload() = arp.serialize();
+    router.interface(out).recv_frame(arp_frame);
+    take_frames(router.interface(out).frames_out());
+
+    struct Flow {
+        double cwnd = 1;
+        size_t in_flight = 0;
+        uint64_t next_seq = 0;
+        uint64_t recovery_seq = 0;  //!< no further halving for losses of datagrams sent before this
+        uint64_t expected_seq = 0;  //!< at the receiver
+        uint64_t last_ack_time = 0;
+    };
+    struct Ack {
+        uint64_t time;
+        size_t flow;
+        uint64_t seq;
+        uint64_t lost;
+    };
+    vector<Flow> flows(num_bulk_flows);
+    deque<Ack> acks;
+    BottleneckResult result;
+
+    const auto send = [&](const size_t flow, const uint64_t seq, const uint64_t now, const size_t size) {
+        InternetDatagram dgram;
+        dgram.header().proto = IPv4Header::PROTO_UDP;
+        dgram.header().src = client_ip + flow;
+        dgram.header().dst = server_ip;
+        // a UDP header (for the ports FQ-CoDel tells flows apart by), then the flow, sequence number and time
+        const uint16_t sport = 40000 + flow, dport = 5001;
+        string payload{char(sport >> 8), char(sport & 0xff), char(dport >> 8), char(dport & 0xff), 0, 0, 0, 0};
+        payload += to_string(flow) + " " + to_string(seq) + " " + to_string(now) + " ";
+        payload.resize(max(payload.size(), size), 'x');
+        dgram.payload() = move(payload);
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        router.interface(in).datagrams_out().push(dgram);
+    };
+
+    for (uint64_t now = 0; now < duration; now++) {
+        // acknowledgments: grow the window, or halve it once per window of losses
+        while (not acks.empty() and acks.front().time <= now) {
+            const Ack ack = acks.front();
+            acks.pop_front();
+            Flow &flow = flows[ack.flow];
+            flow.in_flight -= min(flow.in_flight, 1 + ack.lost);
+            flow.last_ack_time = now;
+            if (ack.lost > 0 and ack.seq >= flow.recovery_seq) {
+                flow.cwnd = max(flow.cwnd / 2, 1.0);
+                flow.recovery_seq = flow.next_seq;
+            } else if (ack.lost == 0) {
+                flow.cwnd += 1 / flow.cwnd;
+            }
+        }
+
+        for (size_t i = 0; i < num_bulk_flows; i++) {
+            Flow &flow = flows[i];
+            // a retransmission timeout, if the losses went unreported
+            if (flow.in_flight > 0 and now - flow.last_ack_time > 1000) {
+                flow.in_flight = 0;
+                flow.cwnd = 1;
+                flow.recovery_seq = flow.next_seq;
+                flow.last_ack_time = now;
+            }
+            while (flow.in_flight < size_t(flow.cwnd)) {
+                send(i, flow.next_seq++, now, 1000);
+                flow.in_flight++;
+            }
+        }
+        if (now % sparse_period == 0) {
+            send(sparse_flow, now / sparse_period, now, 64);
+        }
+
+        router.route();
+        router.interface(out).tick(1);
+        router.tick(1);
+
+        // the link carries one frame per millisecond
+        auto &link = router.interface(out).frames_out();
+        if (not link.empty()) {
+            InternetDatagram dgram;
+            if (dgram.parse(link.front().payload().concatenate()) != ParseResult::NoError) {
+                throw runtime_error("bottleneck link carried a bad datagram");
+            }
+            link.pop();
+
+            size_t flow = 0;
+            uint64_t seq = 0, sent_time = 0;
+            istringstream(dgram.payload().concatenate().substr(8)) >> flow >> seq >> sent_time;
+            if (flow == sparse_flow) {
+                const uint64_t delay = now - sent_time;
+                result.sparse_delivered++;
+                result.sparse_total_delay += delay;
+                result.sparse_max_delay = max(result.sparse_max_delay, delay);
+            } else {
+                Flow &receiver = flows.at(flow);
+                const uint64_t lost = seq > receiver.expected_seq ? seq - receiver.expected_seq : 0;
+                receiver.expected_seq = seq + 1;
+                acks.push_back({now + 2 * one_way_delay, flow, seq, lost});
+                result.bulk_delivered++;
+            }
+        }
+    }
+
+    result.queue = router.interface(out).frames_out().stats();
+    return result;
+}
+
 void network_simulator() {
     const string green = "\033[32;1m", normal = "\033[m";
 
@@ -333,11 +526,128 @@ void network_simulator() {
 
     cout << green << "\n\nSuccess! Testing TTL expiration..." << normal << "\n\n";
     {
+        // the router reports it from the interface the datagram came in on
         auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 1);
+        network.host("applesauce")
+            .expect(make_icmp_error(
+                dgram_sent, ip("10.0.0.1"), ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED));
         network.simulate();
 
         dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 0);
+        network.host("applesauce")
+            .expect(make_icmp_error(
+                dgram_sent, ip("10.0.0.1"), ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED));
+        network.simulate();
+    }
+
+    cout << green << "\n\nSuccess! Testing that ICMP errors resume once the rate limit refills..." << normal << "\n\n";
+    {
+        // count the Time Exceeded errors that come back for `n` datagrams whose TTL runs out
+        const auto errors_for = [&](const size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                network.host("applesauce").send_to({"1.2.3.4"}, 1);
+            }
+            network.run();
+            size_t errors = 0;
+            for (const auto &dgram : network.host("applesauce").take_received()) {
+                errors += dgram.header().proto == IPv4Header::PROTO_ICMP;
+            }
+            return errors;
+        };
+
+        const size_t burst = Router::DEFAULT_ICMP_BURST;
+        const size_t first = errors_for(burst + 10);
+        if (first == 0 or first > burst) {
+            throw runtime_error("router sent " + to_string(first) + " ICMP errors for a burst of expired datagrams");
+        }
+        if (errors_for(10) != 0) {
+            throw runtime_error("router sent ICMP errors beyond its rate limit");
+        }
+        network.tick(1000);
+        if (errors_for(10) != 10) {
+            throw runtime_error("router did not send ICMP errors again after its rate limit refilled");
+        }
+        network.simulate();
+    }
+
+    cout << green << "\n\nSuccess! Testing flows spread over two equal-cost uplinks..." << normal << "\n\n";
+    {
+        // traffic from each uplink teaches the router its Ethernet address
+        for (const string uplink : {"isp_a", "isp_b"}) {
+            auto dgram_sent = network.host(uplink).send_to(network.host("applesauce").address());
+            dgram_sent.header().ttl--;
+            network.host("applesauce").expect(dgram_sent);
+        }
         network.simulate();
+
+        constexpr size_t num_flows = 16, datagrams_per_flow = 4;
+        vector<InternetDatagram> sent;
+        for (uint16_t flow = 0; flow < num_flows; flow++) {
+            for (size_t i = 0; i < datagrams_per_flow; i++) {
+                auto dgram_sent = network.host("applesauce").send_tcp_to({"8.8.8.8"}, 40000 + flow, 443);
+                dgram_sent.header().ttl--;
+                sent.push_back(dgram_sent);
+            }
+        }
+        network.run();
+
+        // every datagram arrives exactly once, and each flow uses only one uplink
+        unordered_map<uint16_t, string> uplink_of_flow;
+        size_t received = 0;
+        for (const string uplink : {"isp_a", "isp_b"}) {
+            size_t on_uplink = 0;
+            for (const auto &dgram : network.host(uplink).take_received()) {
+                TCPSegment seg;
+                if (seg.parse(Buffer(dgram.payload()), dgram.header().pseudo_cksum()) != ParseResult::NoError) {
+                    throw runtime_error("uplink " + uplink + " received a bad TCP segment");
+                }
+                const auto [it, inserted] = uplink_of_flow.insert({seg.header().sport, uplink});
+                if (not inserted and it->second != uplink) {
+                    throw runtime_error("flow from port " + to_string(seg.header().sport) +
+                                        " was split across uplinks");
+                }
+                on_uplink++;
+            }
+            cout << "  " << uplink << " received " << on_uplink << " datagrams\n";
+            if (on_uplink == 0) {
+                throw runtime_error("uplink " + uplink + " carried no traffic");
+            }
+            received += on_uplink;
+        }
+        if (received != sent.size() or uplink_of_flow.size() != num_flows) {
+            throw runtime_error("uplinks received " + to_string(received) + " datagrams, expected " +
+                                to_string(sent.size()));
+        }
+        network.simulate();
+    }
+
+    cout << green << "\n\nSuccess! Measuring queueing delay at a congested link..." << normal << "\n\n";
+    {
+        cout << "  discipline   delivered   drops (full/AQM)   queue delay (mean/max ms)"
+             << "   sparse flow delay (mean/max ms)\n";
+        cout << fixed << setprecision(1);
+        vector<BottleneckResult> results;
+        for (const auto discipline :
+             {EgressQueue::Discipline::DropTail, EgressQueue::Discipline::CoDel, EgressQueue::Discipline::FQCoDel}) {
+            const auto r = simulate_bottleneck(discipline);
+            cout << "  " << left << setw(10) << as_string(discipline) << right << setw(12)
+                 << r.bulk_delivered + r.sparse_delivered << setw(10) << r.queue.overflow_drops << " / " << setw(5)
+                 << r.queue.aqm_drops << setw(19) << r.queue.mean_sojourn() << " / " << setw(6)
+                 << r.queue.max_sojourn << setw(25) << r.sparse_mean_delay() << " / " << setw(6)
+                 << r.sparse_max_delay << "\n";
+            results.push_back(r);
+        }
+
+        // CoDel keeps the standing queue short, and FQ-CoDel also keeps the sparse flow out of it
+        if (not(results[1].queue.mean_sojourn() < results[0].queue.mean_sojourn() / 4) or
+            not(results[2].sparse_mean_delay() < results[1].sparse_mean_delay())) {
+            throw runtime_error("queue disciplines did not reduce the delay at the bottleneck");
+        }
+        for (const auto &r : results) {
+            if (r.bulk_delivered + r.sparse_delivered < 20000 * 9 / 10) {
+                throw runtime_error("bottleneck link was left idle too much of the time");
+            }
+        }
     }
 
     cout << "\n\n\033[32;1mCongratulations! All datagrams were routed successfully.\033[m\n";
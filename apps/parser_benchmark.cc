@@ -0,0 +1,205 @@
+#include "ipv4_datagram.hh"
+#include "tcp_segment.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t packets_per_trial = 4 * 1024 * 1024;
+
+//! The original field-at-a-time IPv4 header parser, kept as the baseline to beat
+ParseResult fieldwise_parse(IPv4Header &h, NetParser &p) {
+    Buffer original_serialized_version = p.buffer();
+
+    const size_t data_size = p.buffer().size();
+    if (data_size < IPv4Header::LENGTH) {
+        return ParseResult::PacketTooShort;
+    }
+
+    const uint8_t first_byte = p.u8();
+    h.ver = first_byte >> 4;
+    h.hlen = first_byte & 0x0f;
+    h.tos = p.u8();
+    h.len = p.u16();
+    h.id = p.u16();
+
+    const uint16_t fo_val = p.u16();
+    h.df = static_cast<bool>(fo_val & 0x4000);
+    h.mf = static_cast<bool>(fo_val & 0x2000);
+    h.offset = fo_val & 0x1fff;
+
+    h.ttl = p.u8();
+    h.proto = p.u8();
+    h.cksum = p.u16();
+    h.src = p.u32();
+    h.dst = p.u32();
+
+    if (data_size < 4 * h.hlen) {
+        return ParseResult::PacketTooShort;
+    }
+    if (h.ver != 4) {
+        return ParseResult::WrongIPVersion;
+    }
+    if (h.hlen < 5) {
+        return ParseResult::HeaderTooShort;
+    }
+    if (data_size != h.len) {
+        return ParseResult::TruncatedPacket;
+    }
+
+    p.remove_prefix(h.hlen * 4 - IPv4Header::LENGTH);
+
+    if (p.error()) {
+        return p.get_error();
+    }
+
+    InternetChecksum check;
+    check.add({original_serialized_version.str().data(), size_t(4 * h.hlen)});
+    if (check.value()) {
+        return ParseResult::BadChecksum;
+    }
+
+    return ParseResult::NoError;
+}
+
+//! The original field-at-a-time TCP header parser
+ParseResult fieldwise_parse(TCPHeader &h, NetParser &p) {
+    h.sport = p.u16();
+    h.dport = p.u16();
+    h.seqno = WrappingInt32{p.u32()};
+    h.ackno = WrappingInt32{p.u32()};
+    h.doff = p.u8() >> 4;
+
+    const uint8_t fl_b = p.u8();
+    h.urg = static_cast<bool>(fl_b & 0b0010'0000);
+    h.ack = static_cast<bool>(fl_b & 0b0001'0000);
+    h.psh = static_cast<bool>(fl_b & 0b0000'1000);
+    h.rst = static_cast<bool>(fl_b & 0b0000'0100);
+    h.syn = static_cast<bool>(fl_b & 0b0000'0010);
+    h.fin = static_cast<bool>(fl_b & 0b0000'0001);
+
+    h.win = p.u16();
+    h.cksum = p.u16();
+    h.uptr = p.u16();
+
+    if (h.doff < 5) {
+        return ParseResult::HeaderTooShort;
+    }
+
+    p.remove_prefix(h.doff * 4 - TCPHeader::LENGTH);
+
+    if (p.error()) {
+        return p.get_error();
+    }
+
+    return ParseResult::NoError;
+}
+
+//! Parse the IPv4 and TCP headers of a datagram; returns a value that depends on every field
+uint32_t parse_headers(const Buffer &packet, const bool fieldwise) {
+    IPv4Header ip;
+    TCPHeader tcp;
+    NetParser p{packet};
+    const ParseResult ip_result = fieldwise ? fieldwise_parse(ip, p) : ip.parse(p);
+    const ParseResult tcp_result = fieldwise ? fieldwise_parse(tcp, p) : tcp.parse(p);
+    if (ip_result != ParseResult::NoError or tcp_result != ParseResult::NoError) {
+        throw runtime_error("could not parse headers");
+    }
+    return ip.src ^ ip.dst ^ ip.len ^ ip.id ^ ip.ttl ^ tcp.sport ^ tcp.dport ^ tcp.seqno.raw_value() ^
+           tcp.ackno.raw_value() ^ tcp.win ^ tcp.cksum ^ (tcp.ack ? 1 : 0);
+}
+
+uint32_t fieldwise_headers(const Buffer &packet) { return parse_headers(packet, true); }
+
+uint32_t fixed_layout_headers(const Buffer &packet) { return parse_headers(packet, false); }
+
+//! Parse the whole packet as the stack does on receive, including both checksums
+uint32_t full_datagram(const Buffer &packet) {
+    InternetDatagram dgram;
+    TCPSegment seg;
+    if (dgram.parse(packet) != ParseResult::NoError or
+        seg.parse(dgram.payload().concatenate(), dgram.header().pseudo_cksum()) != ParseResult::NoError) {
+        throw runtime_error("could not parse datagram");
+    }
+    return dgram.header().src ^ seg.header().seqno.raw_value();
+}
+
+vector<Buffer> make_packets(const size_t payload_size) {
+    vector<Buffer> ret;
+    for (uint16_t i = 0; i < 64; i++) {
+        TCPSegment seg;
+        seg.header().sport = 1000 + i;
+        seg.header().dport = 80;
+        seg.header().seqno = WrappingInt32{uint32_t(rand())};
+        seg.header().ackno = WrappingInt32{uint32_t(rand())};
+        seg.header().ack = true;
+        seg.header().win = 65535;
+        seg.payload() = string(payload_size, 'x');
+
+        InternetDatagram dgram;
+        dgram.header().id = i;
+        dgram.header().src = 0x0a000001;
+        dgram.header().dst = 0x0a000002 + i;
+        dgram.header().len = IPv4Header::LENGTH + TCPHeader::LENGTH + payload_size;
+        dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+        ret.emplace_back(dgram.serialize().concatenate());
+    }
+    return ret;
+}
+
+double nanoseconds_per_packet(const vector<Buffer> &packets, uint32_t (*const parse)(const Buffer &)) {
+    uint32_t sink = 0;
+
+    // call through a volatile pointer so the compiler can't inline and hoist the parse out of the loop
+    uint32_t (*volatile parse_function)(const Buffer &) = parse;
+
+    const auto first_time = high_resolution_clock::now();
+    for (size_t i = 0; i < packets_per_trial; i++) {
+        sink ^= parse_function(packets[i % packets.size()]);
+    }
+    const auto final_time = high_resolution_clock::now();
+
+    if (sink == 0x12345678 and packets.empty()) {
+        cout << sink;
+    }
+
+    return double(duration_cast<nanoseconds>(final_time - first_time).count()) / packets_per_trial;
+}
+
+void benchmark(const size_t payload_size) {
+    const auto packets = make_packets(payload_size);
+
+    for (const auto &packet : packets) {
+        if (fieldwise_headers(packet) != fixed_layout_headers(packet)) {
+            throw runtime_error("fixed-layout parser disagrees with the field-at-a-time parser");
+        }
+    }
+
+    cout << setw(5) << payload_size << "-byte payload: headers (field-at-a-time) " << setw(6)
+         << nanoseconds_per_packet(packets, fieldwise_headers) << "  headers (fixed layout) " << setw(6)
+         << nanoseconds_per_packet(packets, fixed_layout_headers) << "  full datagram + checksums " << setw(7)
+         << nanoseconds_per_packet(packets, full_datagram) << "  (ns/packet)\n";
+}
+
+int main() {
+    try {
+        cout << fixed << setprecision(1);
+        cout << "IPv4+TCP parse cost\n";
+        for (const size_t payload_size : {0, 536, 1460}) {
+            benchmark(payload_size);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#include "route_table.hh"
+#include "router.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_prefixes = 500'000;
+
+//! Where lookup results end up, so the compiler can't discard the lookups
+volatile uint64_t sink = 0;
+
+//! A route as the original Router stored it, for the linear scan
+struct LinearRoute {
+    uint32_t prefix;
+    uint32_t mask;
+    uint8_t length;
+    RouteTable::Value value;
+};
+
+//! The original lookup: scan every route and keep the longest match
+optional<RouteTable::Value> linear_lookup(const vector<LinearRoute> &routes, const uint32_t address) {
+    optional<RouteTable::Value> ret;
+    int longest = -1;
+    for (const auto &r : routes) {
+        if ((address & r.mask) == r.prefix and r.length > longest) {
+            ret = r.value;
+            longest = r.length;
+        }
+    }
+    return ret;
+}
+
+//! A prefix length drawn roughly from the distribution in a global BGP table (about half are /24s)
+uint8_t bgp_like_length(mt19937 &rd) {
+    const unsigned int percentile = rd() % 100;
+    if (percentile < 55) {
+        return 24;
+    }
+    if (percentile < 85) {
+        return 19 + rd() % 5;
+    }
+    if (percentile < 97) {
+        return 12 + rd() % 7;
+    }
+    return 8 + rd() % 4;
+}
+
+template <typename Lookup>
+double lookups_per_second(const vector<uint32_t> &addresses, const Lookup &lookup) {
+    uint64_t sum = 0;
+    const auto first_time = high_resolution_clock::now();
+    for (const uint32_t address : addresses) {
+        sum += lookup(address).value_or(0);
+    }
+    const auto final_time = high_resolution_clock::now();
+    sink = sum;
+
+    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+    return addresses.size() * 1e9 / double(duration);
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        RouteTable table;
+        vector<LinearRoute> routes;
+        routes.reserve(num_prefixes);
+
+        const auto load_start = high_resolution_clock::now();
+        while (table.size() < num_prefixes) {
+            const uint8_t length = bgp_like_length(rd);
+            const uint32_t prefix = rd() & RouteTable::mask(length);
+            const RouteTable::Value value = table.size();
+            if (table.insert(prefix, length, value)) {
+                routes.push_back({prefix, RouteTable::mask(length), length, value});
+            }
+        }
+        const auto load_time = duration_cast<milliseconds>(high_resolution_clock::now() - load_start).count();
+
+        // destinations: half inside a random route, half anywhere
+        vector<uint32_t> addresses(1 << 22);
+        for (size_t i = 0; i < addresses.size(); i++) {
+            const LinearRoute &r = routes[rd() % routes.size()];
+            addresses[i] = (i % 2) ? rd() : (r.prefix | (rd() & ~r.mask));
+        }
+
+        const vector<uint32_t> few_addresses(addresses.begin(), addresses.begin() + 1000);
+        for (const uint32_t address : few_addresses) {
+            if (table.lookup(address) != linear_lookup(routes, address)) {
+                throw runtime_error("RouteTable disagrees with the linear scan");
+            }
+        }
+
+        cout << fixed << setprecision(0);
+        cout << "Loaded " << table.size() << " prefixes into RouteTable in " << load_time << " ms\n";
+        cout << "  linear scan:                      " << setw(12)
+             << lookups_per_second(few_addresses, [&](const uint32_t a) { return linear_lookup(routes, a); })
+             << " lookups/s\n";
+        cout << "  RouteTable:                       " << setw(12)
+             << lookups_per_second(addresses, [&](const uint32_t a) { return table.lookup(a); }) << " lookups/s\n";
+
+        // most traffic goes to a few hot destinations
+        vector<uint32_t> hot_addresses(addresses.size());
+        for (size_t i = 0; i < hot_addresses.size(); i++) {
+            hot_addresses[i] = addresses[rd() % 256];
+        }
+        RouteCache cache{Router::DEFAULT_ROUTE_CACHE_ENTRIES};
+        cout << "  RouteTable, 256 hot destinations: " << setw(12)
+             << lookups_per_second(hot_addresses, [&](const uint32_t a) { return table.lookup(a); })
+             << " lookups/s\n";
+        cout << "  with RouteCache:                  " << setw(12)
+             << lookups_per_second(hot_addresses, [&](const uint32_t a) { return cache.lookup(table, a); })
+             << " lookups/s (" << cache.hits() << " hits, " << cache.misses() << " misses)\n";
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
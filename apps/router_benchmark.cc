@@ -0,0 +1,148 @@
+#include "arp_message.hh"
+#include "router.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_egress = 4;
+constexpr size_t num_prefixes = 1024;
+constexpr size_t datagrams_per_round = 256;
+constexpr size_t datagrams_per_trial = 1 << 21;
+constexpr size_t num_loaded_routes = 100'000;
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! A router with one ingress and `num_egress` egress interfaces, whose next hops are already resolved
+class Setup {
+  public:
+    Router router{};
+    size_t ingress;
+    vector<size_t> egress{};
+
+    Setup() : ingress(router.add_interface({ethernet_address(1), Address{"10.0.0.1"}})) {
+        for (uint8_t i = 0; i < num_egress; i++) {
+            const uint32_t router_ip = 0xac100001 + (i << 8);  // 172.16.i.1
+            const uint32_t gateway_ip = router_ip + 1;
+            egress.push_back(router.add_interface(
+                {ethernet_address(2 + i), Address::from_ipv4_numeric(router_ip)}));
+
+            // teach the interface the gateway's Ethernet address
+            ARPMessage arp;
+            arp.opcode = ARPMessage::OPCODE_REPLY;
+            arp.sender_ethernet_address = ethernet_address(100 + i);
+            arp.sender_ip_address = gateway_ip;
+            arp.target_ethernet_address = ethernet_address(2 + i);
+            arp.target_ip_address = router_ip;
+            EthernetFrame frame;
+            frame.header() = {ethernet_address(2 + i), ethernet_address(100 + i), EthernetHeader::TYPE_ARP};
+            frame.payload() = arp.serialize();
+            router.interface(egress.back()).recv_frame(frame);
+        }
+
+        // 1024 /24s, spread over the egress interfaces
+        for (uint32_t i = 0; i < num_prefixes; i++) {
+            const size_t out = i % num_egress;
+            const uint32_t gateway_ip = 0xac100002 + (out << 8);
+            router.add_route(0x64000000 + (i << 8), 24, Address::from_ipv4_numeric(gateway_ip), egress[out]);
+        }
+    }
+};
+
+//! Datagrams as they would arrive off the wire (parsed, so their checksums are known to be valid)
+vector<InternetDatagram> make_traffic() {
+    vector<InternetDatagram> ret;
+    for (size_t i = 0; i < datagrams_per_round; i++) {
+        InternetDatagram dgram;
+        dgram.header().ttl = 64;
+        dgram.header().proto = IPv4Header::PROTO_TCP;
+        dgram.header().src = 0x0a000002;
+        dgram.header().dst = 0x64000000 + ((rand() % num_prefixes) << 8) + rand() % 256;
+        dgram.payload() = string(1000, 'x');
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+
+        InternetDatagram parsed;
+        if (parsed.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+            throw runtime_error("could not parse datagram");
+        }
+        ret.push_back(move(parsed));
+    }
+    return ret;
+}
+
+double datagrams_per_second(const vector<InternetDatagram> &traffic, const size_t batch_size) {
+    Setup setup;
+    for (const size_t out : setup.egress) {
+        auto &frames = setup.router.interface(out).frames_out();
+        while (not frames.empty()) {
+            frames.pop();
+        }
+    }
+
+    size_t forwarded = 0;
+    const auto first_time = high_resolution_clock::now();
+    while (forwarded < datagrams_per_trial) {
+        auto &ingress_queue = setup.router.interface(setup.ingress).datagrams_out();
+        for (const auto &dgram : traffic) {
+            ingress_queue.push(dgram);
+        }
+
+        setup.router.route(batch_size);
+
+        for (const size_t out : setup.egress) {
+            auto &frames = setup.router.interface(out).frames_out();
+            while (not frames.empty()) {
+                frames.pop();
+                forwarded++;
+            }
+        }
+    }
+    const auto final_time = high_resolution_clock::now();
+
+    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+    return forwarded * 1e9 / double(duration);
+}
+
+//! Time to replace the routes with a table of `num_loaded_routes` /24s
+double load_milliseconds() {
+    Setup setup;
+    vector<Route> routes;
+    for (uint32_t i = 0; i < num_loaded_routes; i++) {
+        const size_t out = i % num_egress;
+        const uint32_t gateway_ip = 0xac100002 + (out << 8);
+        routes.push_back({0x40000000 + (i << 8), 24, Address::from_ipv4_numeric(gateway_ip), setup.egress[out]});
+    }
+
+    const auto first_time = high_resolution_clock::now();
+    setup.router.load_routes(routes);
+    const auto final_time = high_resolution_clock::now();
+    return duration_cast<microseconds>(final_time - first_time).count() / 1e3;
+}
+
+int main() {
+    try {
+        cout << fixed << setprecision(1);
+        cout << "Loading " << num_loaded_routes << " routes: " << load_milliseconds() << " ms\n";
+
+        const auto traffic = make_traffic();
+
+        cout << "Forwarding " << datagrams_per_round << " datagrams at a time from 1 to " << num_egress
+             << " interfaces\n";
+        cout << fixed << setprecision(0);
+        for (const size_t batch_size : {1, 8, 32, 128}) {
+            cout << "  batch size " << setw(3) << batch_size << ": " << setw(9)
+                 << datagrams_per_second(traffic, batch_size) << " datagrams/s\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
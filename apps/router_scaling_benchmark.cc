@@ -0,0 +1,121 @@
+#include "arp_message.hh"
+#include "router.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_interfaces = 8;
+constexpr size_t num_prefixes = 1024;
+constexpr size_t datagrams_per_interface = 4096;
+constexpr size_t datagrams_per_trial = 1 << 21;
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! A router whose interfaces all receive traffic for, and send traffic to, one another
+void setup(Router &router) {
+    for (uint8_t i = 0; i < num_interfaces; i++) {
+        const uint32_t router_ip = 0xac100001 + (i << 8);  // 172.16.i.1
+        const uint32_t gateway_ip = router_ip + 1;
+        router.add_interface({ethernet_address(1 + i), Address::from_ipv4_numeric(router_ip)});
+
+        // teach the interface the gateway's Ethernet address
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = ethernet_address(100 + i);
+        arp.sender_ip_address = gateway_ip;
+        arp.target_ethernet_address = ethernet_address(1 + i);
+        arp.target_ip_address = router_ip;
+        EthernetFrame frame;
+        frame.header() = {ethernet_address(1 + i), ethernet_address(100 + i), EthernetHeader::TYPE_ARP};
+        frame.payload() = arp.serialize();
+        router.interface(i).recv_frame(frame);
+    }
+
+    // 1024 /24s, spread over the interfaces
+    vector<Route> routes;
+    for (uint32_t i = 0; i < num_prefixes; i++) {
+        const size_t out = i % num_interfaces;
+        const uint32_t gateway_ip = 0xac100002 + (out << 8);
+        routes.push_back({0x64000000 + (i << 8), 24, Address::from_ipv4_numeric(gateway_ip), out});
+    }
+    router.load_routes(routes);
+}
+
+//! Datagrams as they would arrive off the wire (parsed, so their checksums are known to be valid)
+vector<InternetDatagram> make_traffic() {
+    vector<InternetDatagram> ret;
+    for (size_t i = 0; i < datagrams_per_interface; i++) {
+        InternetDatagram dgram;
+        dgram.header().ttl = 64;
+        dgram.header().proto = IPv4Header::PROTO_TCP;
+        dgram.header().src = 0x0a000002;
+        dgram.header().dst = 0x64000000 + ((rand() % num_prefixes) << 8) + rand() % 256;
+        dgram.payload() = string(1000, 'x');
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+
+        InternetDatagram parsed;
+        if (parsed.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+            throw runtime_error("could not parse datagram");
+        }
+        ret.push_back(move(parsed));
+    }
+    return ret;
+}
+
+//! Forwarding rate, counting only the time spent in route()
+double datagrams_per_second(const vector<InternetDatagram> &traffic, const size_t num_threads) {
+    Router router{Router::DEFAULT_ROUTE_CACHE_ENTRIES, num_threads};
+    setup(router);
+
+    size_t forwarded = 0;
+    nanoseconds routing_time{0};
+    while (forwarded < datagrams_per_trial) {
+        for (size_t i = 0; i < num_interfaces; i++) {
+            auto &queue = router.interface(i).datagrams_out();
+            for (const auto &dgram : traffic) {
+                queue.push(dgram);
+            }
+        }
+
+        const auto first_time = high_resolution_clock::now();
+        router.route();
+        routing_time += high_resolution_clock::now() - first_time;
+
+        for (size_t i = 0; i < num_interfaces; i++) {
+            auto &frames = router.interface(i).frames_out();
+            while (not frames.empty()) {
+                frames.pop();
+                forwarded++;
+            }
+        }
+    }
+
+    return forwarded * 1e9 / double(routing_time.count());
+}
+
+int main() {
+    try {
+        const auto traffic = make_traffic();
+
+        cout << "Forwarding among " << num_interfaces << " interfaces (" << thread::hardware_concurrency()
+             << " hardware threads)\n";
+        cout << fixed << setprecision(0);
+        for (const size_t num_threads : {1, 2, 4, 8}) {
+            cout << "  " << num_threads << " thread" << (num_threads == 1 ? ": " : "s:") << setw(10)
+                 << datagrams_per_second(traffic, num_threads) << " datagrams/s\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
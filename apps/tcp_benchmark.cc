@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <new>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
@@ -11,11 +13,59 @@ using namespace std::chrono;
 
 constexpr size_t len = 100 * 1024 * 1024;
 
-void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segments, const bool reorder) {
+//! \name Counters for the allocations-per-segment report
+//!@{
+size_t heap_allocations = 0;
+size_t segments_delivered = 0;
+//!@}
+
+//! Count every heap allocation the program makes
+void *operator new(size_t size) {
+    heap_allocations++;
+    if (void *ret = malloc(size ? size : 1)) {
+        return ret;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+//! How segments travel from one TCPConnection to the other
+struct Link {
+    bool reorder = false;           //!< deliver each batch of segments in reverse order
+    bool serialize = false;         //!< serialize and re-parse each segment, as if it crossed a wire
+    bool checksum_offload = false;  //!< when serializing, skip TCP checksums (see FdAdapterConfig)
+
+    string description() const {
+        if (not serialize) {
+            return reorder ? " with reordering" : "";
+        }
+        return checksum_offload ? " with serialization, checksum offload" : " with serialization";
+    }
+};
+
+TCPSegment over_the_wire(const TCPSegment &seg, const Link &link) {
+    TCPSegment ret;
+    if (ret.parse(seg.serialize(0, link.checksum_offload).concatenate(), 0, link.checksum_offload) !=
+        ParseResult::NoError) {
+        throw runtime_error("could not parse serialized segment");
+    }
+    return ret;
+}
+
+void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segments, const Link &link) {
+    const bool reorder = link.reorder;
     while (not x.segments_out().empty()) {
-        segments.emplace_back(move(x.segments_out().front()));
+        if (link.serialize) {
+            segments.emplace_back(over_the_wire(x.segments_out().front(), link));
+        } else {
+            segments.emplace_back(move(x.segments_out().front()));
+        }
         x.segments_out().pop();
     }
+    segments_delivered += segments.size();
     if (reorder) {
         for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
             y.segment_received(move(*it));
@@ -28,7 +78,7 @@ void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segme
     segments.clear();
 }
 
-void main_loop(const bool reorder) {
+void main_loop(const Link &link) {
     TCPConfig config;
     TCPConnection x{config}, y{config};
 
@@ -47,6 +97,8 @@ void main_loop(const bool reorder) {
     string_received.reserve(len);
 
     const auto first_time = high_resolution_clock::now();
+    const size_t first_heap_allocations = heap_allocations;
+    const size_t first_segments_delivered = segments_delivered;
 
     auto loop = [&] {
         // write input into x
@@ -66,8 +118,10 @@ void main_loop(const bool reorder) {
 
         // exchange segments between x and y but in reverse order
         vector<TCPSegment> segments;
-        move_segments(x, y, segments, reorder);
-        move_segments(y, x, segments, false);
+        move_segments(x, y, segments, link);
+        Link reverse_link = link;
+        reverse_link.reorder = false;
+        move_segments(y, x, segments, reverse_link);
 
         // read output from y
         const auto available_output = y.inbound_stream().buffer_size();
@@ -89,14 +143,16 @@ void main_loop(const bool reorder) {
     }
 
     const auto final_time = high_resolution_clock::now();
+    const double allocations_per_segment =
+        double(heap_allocations - first_heap_allocations) / double(segments_delivered - first_segments_delivered);
 
     const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
 
     const auto gigabits_per_second = len * 8.0 / double(duration);
 
     cout << fixed << setprecision(2);
-    cout << "CPU-limited throughput" << (reorder ? " with reordering: " : "                : ") << gigabits_per_second
-         << " Gbit/s\n";
+    cout << "CPU-limited throughput" << left << setw(38) << link.description() << right << ": "
+         << gigabits_per_second << " Gbit/s (" << allocations_per_segment << " allocations/segment)\n";
 
     while (x.active() or y.active()) {
         loop();
@@ -105,8 +161,10 @@ void main_loop(const bool reorder) {
 
 int main() {
     try {
-        main_loop(false);
-        main_loop(true);
+        main_loop({});
+        main_loop({true, false, false});
+        main_loop({false, true, false});
+        main_loop({false, true, true});
     } catch (const exception &e) {
         cerr << e.what() << "\n";
         return EXIT_FAILURE;
@@ -31,6 +31,15 @@ static void show_usage(const char *argv0, const char *msg) {
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
          << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
 
+         << "   -c              Checksum offload: rely on UDP's checksum and    (TCP checksums)\n"
+         << "                   skip TCP checksums (peer must also use -c).\n\n"
+
+         << "   -g              Segmentation offload: send runs of segments     (a datagram per segment)\n"
+         << "                   as UDP GSO datagrams, receive with UDP GRO.\n\n"
+
+         << "   -u              io_uring: receive, send and wait for datagrams  (socket syscalls, epoll)\n"
+         << "                   through io_uring, if the kernel has it.\n\n"
+
          << "   -h              Show this message and quit.\n\n";
 
     if (msg != nullptr) {
@@ -46,12 +55,13 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, bool, bool> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
 
     int curr = 1;
     bool listen = false;
+    bool io_uring = false;
 
     while (argc - curr > 2) {
         if (strncmp("-l", argv[curr], 3) == 0) {
@@ -84,6 +94,18 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
                 static_cast<LossRateDnT>(static_cast<float>(numeric_limits<LossRateDnT>::max()) * lossrate);
             curr += 2;
 
+        } else if (strncmp("-c", argv[curr], 3) == 0) {
+            c_filt.checksum_offload = true;
+            curr += 1;
+
+        } else if (strncmp("-g", argv[curr], 3) == 0) {
+            c_filt.segmentation_offload = true;
+            curr += 1;
+
+        } else if (strncmp("-u", argv[curr], 3) == 0) {
+            io_uring = true;
+            curr += 1;
+
         } else if (strncmp("-h", argv[curr], 3) == 0) {
             show_usage(argv[0], nullptr);
             exit(0);
@@ -100,7 +122,7 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
         c_filt.destination = {argv[argc - 2], argv[argc - 1]};
     }
 
-    return make_tuple(c_fsm, c_filt, listen);
+    return make_tuple(c_fsm, c_filt, listen, io_uring);
 }
 
 int main(int argc, char **argv) {
@@ -111,14 +133,15 @@ int main(int argc, char **argv) {
         }
 
         // handle configuration and UDP setup from cmdline arguments
-        auto [c_fsm, c_filt, listen] = get_config(argc, argv);
+        auto [c_fsm, c_filt, listen, io_uring] = get_config(argc, argv);
 
         // build a TCP FSM on top of the UDP socket
         UDPSocket udp_sock;
         if (listen) {
             udp_sock.bind(c_filt.source);
         }
-        LossyTCPOverUDPSpongeSocket tcp_socket(LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock))));
+        LossyTCPOverUDPSpongeSocket tcp_socket(
+            LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock), io_uring)));
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
         } else {
@@ -0,0 +1,294 @@
+#include "address.hh"
+#include "icmp_message.hh"
+#include "socket.hh"
+#include "tcp_sponge_socket.hh"
+#include "tun.hh"
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+// Echo requests go through a TUN device to the kernel's own address on it, and the kernel's echo
+// replies come back through the device: a loopback that exercises TUN I/O with nothing else on the
+// wire, one frame per system call, in batches, and through a TunTapIoUring. Then a TCPSpongeSocket
+// sends a stream through the device to a kernel TCP socket, with and without a virtio-net header
+// (checksum and segmentation offload), and with and without io_uring. Creating and configuring the
+// device takes CAP_NET_ADMIN; to keep it out of the way of the host's networking, run this in a
+// network namespace of its own:
+//
+//     unshare -rn apps/tun_benchmark
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr const char *device_name = "spongebench0";
+constexpr const char *device_address = "10.144.0.1";  // the kernel's end, which answers the echo requests
+constexpr const char *peer_address = "10.144.0.2";    // ours
+constexpr size_t num_round_trips = 1 << 17;
+constexpr size_t window = 64;  // echo requests in flight at once
+constexpr size_t payload_size = 1400;
+constexpr size_t stream_size = 256 << 20;  // bytes sent over TCP
+
+//! Give the device its address and bring it up, as `ip addr add` and `ip link set up` would
+void configure(const string &name) {
+    FileDescriptor sock{SystemCall("socket", socket(AF_INET, SOCK_DGRAM, 0))};
+    struct ifreq req {};
+    strncpy(static_cast<char *>(req.ifr_name), name.c_str(), IFNAMSIZ - 1);
+
+    const auto set_address = [&](const unsigned long request, const char *address) {
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        SystemCall("inet_pton", inet_pton(AF_INET, address, &sin.sin_addr) == 1 ? 0 : -1);
+        memcpy(&req.ifr_addr, &sin, sizeof(sin));
+        SystemCall("ioctl", ioctl(sock.fd_num(), request, &req));
+    };
+    set_address(SIOCSIFADDR, device_address);
+    set_address(SIOCSIFNETMASK, "255.255.255.0");
+
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCGIFFLAGS, &req));
+    req.ifr_flags |= IFF_UP | IFF_RUNNING;
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCSIFFLAGS, &req));
+}
+
+//! An echo request from us to the device's address
+BufferList make_echo_request(const uint16_t sequence) {
+    ICMPMessage echo;
+    echo.type = ICMPMessage::TYPE_ECHO_REQUEST;
+    echo.rest_of_header = (0x5350u << 16) | sequence;
+    echo.payload = string(payload_size, 'x');
+
+    InternetDatagram dgram;
+    dgram.header().proto = IPv4Header::PROTO_ICMP;
+    dgram.header().src = Address{peer_address}.ipv4_numeric();
+    dgram.header().dst = Address{device_address}.ipv4_numeric();
+    dgram.payload() = echo.serialize();
+    dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+    return dgram.serialize();
+}
+
+//! Is this datagram an echo reply (rather than, say, a router solicitation the kernel sent)?
+bool is_echo_reply(const string_view dgram) {
+    return dgram.size() > 20 and (uint8_t(dgram[0]) >> 4) == 4 and uint8_t(dgram[9]) == IPv4Header::PROTO_ICMP and
+           uint8_t(dgram[(uint8_t(dgram[0]) & 0xf) * 4]) == ICMPMessage::TYPE_ECHO_REPLY;
+}
+
+void wait_for(const FileDescriptor &fd, const short events, uint64_t &polls) {
+    pollfd pfd{fd.fd_num(), events, 0};
+    SystemCall("poll", poll(&pfd, 1, 1000));
+    polls++;
+    if (not(pfd.revents & events)) {
+        throw runtime_error("no echo reply within a second");
+    }
+}
+
+struct Result {
+    uint64_t syscalls = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+//! One frame per syscall, and a poll() before each read, as the adapters did before batching
+Result one_at_a_time(TunFD &tun, const vector<BufferList> &requests) {
+    tun.set_blocking(true);
+    const unsigned reads = tun.read_count(), writes = tun.write_count();
+    uint64_t polls = 0, bytes = 0;
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_round_trips; sent += window) {
+        for (size_t i = 0; i < window; i++) {
+            bytes += tun.write(requests[(sent + i) % requests.size()]);
+        }
+        for (size_t replies = 0; replies < window;) {
+            wait_for(tun, POLLIN, polls);
+            const string dgram = tun.read();
+            bytes += dgram.size();
+            replies += is_echo_reply(dgram);
+        }
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    return {polls + (tun.read_count() - reads) + (tun.write_count() - writes), bytes, seconds};
+}
+
+//! Batches through TunTapFD::write_frames and TunTapFD::read_frames, on a non-blocking device
+Result batched(TunFD &tun, const vector<BufferList> &requests) {
+    tun.set_blocking(false);
+    const unsigned reads = tun.read_count(), writes = tun.write_count();
+    uint64_t polls = 0, bytes = 0;
+    vector<BufferList> batch;
+    vector<Buffer> frames;
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_round_trips; sent += window) {
+        batch.clear();
+        for (size_t i = 0; i < window; i++) {
+            batch.push_back(requests[(sent + i) % requests.size()]);
+            bytes += batch.back().size();
+        }
+        for (size_t written = 0; written < batch.size();) {
+            written += tun.write_frames(batch, written);
+            if (written < batch.size()) {
+                wait_for(tun, POLLOUT, polls);
+            }
+        }
+        for (size_t replies = 0; replies < window;) {
+            wait_for(tun, POLLIN, polls);
+            frames.clear();
+            tun.read_frames(frames);
+            for (const auto &frame : frames) {
+                bytes += frame.size();
+                replies += is_echo_reply(frame.str());
+            }
+        }
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    return {polls + (tun.read_count() - reads) + (tun.write_count() - writes), bytes, seconds};
+}
+
+//! Batches through a TunTapIoUring on a blocking device: each batch of writes submitted together, and the
+//! reads in flight all along; counting its io_uring_enter()s and the polls of its ring
+Result io_uring(TunFD &tun, const vector<BufferList> &requests) {
+    tun.set_blocking(true);
+    TunTapIoUring ring{tun};
+    const unsigned enters = ring.ring().write_count();
+    uint64_t polls = 0, bytes = 0;
+    vector<BufferList> batch;
+    vector<Buffer> frames;
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_round_trips; sent += window) {
+        batch.clear();
+        for (size_t i = 0; i < window; i++) {
+            batch.push_back(requests[(sent + i) % requests.size()]);
+            bytes += batch.back().size();
+        }
+        ring.write_frames(batch);
+        for (size_t replies = 0; replies < window;) {
+            wait_for(ring.ring(), POLLIN, polls);
+            frames.clear();
+            ring.read_frames(frames);
+            for (const auto &frame : frames) {
+                bytes += frame.size();
+                replies += is_echo_reply(frame.str());
+            }
+        }
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    return {polls + (ring.ring().write_count() - enters), bytes, seconds};
+}
+
+void report(const string &name, const Result &result) {
+    const double megabytes = double(result.bytes) / 1e6;
+    cout << "   " << left << setw(16) << name << right << fixed << setprecision(1) << setw(8)
+         << double(result.syscalls) / megabytes << " syscalls/MB  " << setw(8)
+         << double(result.syscalls) / (2 * num_round_trips) << " syscalls/frame  " << setw(8)
+         << megabytes / result.seconds << " MB/s\n";
+}
+
+//! Send a stream over TCP through the TUN device to a kernel socket; with `offload`, in super-segments, and
+//! with `io_uring`, through a TunTapIoUring
+void tcp_stream(const bool offload, const bool io_uring) {
+    TunFD tun{device_name, false, offload};
+    configure(device_name);
+    TCPOverIPv4OverTunFdAdapter adapter(move(tun), TCPOverIPv4OverTunFdAdapter::DEFAULT_MSS, io_uring);
+    // the device, or its ring (whose io_uring_enter()s count as writes); shares the read and write counts
+    const FileDescriptor counts = static_cast<const FileDescriptor &>(adapter).duplicate();
+    const bool ring = adapter.uses_io_uring();
+
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind(Address{device_address, 9090});
+    listener.listen();
+    size_t received = 0;
+    thread server([&] {
+        TCPSocket connection = listener.accept();
+        string buffer;
+        while (not connection.eof()) {
+            connection.read(buffer);
+            received += buffer.size();
+        }
+    });
+
+    TCPConfig tcp_config;
+    tcp_config.rt_timeout = 100;
+    if (offload) {
+        tcp_config.max_payload_size = 65535 - IPv4Header::LENGTH - TCPHeader::LENGTH;
+    } else {
+        tcp_config.max_payload_size = TCPOverIPv4OverTunFdAdapter::DEFAULT_MSS;
+    }
+    FdAdapterConfig adapter_config;
+    adapter_config.source = {peer_address, 40000};
+    adapter_config.destination = {device_address, 9090};
+
+    const auto start = steady_clock::now();
+    {
+        TCPOverIPv4SpongeSocket sock{move(adapter)};
+        sock.connect(tcp_config, adapter_config);
+        const string chunk(1 << 16, 'x');
+        for (size_t sent = 0; sent < stream_size; sent += chunk.size()) {
+            sock.write(chunk);
+        }
+        sock.wait_until_closed();
+    }
+    server.join();
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    if (received != stream_size) {
+        throw runtime_error("TCP stream arrived incomplete");
+    }
+
+    // a ring's reads are takes from its completion queue, not system calls
+    const uint64_t calls = (ring ? 0 : counts.read_count()) + counts.write_count();
+    const double megabytes = double(stream_size) / 1e6;
+    const string name = string(offload ? "TSO/GRO" : "MSS segments") + (ring ? ", io_uring" : "");
+    cout << "   " << left << setw(24) << name << right << fixed << setprecision(1) << setw(8) << calls / megabytes
+         << " syscalls/MB  " << setw(8) << megabytes / seconds << " MB/s\n";
+}
+
+int main() {
+    try {
+        TunFD tun{device_name};
+        configure(device_name);
+
+        vector<BufferList> requests;
+        for (size_t i = 0; i < window; i++) {
+            requests.push_back(make_echo_request(i));
+        }
+
+        cout << "TUN loopback: " << num_round_trips << " echo round trips of " << requests.front().size()
+             << "-byte datagrams, " << window << " in flight\n";
+        one_at_a_time(tun, requests);  // warm up
+        report("one at a time", one_at_a_time(tun, requests));
+        report("batched", batched(tun, requests));
+        if (IoUring::available()) {
+            report("io_uring", io_uring(tun, requests));
+        }
+        tun.close();
+
+        cout << "TCP through the TUN adapter: " << (stream_size >> 20) << " MiB to a kernel socket\n";
+        tcp_stream(false, false);
+        tcp_stream(true, false);
+        if (IoUring::available()) {
+            tcp_stream(false, true);
+            tcp_stream(true, true);
+        } else {
+            cout << "   (io_uring is not available)\n";
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+#include "address.hh"
+#include "socket.hh"
+#include "tcp_sponge_socket.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Datagrams go from one UDP socket to another over localhost, a window at a time: one per sendto()
+// and recv(), then in batches with UDPSocket::send_batch() and UDPSocket::recv_batch(), then as one
+// UDP GSO datagram per window, received with UDP GRO. Then two TCPSpongeSockets stream over
+// localhost UDP through the TCPOverUDPSocketAdapter, without and with segmentation offload, first
+// with the sockets' own system calls and an epoll EventLoop, then through io_uring (a UDPIoUring in
+// each adapter, and an io_uring EventLoop), where the only system calls are io_uring_enter()s.
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t num_datagrams = 1 << 20;
+constexpr size_t window = UDPSocket::DEFAULT_BATCH_SIZE;  // datagrams in flight at once
+constexpr size_t payload_size = 1400;
+constexpr size_t stream_size = 256 << 20;  // bytes sent over TCP
+
+struct Result {
+    uint64_t syscalls = 0;
+    double seconds = 0;
+};
+
+//! Counts the reads and writes on both sockets
+uint64_t syscalls(const UDPSocket &sender, const UDPSocket &receiver) {
+    return sender.read_count() + sender.write_count() + receiver.read_count() + receiver.write_count();
+}
+
+//! One datagram per sendto() and per recv()
+Result one_at_a_time(UDPSocket &sender, UDPSocket &receiver, const vector<BufferList> &payloads) {
+    const Address destination = receiver.local_address();
+    const uint64_t before = syscalls(sender, receiver);
+    UDPSocket::received_datagram datagram{{nullptr, 0}, ""};
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_datagrams; sent += window) {
+        for (const auto &payload : payloads) {
+            sender.sendto(destination, payload);
+        }
+        for (size_t i = 0; i < window; i++) {
+            receiver.recv(datagram);
+        }
+    }
+    return {syscalls(sender, receiver) - before, duration<double>(steady_clock::now() - start).count()};
+}
+
+//! A window per send_batch(), received with as many recv_batch()es as it takes
+Result batched(UDPSocket &sender, UDPSocket &receiver, const vector<BufferList> &payloads) {
+    const Address destination = receiver.local_address();
+    const uint64_t before = syscalls(sender, receiver);
+    UDPSocket::RecvRing ring{window, payload_size};
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_datagrams; sent += window) {
+        if (sender.send_batch(destination, payloads) != payloads.size()) {
+            throw runtime_error("send_batch() sent only part of a window");
+        }
+        for (size_t received = 0; received < window;) {
+            received += receiver.recv_batch(ring);
+        }
+    }
+    return {syscalls(sender, receiver) - before, duration<double>(steady_clock::now() - start).count()};
+}
+
+//! A window per UDP GSO datagram, received (coalesced again by UDP GRO) with as many recv_batch()es as it takes
+Result segmentation_offload(UDPSocket &sender, UDPSocket &receiver, const vector<BufferList> &payloads) {
+    const Address destination = receiver.local_address();
+    receiver.set_gro(true);
+    const uint64_t before = syscalls(sender, receiver);
+    UDPSocket::RecvRing ring{window};
+
+    BufferList whole_window;
+    for (const auto &payload : payloads) {
+        whole_window.append(payload);
+    }
+    const vector<BufferList> gso_payloads{whole_window};
+    const vector<uint16_t> segment_sizes{payload_size};
+
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < num_datagrams; sent += window) {
+        if (sender.send_batch(destination, gso_payloads, 0, segment_sizes) != 1) {
+            throw runtime_error("send_batch() didn't send the window");
+        }
+        for (size_t received = 0; received < window;) {
+            receiver.recv_batch(ring);
+            for (size_t i = 0; i < ring.size(); i++) {
+                const size_t size = ring.payload(i).size(), segment_size = ring.segment_size(i);
+                received += segment_size ? (size + segment_size - 1) / segment_size : 1;
+            }
+        }
+    }
+    const Result result{syscalls(sender, receiver) - before, duration<double>(steady_clock::now() - start).count()};
+    receiver.set_gro(false);
+    return result;
+}
+
+void report(const string &name, const Result &result) {
+    const double megabytes = double(num_datagrams * payload_size) / 1e6;
+    cout << "   " << left << setw(16) << name << right << fixed << setprecision(2) << setw(8)
+         << double(result.syscalls) / num_datagrams << " syscalls/datagram  " << setw(10) << setprecision(0)
+         << num_datagrams / result.seconds << " datagrams/s  " << setw(8) << setprecision(1)
+         << megabytes / result.seconds << " MB/s\n";
+}
+
+//! Stream over TCP between two TCPSpongeSockets, each on a UDP socket bound to localhost; with `offload`,
+//! with FdAdapterConfig::segmentation_offload, and with `io_uring`, through a UDPIoUring
+void tcp_stream(const bool offload, const bool io_uring) {
+    UDPSocket server_udp, client_udp;
+    server_udp.bind(Address{"127.0.0.1", 0});
+    client_udp.bind(Address{"127.0.0.1", 0});
+    const Address server_address = server_udp.local_address(), client_address = client_udp.local_address();
+    TCPOverUDPSocketAdapter server_adapter(move(server_udp), io_uring), client_adapter(move(client_udp), io_uring);
+
+    // the sockets, or their rings, whose io_uring_enter()s count as writes
+    const FileDescriptor server_counts = static_cast<const FileDescriptor &>(server_adapter).duplicate();
+    const FileDescriptor client_counts = static_cast<const FileDescriptor &>(client_adapter).duplicate();
+    const bool rings = server_adapter.uses_io_uring();
+
+    TCPConfig tcp_config;
+    tcp_config.rt_timeout = 100;
+    FdAdapterConfig server_config, client_config;
+    server_config.source = server_address;
+    client_config.source = client_address;
+    client_config.destination = server_address;
+    server_config.segmentation_offload = client_config.segmentation_offload = offload;
+
+    size_t received = 0;
+    const auto start = steady_clock::now();
+    {
+        TCPOverUDPSpongeSocket server{move(server_adapter)};
+        TCPOverUDPSpongeSocket client{move(client_adapter)};
+        thread server_thread([&] {
+            server.listen_and_accept(tcp_config, server_config);
+            string buffer;
+            while (not server.eof()) {
+                server.read(buffer);
+                received += buffer.size();
+            }
+            server.wait_until_closed();
+        });
+
+        client.connect(tcp_config, client_config);
+        const string chunk(1 << 16, 'x');
+        for (size_t sent = 0; sent < stream_size; sent += chunk.size()) {
+            client.write(chunk);
+        }
+        client.wait_until_closed();
+        server_thread.join();
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    if (received != stream_size) {
+        throw runtime_error("TCP stream arrived incomplete");
+    }
+
+    // a ring's reads are takes from its completion queue, not system calls
+    const uint64_t calls = (rings ? 0 : server_counts.read_count() + client_counts.read_count()) +
+                           server_counts.write_count() + client_counts.write_count();
+    const double megabytes = double(stream_size) / 1e6;
+    const string name = string(offload ? "GSO/GRO" : "no offload") + (rings ? ", io_uring" : "");
+    cout << "   " << left << setw(20) << name << right << fixed << setprecision(1) << setw(8) << calls / megabytes
+         << " UDP syscalls/MB  " << setw(8) << megabytes / seconds << " MB/s\n";
+}
+
+int main() {
+    try {
+        UDPSocket sender, receiver;
+        sender.bind(Address{"127.0.0.1", 0});
+        receiver.bind(Address{"127.0.0.1", 0});
+        const vector<BufferList> payloads(window, BufferList{string(payload_size, 'x')});
+
+        cout << "UDP over localhost: " << num_datagrams << " datagrams of " << payload_size << " bytes, " << window
+             << " in flight\n";
+        one_at_a_time(sender, receiver, payloads);  // warm up
+        report("one at a time", one_at_a_time(sender, receiver, payloads));
+        report("batched", batched(sender, receiver, payloads));
+        report("GSO/GRO", segmentation_offload(sender, receiver, payloads));
+
+        cout << (stream_size >> 20) << " MiB over TCP through the TCPOverUDPSocketAdapter\n";
+        tcp_stream(false, false);
+        tcp_stream(true, false);
+        if (IoUring::available()) {
+            tcp_stream(false, true);
+            tcp_stream(true, true);
+        } else {
+            cout << "   (io_uring is not available)\n";
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -7,6 +7,20 @@ add_test(NAME t_wrapping_ints_unwrap      COMMAND wrapping_integers_unwrap)
 add_test(NAME t_wrapping_ints_wrap        COMMAND wrapping_integers_wrap)
 add_test(NAME t_wrapping_ints_roundtrip   COMMAND wrapping_integers_roundtrip)
 
+add_test(NAME t_internet_checksum    COMMAND internet_checksum)
+add_test(NAME t_buffer_list          COMMAND buffer_list)
+add_test(NAME t_route_table          COMMAND route_table)
+add_test(NAME t_router_routes        COMMAND router_routes)
+add_test(NAME t_router_threads       COMMAND router_threads)
+add_test(NAME t_ipv4_fragments       COMMAND ipv4_fragments)
+add_test(NAME t_router_icmp          COMMAND router_icmp)
+add_test(NAME t_egress_queue         COMMAND egress_queue)
+add_test(NAME t_neighbor_table       COMMAND neighbor_table)
+add_test(NAME t_frame_channel        COMMAND frame_channel)
+add_test(NAME t_udp_batch            COMMAND udp_batch)
+add_test(NAME t_eventloop            COMMAND eventloop)
+add_test(NAME t_io_uring             COMMAND io_uring)
+
 add_test(NAME t_recv_connect         COMMAND recv_connect)
 add_test(NAME t_recv_transmit        COMMAND recv_transmit)
 add_test(NAME t_recv_window          COMMAND recv_window)
@@ -0,0 +1,264 @@
+#include "egress_queue.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+//! Bytes a frame takes on the wire (not counting the preamble and FCS)
+size_t frame_size(const EthernetFrame &frame) { return EthernetHeader::LENGTH + frame.payload().size(); }
+
+//! Largest frame: CoDel never drops when no more than this is queued, since that can't be a standing queue
+constexpr size_t MAX_FRAME_SIZE = 1514;
+
+}  // namespace
+
+EgressQueue::EgressQueue(const Config &config)
+    : _config(config), _flows(config.discipline == Discipline::FQCoDel ? max(config.flows, size_t(1)) : 1) {
+    if (_config.limit == 0) {
+        throw runtime_error("EgressQueue: limit must be at least one frame");
+    }
+}
+
+//! \details Flows are told apart by IPv4 addresses, protocol and (for TCP and UDP) ports; frames that
+//! aren't IPv4, such as ARP, share flow 0.
+size_t EgressQueue::_classify(const EthernetFrame &frame) const {
+    if (_flows.size() == 1 or frame.header().type != EthernetHeader::TYPE_IPv4) {
+        return 0;
+    }
+
+    // the IPv4 header and the ports after it, gathered from however many buffers hold them
+    array<uint8_t, 24> bytes{};
+    size_t have = 0;
+    for (const auto &buffer : frame.payload().buffers()) {
+        const string_view str = buffer.str();
+        const size_t n = min(str.size(), bytes.size() - have);
+        memcpy(bytes.data() + have, str.data(), n);
+        have += n;
+        if (have == bytes.size()) {
+            break;
+        }
+    }
+    if (have < 20) {
+        return 0;
+    }
+
+    const uint8_t proto = bytes[9];
+    const bool first_fragment = ((bytes[6] & 0x1f) | bytes[7]) == 0;
+    uint64_t h = 0;
+    for (size_t i = 12; i < 20; i++) {
+        h = (h << 8) | bytes[i];
+    }
+    uint64_t ports = 0;
+    if ((proto == 6 or proto == 17) and (bytes[0] & 0xf) == 5 and first_fragment and have == bytes.size()) {
+        ports = (uint64_t(bytes[20]) << 24) | (uint64_t(bytes[21]) << 16) | (uint64_t(bytes[22]) << 8) | bytes[23];
+    }
+
+    // the 64-bit finalizer from MurmurHash3, so that every input bit affects the result
+    h ^= ((ports << 8) | proto) * 0x9e3779b97f4a7c15;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return (uint64_t(uint32_t(h)) * _flows.size()) >> 32;
+}
+
+//! \details This is CoDel's `dodequeue`: the delay is acceptable while it is under target, or while
+//! there is no more than a frame's worth left behind; once it has been above target for a whole
+//! interval, dropping is allowed.
+EgressQueue::Entry EgressQueue::_take(Flow &flow, bool &ok_to_drop) {
+    Entry entry = move(flow.entries.front());
+    flow.entries.pop_front();
+    flow.bytes -= frame_size(entry.frame);
+    _size--;
+
+    ok_to_drop = false;
+    const uint64_t sojourn = _now - entry.enqueue_time;
+    if (sojourn < _config.target or flow.bytes <= MAX_FRAME_SIZE) {
+        flow.first_above_time = 0;
+    } else if (flow.first_above_time == 0) {
+        flow.first_above_time = _now + _config.interval;
+    } else if (_now >= flow.first_above_time) {
+        ok_to_drop = true;
+    }
+    return entry;
+}
+
+//! \details Follows the pseudocode of [RFC 8289](\ref rfc::rfc8289) section 5. While dropping, the
+//! time between drops shrinks as interval / sqrt(count), but never below a millisecond, the
+//! resolution of tick().
+optional<EgressQueue::Entry> EgressQueue::_codel_dequeue(Flow &flow) {
+    const auto control_law = [&](const uint64_t t, const uint32_t count) {
+        const auto step = uint64_t(llround(double(_config.interval) / sqrt(double(count))));
+        return t + max(step, uint64_t(1));
+    };
+
+    if (flow.entries.empty()) {
+        flow.dropping = false;
+        return {};
+    }
+
+    bool ok_to_drop = false;
+    Entry entry = _take(flow, ok_to_drop);
+    if (flow.dropping) {
+        if (not ok_to_drop) {
+            // the delay has come back down
+            flow.dropping = false;
+        }
+        while (flow.dropping and _now >= flow.drop_next) {
+            _stats.aqm_drops++;
+            flow.count++;
+            if (flow.entries.empty()) {
+                flow.dropping = false;
+                return {};
+            }
+            entry = _take(flow, ok_to_drop);
+            if (not ok_to_drop) {
+                flow.dropping = false;
+            } else {
+                flow.drop_next = control_law(flow.drop_next, flow.count);
+            }
+        }
+    } else if (ok_to_drop) {
+        _stats.aqm_drops++;
+        flow.dropping = true;
+        // if dropping stopped only recently, pick up close to the drop rate it had reached
+        const uint32_t delta = flow.count - flow.last_count;
+        flow.count = (delta > 1 and _now < flow.drop_next + 16 * _config.interval) ? delta : 1;
+        flow.last_count = flow.count;
+        flow.drop_next = control_law(_now, flow.count);
+        if (flow.entries.empty()) {
+            return {};
+        }
+        entry = _take(flow, ok_to_drop);
+    }
+    return entry;
+}
+
+void EgressQueue::_settle() {
+    if (_head.has_value() or _size == 0) {
+        return;
+    }
+
+    switch (_config.discipline) {
+        case Discipline::DropTail: {
+            bool ok_to_drop = false;
+            _head = _take(_flows.front(), ok_to_drop);
+        } break;
+        case Discipline::CoDel:
+            _head = _codel_dequeue(_flows.front());
+            break;
+        case Discipline::FQCoDel:
+            // deficit round robin, new flows first (RFC 8290 section 4.2)
+            while (not _head.has_value()) {
+                const bool from_new = not _new_flows.empty();
+                deque<size_t> &list = from_new ? _new_flows : _old_flows;
+                if (list.empty()) {
+                    return;
+                }
+                const size_t index = list.front();
+                Flow &flow = _flows[index];
+                if (flow.deficit <= 0) {
+                    flow.deficit += _config.quantum;
+                    list.pop_front();
+                    _old_flows.push_back(index);
+                    continue;
+                }
+
+                _head = _codel_dequeue(flow);
+                if (not _head.has_value()) {
+                    // an emptied new flow goes to the back of the old ones, so it can't starve them
+                    list.pop_front();
+                    if (from_new and not _old_flows.empty()) {
+                        _old_flows.push_back(index);
+                    } else {
+                        flow.active = false;
+                    }
+                    continue;
+                }
+                flow.deficit -= frame_size(_head->frame);
+            }
+            break;
+    }
+}
+
+void EgressQueue::_drop_from_fattest_flow() {
+    auto fattest = max_element(
+        _flows.begin(), _flows.end(), [](const Flow &a, const Flow &b) { return a.bytes < b.bytes; });
+    if (fattest->entries.empty()) {
+        return;
+    }
+    fattest->bytes -= frame_size(fattest->entries.front().frame);
+    fattest->entries.pop_front();
+    _size--;
+    _stats.overflow_drops++;
+}
+
+void EgressQueue::push(EthernetFrame &&frame) {
+    if (_config.discipline != Discipline::FQCoDel and size() >= _config.limit) {
+        _stats.overflow_drops++;
+        return;
+    }
+
+    const size_t index = _classify(frame);
+    Flow &flow = _flows[index];
+    flow.bytes += frame_size(frame);
+    flow.entries.push_back({move(frame), _now});
+    _size++;
+    _stats.enqueued++;
+
+    if (_config.discipline == Discipline::FQCoDel) {
+        if (not flow.active) {
+            flow.active = true;
+            flow.deficit = _config.quantum;
+            _new_flows.push_back(index);
+        }
+        if (size() > _config.limit) {
+            _drop_from_fattest_flow();
+        }
+    }
+}
+
+bool EgressQueue::empty() {
+    _settle();
+    return not _head.has_value();
+}
+
+EthernetFrame &EgressQueue::front() {
+    _settle();
+    if (not _head.has_value()) {
+        throw runtime_error("EgressQueue::front(): no frame to send");
+    }
+    return _head->frame;
+}
+
+void EgressQueue::pop() {
+    _settle();
+    if (not _head.has_value()) {
+        throw runtime_error("EgressQueue::pop(): no frame to send");
+    }
+    const uint64_t sojourn = _now - _head->enqueue_time;
+    _stats.dequeued++;
+    _stats.total_sojourn += sojourn;
+    _stats.max_sojourn = max(_stats.max_sojourn, sojourn);
+    _head.reset();
+}
+
+string as_string(const EgressQueue::Discipline discipline) {
+    switch (discipline) {
+        case EgressQueue::Discipline::DropTail:
+            return "drop-tail";
+        case EgressQueue::Discipline::CoDel:
+            return "CoDel";
+        case EgressQueue::Discipline::FQCoDel:
+            return "FQ-CoDel";
+        default:
+            throw runtime_error("unknown queue discipline");
+    }
+}
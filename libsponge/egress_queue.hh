@@ -0,0 +1,142 @@
+#ifndef SPONGE_LIBSPONGE_EGRESS_QUEUE_HH
+#define SPONGE_LIBSPONGE_EGRESS_QUEUE_HH
+
+#include "ethernet_frame.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+//! \brief A bounded queue of Ethernet frames waiting to be sent, with a choice of queue discipline
+//! \details Frames go in with push() and come out with front() and pop(), as from a `std::queue`.
+//! Every discipline holds at most `limit` frames. Beyond that:
+//!
+//! - DropTail drops arriving frames while the queue is full.
+//! - CoDel ([RFC 8289](\ref rfc::rfc8289)) also drops frames from the head once they have been waiting
+//!   longer than `target` for at least `interval`, at a rate that rises until the delay comes back down.
+//! - FQ-CoDel ([RFC 8290](\ref rfc::rfc8290)) hashes frames into per-flow queues, each with its own
+//!   CoDel state, and serves the flows by deficit round robin, with flows that have just become active
+//!   served first. A full queue drops from the head of the flow with the longest backlog.
+//!
+//! Time advances only through tick(); a frame's sojourn time is the time from push() until it
+//! comes out. Because CoDel decides what to drop as frames come out, empty() and front() may drop
+//! frames (and so are not `const`).
+class EgressQueue {
+  public:
+    enum class Discipline { DropTail, CoDel, FQCoDel };
+
+    //! How an EgressQueue behaves
+    struct Config {
+        Discipline discipline = Discipline::DropTail;
+        size_t limit = 10240;     //!< Most frames held (as for FQ-CoDel in Linux)
+        uint64_t target = 5;      //!< CoDel: acceptable standing delay (ms)
+        uint64_t interval = 100;  //!< CoDel: how long the delay must stay above target before dropping (ms)
+        size_t flows = 1024;      //!< FQ-CoDel: number of flow queues
+        size_t quantum = 1514;    //!< FQ-CoDel: bytes each flow may send per round
+    };
+
+    //! Counters, and the sojourn times of frames that came out
+    struct Stats {
+        uint64_t enqueued = 0;        //!< Frames accepted by push()
+        uint64_t dequeued = 0;        //!< Frames taken out by pop()
+        uint64_t overflow_drops = 0;  //!< Frames dropped because the queue was full
+        uint64_t aqm_drops = 0;       //!< Frames dropped by CoDel
+        uint64_t total_sojourn = 0;   //!< Sum of the sojourn times of dequeued frames (ms)
+        uint64_t max_sojourn = 0;     //!< Longest sojourn time of a dequeued frame (ms)
+
+        //! Mean sojourn time of dequeued frames (ms)
+        double mean_sojourn() const { return dequeued ? double(total_sojourn) / dequeued : 0; }
+    };
+
+  private:
+    //! A frame, with the time it was pushed
+    struct Entry {
+        EthernetFrame frame{};
+        uint64_t enqueue_time = 0;
+    };
+
+    //! One queue, with its CoDel state (DropTail and CoDel use a single flow)
+    struct Flow {
+        std::deque<Entry> entries{};
+        size_t bytes = 0;
+
+        //! \name CoDel state
+        //!@{
+        uint64_t first_above_time = 0;  //!< When the delay will have been above target for an interval (0: it isn't)
+        uint64_t drop_next = 0;         //!< When to drop next, while dropping
+        uint32_t count = 0;             //!< Frames dropped since entering the dropping state
+        uint32_t last_count = 0;        //!< `count` when the dropping state was last left
+        bool dropping = false;
+        //!@}
+
+        //! \name FQ-CoDel scheduling state
+        //!@{
+        int64_t deficit = 0;
+        bool active = false;  //!< In `_new_flows` or `_old_flows`
+        //!@}
+    };
+
+    Config _config;
+    std::vector<Flow> _flows;
+    std::deque<size_t> _new_flows{};  //!< FQ-CoDel: flows that just became active
+    std::deque<size_t> _old_flows{};  //!< FQ-CoDel: other active flows
+    size_t _size = 0;                 //!< Frames held, not counting `_head`
+    uint64_t _now = 0;                //!< Milliseconds elapsed, as told by tick()
+
+    //! The next frame to send, once chosen (and no longer counted in any flow)
+    std::optional<Entry> _head{};
+
+    Stats _stats{};
+
+    //! Which flow a frame belongs to
+    size_t _classify(const EthernetFrame &frame) const;
+
+    //! Take the frame at the head of a flow; `ok_to_drop` says whether CoDel would allow dropping it
+    Entry _take(Flow &flow, bool &ok_to_drop);
+
+    //! CoDel's dequeue: the next frame from `flow` that should be sent, dropping others as needed
+    std::optional<Entry> _codel_dequeue(Flow &flow);
+
+    //! Choose the next frame to send (in `_head`), if there isn't one already
+    void _settle();
+
+    //! Drop the frame at the head of the flow with the most bytes queued (FQ-CoDel on overflow)
+    void _drop_from_fattest_flow();
+
+  public:
+    //! A drop-tail queue, with the default limit
+    EgressQueue() : EgressQueue(Config{}) {}
+
+    explicit EgressQueue(const Config &config);
+
+    //! \brief Add a frame at the tail (or drop it, or another, if the queue is full)
+    void push(EthernetFrame &&frame);
+    void push(const EthernetFrame &frame) { push(EthernetFrame(frame)); }
+
+    //! \brief Whether there is no frame to send
+    bool empty();
+
+    //! \brief The next frame to send
+    //! \note Throws std::runtime_error if there is none
+    EthernetFrame &front();
+
+    //! \brief Take the next frame out (counting its sojourn time)
+    void pop();
+
+    //! \brief Frames held
+    size_t size() const { return _size + (_head.has_value() ? 1 : 0); }
+
+    //! \brief Called periodically when time elapses
+    void tick(const size_t ms_since_last_tick) { _now += ms_since_last_tick; }
+
+    const Config &config() const { return _config; }
+    const Stats &stats() const { return _stats; }
+};
+
+//! Output a string representation of an EgressQueue::Discipline
+std::string as_string(const EgressQueue::Discipline discipline);
+
+#endif  // SPONGE_LIBSPONGE_EGRESS_QUEUE_HH
@@ -0,0 +1,282 @@
+#include "neighbor_table.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+//! Fewest slots in the hash table
+static constexpr uint32_t MIN_SLOT_BITS = 4;
+
+NeighborTable::NeighborTable() : _slots(size_t(1) << MIN_SLOT_BITS, Slot{0, NONE}), _slot_bits(MIN_SLOT_BITS) {
+    _oldest.fill(NONE);
+    _newest.fill(NONE);
+}
+
+size_t NeighborTable::_probe(const uint32_t ip_address) const {
+    const size_t mask = _slots.size() - 1;
+    size_t i = _home(ip_address);
+    while (_slots[i].node != NONE and _slots[i].ip_address != ip_address) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void NeighborTable::_grow() {
+    vector<Slot> old_slots(size_t(1) << (_slot_bits + 1), Slot{0, NONE});
+    swap(old_slots, _slots);
+    _slot_bits++;
+    for (const Slot &slot : old_slots) {
+        if (slot.node != NONE) {
+            _slots[_probe(slot.ip_address)] = slot;
+        }
+    }
+}
+
+void NeighborTable::_unlink(Node &node) {
+    if (not node.listed) {
+        return;
+    }
+    (node.prev == NONE ? _oldest[node.list] : _nodes[node.prev].next) = node.next;
+    (node.next == NONE ? _newest[node.list] : _nodes[node.next].prev) = node.prev;
+    node.prev = node.next = NONE;
+    node.listed = false;
+}
+
+uint32_t NeighborTable::_first_to_expire() const {
+    uint32_t first = NONE;
+    for (const uint32_t oldest : _oldest) {
+        if (oldest != NONE and (first == NONE or _nodes[oldest].expiry_time < _nodes[first].expiry_time)) {
+            first = oldest;
+        }
+    }
+    return first;
+}
+
+NeighborTable::Neighbor *NeighborTable::find(const uint32_t ip_address) {
+    const Slot &slot = _slots[_probe(ip_address)];
+    return slot.node == NONE ? nullptr : &_nodes[slot.node];
+}
+
+const NeighborTable::Neighbor *NeighborTable::find(const uint32_t ip_address) const {
+    const Slot &slot = _slots[_probe(ip_address)];
+    return slot.node == NONE ? nullptr : &_nodes[slot.node];
+}
+
+NeighborTable::Neighbor &NeighborTable::insert(const uint32_t ip_address) {
+    if ((_size + 1) * 2 > _slots.size()) {
+        _grow();
+    }
+    Slot &slot = _slots[_probe(ip_address)];
+    if (slot.node != NONE) {
+        throw runtime_error("NeighborTable: neighbor is already present");
+    }
+
+    uint32_t index = _free;
+    if (index == NONE) {
+        index = _nodes.size();
+        _nodes.emplace_back();
+    } else {
+        _free = _nodes[index].next;
+        _nodes[index].next = NONE;
+    }
+    slot = {ip_address, index};
+    _size++;
+
+    Node &node = _nodes[index];
+    node.ip_address = ip_address;
+    return node;
+}
+
+//! \details Backward-shift deletion: the neighbors after the hole in the same run move back into it if
+//! that takes them no further from their home slot, so that every probe still stops at the right place.
+bool NeighborTable::erase(const uint32_t ip_address) {
+    size_t hole = _probe(ip_address);
+    const uint32_t index = _slots[hole].node;
+    if (index == NONE) {
+        return false;
+    }
+
+    Node &node = _nodes[index];
+    _unlink(node);
+    drop_waiting(node);
+    node = Node{};
+    node.next = _free;
+    _free = index;
+    _size--;
+
+    const size_t mask = _slots.size() - 1;
+    for (size_t i = (hole + 1) & mask; _slots[i].node != NONE; i = (i + 1) & mask) {
+        const size_t home = _home(_slots[i].ip_address);
+        // move back unless the home slot lies in (hole, i], wrapping around the end of the table
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            _slots[hole] = _slots[i];
+            hole = i;
+        }
+    }
+    _slots[hole].node = NONE;
+    return true;
+}
+
+void NeighborTable::set_expiry(Neighbor &neighbor, const uint64_t time) {
+    Node &node = static_cast<Node &>(neighbor);
+    const uint32_t index = _index(node);
+    _unlink(node);
+    node.expiry_time = time;
+    node.listed = true;
+
+    // Prefer the list whose back is latest without being later than `time` (it can be appended to),
+    // then an empty list, and otherwise the list whose back is earliest (walked from the back).
+    size_t list = NUM_EXPIRY_LISTS;
+    for (size_t i = 0; i < NUM_EXPIRY_LISTS; i++) {
+        if (_newest[i] != NONE and _nodes[_newest[i]].expiry_time <= time and
+            (list == NUM_EXPIRY_LISTS or _nodes[_newest[i]].expiry_time > _nodes[_newest[list]].expiry_time)) {
+            list = i;
+        }
+    }
+    for (size_t i = 0; list == NUM_EXPIRY_LISTS and i < NUM_EXPIRY_LISTS; i++) {
+        if (_newest[i] == NONE) {
+            list = i;
+        }
+    }
+    if (list == NUM_EXPIRY_LISTS) {
+        list = 0;
+        for (size_t i = 1; i < NUM_EXPIRY_LISTS; i++) {
+            if (_nodes[_newest[i]].expiry_time < _nodes[_newest[list]].expiry_time) {
+                list = i;
+            }
+        }
+    }
+    node.list = list;
+
+    uint32_t after = _newest[list];
+    while (after != NONE and _nodes[after].expiry_time > time) {
+        after = _nodes[after].prev;
+    }
+    node.prev = after;
+    node.next = (after == NONE ? _oldest[list] : _nodes[after].next);
+    (node.prev == NONE ? _oldest[list] : _nodes[node.prev].next) = index;
+    (node.next == NONE ? _newest[list] : _nodes[node.next].prev) = index;
+}
+
+void NeighborTable::clear_expiry(Neighbor &neighbor) { _unlink(static_cast<Node &>(neighbor)); }
+
+uint64_t NeighborTable::expiry_time(const Neighbor &neighbor) const {
+    const Node &node = static_cast<const Node &>(neighbor);
+    return node.listed ? node.expiry_time : UINT64_MAX;
+}
+
+NeighborTable::Neighbor *NeighborTable::first_expired(const uint64_t now) {
+    const uint32_t first = _first_to_expire();
+    if (first == NONE or _nodes[first].expiry_time > now) {
+        return nullptr;
+    }
+    return &_nodes[first];
+}
+
+size_t NeighborTable::expire(const uint64_t now) {
+    size_t removed = 0;
+    for (Neighbor *neighbor = first_expired(now); neighbor; neighbor = first_expired(now)) {
+        erase(neighbor->ip_address);
+        removed++;
+    }
+    return removed;
+}
+
+InternetDatagram NeighborTable::_take_waiting(Node &node) {
+    const uint32_t index = node.first_waiting;
+    Waiting &waiting = _waiting[index];
+
+    node.first_waiting = waiting.next;
+    if (node.first_waiting == NONE) {
+        node.last_waiting = NONE;
+    }
+    node.waiting_datagrams--;
+    node.waiting_bytes -= waiting.bytes;
+    (waiting.older == NONE ? _oldest_waiting : _waiting[waiting.older].newer) = waiting.newer;
+    (waiting.newer == NONE ? _newest_waiting : _waiting[waiting.newer].older) = waiting.older;
+    _waiting_stats.datagrams--;
+    _waiting_stats.bytes -= waiting.bytes;
+
+    InternetDatagram dgram = move(waiting.dgram);
+    waiting = Waiting{};
+    waiting.next = _free_waiting;
+    _free_waiting = index;
+    return dgram;
+}
+
+void NeighborTable::_trim_waiting(Node &node) {
+    while (node.waiting_bytes > _waiting_limits.per_neighbor_bytes) {
+        _take_waiting(node);
+        _waiting_stats.dropped++;
+    }
+}
+
+void NeighborTable::_trim_total_waiting() {
+    // the oldest datagram overall is also the oldest for its neighbor
+    while (_waiting_stats.bytes > _waiting_limits.total_bytes) {
+        _take_waiting(_nodes[_waiting[_oldest_waiting].node]);
+        _waiting_stats.dropped++;
+    }
+}
+
+void NeighborTable::enqueue(Neighbor &neighbor, InternetDatagram dgram) {
+    Node &node = static_cast<Node &>(neighbor);
+    const size_t bytes = dgram.header().hlen * 4 + dgram.payload().size();
+    if (bytes > _waiting_limits.per_neighbor_bytes or bytes > _waiting_limits.total_bytes) {
+        _waiting_stats.dropped++;
+        return;
+    }
+
+    uint32_t index = _free_waiting;
+    if (index == NONE) {
+        index = _waiting.size();
+        _waiting.emplace_back();
+    } else {
+        _free_waiting = _waiting[index].next;
+    }
+    Waiting &waiting = _waiting[index];
+    waiting.dgram = move(dgram);
+    waiting.bytes = bytes;
+    waiting.node = _index(node);
+    waiting.next = NONE;
+    waiting.older = _newest_waiting;
+    waiting.newer = NONE;
+
+    (node.last_waiting == NONE ? node.first_waiting : _waiting[node.last_waiting].next) = index;
+    node.last_waiting = index;
+    node.waiting_datagrams++;
+    node.waiting_bytes += bytes;
+    (_newest_waiting == NONE ? _oldest_waiting : _waiting[_newest_waiting].newer) = index;
+    _newest_waiting = index;
+    _waiting_stats.queued++;
+    _waiting_stats.datagrams++;
+    _waiting_stats.bytes += bytes;
+
+    _trim_waiting(node);
+    _trim_total_waiting();
+}
+
+optional<InternetDatagram> NeighborTable::dequeue(Neighbor &neighbor) {
+    Node &node = static_cast<Node &>(neighbor);
+    if (node.waiting_datagrams == 0) {
+        return {};
+    }
+    _waiting_stats.flushed++;
+    return _take_waiting(node);
+}
+
+void NeighborTable::drop_waiting(Neighbor &neighbor) {
+    Node &node = static_cast<Node &>(neighbor);
+    while (node.waiting_datagrams > 0) {
+        _take_waiting(node);
+        _waiting_stats.dropped++;
+    }
+}
+
+void NeighborTable::set_waiting_limits(const WaitingLimits &limits) {
+    _waiting_limits = limits;
+    for (Node &node : _nodes) {
+        _trim_waiting(node);
+    }
+    _trim_total_waiting();
+}
@@ -0,0 +1,203 @@
+#ifndef SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
+#define SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
+
+#include "buffer.hh"
+#include "ethernet_header.hh"
+#include "ipv4_datagram.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+//! \brief A NetworkInterface's ARP cache: the neighbors whose Ethernet addresses it knows or is asking for,
+//! and the datagrams waiting for them
+//! \details Neighbors are kept in a pool and found through an open-addressing hash table (linear probing,
+//! with backward-shift deletion so there are no tombstones), so a lookup costs one hash and a short probe
+//! however many neighbors there are. Neighbors that have an expiry time are also threaded, soonest first,
+//! on one of a few intrusive expiry lists; expire() only ever looks at the fronts of those lists, so aging
+//! the cache costs nothing for the neighbors that are still fresh. A new expiry time goes on the back of
+//! the list whose back it doesn't precede, so when entries live for a few fixed durations (resolved,
+//! pending and negatively cached neighbors, say), each duration keeps to a list of its own and setting an
+//! expiry time costs O(1).
+//!
+//! Waiting datagrams are kept in a second pool, chained in order per neighbor and, oldest first, across
+//! all neighbors. Their bytes are bounded both per neighbor and in total; going over either limit drops
+//! the oldest datagrams (for that neighbor, or overall), so a burst toward a neighbor that never answers
+//! costs a bounded amount of memory.
+class NeighborTable {
+  public:
+    //! What the interface knows about one neighbor
+    struct Neighbor {
+        uint32_t ip_address = 0;                            //!< Key
+        std::optional<EthernetAddress> ethernet_address{};  //!< Known Ethernet address (none while resolving)
+        uint64_t last_request_time = 0;                     //!< When an ARP request for it was last sent (ms)
+        uint32_t requests_sent = 0;                         //!< ARP requests sent since it last answered
+        bool unreachable = false;                           //!< Negatively cached: it never answered
+
+        //! \name Header of IPv4 frames to the neighbor, once its Ethernet address is known
+        //!@{
+        EthernetHeader frame_header{};
+        Buffer serialized_frame_header{};  //!< `frame_header`, serialized once and shared by every frame
+        //!@}
+    };
+
+    //! Bounds on the datagrams waiting for Ethernet addresses (counting IP header and payload)
+    struct WaitingLimits {
+        size_t per_neighbor_bytes = 64 * 1024;  //!< Most bytes waiting for any one neighbor
+        size_t total_bytes = 1024 * 1024;       //!< Most bytes waiting for all neighbors together
+    };
+
+    //! Counters for the datagrams waiting for Ethernet addresses
+    struct WaitingStats {
+        uint64_t queued = 0;   //!< Datagrams accepted by enqueue()
+        uint64_t flushed = 0;  //!< Datagrams taken out by dequeue()
+        uint64_t dropped = 0;  //!< Datagrams dropped to stay within the limits, or with their neighbor
+        size_t datagrams = 0;  //!< Datagrams waiting now
+        size_t bytes = 0;      //!< Bytes waiting now
+    };
+
+  private:
+    static constexpr uint32_t NONE = UINT32_MAX;  //!< No node
+
+    //! Number of expiry lists (different lifetimes that can each be appended in O(1))
+    static constexpr size_t NUM_EXPIRY_LISTS = 4;
+
+    //! A neighbor in the pool, with its place on the expiry list and its waiting datagrams
+    struct Node : Neighbor {
+        uint64_t expiry_time = 0;       //!< When to forget the neighbor (if `listed`)
+        uint32_t prev = NONE;           //!< Next-older node on the expiry list
+        uint32_t next = NONE;           //!< Next-newer node on the expiry list (or next free node)
+        bool listed = false;            //!< On an expiry list
+        uint8_t list = 0;               //!< Which expiry list (if `listed`)
+        uint32_t first_waiting = NONE;  //!< Oldest datagram waiting for this neighbor
+        uint32_t last_waiting = NONE;   //!< Newest datagram waiting for this neighbor
+        size_t waiting_datagrams = 0;   //!< Datagrams waiting for this neighbor
+        size_t waiting_bytes = 0;       //!< Their bytes
+    };
+
+    //! A datagram waiting for its neighbor's Ethernet address
+    struct Waiting {
+        InternetDatagram dgram{};
+        size_t bytes = 0;
+        uint32_t node = NONE;   //!< Neighbor it is waiting for
+        uint32_t next = NONE;   //!< Next datagram for the same neighbor (or next free entry)
+        uint32_t older = NONE;  //!< Next-older datagram for any neighbor
+        uint32_t newer = NONE;  //!< Next-newer datagram for any neighbor
+    };
+
+    //! A hash table slot
+    struct Slot {
+        uint32_t ip_address;  //!< Key of the node (so a probe doesn't have to visit the pool)
+        uint32_t node;        //!< Index in `_nodes`, or NONE if the slot is empty
+    };
+
+    std::vector<Node> _nodes{};  //!< Pool of neighbors
+    std::vector<Slot> _slots{};  //!< Hash table; the number of slots is a power of two, at least twice `_size`
+    uint32_t _slot_bits = 0;     //!< log2 of the number of slots
+    uint32_t _free = NONE;       //!< First unused node in `_nodes`, chained through `next`
+    std::array<uint32_t, NUM_EXPIRY_LISTS> _oldest{};  //!< Front of each expiry list (expires first)
+    std::array<uint32_t, NUM_EXPIRY_LISTS> _newest{};  //!< Back of each expiry list
+    size_t _size = 0;            //!< Neighbors in the table
+
+    std::vector<Waiting> _waiting{};  //!< Pool of waiting datagrams
+    uint32_t _free_waiting = NONE;    //!< First unused entry in `_waiting`, chained through `next`
+    uint32_t _oldest_waiting = NONE;  //!< Oldest waiting datagram
+    uint32_t _newest_waiting = NONE;  //!< Newest waiting datagram
+    WaitingLimits _waiting_limits{};
+    WaitingStats _waiting_stats{};
+
+    //! Home slot of a key
+    size_t _home(const uint32_t ip_address) const { return (ip_address * 0x9e3779b1u) >> (32 - _slot_bits); }
+
+    //! Index of the slot holding `ip_address`, or of the empty slot where it would go
+    size_t _probe(const uint32_t ip_address) const;
+
+    //! Double the number of slots and reinsert every neighbor
+    void _grow();
+
+    //! Take a node off its expiry list
+    void _unlink(Node &node);
+
+    //! Index of the node that expires first, or NONE if no node has an expiry time
+    uint32_t _first_to_expire() const;
+
+    //! Index of a node in `_nodes`
+    uint32_t _index(const Node &node) const { return &node - _nodes.data(); }
+
+    //! Take the oldest datagram waiting for `node` out of the pool
+    InternetDatagram _take_waiting(Node &node);
+
+    //! Drop the oldest datagrams waiting for `node` until it is within the per-neighbor limit
+    void _trim_waiting(Node &node);
+
+    //! Drop the oldest waiting datagrams until they are within the total limit
+    void _trim_total_waiting();
+
+  public:
+    NeighborTable();
+
+    //! \brief The neighbor with this IP address, if present
+    //! \note The pointer is valid until the next insert() or erase()
+    Neighbor *find(const uint32_t ip_address);
+    const Neighbor *find(const uint32_t ip_address) const;
+
+    //! \brief Add a neighbor that isn't present yet (with no Ethernet address, and no expiry time)
+    //! \note Throws std::runtime_error if it is already present. The reference is valid until the next
+    //! insert() or erase().
+    Neighbor &insert(const uint32_t ip_address);
+
+    //! \brief Remove a neighbor (dropping any datagrams waiting for it)
+    //! \returns `false` if it was not present
+    bool erase(const uint32_t ip_address);
+
+    //! \brief Forget `neighbor` (which must be in this table) at time `time`, instead of at any time set before
+    //! \details O(1) when `time` is no earlier than the last expiry time set for one of the expiry
+    //! lists, as when entries live for at most NUM_EXPIRY_LISTS different durations.
+    void set_expiry(Neighbor &neighbor, const uint64_t time);
+
+    //! \brief Keep `neighbor` (which must be in this table) until it is erased
+    void clear_expiry(Neighbor &neighbor);
+
+    //! \brief When `neighbor` (which must be in this table) expires, or UINT64_MAX if it doesn't
+    uint64_t expiry_time(const Neighbor &neighbor) const;
+
+    //! \brief The neighbor that expires first, if its expiry time is `now` or earlier
+    //! \details For an owner that wants to do more than forget expired neighbors: it must erase the
+    //! neighbor, or give it a later expiry time, before asking again.
+    Neighbor *first_expired(const uint64_t now);
+
+    //! \brief Remove every neighbor whose expiry time is `now` or earlier
+    //! \returns the number removed
+    size_t expire(const uint64_t now);
+
+    //! \brief Number of neighbors in the table
+    size_t size() const { return _size; }
+
+    //! \name Datagrams waiting for Ethernet addresses
+    //!@{
+
+    //! \brief Queue a datagram behind any others waiting for `neighbor` (which must be in this table)
+    //! \details Drops the oldest waiting datagrams if that goes over a limit. A datagram bigger than
+    //! the per-neighbor limit is dropped straight away.
+    void enqueue(Neighbor &neighbor, InternetDatagram dgram);
+
+    //! \brief Take out the oldest datagram waiting for `neighbor` (which must be in this table), if any
+    std::optional<InternetDatagram> dequeue(Neighbor &neighbor);
+
+    //! \brief Drop every datagram waiting for `neighbor` (which must be in this table)
+    void drop_waiting(Neighbor &neighbor);
+
+    //! \brief Number of datagrams waiting for `neighbor` (which must be in this table)
+    size_t waiting(const Neighbor &neighbor) const { return static_cast<const Node &>(neighbor).waiting_datagrams; }
+
+    //! \brief Change the limits, dropping datagrams right away if they are now over
+    void set_waiting_limits(const WaitingLimits &limits);
+
+    const WaitingLimits &waiting_limits() const { return _waiting_limits; }
+    const WaitingStats &waiting_stats() const { return _waiting_stats; }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
@@ -4,6 +4,7 @@
 #include "ethernet_frame.hh"
 
 #include <iostream>
+#include <stdexcept>
 
 // Dummy implementation of a network interface
 // Translates from {IP datagram, next hop address} to link-layer frame, and from link-layer frame to IP datagram
@@ -26,61 +27,59 @@ NetworkInterface::NetworkInterface(const EthernetAddress &ethernet_address, cons
          << ip_address.ip() << "\n";
 }
 
-optional<EthernetAddress> NetworkInterface::get_EthernetAdress(const uint32_t ip_addr) {
-    optional<EthernetAddress> ret = nullopt;
-    map<uint32_t, EthernetAddressEntry>::iterator iter;
-    iter = _cache.find(ip_addr);
-    if (iter != _cache.end()) {
-        ret = iter->second.MAC_address;
+void NetworkInterface::set_queue_discipline(const EgressQueue::Config &config) {
+    if (_frames_out.size() != 0) {
+        throw runtime_error("NetworkInterface: can't change the queue discipline while frames are waiting");
     }
-    return ret;
+    _frames_out = EgressQueue(config);
 }
 
-optional<NetworkInterface::WaitingList> NetworkInterface::get_WaitingList(const uint32_t ip_addr) {
-    optional<WaitingList> ret = nullopt;
-    map<uint32_t, NetworkInterface::WaitingList>::iterator iter;
-    iter = _queue_map.find(ip_addr);
-    if (iter != _queue_map.end()) {
-        ret = iter->second;
-    }
-    return ret;
+NeighborTable::Neighbor *NetworkInterface::get_resolved_neighbor(const uint32_t ip_addr) {
+    NeighborTable::Neighbor *neighbor = _neighbors.find(ip_addr);
+    return neighbor and neighbor->ethernet_address.has_value() ? neighbor : nullptr;
 }
 
-//! \param[in] MAC_addr the destination Ethernet Address
+//! \param[in] neighbor the destination, whose Ethernet address is known
 //! \param[in] dgram the IPv4 datagram to be sent
-void NetworkInterface::send_helper(const EthernetAddress MAC_addr, const InternetDatagram &dgram) {
+//! the frame starts with the neighbor's ready-made Ethernet header
+void NetworkInterface::send_helper(const NeighborTable::Neighbor &neighbor, const InternetDatagram &dgram) {
     EthernetFrame frame;
-    frame.header().type = EthernetHeader::TYPE_IPv4;
-    frame.header().src = _ethernet_address;
-    frame.header().dst = MAC_addr;
+    frame.set_header(neighbor.frame_header, neighbor.serialized_frame_header);
     frame.payload() = dgram.serialize();
-    _frames_out.push(frame);
+    _frames_out.push(move(frame));
 }
 
 //! \param[in] ipaddr the IPv4 address waits for resolving
 //! \param[in] dgram the IPv4 datagram queued to be sent
-//! push the datagram into the waiting queue
+//! push the datagram into the waiting queue (which may drop the oldest waiting datagrams, to stay within the limits)
 //! resend ARP request if a new ARP request need to be sent ,i.e., the last request was sent over 5 seconds ago or there is no request sent before
+//! a negatively cached neighbor gets no request, and the datagram is dropped
 void NetworkInterface::queue_helper(const uint32_t ip_addr, const InternetDatagram &dgram) {
-    optional<WaitingList> wait_list = get_WaitingList(ip_addr);
+    NeighborTable::Neighbor *neighbor = _neighbors.find(ip_addr);
     bool send_ARP = false;
-    if (wait_list.has_value()) {
-        wait_list.value().waiting_datagram.push(dgram);        
-        send_ARP = wait_list.value().time_since_last_ARP_request_send >= NetworkInterface::MAX_RETX_WAITING_TIME;
+    if (neighbor) {
+        if (neighbor->unreachable) {
+            _unreachable_drops++;
+            return;
+        }
+        send_ARP = _now - neighbor->last_request_time >= NetworkInterface::MAX_RETX_WAITING_TIME;
     } else {
-        WaitingList new_wait_list;
-        new_wait_list.waiting_datagram.push(dgram);
-        _queue_map[ip_addr] = new_wait_list; 
+        neighbor = &_neighbors.insert(ip_addr);
         send_ARP = true;
     }
-    if (send_ARP) send_ARP_request(ip_addr);
+    _neighbors.enqueue(*neighbor, dgram);
+    if (send_ARP) {
+        request_address(*neighbor);
+    }
 }
 
-void NetworkInterface::send_ARP_request(const uint32_t ip_addr) {
+//! \param[in] ip_addr the IPv4 address to ask about
+//! \param[in] dst where to send the request: broadcast, or the neighbor itself to check a mapping still holds
+void NetworkInterface::send_ARP_request(const uint32_t ip_addr, const EthernetAddress &dst) {
     EthernetFrame frame;
     frame.header().type = EthernetHeader::TYPE_ARP;
     frame.header().src = _ethernet_address;
-    frame.header().dst = ETHERNET_BROADCAST;
+    frame.header().dst = dst;
     ARPMessage arp;
     arp.opcode = ARPMessage::OPCODE_REQUEST;
     arp.sender_ethernet_address = _ethernet_address;
@@ -91,6 +90,32 @@ void NetworkInterface::send_ARP_request(const uint32_t ip_addr) {
     _frames_out.push(frame);
 }
 
+//! \param[in] neighbor the neighbor to ask about
+//! \param[in] dst where to send the request
+//! a neighbor still waiting for its address is asked again (or given up on) after MAX_RETX_WAITING_TIME
+void NetworkInterface::request_address(NeighborTable::Neighbor &neighbor, const EthernetAddress &dst) {
+    send_ARP_request(neighbor.ip_address, dst);
+    neighbor.last_request_time = _now;
+    neighbor.requests_sent++;
+    if (not neighbor.ethernet_address.has_value()) {
+        _neighbors.set_expiry(neighbor, _now + NetworkInterface::MAX_RETX_WAITING_TIME);
+    }
+}
+
+//! \param[in] neighbor a neighbor in use, whose Ethernet address is known
+//! within MAX_RETX_WAITING_TIME of the end of its cache time, ask the neighbor (directly) to confirm
+//! the mapping, so that its reply extends the mapping before it expires and traffic doesn't stall
+void NetworkInterface::refresh_helper(NeighborTable::Neighbor &neighbor) {
+    const uint64_t expiry = _neighbors.expiry_time(neighbor);
+    if (expiry - _now < NetworkInterface::MAX_RETX_WAITING_TIME and
+        _now - neighbor.last_request_time >= NetworkInterface::MAX_RETX_WAITING_TIME) {
+        request_address(neighbor, neighbor.ethernet_address.value());
+    }
+}
+
+//! a gratuitous ARP request: asks about our own IP address, so that anyone listening learns our Ethernet address
+void NetworkInterface::announce() { send_ARP_request(_ip_address.ipv4_numeric()); }
+
 void NetworkInterface::send_ARP_reply(const uint32_t ip_addr, const EthernetAddress& MAC_addr) {
     EthernetFrame frame;
     frame.header().type = EthernetHeader::TYPE_ARP;
@@ -111,32 +136,28 @@ bool NetworkInterface::valid_frame(const EthernetFrame &frame) {
 }
 
 void NetworkInterface::cache_mapping(uint32_t ip_addr, EthernetAddress MAC_addr) {
-    map<uint32_t, EthernetAddressEntry>::iterator iter;
-    iter = _cache.find(ip_addr);
-    if (iter != _cache.end()) {
-        // update the cache
-        iter->second.caching_time = 0;
-        iter->second.MAC_address = MAC_addr;
-    } else {
-        // add new entry
-        EthernetAddressEntry entry;
-        entry.caching_time = 0;
-        entry.MAC_address = MAC_addr;
-        _cache[ip_addr] = entry;
+    NeighborTable::Neighbor *neighbor = _neighbors.find(ip_addr);
+    if (not neighbor) {
+        neighbor = &_neighbors.insert(ip_addr);
+    }
+    // add or update the mapping, and keep it for another MAX_CACHE_TIME
+    neighbor->requests_sent = 0;
+    neighbor->unreachable = false;
+    if (neighbor->ethernet_address != MAC_addr) {
+        neighbor->ethernet_address = MAC_addr;
+        neighbor->frame_header = {MAC_addr, _ethernet_address, EthernetHeader::TYPE_IPv4};
+        neighbor->serialized_frame_header = Buffer{neighbor->frame_header.serialize()};
     }
+    _neighbors.set_expiry(*neighbor, _now + NetworkInterface::MAX_CACHE_TIME);
 }
 
-void NetworkInterface::clear_waitinglist(uint32_t ip_addr, EthernetAddress MAC_addr) {
-    map<uint32_t, WaitingList>::iterator iter;
-    iter = _queue_map.find(ip_addr);
-    if (iter != _queue_map.end()) {
-        while (!iter->second.waiting_datagram.empty()) {
-            InternetDatagram dgram = iter->second.waiting_datagram.front();
-            iter->second.waiting_datagram.pop();
-            send_helper(MAC_addr, dgram);
+void NetworkInterface::clear_waitinglist(uint32_t ip_addr) {
+    NeighborTable::Neighbor *neighbor = _neighbors.find(ip_addr);
+    if (neighbor) {
+        while (optional<InternetDatagram> dgram = _neighbors.dequeue(*neighbor)) {
+            send_helper(*neighbor, dgram.value());
         }
     }
-    _queue_map.erase(ip_addr);
 }
 
 //! \param[in] dgram the IPv4 datagram to be sent
@@ -145,14 +166,33 @@ void NetworkInterface::clear_waitinglist(uint32_t ip_addr, EthernetAddress MAC_a
 void NetworkInterface::send_datagram(const InternetDatagram &dgram, const Address &next_hop) {
     // convert IP address of next hop to raw 32-bit representation (used in ARP header)
     const uint32_t next_hop_ip = next_hop.ipv4_numeric();
-    optional<EthernetAddress> MAC_addr = get_EthernetAdress(next_hop_ip);
-    if (MAC_addr.has_value()) {
-        send_helper(MAC_addr.value(), dgram);
+    NeighborTable::Neighbor *neighbor = get_resolved_neighbor(next_hop_ip);
+    if (neighbor) {
+        send_helper(*neighbor, dgram);
+        refresh_helper(*neighbor);
     } else {
         queue_helper(next_hop_ip, dgram);
     }    
 }
 
+//! \param[in] dgrams the IPv4 datagrams to be sent, in order
+//! \param[in] next_hop the IP address of the interface to send them all to
+void NetworkInterface::send_datagrams(const vector<InternetDatagram> &dgrams, const Address &next_hop) {
+    const uint32_t next_hop_ip = next_hop.ipv4_numeric();
+    NeighborTable::Neighbor *neighbor = get_resolved_neighbor(next_hop_ip);
+    if (not neighbor) {
+        for (const auto &dgram : dgrams) {
+            queue_helper(next_hop_ip, dgram);
+        }
+        return;
+    }
+
+    for (const auto &dgram : dgrams) {
+        send_helper(*neighbor, dgram);
+    }
+    refresh_helper(*neighbor);
+}
+
 //! \param[in] frame the incoming Ethernet frame
 optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &frame) {
     // filter frames whose dst is not this Network Interface
@@ -167,7 +207,7 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
         ARPMessage arp;
         if (arp.parse(Buffer(frame.payload())) == ParseResult::NoError) {
             cache_mapping(arp.sender_ip_address, arp.sender_ethernet_address);
-            clear_waitinglist(arp.sender_ip_address, arp.sender_ethernet_address);
+            clear_waitinglist(arp.sender_ip_address);
             if (arp.opcode == ARPMessage::OPCODE_REQUEST && arp.target_ip_address == _ip_address.ipv4_numeric()) 
                 send_ARP_reply(arp.sender_ip_address, arp.sender_ethernet_address);
         }
@@ -177,23 +217,21 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void NetworkInterface::tick(const size_t ms_since_last_tick) {
-    map<uint32_t, NetworkInterface::WaitingList>::iterator iter1; 
-    for (iter1 = _queue_map.begin(); iter1 != _queue_map.end(); iter1++) {
-        iter1->second.time_since_last_ARP_request_send += ms_since_last_tick;
-    }
-
-    map<uint32_t, EthernetAddressEntry>::iterator iter2;
-    queue<uint32_t> deleted_ips;
-    for (iter2 = _cache.begin(); iter2 != _cache.end(); iter2++) {
-        iter2->second.caching_time += ms_since_last_tick;
-        if (iter2->second.caching_time >= NetworkInterface::MAX_CACHE_TIME) {
-            deleted_ips.push(iter2->first);
+    _frames_out.tick(ms_since_last_tick);
+
+    _now += ms_since_last_tick;
+    while (NeighborTable::Neighbor *neighbor = _neighbors.first_expired(_now)) {
+        if (neighbor->ethernet_address.has_value() or neighbor->unreachable) {
+            // forget the mappings that are MAX_CACHE_TIME old, and negative entries that are NEGATIVE_CACHE_TIME old
+            _neighbors.erase(neighbor->ip_address);
+        } else if (neighbor->requests_sent < NetworkInterface::MAX_ARP_REQUESTS) {
+            // no reply yet: ask again
+            request_address(*neighbor);
+        } else {
+            // no reply to any request: drop what's waiting, and stop asking for a while
+            _neighbors.drop_waiting(*neighbor);
+            neighbor->unreachable = true;
+            _neighbors.set_expiry(*neighbor, _now + NetworkInterface::NEGATIVE_CACHE_TIME);
         }
     }
-
-    while (!deleted_ips.empty()) {
-        uint32_t ip = deleted_ips.front();
-        deleted_ips.pop();
-        _cache.erase(ip);
-    }
 }
@@ -1,13 +1,15 @@
 #ifndef SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
 #define SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
 
+#include "egress_queue.hh"
 #include "ethernet_frame.hh"
+#include "neighbor_table.hh"
 #include "tcp_over_ip.hh"
 #include "tun.hh"
 
-#include <map>
 #include <optional>
 #include <queue>
+#include <vector>
 
 //! \brief A "network interface" that connects IP (the internet layer, or network layer)
 //! with Ethernet (the network access layer, or link layer).
@@ -38,52 +40,80 @@ class NetworkInterface {
     //! cache the mapping for 30 seconds
     static constexpr size_t MAX_CACHE_TIME = 30000;
 
+    //! give up on a neighbor after this many ARP requests (one every MAX_RETX_WAITING_TIME) go unanswered
+    static constexpr size_t MAX_ARP_REQUESTS = 3;
+
+    //! then drop datagrams for it at once, without asking again, for 20 seconds
+    static constexpr size_t NEGATIVE_CACHE_TIME = 20000;
+
     //! Ethernet (known as hardware, network-access-layer, or link-layer) address of the interface
     EthernetAddress _ethernet_address;
 
     //! IP (known as internet-layer or network-layer) address of the interface
     Address _ip_address;
 
+    //! largest IP datagram (header included) the link can carry
+    size_t _mtu = DEFAULT_MTU;
+
     //! outbound queue of Ethernet frames that the NetworkInterface wants sent
-    std::queue<EthernetFrame> _frames_out{};
-
-    //! cache entry for ethernet address mapping
-    struct EthernetAddressEntry {
-      size_t caching_time;
-      EthernetAddress MAC_address;
-    };
-
-    //! mapping from ip_address to ethernet address
-    std::map<uint32_t, EthernetAddressEntry> _cache{};
-
-    //! to avoid flooding the network with ARP requests. If the network interface 
-    // already sent an ARP request about the same IP address in the last five seconds,
-    // don’t send a second request—just wait for a reply to the first one. 
-    // Again, queue the datagram until you learn the destination Ethernet address.
-    struct WaitingList {
-      size_t time_since_last_ARP_request_send = 0;
-      std::queue<InternetDatagram> waiting_datagram{};
-    };
-
-    //! mapping from the ip_address to the waiting queue
-    std::map<uint32_t, WaitingList> _queue_map{};
-
-    std::optional<EthernetAddress>get_EthernetAdress(const uint32_t ip_addr);
-    std::optional<WaitingList>get_WaitingList(const uint32_t ip_addr); 
-    void send_helper(const EthernetAddress MAC_addr, const InternetDatagram &dgram);
+    EgressQueue _frames_out{};
+
+    //! milliseconds elapsed, as told by tick()
+    uint64_t _now = 0;
+
+    //! neighbors whose Ethernet addresses are known (for MAX_CACHE_TIME), being requested (with the
+    //! datagrams waiting for them), or negatively cached. To avoid flooding the network with ARP requests,
+    //! a request for the same IP address is sent at most once every MAX_RETX_WAITING_TIME.
+    NeighborTable _neighbors{};
+
+    //! datagrams dropped because their next hop is negatively cached
+    uint64_t _unreachable_drops = 0;
+
+    NeighborTable::Neighbor *get_resolved_neighbor(const uint32_t ip_addr);
+    void send_helper(const NeighborTable::Neighbor &neighbor, const InternetDatagram &dgram);
     void queue_helper(const uint32_t ip_addr, const InternetDatagram &dgram);
-    void send_ARP_request(const uint32_t ip_addr);
+    void send_ARP_request(const uint32_t ip_addr, const EthernetAddress &dst = ETHERNET_BROADCAST);
+    void request_address(NeighborTable::Neighbor &neighbor, const EthernetAddress &dst = ETHERNET_BROADCAST);
+    void refresh_helper(NeighborTable::Neighbor &neighbor);
     void send_ARP_reply(const uint32_t ip_addr, const EthernetAddress& MAC_addr);
     bool valid_frame(const EthernetFrame &frame);
     void cache_mapping(uint32_t ip_addr, EthernetAddress MAC_addr);
-    void clear_waitinglist(uint32_t ip_addr, EthernetAddress MAC_addr);
+    void clear_waitinglist(uint32_t ip_addr);
 
   public:
+    //! MTU of Ethernet
+    static constexpr size_t DEFAULT_MTU = 1500;
+
     //! \brief Construct a network interface with given Ethernet (network-access-layer) and IP (internet-layer) addresses
     NetworkInterface(const EthernetAddress &ethernet_address, const Address &ip_address);
 
     //! \brief Access queue of Ethernet frames awaiting transmission
-    std::queue<EthernetFrame> &frames_out() { return _frames_out; }
+    EgressQueue &frames_out() { return _frames_out; }
+
+    //! \brief Choose how frames awaiting transmission are queued, and dropped under congestion
+    //! \note Throws std::runtime_error if frames are waiting
+    void set_queue_discipline(const EgressQueue::Config &config);
+
+    //! \brief Announce the interface's addresses with a gratuitous ARP request (when the interface starts)
+    void announce();
+
+    //! \brief Datagrams dropped because their next hop never answered ARP requests
+    uint64_t unreachable_drops() const { return _unreachable_drops; }
+
+    //! \brief Bound the datagrams waiting for ARP replies, per neighbor and in total
+    void set_waiting_limits(const NeighborTable::WaitingLimits &limits) { _neighbors.set_waiting_limits(limits); }
+
+    //! \brief Datagrams queued, flushed and dropped while waiting for ARP replies
+    const NeighborTable::WaitingStats &waiting_stats() const { return _neighbors.waiting_stats(); }
+
+    //! \brief IP address of the interface
+    const Address &ip_address() const { return _ip_address; }
+
+    //! \brief Largest IP datagram (header included) that fits in one frame; a Router fragments anything larger
+    size_t mtu() const { return _mtu; }
+
+    //! \brief Change the MTU (e.g., for a link with a smaller frame size than Ethernet)
+    void set_mtu(const size_t mtu) { _mtu = mtu; }
 
     //! \brief Sends an IPv4 datagram, encapsulated in an Ethernet frame (if it knows the Ethernet destination address).
 
@@ -91,10 +121,16 @@ class NetworkInterface {
     //! ("Sending" is accomplished by pushing the frame onto the frames_out queue.)
     void send_datagram(const InternetDatagram &dgram, const Address &next_hop);
 
+    //! \brief Sends several IPv4 datagrams to the same next hop.
+
+    //! Equivalent to calling send_datagram() on each in turn, but looks up the next hop's
+    //! Ethernet address once.
+    void send_datagrams(const std::vector<InternetDatagram> &dgrams, const Address &next_hop);
+
     //! \brief Receives an Ethernet frame and responds appropriately.
 
     //! If type is IPv4, returns the datagram.
-    //! If type is ARP request, learn a mapping from the "sender" fields, and send an ARP reply.
+    //! If type is ARP request, learn a mapping from the "sender" fields, and send an ARP reply (if it asks for us).
     //! If type is ARP reply, learn a mapping from the "sender" fields.
     std::optional<InternetDatagram> recv_frame(const EthernetFrame &frame);
 
@@ -0,0 +1,221 @@
+#include "route_table.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+//! The bit of `address` just after the first `position` bits (i.e., bit `position` counting from the top)
+unsigned int bit_after(const uint32_t address, const uint8_t position) { return (address >> (31 - position)) & 1; }
+
+//! Length of the longest prefix shared by `a` and `b`, up to `limit` bits
+uint8_t common_prefix_length(const uint32_t a, const uint32_t b, const uint8_t limit) {
+    const uint32_t difference = a ^ b;
+    const uint8_t common = difference == 0 ? 32 : __builtin_clz(difference);
+    return min(common, limit);
+}
+
+}  // namespace
+
+RouteTable::RouteTable() : _jump(size_t(1) << JUMP_BITS, Jump{0, NONE}) { _new_node(0, 0, NONE); }
+
+uint32_t RouteTable::_new_node(const uint32_t prefix, const uint8_t length, const Value value) {
+    if (_nodes.size() >= NONE) {
+        throw runtime_error("RouteTable: too many routes");
+    }
+    _nodes.push_back({prefix, length, value});
+    return _nodes.size() - 1;
+}
+
+//! \param[in] prefix The "up-to-32-bit" IPv4 address prefix
+//! \param[in] length How many high-order bits of `prefix` are significant
+//! \param[in] value What to associate with the prefix
+bool RouteTable::insert(const uint32_t prefix, const uint8_t length, const Value value) {
+    if (length > 32) {
+        throw runtime_error("RouteTable: prefix length " + to_string(length) + " is longer than 32 bits");
+    }
+    if (value == NONE) {
+        throw runtime_error("RouteTable: reserved value");
+    }
+    const uint32_t key = prefix & mask(length);
+
+    // invariant: `node` is a prefix of the new prefix
+    uint32_t node = 0;
+    while (true) {
+        if (_nodes[node].length == length) {
+            if (_nodes[node].value != NONE) {
+                return false;
+            }
+            _nodes[node].value = value;
+            _size++;
+            if (length <= JUMP_BITS) {
+                _update_jump(key, length);
+            }
+            return true;
+        }
+
+        const unsigned int branch = bit_after(key, _nodes[node].length);
+        const uint32_t child = _nodes[node].child[branch];
+        if (child == NONE) {
+            const uint32_t leaf = _new_node(key, length, value);
+            _nodes[node].child[branch] = leaf;
+            _size++;
+            if (length <= JUMP_BITS) {
+                _update_jump(key, length);
+            }
+            return true;
+        }
+
+        const uint8_t common = common_prefix_length(key, _nodes[child].prefix, min(length, _nodes[child].length));
+        if (common == _nodes[child].length) {
+            node = child;
+            continue;
+        }
+
+        // the new prefix and the child diverge (or the new prefix ends) partway along the edge, so split it
+        const uint32_t middle = _new_node(key & mask(common), common, common == length ? value : NONE);
+        _nodes[middle].child[bit_after(_nodes[child].prefix, common)] = child;
+        _nodes[node].child[branch] = middle;
+        if (common != length) {
+            const uint32_t leaf = _new_node(key, length, value);
+            _nodes[middle].child[bit_after(key, common)] = leaf;
+        }
+        _size++;
+        if (common <= JUMP_BITS) {
+            _update_jump(key & mask(common), common);
+        }
+        return true;
+    }
+}
+
+uint32_t RouteTable::_find_node(const uint32_t prefix, const uint8_t length) const {
+    if (length > 32) {
+        return NONE;
+    }
+    const uint32_t key = prefix & mask(length);
+    uint32_t node = 0;
+    while (node != NONE and _nodes[node].length <= length and
+           (key & mask(_nodes[node].length)) == _nodes[node].prefix) {
+        if (_nodes[node].length == length) {
+            return node;
+        }
+        node = _nodes[node].child[bit_after(key, _nodes[node].length)];
+    }
+    return NONE;
+}
+
+//! \details The node stays in the trie (without a value), ready for the prefix to be added again.
+bool RouteTable::erase(const uint32_t prefix, const uint8_t length) {
+    const uint32_t node = _find_node(prefix, length);
+    if (node == NONE or _nodes[node].value == NONE) {
+        return false;
+    }
+    _nodes[node].value = NONE;
+    _size--;
+    if (length <= JUMP_BITS) {
+        _update_jump(_nodes[node].prefix, length);
+    }
+    return true;
+}
+
+optional<RouteTable::Value> RouteTable::find(const uint32_t prefix, const uint8_t length) const {
+    const uint32_t node = _find_node(prefix, length);
+    if (node == NONE or _nodes[node].value == NONE) {
+        return {};
+    }
+    return _nodes[node].value;
+}
+
+void RouteTable::_update_jump(const uint32_t prefix, const uint8_t length) {
+    const uint32_t first = prefix >> (32 - JUMP_BITS);
+    const uint32_t count = uint32_t(1) << (JUMP_BITS - length);
+    for (uint32_t entry = first; entry < first + count; entry++) {
+        const uint32_t address = entry << (32 - JUMP_BITS);
+        Jump jump{0, NONE};
+        uint32_t node = 0;
+        while (node != NONE and _nodes[node].length <= JUMP_BITS and
+               (address & mask(_nodes[node].length)) == _nodes[node].prefix) {
+            jump.node = node;
+            if (_nodes[node].value != NONE) {
+                jump.best = _nodes[node].value;
+            }
+            node = _nodes[node].child[bit_after(address, _nodes[node].length)];
+        }
+        _jump[entry] = jump;
+    }
+}
+
+optional<RouteTable::Value> RouteTable::lookup(const uint32_t address) const {
+    // skip the nodes that the top bits of the address determine
+    const Jump &jump = _jump[address >> (32 - JUMP_BITS)];
+    Value best = jump.best;
+    uint32_t node = _nodes[jump.node].child[bit_after(address, _nodes[jump.node].length)];
+
+    while (node != NONE) {
+        const Node &n = _nodes[node];
+        if ((address & mask(n.length)) != n.prefix) {
+            break;
+        }
+        if (n.value != NONE) {
+            best = n.value;
+        }
+        if (n.length == 32) {
+            break;
+        }
+        node = n.child[bit_after(address, n.length)];
+    }
+
+    if (best == NONE) {
+        return {};
+    }
+    return best;
+}
+
+RouteCache::RouteCache(const size_t entries) : _entries(), _victims(), _set_bits(0) {
+    if (entries == 0) {
+        return;
+    }
+    while ((WAYS << _set_bits) < entries) {
+        _set_bits++;
+    }
+    _entries.assign(WAYS << _set_bits, Entry{0, NO_ROUTE, 0});
+    _victims.assign(size_t(1) << _set_bits, 0);
+}
+
+optional<RouteTable::Value> RouteCache::lookup(const RouteTable &table, const uint32_t address) {
+    if (_entries.empty()) {
+        return table.lookup(address);
+    }
+
+    // multiplicative (Fibonacci) hashing spreads nearby addresses across sets
+    const size_t set = _set_bits == 0 ? 0 : (address * 0x9e3779b1u) >> (32 - _set_bits);
+    Entry *const ways = &_entries[set * WAYS];
+    for (size_t way = 0; way < WAYS; way++) {
+        if (ways[way].generation == _generation and ways[way].address == address) {
+            _hits++;
+            if (ways[way].value == NO_ROUTE) {
+                return {};
+            }
+            return ways[way].value;
+        }
+    }
+
+    _misses++;
+    const auto result = table.lookup(address);
+    Entry &victim = ways[_victims[set]];
+    _victims[set] = (_victims[set] + 1) % WAYS;
+    victim = {address, result.value_or(NO_ROUTE), _generation};
+    return result;
+}
+
+void RouteCache::invalidate() {
+    _generation++;
+    if (_generation == 0) {
+        // wrapped around: entries from long ago could look current again
+        for (auto &entry : _entries) {
+            entry.generation = 0;
+        }
+        _generation = 1;
+    }
+}
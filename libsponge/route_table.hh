@@ -0,0 +1,118 @@
+#ifndef SPONGE_LIBSPONGE_ROUTE_TABLE_HH
+#define SPONGE_LIBSPONGE_ROUTE_TABLE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+//! \brief Longest-prefix-match lookup for IPv4 routes
+//! \details A path-compressed binary (Patricia) trie: each node stands for a prefix, and chains of
+//! nodes with a single child and no route are collapsed, so a lookup visits at most one node per
+//! prefix length that is actually present (at most 33 nodes) no matter how many routes there are.
+//! A table indexed by the top 16 bits of the address skips a lookup straight to the deepest node
+//! of length 16 or less, so in practice a lookup touches only a handful of nodes.
+//! Each prefix carries a value, e.g. an index into a table of next hops.
+class RouteTable {
+  public:
+    using Value = uint32_t;  //!< What a prefix maps to
+
+  private:
+    static constexpr uint32_t NONE = UINT32_MAX;  //!< No node or no value
+
+    //! A prefix in the trie
+    struct Node {
+        uint32_t prefix;                   //!< Prefix bits (any bits after `length` are zero)
+        uint8_t length;                    //!< Number of significant bits in `prefix`
+        Value value = NONE;                //!< Value of the route for exactly this prefix, if any
+        uint32_t child[2] = {NONE, NONE};  //!< Next node when the bit after the prefix is 0 or 1
+    };
+
+    static constexpr uint8_t JUMP_BITS = 16;  //!< Address bits that index `_jump`
+
+    //! Where to start the lookup of an address, given its top JUMP_BITS bits
+    struct Jump {
+        uint32_t node;  //!< Deepest node of length <= JUMP_BITS that covers the addresses
+        Value best;     //!< Value of the longest prefix on the way to (and including) `node`
+    };
+
+    std::vector<Node> _nodes{};  //!< Node 0 is the root (the empty prefix)
+    std::vector<Jump> _jump{};   //!< Indexed by the top JUMP_BITS bits of an address
+    size_t _size = 0;            //!< Number of prefixes with a value
+
+    //! Index of a new node
+    uint32_t _new_node(const uint32_t prefix, const uint8_t length, const Value value);
+
+    //! Index of the node for exactly this prefix (with or without a value), or NONE
+    uint32_t _find_node(const uint32_t prefix, const uint8_t length) const;
+
+    //! Recompute the `_jump` entries under a prefix of length <= JUMP_BITS whose node has changed
+    void _update_jump(const uint32_t prefix, const uint8_t length);
+
+  public:
+    //! \brief Netmask with the top `length` bits set
+    static constexpr uint32_t mask(const uint8_t length) { return length == 0 ? 0 : UINT32_MAX << (32 - length); }
+
+    RouteTable();
+
+    //! \brief Add a prefix; bits of `prefix` past `length` are ignored
+    //! \returns `false` (and leaves the table unchanged) if the prefix was already present
+    bool insert(const uint32_t prefix, const uint8_t length, const Value value);
+
+    //! \brief Remove a prefix
+    //! \returns `false` if the prefix was not present
+    bool erase(const uint32_t prefix, const uint8_t length);
+
+    //! \brief The value of exactly this prefix, if present
+    std::optional<Value> find(const uint32_t prefix, const uint8_t length) const;
+
+    //! \brief The value of the longest prefix that matches `address`, if any
+    std::optional<Value> lookup(const uint32_t address) const;
+
+    //! \brief Number of prefixes in the table
+    size_t size() const { return _size; }
+};
+
+//! \brief A small set-associative cache of RouteTable lookups, keyed on the exact destination address
+//! \details Traffic tends to go to a few hot destinations, and a hit costs one hash and a short probe
+//! instead of a walk through the trie. Results of "no route" are cached too. The owner must call
+//! invalidate() whenever the RouteTable changes.
+class RouteCache {
+  public:
+    static constexpr size_t WAYS = 4;  //!< Entries per set
+
+  private:
+    //! A cached lookup
+    struct Entry {
+        uint32_t address;         //!< Destination address
+        RouteTable::Value value;  //!< Lookup result, or NO_ROUTE
+        uint32_t generation;      //!< Valid only if equal to RouteCache::_generation
+    };
+
+    static constexpr RouteTable::Value NO_ROUTE = UINT32_MAX;  //!< Cached result when nothing matched
+
+    std::vector<Entry> _entries;    //!< WAYS consecutive entries per set
+    std::vector<uint8_t> _victims;  //!< Per set, the way to replace next
+    uint32_t _set_bits;             //!< log2 of the number of sets
+    uint32_t _generation = 1;       //!< Bumped to invalidate every entry at once
+    uint64_t _hits = 0;             //!< Lookups answered from the cache
+    uint64_t _misses = 0;           //!< Lookups that went to the RouteTable
+
+  public:
+    //! \param[in] entries is the capacity, rounded up to a power of two and at least WAYS; 0 disables the cache
+    explicit RouteCache(const size_t entries);
+
+    //! \brief Look up `address`, consulting `table` (and remembering the result) on a miss
+    std::optional<RouteTable::Value> lookup(const RouteTable &table, const uint32_t address);
+
+    //! \brief Forget every cached lookup
+    void invalidate();
+
+    //! \name Statistics
+    //!@{
+    uint64_t hits() const { return _hits; }
+    uint64_t misses() const { return _misses; }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_ROUTE_TABLE_HH
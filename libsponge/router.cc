@@ -1,7 +1,13 @@
 #include "router.hh"
 
-#include <iostream>
-#include <limits>
+#include "icmp_message.hh"
+#include "ipv4_fragments.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 using namespace std;
 
@@ -19,6 +25,38 @@ using namespace std;
 template <typename... Targs>
 void DUMMY_CODE(Targs &&... /* unused */) {}
 
+namespace {
+
+//! \brief Hash of the flow a datagram belongs to: its addresses, protocol and (for TCP and UDP) ports
+//! \details Fragments after the first carry no ports, so they hash without them.
+uint32_t flow_hash(const InternetDatagram &dgram) {
+    const IPv4Header &header = dgram.header();
+    uint32_t ports = 0;
+    if ((header.proto == IPv4Header::PROTO_TCP or header.proto == IPv4Header::PROTO_UDP) and header.offset == 0) {
+        const auto &buffers = dgram.payload().buffers();
+        if (not buffers.empty() and buffers.front().size() >= sizeof(ports)) {
+            memcpy(&ports, buffers.front().str().data(), sizeof(ports));
+        } else if (dgram.payload().size() >= sizeof(ports)) {
+            memcpy(&ports, dgram.payload().concatenate().data(), sizeof(ports));
+        }
+    }
+
+    // the 64-bit finalizer from MurmurHash3, so that every input bit affects the result
+    const uint64_t addresses = (uint64_t(header.src) << 32) | header.dst;
+    uint64_t h = addresses ^ (((uint64_t(ports) << 8) | header.proto) * 0x9e3779b97f4a7c15);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+//! One of `count` paths, chosen by a hash (a multiply and shift, instead of a division)
+size_t pick_path(const uint32_t hash, const size_t count) { return (uint64_t(hash) * count) >> 32; }
+
+}  // namespace
+
 //! \param[in] route_prefix The "up-to-32-bit" IPv4 address prefix to match the datagram's destination address against
 //! \param[in] prefix_length For this route to be applicable, how many high-order (most-significant) bits of the route_prefix will need to match the corresponding bits of the datagram's destination address?
 //! \param[in] next_hop The IP address of the next hop. Will be empty if the network is directly attached to the router (in which case, the next hop address should be the datagram's final destination).
@@ -27,48 +65,433 @@ void Router::add_route(const uint32_t route_prefix,
                        const uint8_t prefix_length,
                        const optional<Address> next_hop,
                        const size_t interface_num) {
-    cerr << "DEBUG: adding route " << Address::from_ipv4_numeric(route_prefix).ip() << "/" << int(prefix_length)
-         << " => " << (next_hop.has_value() ? next_hop->ip() : "(direct)") << " on interface " << interface_num << "\n";
+    add_route(route_prefix, prefix_length, {{next_hop, interface_num}});
+}
+
+void Router::add_route(const uint32_t route_prefix, const uint8_t prefix_length, const vector<NextHop> &next_hops) {
+    const Route route{route_prefix, prefix_length, next_hops};
+    check_route(route);
+    // the first route added for a prefix wins, as it would in a linear scan
+    if (_routes.add(route)) {
+        _routes_version++;
+    }
+}
+
+bool Router::remove_route(const uint32_t route_prefix, const uint8_t prefix_length) {
+    if (not _routes.remove(route_prefix, prefix_length)) {
+        return false;
+    }
+    _routes_version++;
+    return true;
+}
+
+void Router::replace_route(const uint32_t route_prefix,
+                           const uint8_t prefix_length,
+                           const optional<Address> next_hop,
+                           const size_t interface_num) {
+    replace_route(route_prefix, prefix_length, {{next_hop, interface_num}});
+}
+
+void Router::replace_route(const uint32_t route_prefix,
+                           const uint8_t prefix_length,
+                           const vector<NextHop> &next_hops) {
+    const Route route{route_prefix, prefix_length, next_hops};
+    check_route(route);
+    _routes.replace(route);
+    _routes_version++;
+}
+
+void Router::load_routes(const vector<Route> &routes) {
+    RoutingTable fresh;
+    fresh.entries.reserve(routes.size());
+    for (const auto &route : routes) {
+        check_route(route);
+        fresh.add(route);
+    }
+
+    _routes = move(fresh);
+    _routes_version++;
+}
+
+void Router::check_route(const Route &route) const {
+    if (route.next_hops.empty()) {
+        throw runtime_error("Router: route without a next hop");
+    }
+    for (const auto &next_hop : route.next_hops) {
+        if (next_hop.interface_num >= _interfaces.size()) {
+            throw runtime_error("Router: route to nonexistent interface " + to_string(next_hop.interface_num));
+        }
+    }
+    if (route.prefix_length > 32) {
+        throw runtime_error("Router: prefix length " + to_string(route.prefix_length) + " is longer than 32 bits");
+    }
+}
+
+//! \param[out] paths the route's next hops, as RouteEntry objects
+void Router::RoutingTable::set_paths(const Route &route, vector<RouteEntry> &paths) {
+    const uint32_t mask = RouteTable::mask(route.prefix_length);
+    paths.clear();
+    paths.reserve(route.next_hops.size());
+    for (const auto &next_hop : route.next_hops) {
+        paths.emplace_back(
+            route.route_prefix & mask, route.prefix_length, next_hop.address, next_hop.interface_num, mask);
+    }
+}
+
+bool Router::RoutingTable::add(const Route &route) {
+    const RouteTable::Value slot = free_slots.empty() ? entries.size() : free_slots.back();
+    if (not lookup.insert(route.route_prefix, route.prefix_length, slot)) {
+        return false;
+    }
+
+    if (slot == entries.size()) {
+        entries.emplace_back();
+    } else {
+        free_slots.pop_back();
+    }
+    set_paths(route, entries[slot]);
+    return true;
+}
 
-    _routing_table.push_back(RouteEntry(route_prefix, prefix_length, next_hop, interface_num, prefix_length == 0 ? 0 : numeric_limits<int>::min() >> (prefix_length - 1)));
+void Router::RoutingTable::replace(const Route &route) {
+    const auto slot = lookup.find(route.route_prefix, route.prefix_length);
+    if (not slot.has_value()) {
+        add(route);
+        return;
+    }
+
+    // the prefix keeps its slot, so the index doesn't change
+    set_paths(route, entries[slot.value()]);
+}
+
+bool Router::RoutingTable::remove(const uint32_t route_prefix, const uint8_t prefix_length) {
+    const auto slot = lookup.find(route_prefix, prefix_length);
+    if (not slot.has_value()) {
+        return false;
+    }
+    lookup.erase(route_prefix, prefix_length);
+    entries[slot.value()].clear();
+    free_slots.push_back(slot.value());
+    return true;
 }
 
+const RouteEntry *Router::lookup_path(Worker &worker, const RoutingTable &routes, const InternetDatagram &dgram) {
+    // longest prefix match
+    const auto match = worker.route_cache.lookup(routes.lookup, dgram.header().dst);
+    if (not match.has_value()) {
+        return nullptr;
+    }
+    // with several equal-cost next hops, the datagram's flow picks one
+    const auto &paths = routes.entries[match.value()];
+    return paths.size() == 1 ? &paths.front() : &paths[pick_path(flow_hash(dgram), paths.size())];
+}
+
+//! \param[in] arrival_interface The index of the interface the datagram was received on
 //! \param[in] dgram The datagram to be routed
-void Router::route_one_datagram(InternetDatagram &dgram) {
+//! \param[out] interface_num The index of the interface to send it out on
+//! \param[out] next_hop The numeric IP address of the next hop
+bool Router::route_one_datagram(Worker &worker,
+                                const RoutingTable &routes,
+                                const size_t arrival_interface,
+                                InternetDatagram &dgram,
+                                size_t &interface_num,
+                                uint32_t &next_hop) {
+    // read the header through a const reference: mutable access would make serialize() recompute the checksum
+    const IPv4Header &header = as_const(dgram).header();
     // check TTL
-    if (dgram.header().ttl <= 1) return;
-    // longest prefix match
-    uint32_t destination = dgram.header().dst;
-    int match_idx = -1;
-    int max_matched_len = -1;
-    for (size_t i = 0; i < _routing_table.size(); i++) {
-        auto mask = _routing_table[i]._prefix_mask;
-        if ((destination & mask) == _routing_table[i]._route_prefix && max_matched_len < _routing_table[i]._prefix_length) {
-            match_idx = i;
-            max_matched_len = _routing_table[i]._prefix_length;
-        }
+    if (header.ttl <= 1) {
+        send_icmp_error(
+            worker, routes, arrival_interface, dgram, ICMPMessage::TYPE_TIME_EXCEEDED, ICMPMessage::CODE_TTL_EXCEEDED);
+        return false;
     }
     // if no match, drop the datagram
-    if (match_idx == -1) return;
-    // decrement TTL
-    dgram.header().ttl -= 1;
-    // send the datagram
-    auto next_hop = _routing_table[match_idx]._next_hop;
-    auto interface_num = _routing_table[match_idx]._interface_num;
-    if (next_hop.has_value()) {
-        _interfaces[interface_num].send_datagram(dgram, next_hop.value());
-    } else {
-        _interfaces[interface_num].send_datagram(dgram, Address::from_ipv4_numeric(destination));
+    const RouteEntry *entry = lookup_path(worker, routes, dgram);
+    if (entry == nullptr) {
+        send_icmp_error(worker,
+                        routes,
+                        arrival_interface,
+                        dgram,
+                        ICMPMessage::TYPE_DESTINATION_UNREACHABLE,
+                        ICMPMessage::CODE_NET_UNREACHABLE);
+        return false;
     }
+    // too big for the outbound link, and not to be fragmented (path MTU discovery relies on hearing about it)
+    const size_t mtu = _interfaces[entry->_interface_num].mtu();
+    if (header.df and header.hlen * 4 + dgram.payload().size() > mtu) {
+        send_icmp_error(worker,
+                        routes,
+                        arrival_interface,
+                        dgram,
+                        ICMPMessage::TYPE_DESTINATION_UNREACHABLE,
+                        ICMPMessage::CODE_FRAGMENTATION_NEEDED,
+                        min(mtu, size_t(UINT16_MAX)));
+        return false;
+    }
+    // decrement TTL (adjusts the header checksum incrementally)
+    dgram.decrement_ttl();
+    // directly attached networks: the next hop is the datagram's final destination
+    interface_num = entry->_interface_num;
+    next_hop = entry->_next_hop.has_value() ? entry->_next_hop->ipv4_numeric() : header.dst;
+    return true;
 }
 
-void Router::route() {
-    // Go through all the interfaces, and route every incoming datagram to its proper outgoing interface.
-    for (auto &interface : _interfaces) {
-        auto &queue = interface.datagrams_out();
+//! \details The error is built only once the rate limit allows it, so suppressed errors cost no more
+//! than the check. It is routed like any other datagram, but from this router, so its TTL is left alone.
+void Router::send_icmp_error(Worker &worker,
+                             const RoutingTable &routes,
+                             const size_t arrival_interface,
+                             const InternetDatagram &original,
+                             const uint8_t type,
+                             const uint8_t code,
+                             const uint16_t next_hop_mtu) {
+    if (not icmp_error_allowed(original)) {
+        return;
+    }
+    if (not worker.icmp_limit.try_take()) {
+        worker.icmp_rate_limited++;
+        return;
+    }
+
+    const uint32_t src = _interfaces[arrival_interface].ip_address().ipv4_numeric();
+    InternetDatagram error = make_icmp_error(original, src, type, code, next_hop_mtu);
+    const RouteEntry *entry = lookup_path(worker, routes, error);
+    if (entry == nullptr) {
+        return;
+    }
+    const uint32_t next_hop = entry->_next_hop.has_value() ? entry->_next_hop->ipv4_numeric() : error.header().dst;
+    worker.batch.push_back({entry->_interface_num, next_hop, move(error), false});
+    worker.icmp_sent++;
+}
+
+//! \details A batch goes to only a few distinct next hops, so each group is gathered by a scan
+//! over the rest of the batch (which also keeps every group in arrival order).
+void Router::send_batch(const size_t w, vector<Forward> &batch) {
+    Worker &worker = *_workers[w];
+    const size_t num_workers = _workers.size();
+
+    for (size_t first = 0; first < batch.size(); first++) {
+        if (batch[first].sent) {
+            continue;
+        }
+
+        const size_t interface_num = batch[first].interface_num;
+        const size_t owner = interface_num % num_workers;
+        if (owner != w) {
+            // another worker's interface: hand the datagram over, making room by doing our own sends if need be
+            auto &ring = *_workers[owner]->inbox[w];
+            while (not ring.try_push(batch[first])) {
+                drain_inbox(w);
+                this_thread::yield();
+            }
+            batch[first].sent = true;
+            continue;
+        }
+
+        const uint32_t next_hop = batch[first].next_hop;
+        const size_t mtu = _interfaces[interface_num].mtu();
+        worker.group.clear();
+        for (size_t i = first; i < batch.size(); i++) {
+            if (not batch[i].sent and batch[i].interface_num == interface_num and batch[i].next_hop == next_hop) {
+                InternetDatagram &dgram = batch[i].dgram;
+                if (as_const(dgram).header().hlen * 4 + dgram.payload().size() <= mtu) {
+                    worker.group.push_back(move(dgram));
+                } else {
+                    // too big for the link (route_one_datagram() has already turned away those with DF set)
+                    fragment_datagram(dgram, mtu, worker.group);
+                }
+                batch[i].sent = true;
+            }
+        }
+        _interfaces[interface_num].send_datagrams(worker.group, Address::from_ipv4_numeric(next_hop));
+    }
+
+    batch.clear();
+    worker.group.clear();
+}
+
+void Router::drain_inbox(const size_t w) {
+    Worker &worker = *_workers[w];
+    for (auto &ring : worker.inbox) {
+        if (not ring) {
+            continue;
+        }
+        Forward forward;
+        while (ring->try_pop(forward)) {
+            worker.handed_over.push_back(move(forward));
+        }
+    }
+    // every datagram here goes out on this worker's interfaces, so this never hands any over
+    send_batch(w, worker.handed_over);
+}
+
+//! \param[in] routes The routes to look datagrams up in
+//! \param[in] batch_size The most datagrams to take from one interface before sending them
+void Router::forward_pass(const size_t w, const RoutingTable &routes, const size_t batch_size) {
+    Worker &worker = *_workers[w];
+    if (worker.routes_version != _routes_version) {
+        worker.route_cache.invalidate();
+        worker.routes_version = _routes_version;
+    }
+
+    // Go through this worker's interfaces, and route every incoming datagram to its proper outgoing interface.
+    const size_t num_workers = _workers.size();
+    for (size_t i = w; i < _interfaces.size(); i += num_workers) {
+        auto &queue = _interfaces[i].datagrams_out();
         while (not queue.empty()) {
-            route_one_datagram(queue.front());
-            queue.pop();
+            // look up the routes for a whole batch first, then send
+            while (not queue.empty() and worker.batch.size() < max(batch_size, size_t(1))) {
+                size_t interface_num = 0;
+                uint32_t next_hop = 0;
+                if (route_one_datagram(worker, routes, i, queue.front(), interface_num, next_hop)) {
+                    worker.batch.push_back({interface_num, next_hop, move(queue.front()), false});
+                }
+                queue.pop();
+            }
+            send_batch(w, worker.batch);
+            if (num_workers > 1) {
+                drain_inbox(w);
+            }
+        }
+    }
+
+    if (num_workers == 1) {
+        return;
+    }
+
+    // keep sending what the other workers hand over until none of them has anything left to hand over
+    _producers.fetch_sub(1, memory_order_acq_rel);
+    while (true) {
+        const bool others_done = _producers.load(memory_order_acquire) == 0;
+        drain_inbox(w);
+        if (others_done) {
+            break;
+        }
+        this_thread::yield();
+    }
+}
+
+void Router::worker_main(const size_t w) {
+    uint64_t pass_seen = 0;
+    while (true) {
+        size_t batch_size = 0;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _pass_started.wait(lock, [&] { return _stopping or _pass != pass_seen; });
+            if (_stopping) {
+                return;
+            }
+            pass_seen = _pass;
+            batch_size = _pass_batch_size;
+        }
+
+        forward_pass(w, _routes, batch_size);
+
+        lock_guard<mutex> lock(_mutex);
+        if (--_threads_running == 0) {
+            _pass_finished.notify_one();
+        }
+    }
+}
+
+Router::Router(const size_t route_cache_entries,
+               const size_t num_threads,
+               const size_t icmp_rate,
+               const size_t icmp_burst) {
+    const size_t num_workers = max(num_threads, size_t(1));
+    // each worker limits its own ICMP errors (so they need no lock), to an equal share of the total
+    const TokenBucket icmp_share{(icmp_rate + num_workers - 1) / num_workers,
+                                 (icmp_burst + num_workers - 1) / num_workers};
+    for (size_t w = 0; w < num_workers; w++) {
+        _workers.push_back(make_unique<Worker>(route_cache_entries, icmp_share));
+    }
+    for (size_t receiver = 0; receiver < num_workers; receiver++) {
+        auto &inbox = _workers[receiver]->inbox;
+        inbox.resize(num_workers);
+        for (size_t sender = 0; sender < num_workers; sender++) {
+            if (sender != receiver) {
+                inbox[sender] = make_unique<SpscRing<Forward>>(RING_CAPACITY);
+            }
         }
     }
+    for (size_t w = 1; w < num_workers; w++) {
+        _threads.emplace_back(&Router::worker_main, this, w);
+    }
+}
+
+Router::~Router() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _pass_started.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+void Router::announce() {
+    for (auto &interface : _interfaces) {
+        interface.announce();
+    }
+}
+
+//! \param[in] batch_size The most datagrams to take from one interface before sending them
+void Router::route(const size_t batch_size) {
+    if (_threads.empty()) {
+        forward_pass(0, _routes, batch_size);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _pass++;
+        _pass_batch_size = batch_size;
+        _threads_running = _threads.size();
+        _producers.store(_workers.size(), memory_order_release);
+    }
+    _pass_started.notify_all();
+
+    forward_pass(0, _routes, batch_size);
+
+    unique_lock<mutex> lock(_mutex);
+    _pass_finished.wait(lock, [&] { return _threads_running == 0; });
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void Router::tick(const size_t ms_since_last_tick) {
+    for (auto &worker : _workers) {
+        worker->icmp_limit.tick(ms_since_last_tick);
+    }
+}
+
+uint64_t Router::route_cache_hits() const {
+    uint64_t hits = 0;
+    for (const auto &worker : _workers) {
+        hits += worker->route_cache.hits();
+    }
+    return hits;
+}
+
+uint64_t Router::route_cache_misses() const {
+    uint64_t misses = 0;
+    for (const auto &worker : _workers) {
+        misses += worker->route_cache.misses();
+    }
+    return misses;
+}
+
+uint64_t Router::icmp_sent() const {
+    uint64_t sent = 0;
+    for (const auto &worker : _workers) {
+        sent += worker->icmp_sent;
+    }
+    return sent;
+}
+
+uint64_t Router::icmp_rate_limited() const {
+    uint64_t limited = 0;
+    for (const auto &worker : _workers) {
+        limited += worker->icmp_rate_limited;
+    }
+    return limited;
 }
@@ -2,9 +2,18 @@
 #define SPONGE_LIBSPONGE_ROUTER_HH
 
 #include "network_interface.hh"
+#include "route_table.hh"
+#include "spsc_ring.hh"
+#include "token_bucket.hh"
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <thread>
+#include <vector>
 
 //! \brief A wrapper for NetworkInterface that makes the host-side
 //! interface asynchronous: instead of returning received datagrams
@@ -13,6 +22,7 @@
 //! implementation of NetworkInterface.
 class AsyncNetworkInterface : public NetworkInterface {
     std::queue<InternetDatagram> _datagrams_out{};
+    bool _drop_link_broadcasts = false;  //!< Drop datagrams that came in link-layer broadcast frames
 
   public:
     using NetworkInterface::NetworkInterface;
@@ -29,13 +39,19 @@ class AsyncNetworkInterface : public NetworkInterface {
     //! \param[in] frame the incoming Ethernet frame
     void recv_frame(const EthernetFrame &frame) {
         auto optional_dgram = NetworkInterface::recv_frame(frame);
-        if (optional_dgram.has_value()) {
+        if (optional_dgram.has_value() and
+            not(_drop_link_broadcasts and frame.header().dst == ETHERNET_BROADCAST)) {
             _datagrams_out.push(std::move(optional_dgram.value()));
         }
     };
 
     //! Access queue of Internet datagrams that have been received
     std::queue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
+
+    //! \brief Drop (after learning from any ARP) IPv4 datagrams sent to the link-layer broadcast address
+    //! \details A router must neither forward them nor send ICMP errors about them
+    //! ([RFC 1812](\ref rfc::rfc1812) section 5.3.4, [RFC 1122](\ref rfc::rfc1122) section 3.2.2).
+    void set_drop_link_broadcasts(const bool drop) { _drop_link_broadcasts = drop; }
 };
 
 class RouteEntry {
@@ -48,25 +64,205 @@ class RouteEntry {
     RouteEntry(uint32_t a, uint8_t b, std::optional<Address> c, size_t d, uint32_t e):_route_prefix(a), _prefix_length(b), _next_hop(c), _interface_num(d), _prefix_mask(e){}
 };
 
+//! One way out for a route
+struct NextHop {
+    std::optional<Address> address;  //!< Gateway, or empty for a directly attached network
+    size_t interface_num;            //!< Interface to send matching datagrams out on
+};
+
+//! A forwarding rule, as given to Router::load_routes()
+struct Route {
+    uint32_t route_prefix;           //!< Prefix to match the destination address against
+    uint8_t prefix_length;           //!< Number of significant bits in `route_prefix`
+    std::vector<NextHop> next_hops;  //!< Equal-cost ways out; each flow always takes the same one
+
+    //! A route with a single next hop
+    Route(const uint32_t prefix,
+          const uint8_t length,
+          const std::optional<Address> next_hop,
+          const size_t interface_num)
+        : route_prefix(prefix), prefix_length(length), next_hops{{next_hop, interface_num}} {}
+
+    //! A route with several equal-cost next hops
+    Route(const uint32_t prefix, const uint8_t length, std::vector<NextHop> paths)
+        : route_prefix(prefix), prefix_length(length), next_hops(std::move(paths)) {}
+};
 
 //! \brief A router that has multiple network interfaces and
 //! performs longest-prefix-match routing between them.
+//! \details With more than one thread, route() splits the interfaces among worker threads. Each worker
+//! alone reads its interfaces' received datagrams and sends on its interfaces, so the interfaces need
+//! no locks; a datagram leaving through another worker's interface is handed over through a
+//! single-producer, single-consumer ring. The workers only read the routes while route() is running,
+//! and route() returns only once they are all done, so add_route() and the other changes edit the
+//! routes in place between passes; the next pass just clears each worker's route cache.
+//!
+//! A datagram that can't be forwarded is answered with an [ICMP](\ref rfc::rfc792) error (Time
+//! Exceeded, Destination Unreachable, or Fragmentation Needed), sent from the address of the interface
+//! it arrived on. Errors are rate-limited by a token bucket, refilled by tick(), so that a flood of
+//! bad datagrams costs little more than dropping them.
 class Router {
     //! The router's collection of network interfaces
     std::vector<AsyncNetworkInterface> _interfaces{};
 
-    std::vector<RouteEntry> _routing_table{};
+    //! The routes, and the index used to look them up
+    struct RoutingTable {
+        //! Routes by position, each with its equal-cost next hops; an empty slot is a route that has been removed
+        std::vector<std::vector<RouteEntry>> entries{};
+
+        //! Empty slots in `entries`, to be reused by the next routes added
+        std::vector<RouteTable::Value> free_slots{};
+
+        //! Longest-prefix-match index from destination address to position in `entries`
+        RouteTable lookup{};
+
+        //! Fill `paths` with a RouteEntry per next hop of `route`
+        static void set_paths(const Route &route, std::vector<RouteEntry> &paths);
+
+        //! Add a route unless its prefix is already present
+        bool add(const Route &route);
+
+        //! Add a route, or replace the one already present for its prefix
+        void replace(const Route &route);
+
+        //! Remove the route for a prefix, if present
+        bool remove(const uint32_t route_prefix, const uint8_t prefix_length);
+    };
+
+    //! The routes, as changed by add_route() and the like (never while route() is running)
+    RoutingTable _routes{};
+
+    //! Bumped each time `_routes` changes (so that workers know to invalidate their caches)
+    uint64_t _routes_version = 0;
+
+    //! Throw unless `route` has at least one next hop, and sends datagrams out only existing interfaces
+    void check_route(const Route &route) const;
+
+    //! A datagram in a forwarding batch, with the interface and next hop it is going to
+    struct Forward {
+        size_t interface_num = 0;
+        uint32_t next_hop = 0;
+        InternetDatagram dgram{};
+        bool sent = false;
+    };
+
+    //! Capacity of the ring from each worker to each other worker
+    static constexpr size_t RING_CAPACITY = 1024;
+
+    //! What a worker thread needs while forwarding (worker 0 runs on the thread that calls route())
+    struct Worker {
+        //! Recent lookups in the routes, by exact destination address
+        RouteCache route_cache;
+
+        //! Version of the routes that `route_cache` holds lookups from
+        uint64_t routes_version = 0;
+
+        //! Datagrams taken from an interface and routed, not yet sent (kept to reuse its storage)
+        std::vector<Forward> batch{};
+
+        //! Datagrams handed over by other workers, not yet sent (kept to reuse its storage)
+        std::vector<Forward> handed_over{};
+
+        //! Datagrams of a batch going to the same interface and next hop (kept to reuse its storage)
+        std::vector<InternetDatagram> group{};
+
+        //! Datagrams from each other worker (indexed by sender) to go out on this worker's interfaces
+        std::vector<std::unique_ptr<SpscRing<Forward>>> inbox{};
+
+        //! This worker's share of the ICMP error rate
+        TokenBucket icmp_limit;
+
+        uint64_t icmp_sent = 0;          //!< ICMP errors sent
+        uint64_t icmp_rate_limited = 0;  //!< ICMP errors suppressed by `icmp_limit`
 
-    //! Send a single datagram from the appropriate outbound interface to the next hop,
-    //! as specified by the route with the longest prefix_length that matches the
-    //! datagram's destination address.
-    void route_one_datagram(InternetDatagram &dgram);
+        Worker(const size_t route_cache_entries, const TokenBucket &icmp_share)
+            : route_cache(route_cache_entries), icmp_limit(icmp_share) {}
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers{};
+
+    //! \name Worker threads (for workers other than 0)
+    //!@{
+    std::vector<std::thread> _threads{};
+    std::mutex _mutex{};
+    std::condition_variable _pass_started{};   //!< Signaled when `_pass` is bumped or `_stopping` is set
+    std::condition_variable _pass_finished{};  //!< Signaled when `_threads_running` drops to zero
+    uint64_t _pass = 0;                         //!< Number of forwarding passes started
+    size_t _threads_running = 0;                //!< Threads still working on the current pass
+    bool _stopping = false;                     //!< Set when the threads should exit
+    size_t _pass_batch_size = 0;                //!< Batch size for the current pass
+    std::atomic<size_t> _producers{0};          //!< Workers still routing the datagrams they received
+    //!@}
+
+    //! Main loop of worker thread `w`
+    void worker_main(const size_t w);
+
+    //! Forward everything received on worker `w`'s interfaces, and everything other workers hand it
+    void forward_pass(const size_t w, const RoutingTable &routes, const size_t batch_size);
+
+    //! Find the outbound interface and next hop for a datagram, as specified by the route
+    //! with the longest prefix_length that matches the datagram's destination address,
+    //! and decrement its TTL. Returns `false` if the datagram should be dropped (in which case
+    //! an ICMP error may have been added to the worker's batch).
+    bool route_one_datagram(Worker &worker,
+                            const RoutingTable &routes,
+                            const size_t arrival_interface,
+                            InternetDatagram &dgram,
+                            size_t &interface_num,
+                            uint32_t &next_hop);
+
+    //! Find the next hop for `dgram` among a route's equal-cost paths, if it has a route
+    const RouteEntry *lookup_path(Worker &worker, const RoutingTable &routes, const InternetDatagram &dgram);
+
+    //! Add an ICMP error about `original` (received on `arrival_interface`) to the worker's batch,
+    //! unless ICMP forbids it, the rate limit suppresses it, or there is no route back to the sender
+    void send_icmp_error(Worker &worker,
+                         const RoutingTable &routes,
+                         const size_t arrival_interface,
+                         const InternetDatagram &original,
+                         const uint8_t type,
+                         const uint8_t code,
+                         const uint16_t next_hop_mtu = 0);
+
+    //! Send every datagram in `batch` that goes out on worker `w`'s interfaces, grouped by outbound
+    //! interface and next hop, and hand every other one to the worker whose interface it goes out on
+    void send_batch(const size_t w, std::vector<Forward> &batch);
+
+    //! Send the datagrams other workers have handed to worker `w`
+    void drain_inbox(const size_t w);
 
   public:
+    //! Default capacity of the route cache
+    static constexpr size_t DEFAULT_ROUTE_CACHE_ENTRIES = 1024;
+
+    //! Default number of datagrams route() takes from an interface at a time
+    static constexpr size_t DEFAULT_BATCH_SIZE = 32;
+
+    //! Default rate of ICMP errors (per second) and burst size, as in Linux's `icmp_msgs_per_sec`
+    //! and `icmp_msgs_burst`
+    static constexpr size_t DEFAULT_ICMP_RATE = 1000;
+    static constexpr size_t DEFAULT_ICMP_BURST = 50;
+
+    //! \param[in] route_cache_entries is the capacity of each thread's destination cache (0 disables it)
+    //! \param[in] num_threads is the number of threads that forward datagrams, including the one calling route()
+    //! \param[in] icmp_rate is the most ICMP errors to send per second, on average
+    //! \param[in] icmp_burst is the most ICMP errors to send at once (0 sends none at all)
+    explicit Router(const size_t route_cache_entries = DEFAULT_ROUTE_CACHE_ENTRIES,
+                    const size_t num_threads = 1,
+                    const size_t icmp_rate = DEFAULT_ICMP_RATE,
+                    const size_t icmp_burst = DEFAULT_ICMP_BURST);
+
+    //! Stops the worker threads
+    ~Router();
+
+    Router(const Router &other) = delete;
+    Router &operator=(const Router &other) = delete;
+
     //! Add an interface to the router
     //! \param[in] interface an already-constructed network interface
     //! \returns The index of the interface after it has been added to the router
     size_t add_interface(AsyncNetworkInterface &&interface) {
+        interface.set_drop_link_broadcasts(true);
         _interfaces.push_back(std::move(interface));
         return _interfaces.size() - 1;
     }
@@ -74,14 +270,71 @@ class Router {
     //! Access an interface by index
     AsyncNetworkInterface &interface(const size_t N) { return _interfaces.at(N); }
 
-    //! Add a route (a forwarding rule)
+    //! \brief Announce every interface with a gratuitous ARP request
+    //! \details Call when the router comes up, once its interfaces are configured (an interface
+    //! can't change its queue discipline while the announcement is waiting to be sent).
+    void announce();
+
+    //! Add a route (a forwarding rule); if a route for the same prefix exists, it is kept
     void add_route(const uint32_t route_prefix,
                    const uint8_t prefix_length,
                    const std::optional<Address> next_hop,
                    const size_t interface_num);
 
-    //! Route packets between the interfaces
-    void route();
+    //! \brief Add a route with several equal-cost next hops
+    //! \details Each datagram takes the next hop chosen by a hash of its flow (addresses, protocol,
+    //! and TCP or UDP ports), so the flows share the paths but every flow stays on one path.
+    void add_route(const uint32_t route_prefix, const uint8_t prefix_length, const std::vector<NextHop> &next_hops);
+
+    //! \brief Remove the route for a prefix
+    //! \returns `false` if there was no route for the prefix
+    bool remove_route(const uint32_t route_prefix, const uint8_t prefix_length);
+
+    //! Add a route, replacing any existing route for the same prefix
+    void replace_route(const uint32_t route_prefix,
+                       const uint8_t prefix_length,
+                       const std::optional<Address> next_hop,
+                       const size_t interface_num);
+
+    //! Add a route with several equal-cost next hops, replacing any existing route for the same prefix
+    void replace_route(const uint32_t route_prefix,
+                       const uint8_t prefix_length,
+                       const std::vector<NextHop> &next_hops);
+
+    //! \brief Replace every route at once
+    //! \details The new table is built off to the side and swapped in only when complete, so
+    //! route() sees either all of the old routes or all of the new ones. If any route is invalid,
+    //! an exception is thrown and the current routes are left as they were. As with add_route(),
+    //! the first of several routes for the same prefix is the one kept.
+    void load_routes(const std::vector<Route> &routes);
+
+    //! Number of routes
+    size_t route_count() const { return _routes.lookup.size(); }
+
+    //! Number of threads that forward datagrams
+    size_t num_threads() const { return _workers.size(); }
+
+    //! \brief Route packets between the interfaces
+    //! \details Takes up to `batch_size` datagrams at a time from each interface, looks up all of
+    //! their routes, and then sends them in groups that share an outbound interface and next hop.
+    //! Datagrams from one interface to the same next hop keep their order. With several threads,
+    //! interface `i` belongs to worker `i % num_threads()`; returns once every worker is done.
+    void route(const size_t batch_size = DEFAULT_BATCH_SIZE);
+
+    //! \brief Called periodically when time elapses (refills the ICMP rate limit); not while route() runs
+    void tick(const size_t ms_since_last_tick);
+
+    //! \name Route cache statistics (summed over the threads)
+    //!@{
+    uint64_t route_cache_hits() const;
+    uint64_t route_cache_misses() const;
+    //!@}
+
+    //! \name ICMP statistics (summed over the threads)
+    //!@{
+    uint64_t icmp_sent() const;          //!< ICMP errors sent
+    uint64_t icmp_rate_limited() const;  //!< ICMP errors suppressed by the rate limit
+    //!@}
 };
 
 #endif  // SPONGE_LIBSPONGE_ROUTER_HH
@@ -9,6 +9,7 @@
 using namespace std;
 
 ParseResult EthernetFrame::parse(const Buffer buffer) {
+    _serialized_header = Buffer{};
     NetParser p{buffer};
     _header.parse(p);
     _payload = p.buffer();
@@ -18,7 +19,11 @@ ParseResult EthernetFrame::parse(const Buffer buffer) {
 
 BufferList EthernetFrame::serialize() const {
     BufferList ret;
-    ret.append(_header.serialize());
+    if (_serialized_header.size() == EthernetHeader::LENGTH) {
+        ret.append(_serialized_header);
+    } else {
+        ret.append(_header.serialize());
+    }
     ret.append(_payload);
     return ret;
 }
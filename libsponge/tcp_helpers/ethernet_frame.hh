@@ -10,6 +10,9 @@ class EthernetFrame {
     EthernetHeader _header{};
     BufferList _payload{};
 
+    //! `_header` already serialized, if known; cleared whenever `_header` may be modified
+    Buffer _serialized_header{};
+
   public:
     //! \brief Parse the frame from a string
     ParseResult parse(const Buffer buffer);
@@ -17,10 +20,20 @@ class EthernetFrame {
     //! \brief Serialize the frame to a string
     BufferList serialize() const;
 
+    //! \brief Set the header along with its serialized form, which serialize() will then reuse
+    //! \note `serialized` must be what `header.serialize()` returns
+    void set_header(const EthernetHeader &header, const Buffer &serialized) {
+        _header = header;
+        _serialized_header = serialized;
+    }
+
     //! \name Accessors
     //!@{
     const EthernetHeader &header() const { return _header; }
-    EthernetHeader &header() { return _header; }
+    EthernetHeader &header() {
+        _serialized_header = Buffer{};
+        return _header;
+    }
 
     const BufferList &payload() const { return _payload; }
     BufferList &payload() { return _payload; }
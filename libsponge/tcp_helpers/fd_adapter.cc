@@ -6,8 +6,24 @@
 
 using namespace std;
 
+//! \param[in] sock is the UDP socket, which will be owned by the adapter
+//! \param[in] use_io_uring is whether to receive and send through a UDPIoUring, if the kernel allows
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool use_io_uring) : _sock(move(sock)) {
+    if (use_io_uring and IoUring::available()) {
+        _ring = make_unique<UDPIoUring>(_sock);
+    }
+}
+
+TCPOverUDPSocketAdapter::operator const FileDescriptor &() const {
+    if (_ring) {
+        return _ring->ring();
+    }
+    return _sock;
+}
+
 //! \details This function first attempts to parse a TCP segment from the next UDP
-//! payload recv()d from the socket.
+//! payload received from the socket. Once those received in a batch have all been
+//! parsed, it receives another batch.
 //!
 //! If this succeeds, it then checks that the received segment is related to the
 //! current connection. When a TCP connection has been established, this means
@@ -19,23 +35,49 @@ using namespace std;
 //! the result that future outgoing segments go to the sender of the SYN segment.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
 optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
-    auto datagram = _sock.recv();
+    if (not read_pending()) {
+        _configure_offload();
+        _next_datagram_in = 0;
+        _offset_in = 0;
+        if ((_ring ? _ring->recv_batch() : _sock.recv_batch(_datagrams_in)) == 0) {
+            return {};
+        }
+    }
+    return _ring ? _read_from(*_ring) : _read_from(_datagrams_in);
+}
+
+//! \param[in] datagrams holds the datagrams received, the next of which (or the next segment of which) to parse
+template <typename DatagramsT>
+optional<TCPSegment> TCPOverUDPSocketAdapter::_read_from(const DatagramsT &datagrams) {
+    const size_t index = _next_datagram_in;
+    Address source_address = datagrams.source_address(index);
+
+    // a datagram the kernel coalesced holds several, each of segment_size() bytes but the last
+    const string_view datagram = datagrams.payload(index);
+    const size_t segment_size = datagrams.segment_size(index);
+    const string_view payload = datagram.substr(_offset_in, segment_size ? segment_size : datagram.size());
+    _offset_in += payload.size();
+    if (_offset_in >= datagram.size()) {
+        _next_datagram_in++;
+        _offset_in = 0;
+    }
 
     // is it for us?
-    if (not listening() and (datagram.source_address != config().destination)) {
+    if (not listening() and (source_address != config().destination)) {
         return {};
     }
 
     // is the payload a valid TCP segment?
     TCPSegment seg;
-    if (ParseResult::NoError != seg.parse(move(datagram.payload), 0)) {
+    if (ParseResult::NoError !=
+        seg.parse(Buffer::copy_of(payload), 0, config().checksum_offload)) {
         return {};
     }
 
     // should we target this source in all future replies?
     if (listening()) {
         if (seg.header().syn and not seg.header().rst) {
-            config_mutable().destination = datagram.source_address;
+            config_mutable().destination = move(source_address);
             set_listening(false);
         } else {
             return {};
@@ -45,12 +87,72 @@ optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
     return seg;
 }
 
-//! Serialize a TCP segment and send it as the payload of a UDP datagram.
+//! Serialize a TCP segment, to be sent as the payload of a UDP datagram by flush().
 //! \param[in] seg is the TCP segment to write
 void TCPOverUDPSocketAdapter::write(TCPSegment &seg) {
     seg.header().sport = config().source.port();
     seg.header().dport = config().destination.port();
-    _sock.sendto(config().destination, seg.serialize(0));
+    _datagrams_out.push_back(seg.serialize(0, config().checksum_offload));
+}
+
+void TCPOverUDPSocketAdapter::flush() {
+    if (_datagrams_out.empty()) {
+        return;
+    }
+    _configure_offload();
+    if (config().segmentation_offload) {
+        _coalesce_out();
+        if (_ring) {
+            _ring->send_batch(config().destination, _gso_out, 0, _gso_sizes_out);
+        } else {
+            _sock.send_batch(config().destination, _gso_out, 0, _gso_sizes_out);
+        }
+    } else if (_ring) {
+        _ring->send_batch(config().destination, _datagrams_out);
+    } else {
+        _sock.send_batch(config().destination, _datagrams_out);
+    }
+    _datagrams_out.clear();
+}
+
+void TCPOverUDPSocketAdapter::_configure_offload() {
+    if (_gro != config().segmentation_offload) {
+        _sock.set_gro(config().segmentation_offload);
+        _gro = config().segmentation_offload;
+    }
+}
+
+//! \details A run takes segments no longer than its first, until one is shorter, the kernel's limit on
+//! segments is reached, or the next wouldn't fit in a UDP datagram.
+void TCPOverUDPSocketAdapter::_coalesce_out() {
+    _gso_out.clear();
+    _gso_sizes_out.clear();
+
+    size_t run_length = 0, run_bytes = 0;
+    bool run_closed = true;
+    for (auto &datagram : _datagrams_out) {
+        const size_t size = datagram.size();
+        if (run_closed or size == 0 or size > _gso_sizes_out.back() or run_length == UDPSocket::MAX_GSO_SEGMENTS or
+            run_bytes + size > UDPSocket::MAX_PAYLOAD_SIZE) {
+            _gso_out.push_back(move(datagram));
+            _gso_sizes_out.push_back(uint16_t(size));
+            run_length = 1;
+            run_bytes = size;
+            run_closed = (size == 0);
+            continue;
+        }
+        _gso_out.back().append(datagram);
+        run_length++;
+        run_bytes += size;
+        run_closed = (size < _gso_sizes_out.back());
+    }
+
+    // a run of one is sent as it is
+    for (size_t i = 0; i < _gso_out.size(); i++) {
+        if (_gso_out[i].size() == _gso_sizes_out[i]) {
+            _gso_sizes_out[i] = 0;
+        }
+    }
 }
 
 //! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
@@ -8,8 +8,10 @@
 #include "tcp_header.hh"
 #include "tcp_segment.hh"
 
+#include <memory>
 #include <optional>
 #include <utility>
+#include <vector>
 
 //! \brief Basic functionality for file descriptor adaptors
 //! \details See TCPOverUDPSocketAdapter and TCPOverIPv4OverTunFdAdapter for more information.
@@ -38,30 +40,87 @@ class FdAdapterBase {
     //! \returns a mutable reference
     FdAdapterConfig &config_mut() { return _cfg; }
 
+    //! \brief Whether read() holds datagrams it has already taken from the file descriptor
+    //! \details An adapter that drains several datagrams per readiness event returns `true` until
+    //! read() has handed them all out, since the file descriptor won't become readable for them again.
+    bool read_pending() const { return false; }
+
+    //! \brief Send whatever write() has queued
+    //! \details An adapter that sends datagrams in batches queues them in write() until flush(), which
+    //! the TCPSpongeSocket calls once it has written all the segments the TCPConnection had ready.
+    void flush() {}
+
     //! Called periodically when time elapses
     void tick(const size_t) {}
+
+    //! \brief Whether the adapter does its I/O through an IoUring
+    //! \details Its file descriptor is then the ring's, which the TCPSpongeSocket waits on with an
+    //! EventLoop of its own io_uring backend (EventLoop::Backend::IoUring).
+    bool uses_io_uring() const { return false; }
 };
 
 //! \brief A FD adaptor that reads and writes TCP segments in UDP payloads
+//! \details Datagrams are received in batches with UDPSocket::recv_batch(), and the segments written
+//! between flush()es are sent together with UDPSocket::send_batch(). If the socket is non-blocking and
+//! its send buffer fills up, the rest of a batch is dropped, as by a congested link.
+//!
+//! With FdAdapterConfig::segmentation_offload, each run of segments of the same size (and perhaps a
+//! shorter one to end it) goes to the kernel as one UDP GSO datagram, so that a whole window of
+//! segments takes one trip through the kernel's UDP and IP layers, and datagrams the kernel has
+//! coalesced with UDP GRO are split back into segments.
+//!
+//! With `use_io_uring`, datagrams are received and sent through a UDPIoUring instead, so that receiving
+//! takes no system call of its own and a flush() takes one io_uring_enter; the adapter's file descriptor
+//! is then the ring's. Without io_uring in the kernel (see IoUring::available()), the adapter uses the
+//! socket as it would otherwise.
 class TCPOverUDPSocketAdapter : public FdAdapterBase {
   private:
     UDPSocket _sock;
 
+    std::unique_ptr<UDPIoUring> _ring{};  //!< The socket's ring, with `use_io_uring`
+
+    UDPSocket::RecvRing _datagrams_in{};  //!< Datagrams received, from `_next_datagram_in` on
+    size_t _next_datagram_in = 0;         //!< Index in `_datagrams_in` of the next one read() parses
+    size_t _offset_in = 0;                //!< Where the next segment starts in a datagram the kernel coalesced
+
+    std::vector<BufferList> _datagrams_out{};  //!< Segments written since the last flush()
+
+    std::vector<BufferList> _gso_out{};      //!< Runs of `_datagrams_out` for UDP GSO, each concatenated
+    std::vector<uint16_t> _gso_sizes_out{};  //!< Segment size of each of `_gso_out` (0: just one segment)
+
+    bool _gro = false;  //!< Whether UDP GRO is enabled on the socket
+
+    //! Enable or disable UDP GRO to match the configuration
+    void _configure_offload();
+
+    //! Group `_datagrams_out` into runs for UDP GSO
+    void _coalesce_out();
+
+    //! Parse the next segment out of `datagrams` (a UDPSocket::RecvRing or the UDPIoUring)
+    template <typename DatagramsT>
+    std::optional<TCPSegment> _read_from(const DatagramsT &datagrams);
+
   public:
-    //! Construct from a UDPSocket sliced into a FileDescriptor
-    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock) : _sock(std::move(sock)) {}
+    //! Construct from a UDPSocket sliced into a FileDescriptor, doing I/O through an IoUring with `use_io_uring`
+    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool use_io_uring = false);
 
     //! Attempts to read and return a TCP segment related to the current connection from a UDP payload
     std::optional<TCPSegment> read();
 
-    //! Writes a TCP segment into a UDP payload
+    //! Writes a TCP segment into a UDP payload, to be sent by the next flush()
     void write(TCPSegment &seg);
 
-    //! Access the underlying UDP socket
-    operator UDPSocket &() { return _sock; }
+    //! Sends the UDP datagrams written since the last flush()
+    void flush();
+
+    //! Whether datagrams (or segments coalesced into them) already received are waiting for read()
+    bool read_pending() const { return _next_datagram_in < (_ring ? _ring->size() : _datagrams_in.size()); }
+
+    //! Whether datagrams go through a UDPIoUring
+    bool uses_io_uring() const { return _ring != nullptr; }
 
-    //! Access the underlying UDP socket
-    operator const UDPSocket &() const { return _sock; }
+    //! The file descriptor to wait on: the UDP socket, or its ring
+    operator const FileDescriptor &() const;
 };
 
 //! Typedef for TCPOverUDPSocketAdapter
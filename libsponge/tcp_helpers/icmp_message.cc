@@ -0,0 +1,123 @@
+#include "icmp_message.hh"
+
+#include "util.hh"
+
+#include <sstream>
+
+using namespace std;
+
+ParseResult ICMPMessage::parse(const Buffer buffer) {
+    InternetChecksum check;
+    check.add(buffer);
+    if (check.value()) {
+        return ParseResult::BadChecksum;
+    }
+
+    NetParser p{buffer};
+    type = p.u8();
+    code = p.u8();
+    cksum = p.u16();
+    rest_of_header = p.u32();
+    if (p.error()) {
+        return p.get_error();
+    }
+    payload = p.buffer().copy();
+    return ParseResult::NoError;
+}
+
+string ICMPMessage::serialize() const {
+    string ret;
+    ret.reserve(HEADER_LENGTH + payload.size());
+    NetUnparser::u8(ret, type);
+    NetUnparser::u8(ret, code);
+    NetUnparser::u16(ret, 0);
+    NetUnparser::u32(ret, rest_of_header);
+    ret.append(payload);
+
+    // the checksum covers the whole message, with the checksum field taken as zero
+    InternetChecksum check;
+    check.add(ret);
+    const uint16_t sum = check.value();
+    ret[2] = char(sum >> 8);
+    ret[3] = char(sum & 0xff);
+    return ret;
+}
+
+bool ICMPMessage::is_error() const {
+    return type == TYPE_DESTINATION_UNREACHABLE or type == TYPE_SOURCE_QUENCH or type == TYPE_REDIRECT or
+           type == TYPE_TIME_EXCEEDED or type == TYPE_PARAMETER_PROBLEM;
+}
+
+string ICMPMessage::to_string() const {
+    stringstream ss{};
+    ss << "type=" << unsigned(type) << ", code=" << unsigned(code);
+    if (type == TYPE_DESTINATION_UNREACHABLE and code == CODE_FRAGMENTATION_NEEDED) {
+        ss << ", mtu=" << (rest_of_header & 0xffff);
+    }
+    ss << ", payload len=" << payload.size();
+    return ss.str();
+}
+
+//! \details The error carries the original's header and first 8 bytes of payload, which include the
+//! ports of a TCP or UDP segment, so the sender can tell which connection it is about.
+InternetDatagram make_icmp_error(const InternetDatagram &original,
+                                 const uint32_t src,
+                                 const uint8_t type,
+                                 const uint8_t code,
+                                 const uint16_t next_hop_mtu) {
+    const IPv4Header &original_header = original.header();
+
+    ICMPMessage message;
+    message.type = type;
+    message.code = code;
+    message.rest_of_header = next_hop_mtu;
+    message.payload = original.serialize_header();
+    size_t quoted = 8;
+    for (const auto &buffer : original.payload().buffers()) {
+        if (quoted == 0) {
+            break;
+        }
+        const auto bytes = buffer.str().substr(0, quoted);
+        message.payload.append(bytes);
+        quoted -= bytes.size();
+    }
+
+    InternetDatagram dgram;
+    IPv4Header &header = dgram.header();
+    header.ttl = 64;
+    header.df = false;
+    header.proto = IPv4Header::PROTO_ICMP;
+    header.src = src;
+    header.dst = original_header.src;
+    dgram.payload() = message.serialize();
+    header.len = header.hlen * 4 + dgram.payload().size();
+    return dgram;
+}
+
+bool icmp_error_allowed(const InternetDatagram &dgram) {
+    const IPv4Header &header = dgram.header();
+    // the source must be one host: not "this host" (0.0.0.0), loopback, multicast or broadcast
+    const uint32_t src = header.src;
+    if (src == 0 or (src >> 24) == 127 or src >= 0xe0000000) {
+        return false;
+    }
+    // nor may the destination be many hosts: the limited broadcast or a multicast group
+    if (header.dst >= 0xe0000000) {
+        return false;
+    }
+    if (header.offset != 0) {
+        return false;
+    }
+    if (header.proto == IPv4Header::PROTO_ICMP) {
+        // only the type matters (the checksum can't be checked if this is the first of several fragments),
+        // and a message too short to have one is treated like an error, to be safe
+        const auto &buffers = dgram.payload().buffers();
+        if (buffers.empty() or buffers.front().size() == 0) {
+            return false;
+        }
+        ICMPMessage message;
+        message.type = buffers.front().at(0);
+        return not message.is_error();
+    }
+    return true;
+}
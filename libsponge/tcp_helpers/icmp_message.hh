@@ -0,0 +1,71 @@
+#ifndef SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
+#define SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
+
+#include "ipv4_datagram.hh"
+
+#include <string>
+
+//! \brief [ICMP](\ref rfc::rfc792) message
+struct ICMPMessage {
+    static constexpr size_t HEADER_LENGTH = 8;  //!< ICMP header length, including the "rest of header" word
+
+    //! \name Types
+    //!@{
+    static constexpr uint8_t TYPE_ECHO_REPLY = 0;
+    static constexpr uint8_t TYPE_DESTINATION_UNREACHABLE = 3;
+    static constexpr uint8_t TYPE_SOURCE_QUENCH = 4;
+    static constexpr uint8_t TYPE_REDIRECT = 5;
+    static constexpr uint8_t TYPE_ECHO_REQUEST = 8;
+    static constexpr uint8_t TYPE_TIME_EXCEEDED = 11;
+    static constexpr uint8_t TYPE_PARAMETER_PROBLEM = 12;
+    //!@}
+
+    //! \name Codes
+    //!@{
+    static constexpr uint8_t CODE_NET_UNREACHABLE = 0;       //!< Destination unreachable: no route
+    static constexpr uint8_t CODE_FRAGMENTATION_NEEDED = 4;  //!< Destination unreachable: too big, and DF set
+    static constexpr uint8_t CODE_TTL_EXCEEDED = 0;          //!< Time exceeded: TTL reached zero in transit
+    //!@}
+
+    //! \name ICMP fields
+    //!@{
+    uint8_t type = 0;
+    uint8_t code = 0;
+    uint16_t cksum = 0;
+    uint32_t rest_of_header = 0;  //!< Depends on the type (the next-hop MTU for "fragmentation needed")
+    std::string payload{};        //!< For errors, the offending datagram's header and first 8 payload bytes
+    //!@}
+
+    //! Parse the ICMP message from a string, checking its checksum
+    ParseResult parse(const Buffer buffer);
+
+    //! Serialize the ICMP message to a string, with a freshly computed checksum
+    std::string serialize() const;
+
+    //! Is this an error message (as opposed to a query, such as an echo request)?
+    bool is_error() const;
+
+    //! Return a string containing the ICMP message in human-readable format
+    std::string to_string() const;
+};
+
+//! \brief Build the [ICMP](\ref rfc::rfc792) error datagram that reports a problem with `original`
+//! \param[in] original the datagram as it was received
+//! \param[in] src the address of the router (or host) reporting the problem
+//! \param[in] type and `code` say what the problem is
+//! \param[in] next_hop_mtu is reported for "fragmentation needed" ([RFC 1191](\ref rfc::rfc1191))
+InternetDatagram make_icmp_error(const InternetDatagram &original,
+                                 const uint32_t src,
+                                 const uint8_t type,
+                                 const uint8_t code,
+                                 const uint16_t next_hop_mtu = 0);
+
+//! \brief Whether an ICMP error may be sent about `dgram`
+//! \details Per [RFC 1122](\ref rfc::rfc1122) section 3.2.2, never about another ICMP error, a fragment
+//! other than the first, a datagram whose source is not a single host, or one sent to a broadcast or
+//! multicast address; otherwise an error about an error could bounce back and forth forever, and one
+//! datagram could draw errors from every host on a network. (Datagrams that came in link-layer
+//! broadcast frames are screened out by the router's interfaces, which see the frames.)
+bool icmp_error_allowed(const InternetDatagram &dgram);
+
+#endif  // SPONGE_LIBSPONGE_ICMP_MESSAGE_HH
@@ -10,9 +10,12 @@ using namespace std;
 
 ParseResult IPv4Datagram::parse(const Buffer buffer) {
     NetParser p{buffer};
-    _header.parse(p);
+    const ParseResult header_result = _header.parse(p);
     _payload = p.buffer();
 
+    // serialize() drops IP options, so a checksum that covered them can't be reused
+    _cksum_valid = (header_result == ParseResult::NoError) and (_header.hlen * 4 == IPv4Header::LENGTH);
+
     if (_payload.size() != _header.payload_length()) {
         return ParseResult::PacketTooShort;
     }
@@ -20,11 +23,23 @@ ParseResult IPv4Datagram::parse(const Buffer buffer) {
     return p.get_error();
 }
 
+//! \details The header checksum is recomputed unless it is known to be current
+//! (the datagram was parsed and since modified only through decrement_ttl()).
 BufferList IPv4Datagram::serialize() const {
     if (_payload.size() != _header.payload_length()) {
         throw runtime_error("IPv4Datagram::serialize: payload is wrong size");
     }
 
+    BufferList ret;
+    ret.append(serialize_header());
+    ret.append(_payload);
+    return ret;
+}
+
+string IPv4Datagram::serialize_header() const {
+    if (_cksum_valid) {
+        return _header.serialize();
+    }
     IPv4Header header_out = _header;
     header_out.cksum = 0;
     const string header_zero_checksum = header_out.serialize();
@@ -34,8 +49,13 @@ BufferList IPv4Datagram::serialize() const {
     check.add(header_zero_checksum);
     header_out.cksum = check.value();
 
-    BufferList ret;
-    ret.append(header_out.serialize());
-    ret.append(_payload);
-    return ret;
+    return header_out.serialize();
+}
+
+void IPv4Datagram::decrement_ttl() {
+    if (_cksum_valid) {
+        _header.set_ttl(_header.ttl - 1);
+    } else {
+        _header.ttl--;
+    }
 }
@@ -10,6 +10,9 @@ class IPv4Datagram {
     IPv4Header _header{};
     BufferList _payload{};
 
+    //! Is `_header.cksum` known to match the rest of the header? (If so, serialize() reuses it.)
+    bool _cksum_valid{false};
+
   public:
     //! \brief Parse the segment from a string
     ParseResult parse(const Buffer buffer);
@@ -17,10 +20,21 @@ class IPv4Datagram {
     //! \brief Serialize the segment to a string
     BufferList serialize() const;
 
+    //! \brief Serialize just the header, as serialize() would (with its checksum)
+    std::string serialize_header() const;
+
+    //! \brief Decrement the TTL, updating the header checksum incrementally
+    void decrement_ttl();
+
     //! \name Accessors
     //!@{
     const IPv4Header &header() const { return _header; }
-    IPv4Header &header() { return _header; }
+
+    //! \note Mutable access may change any field, so serialize() will recompute the checksum
+    IPv4Header &header() {
+        _cksum_valid = false;
+        return _header;
+    }
 
     const BufferList &payload() const { return _payload; }
     BufferList &payload() { return _payload; }
@@ -0,0 +1,178 @@
+#include "ipv4_fragments.hh"
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+//! \param[in] dgram the datagram to be sent
+//! \param[in] mtu the largest datagram (header included) the link can carry
+//! \param[out] fragments where to append the datagram or its fragments, in order
+bool fragment_datagram(const InternetDatagram &dgram, const size_t mtu, vector<InternetDatagram> &fragments) {
+    const IPv4Header &header = dgram.header();
+    const size_t header_length = header.hlen * 4;
+    const size_t payload_length = dgram.payload().size();
+    if (header_length + payload_length <= mtu) {
+        fragments.push_back(dgram);
+        return true;
+    }
+    if (header.df or mtu < header_length + 8) {
+        return false;
+    }
+
+    // fragment offsets count 8-byte units, so every fragment but the last carries a multiple of 8 bytes
+    const size_t max_piece = (mtu - header_length) / 8 * 8;
+    const string payload = dgram.payload().concatenate();
+    for (size_t start = 0; start < payload_length; start += max_piece) {
+        const size_t size = min(max_piece, payload_length - start);
+        InternetDatagram &fragment = fragments.emplace_back();
+        IPv4Header &fragment_header = fragment.header();
+        fragment_header = header;
+        fragment_header.offset = header.offset + start / 8;
+        fragment_header.mf = header.mf or start + size < payload_length;
+        fragment_header.len = header_length + size;
+        fragment.payload() = Buffer::copy_of(string_view(payload).substr(start, size));
+    }
+    return true;
+}
+
+void IPv4Reassembler::_discard(const map<Key, Partial>::iterator it) {
+    _bytes_held -= it->second.bytes;
+    _bytes_charged -= it->second.charge();
+    _arrival_order.erase(it->second.arrival);
+    _partials.erase(it);
+    _discarded++;
+}
+
+//! \details A piece that lands only on units already received, with the same bytes, is a duplicate
+//! and is accepted (changing nothing). Offsets are multiples of 8, and only the last fragment may end
+//! partway through a unit, so the units a piece covers tell exactly whether it overlaps another.
+bool IPv4Reassembler::_add_piece(Partial &partial, const size_t offset, const string &piece) {
+    const size_t end = offset + piece.size();
+    const size_t first_unit = offset / 8;
+    const size_t end_unit = (end + 7) / 8;
+    auto &received = partial.received;
+    const auto units = received.begin() + min(first_unit, received.size());
+    const auto units_end = received.begin() + min(end_unit, received.size());
+    const size_t already = count(units, units_end, true);
+    if (already == end_unit - first_unit) {
+        return partial.payload.compare(offset, piece.size(), piece) == 0;
+    }
+    if (already != 0) {
+        return false;
+    }
+
+    if (end > partial.payload.size()) {
+        partial.payload.resize(end);
+        received.resize(end_unit, false);
+    }
+    partial.payload.replace(offset, piece.size(), piece);
+    fill(received.begin() + first_unit, received.begin() + end_unit, true);
+    partial.bytes += piece.size();
+    return true;
+}
+
+//! \param[in] dgram a datagram just received
+optional<InternetDatagram> IPv4Reassembler::push(const InternetDatagram &dgram) {
+    const IPv4Header &header = dgram.header();
+    if (not header.mf and header.offset == 0) {
+        return dgram;
+    }
+
+    // every fragment carries some payload (a multiple of 8 bytes, unless it's the last), and none
+    // reaches past 64 KiB
+    const size_t offset = size_t(header.offset) * 8;
+    const string piece = dgram.payload().concatenate();
+    const size_t end = offset + piece.size();
+    if (piece.empty() or (header.mf and piece.size() % 8 != 0) or header.hlen * 4 + end > UINT16_MAX) {
+        return {};
+    }
+
+    // make room by giving up on the oldest datagrams (but not the one this fragment belongs to), for
+    // as much as its buffer and bitmap may have to grow
+    const Key key{header.src, header.dst, header.id, header.proto};
+    const auto existing = _partials.find(key);
+    const size_t held = existing == _partials.end() ? 0 : existing->second.payload.size();
+    if (Partial::charge_for(max(end, held)) > _capacity) {
+        return {};
+    }
+    const size_t cost =
+        Partial::charge_for(max(end, held)) - (existing == _partials.end() ? 0 : Partial::charge_for(held));
+    while (_bytes_charged + cost > _capacity) {
+        auto oldest = _arrival_order.begin();
+        if (oldest != _arrival_order.end() and *oldest == key) {
+            oldest++;
+        }
+        if (oldest == _arrival_order.end()) {
+            // only this fragment's own datagram is left, and it has grown too large
+            _discard(_partials.find(key));
+            return {};
+        }
+        _discard(_partials.find(*oldest));
+    }
+
+    auto it = existing;
+    if (it == _partials.end()) {
+        it = _partials.emplace(key, Partial{}).first;
+        it->second.arrival_time = _time;
+        it->second.arrival = _arrival_order.insert(_arrival_order.end(), key);
+        _bytes_charged += it->second.charge();
+    }
+    Partial &partial = it->second;
+
+    // the last fragment says how long the datagram is; nothing may disagree with it
+    if (not header.mf) {
+        if (partial.total.has_value() and partial.total.value() != end) {
+            _discard(it);
+            return {};
+        }
+        partial.total = end;
+    }
+    const bool past_end = partial.total.has_value() and
+                          (end > partial.total.value() or partial.payload.size() > partial.total.value());
+    const size_t bytes_before = partial.bytes;
+    const size_t charge_before = partial.charge();
+    if (past_end or not _add_piece(partial, offset, piece)) {
+        _discard(it);
+        return {};
+    }
+    _bytes_held += partial.bytes - bytes_before;
+    _bytes_charged += partial.charge() - charge_before;
+    if (offset == 0) {
+        partial.first_header = header;
+    }
+
+    // with no overlaps, holding as many bytes as the datagram is long means holding all of them
+    if (not partial.first_header.has_value() or not partial.total.has_value() or
+        partial.bytes != partial.total.value()) {
+        return {};
+    }
+
+    InternetDatagram whole;
+    IPv4Header &whole_header = whole.header();
+    whole_header = partial.first_header.value();
+    whole_header.mf = false;
+    whole_header.offset = 0;
+    whole_header.len = whole_header.hlen * 4 + partial.total.value();
+    _bytes_held -= partial.bytes;
+    _bytes_charged -= partial.charge();
+    whole.payload() = move(partial.payload);
+    _arrival_order.erase(partial.arrival);
+    _partials.erase(it);
+    _reassembled++;
+    return whole;
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void IPv4Reassembler::tick(const size_t ms_since_last_tick) {
+    _time += ms_since_last_tick;
+    // datagrams time out in the order they arrived
+    while (not _arrival_order.empty()) {
+        const auto oldest = _partials.find(_arrival_order.front());
+        if (_time - oldest->second.arrival_time < _timeout) {
+            break;
+        }
+        _discard(oldest);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef SPONGE_LIBSPONGE_IPV4_FRAGMENTS_HH
+#define SPONGE_LIBSPONGE_IPV4_FRAGMENTS_HH
+
+#include "ipv4_datagram.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//! \brief Split a datagram into [IPv4](\ref rfc::rfc791) fragments that each fit in `mtu` bytes
+//! \details A datagram that already fits is appended to `fragments` unchanged. Otherwise each fragment
+//! carries a copy of the header and a slice of the payload whose length is a multiple of 8 bytes.
+//! \returns `false` (and appends nothing) if the datagram doesn't fit but has the "don't fragment" flag
+//! set, or if `mtu` is too small to carry any payload
+bool fragment_datagram(const InternetDatagram &dgram, const size_t mtu, std::vector<InternetDatagram> &fragments);
+
+//! \brief Puts [IPv4](\ref rfc::rfc791) fragments back together, in bounded memory
+//! \details Fragments may arrive in any order. A datagram whose fragments overlap (other than exact
+//! duplicates) is discarded, as Linux does, since conflicting overlaps are a known way to slip data
+//! past a firewall. Incomplete datagrams are discarded once they are older than the timeout, and the
+//! oldest are discarded early whenever the memory held would exceed the capacity. Each incomplete
+//! datagram keeps its payload in one buffer, as long as the furthest fragment reaches, with one bit
+//! per 8-byte unit received; it counts as that buffer and bitmap plus PARTIAL_OVERHEAD. So however
+//! small the fragments, the charge is what is really held, and a flood of fragments that each start a
+//! new datagram is bounded as well as one of large fragments.
+class IPv4Reassembler {
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;  //!< Default bytes held at once
+    static constexpr size_t DEFAULT_TIMEOUT = 30000;        //!< Default lifetime of a partial datagram (ms)
+    static constexpr size_t PARTIAL_OVERHEAD = 256;         //!< Bytes charged per datagram beyond its payload
+
+  private:
+    //! Fragments belong to the same datagram if they agree on these ([RFC 791](\ref rfc::rfc791) section 3.2)
+    struct Key {
+        uint32_t src;
+        uint32_t dst;
+        uint16_t id;
+        uint8_t proto;
+
+        bool operator<(const Key &other) const {
+            return std::tie(src, dst, id, proto) < std::tie(other.src, other.dst, other.id, other.proto);
+        }
+
+        bool operator==(const Key &other) const {
+            return std::tie(src, dst, id, proto) == std::tie(other.src, other.dst, other.id, other.proto);
+        }
+    };
+
+    //! A datagram some of whose fragments have arrived
+    struct Partial {
+        std::optional<IPv4Header> first_header{};  //!< Header of the fragment at offset 0, once it arrives
+        std::optional<size_t> total{};             //!< Payload length, once the last fragment arrives
+        std::string payload{};                     //!< Payload so far, up to the furthest fragment's end
+        std::vector<bool> received{};              //!< Which 8-byte units of `payload` have arrived
+        size_t bytes = 0;                          //!< Payload bytes that have arrived
+        size_t arrival_time = 0;                   //!< Time (in ms) the first fragment arrived
+        std::list<Key>::iterator arrival{};        //!< Place in the arrival order
+
+        //! Bytes charged for a datagram whose buffer is `length` bytes long
+        static size_t charge_for(const size_t length) {
+            return length + ((length + 7) / 8 + 7) / 8 + PARTIAL_OVERHEAD;
+        }
+
+        //! Bytes charged against the capacity
+        size_t charge() const { return charge_for(payload.size()); }
+    };
+
+    std::map<Key, Partial> _partials{};
+    std::list<Key> _arrival_order{};  //!< Keys of `_partials`, oldest first
+    size_t _capacity;
+    size_t _timeout;
+    size_t _bytes_held = 0;
+    size_t _bytes_charged = 0;
+    size_t _time = 0;  //!< Milliseconds ticked so far
+
+    uint64_t _reassembled = 0;
+    uint64_t _discarded = 0;
+
+    //! Forget a partial datagram
+    void _discard(const std::map<Key, Partial>::iterator it);
+
+    //! Add a fragment's payload; returns `false` if it conflicts with what has already arrived
+    static bool _add_piece(Partial &partial, const size_t offset, const std::string &piece);
+
+  public:
+    //! \param[in] capacity is the most bytes to hold for incomplete datagrams (payload plus overhead)
+    //! \param[in] timeout is how long (in ms) to wait for the rest of a datagram
+    explicit IPv4Reassembler(const size_t capacity = DEFAULT_CAPACITY, const size_t timeout = DEFAULT_TIMEOUT)
+        : _capacity(capacity), _timeout(timeout) {}
+
+    //! \brief Take a received datagram
+    //! \returns the datagram if it wasn't a fragment, the reassembled datagram if this was its last
+    //! missing fragment, and nothing otherwise
+    std::optional<InternetDatagram> push(const InternetDatagram &dgram);
+
+    //! \brief Called periodically when time elapses; discards datagrams that have waited too long
+    void tick(const size_t ms_since_last_tick);
+
+    //! \name Statistics
+    //!@{
+    size_t datagrams_pending() const { return _partials.size(); }  //!< Incomplete datagrams being held
+    size_t bytes_held() const { return _bytes_held; }              //!< Payload bytes received and held
+    size_t bytes_charged() const { return _bytes_charged; }        //!< Bytes counted against the capacity
+    uint64_t reassembled() const { return _reassembled; }          //!< Datagrams put back together
+    uint64_t discarded() const { return _discarded; }              //!< Incomplete datagrams given up on
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_IPV4_FRAGMENTS_HH
@@ -8,6 +8,23 @@
 
 using namespace std;
 
+namespace {
+//! \name Layout of the fixed part of the IPv4 header
+//!@{
+constexpr NetField<uint8_t, 0> ver_hlen_field{};
+constexpr NetField<uint8_t, 1> tos_field{};
+constexpr NetField<uint16_t, 2> len_field{};
+constexpr NetField<uint16_t, 4> id_field{};
+constexpr NetField<uint16_t, 6> flags_offset_field{};
+constexpr NetField<uint8_t, 8> ttl_field{};
+constexpr NetField<uint8_t, 9> proto_field{};
+constexpr NetField<uint16_t, 10> cksum_field{};
+constexpr NetField<uint32_t, 12> src_field{};
+constexpr NetField<uint32_t, 16> dst_field{};
+//!@}
+static_assert(dst_field.end == IPv4Header::LENGTH);
+}  // namespace
+
 //! \param[in,out] p is a NetParser from which the IP fields will be extracted
 //! \returns a ParseResult indicating success or the reason for failure
 //! \details It is important to check for (at least) the following potential errors
@@ -20,31 +37,34 @@ using namespace std;
 //! - there is less data in the header than the `doff` field claims
 //! - there is less data in the full datagram than the `len` field claims
 //! - the checksum is bad
+//!
+//! The length is checked once; the fields are then decoded in place from their fixed offsets.
 ParseResult IPv4Header::parse(NetParser &p) {
-    Buffer original_serialized_version = p.buffer();
+    const string_view data = p.str();
 
-    const size_t data_size = p.buffer().size();
+    const size_t data_size = data.size();
     if (data_size < IPv4Header::LENGTH) {
         return ParseResult::PacketTooShort;
     }
 
-    const uint8_t first_byte = p.u8();
+    const uint8_t *const raw = as_octets(data);
+    const uint8_t first_byte = ver_hlen_field.get(raw);
     ver = first_byte >> 4;     // version
     hlen = first_byte & 0x0f;  // header length
-    tos = p.u8();              // type of service
-    len = p.u16();             // length
-    id = p.u16();              // id
+    tos = tos_field.get(raw);  // type of service
+    len = len_field.get(raw);  // length
+    id = id_field.get(raw);    // id
 
-    const uint16_t fo_val = p.u16();
+    const uint16_t fo_val = flags_offset_field.get(raw);
     df = static_cast<bool>(fo_val & 0x4000);  // don't fragment
     mf = static_cast<bool>(fo_val & 0x2000);  // more fragments
     offset = fo_val & 0x1fff;                 // offset
 
-    ttl = p.u8();     // ttl
-    proto = p.u8();   // proto
-    cksum = p.u16();  // checksum
-    src = p.u32();    // source address
-    dst = p.u32();    // destination address
+    ttl = ttl_field.get(raw);      // ttl
+    proto = proto_field.get(raw);  // proto
+    cksum = cksum_field.get(raw);  // checksum
+    src = src_field.get(raw);      // source address
+    dst = dst_field.get(raw);      // destination address
 
     if (data_size < 4 * hlen) {
         return ParseResult::PacketTooShort;
@@ -59,15 +79,18 @@ ParseResult IPv4Header::parse(NetParser &p) {
         return ParseResult::TruncatedPacket;
     }
 
-    p.remove_prefix(hlen * 4 - IPv4Header::LENGTH);
+    // checksum before consuming the header: the parser may hold the only reference to `data`
+    InternetChecksum check;
+    check.add(data.substr(0, 4 * hlen));
+    const bool bad_checksum = check.value();
+
+    p.remove_prefix(hlen * 4);
 
     if (p.error()) {
         return p.get_error();
     }
 
-    InternetChecksum check;
-    check.add({original_serialized_version.str().data(), size_t(4 * hlen)});
-    if (check.value()) {
+    if (bad_checksum) {
         return ParseResult::BadChecksum;
     }
 
@@ -130,6 +153,25 @@ uint32_t IPv4Header::pseudo_cksum() const {
     return pcksum;
 }
 
+//! \details TTL shares a 16-bit word with the protocol number
+void IPv4Header::set_ttl(const uint8_t new_ttl) {
+    cksum = InternetChecksum::update16(cksum, (ttl << 8) | proto, (new_ttl << 8) | proto);
+    ttl = new_ttl;
+}
+
+//! \note A transport-layer checksum that covers the [pseudo-header](\ref rfc::rfc793) must be
+//! adjusted separately, e.g. with InternetChecksum::update32()
+void IPv4Header::set_src(const uint32_t new_src) {
+    cksum = InternetChecksum::update32(cksum, src, new_src);
+    src = new_src;
+}
+
+//! \note See set_src() about transport-layer checksums
+void IPv4Header::set_dst(const uint32_t new_dst) {
+    cksum = InternetChecksum::update32(cksum, dst, new_dst);
+    dst = new_dst;
+}
+
 //! \returns A string with the header's contents
 std::string IPv4Header::to_string() const {
     stringstream ss{};
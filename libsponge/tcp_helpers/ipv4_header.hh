@@ -8,7 +8,9 @@
 struct IPv4Header {
     static constexpr size_t LENGTH = 20;         //!< [IPv4](\ref rfc::rfc791) header length, not including options
     static constexpr uint8_t DEFAULT_TTL = 128;  //!< A reasonable default TTL value
+    static constexpr uint8_t PROTO_ICMP = 1;     //!< Protocol number for [icmp](\ref rfc::rfc792)
     static constexpr uint8_t PROTO_TCP = 6;      //!< Protocol number for [tcp](\ref rfc::rfc793)
+    static constexpr uint8_t PROTO_UDP = 17;     //!< Protocol number for [udp](\ref rfc::rfc768)
 
     //! \struct IPv4Header
     //! ~~~{.txt}
@@ -58,6 +60,14 @@ struct IPv4Header {
     //! [pseudo-header's](\ref rfc::rfc793) contribution to the TCP checksum
     uint32_t pseudo_cksum() const;
 
+    //! \name Field updates that keep `cksum` valid
+    //! These adjust the checksum incrementally (RFC 1624) instead of recomputing it
+    //!@{
+    void set_ttl(const uint8_t new_ttl);    //!< Change the TTL (e.g., decrement when forwarding)
+    void set_src(const uint32_t new_src);  //!< Rewrite the source address (e.g., for NAT)
+    void set_dst(const uint32_t new_dst);  //!< Rewrite the destination address (e.g., for NAT)
+    //!@}
+
     //! Return a string containing a header in human-readable format
     std::string to_string() const;
 
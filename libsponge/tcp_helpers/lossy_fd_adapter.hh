@@ -63,6 +63,9 @@ class LossyFdAdapter {
     void set_listening(const bool l) { _adapter.set_listening(l); }      //!< FdAdapterBase::set_listening passthrough
     const FdAdapterConfig &config() const { return _adapter.config(); }  //!< FdAdapterBase::config passthrough
     FdAdapterConfig &config_mut() { return _adapter.config_mut(); }      //!< FdAdapterBase::config_mut passthrough
+    bool read_pending() const { return _adapter.read_pending(); }        //!< FdAdapterBase::read_pending passthrough
+    void flush() { _adapter.flush(); }                                    //!< FdAdapterBase::flush passthrough
+    bool uses_io_uring() const { return _adapter.uses_io_uring(); }      //!< FdAdapterBase::uses_io_uring passthrough
     void tick(const size_t ms_since_last_tick) {
         _adapter.tick(ms_since_last_tick);
     }  //!< FdAdapterBase::tick passthrough
@@ -0,0 +1,207 @@
+#include "multi_queue_tun.hh"
+
+#include "eventloop.hh"
+#include "ipv4_datagram.hh"
+#include "ipv4_header.hh"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std;
+
+//! \param[in] devname is the name of a multi-queue TUN device, created with `ip tuntap add mode tun multi_queue`
+//! \param[in] num_queues is the number of queues to open, each served by a thread of its own
+MultiQueueTun::MultiQueueTun(const string &devname, const size_t num_queues) {
+    if (num_queues == 0) {
+        throw runtime_error("MultiQueueTun: needs at least one queue");
+    }
+    for (auto &tun : TunFD::open_queues(devname, num_queues)) {
+        tun.set_blocking(false);
+        _queues.push_back(make_unique<Queue>(move(tun)));
+    }
+    for (auto &queue : _queues) {
+        queue->thread = thread(&MultiQueueTun::_serve, this, ref(*queue));
+    }
+}
+
+MultiQueueTun::~MultiQueueTun() {
+    _stopping = true;
+    for (auto &queue : _queues) {
+        queue->stop.notify();
+    }
+    for (auto &queue : _queues) {
+        if (queue->thread.joinable()) {
+            queue->thread.join();
+        }
+    }
+}
+
+//! \details The 64-bit finalizer from MurmurHash3 mixes the addresses and ports, so that every bit
+//! of them affects the choice.
+size_t MultiQueueTun::queue_for(const FdAdapterConfig &config) const {
+    uint64_t h = (uint64_t(config.source.ipv4_numeric()) << 32) | config.destination.ipv4_numeric();
+    h ^= ((uint64_t(config.source.port()) << 16) | config.destination.port()) * 0x9e3779b97f4a7c15;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return (uint64_t(uint32_t(h)) * _queues.size()) >> 32;
+}
+
+void MultiQueueTun::check_queue(const size_t queue) const {
+    const Queue &q = *_queues.at(queue);
+    if (q.failed.load(memory_order_acquire)) {
+        throw runtime_error("MultiQueueTun: queue " + to_string(queue) + " failed: " + q.failure);
+    }
+}
+
+void MultiQueueTun::attach(const uint16_t port, shared_ptr<Inbox> inbox) {
+    lock_guard<mutex> lock(_inboxes_mutex);
+    if (not _inboxes.emplace(port, move(inbox)).second) {
+        throw runtime_error("MultiQueueTun: port " + to_string(port) + " is already in use");
+    }
+}
+
+void MultiQueueTun::detach(const uint16_t port) {
+    lock_guard<mutex> lock(_inboxes_mutex);
+    _inboxes.erase(port);
+}
+
+void MultiQueueTun::_dispatch(vector<Buffer> &datagrams) {
+    lock_guard<mutex> lock(_inboxes_mutex);
+    for (auto &datagram : datagrams) {
+        const string_view bytes = datagram.str();
+        if (bytes.size() < IPv4Header::LENGTH or (uint8_t(bytes[0]) >> 4) != 4 or
+            uint8_t(bytes[9]) != IPv4Header::PROTO_TCP) {
+            continue;
+        }
+
+        const bool first_fragment = ((uint8_t(bytes[6]) & 0x1f) | uint8_t(bytes[7])) == 0;
+        if (not first_fragment) {
+            for (auto &[port, inbox] : _inboxes) {
+                inbox->push(Buffer(datagram));
+            }
+            continue;
+        }
+
+        const size_t header_length = (uint8_t(bytes[0]) & 0xf) * 4;
+        if (bytes.size() < header_length + 4) {
+            continue;
+        }
+        const uint16_t dport = (uint8_t(bytes[header_length + 2]) << 8) | uint8_t(bytes[header_length + 3]);
+        const auto it = _inboxes.find(dport);
+        if (it != _inboxes.end()) {
+            it->second->push(move(datagram));
+        }
+    }
+}
+
+//! \details A failure is recorded in the queue, and every inbox is woken so that its adapter can notice.
+void MultiQueueTun::_serve(Queue &queue) {
+    try {
+        _run_queue(queue);
+    } catch (const exception &e) {
+        cerr << "Exception in MultiQueueTun queue thread: " << e.what() << "\n";
+        queue.failure = e.what();
+        queue.failed.store(true, memory_order_release);
+
+        lock_guard<mutex> lock(_inboxes_mutex);
+        for (auto &[port, inbox] : _inboxes) {
+            inbox->wake();
+        }
+    }
+}
+
+//! \details Datagrams that the queue won't take at once wait, with the rest of their batch, until the
+//! queue is writable; meanwhile, further datagrams wait in the outbox. The stop rule is always polled,
+//! so the thread finishes promptly even while a write is blocked.
+void MultiQueueTun::_run_queue(Queue &queue) {
+    EventLoop loop{EventLoop::Backend::Epoll};
+    vector<Buffer> received;
+    bool hung_up = false;
+    const auto hang_up = [&] { hung_up = true; };
+
+    loop.add_rule(queue.stop, Direction::In, [&] { queue.stop.clear(); });
+
+    // datagrams from the kernel, for the connections
+    loop.add_rule(
+        queue.tun,
+        Direction::In,
+        [&] {
+            received.clear();
+            queue.tun.read_frames(received);
+            _dispatch(received);
+        },
+        [] { return true; },
+        hang_up);
+
+    // datagrams from the connections, for the kernel
+    const auto all_sent = [&] { return queue.next_to_send == queue.sending.size(); };
+    const auto send = [&] { queue.next_to_send += queue.tun.write_frames(queue.sending, queue.next_to_send); };
+    loop.add_rule(
+        queue.outbox.ready(),
+        Direction::In,
+        [&] {
+            queue.outbox.take(queue.sending);
+            queue.next_to_send = 0;
+            send();
+        },
+        all_sent);
+    loop.add_rule(queue.tun, Direction::Out, send, [&] { return not all_sent(); }, hang_up);
+
+    while (not _stopping) {
+        if (loop.wait_next_event(-1) == EventLoop::Result::Exit) {
+            break;
+        }
+        if (hung_up) {
+            throw runtime_error("the device hung up");
+        }
+    }
+}
+
+TCPOverIPv4OverMultiQueueTunAdapter::~TCPOverIPv4OverMultiQueueTunAdapter() {
+    if (_tun and _attached_port.has_value()) {
+        _tun->detach(_attached_port.value());
+    }
+}
+
+void TCPOverIPv4OverMultiQueueTunAdapter::_attach() {
+    if (not _attached_port.has_value()) {
+        _tun->attach(config().source.port(), _inbox);
+        _attached_port = config().source.port();
+    }
+}
+
+optional<TCPSegment> TCPOverIPv4OverMultiQueueTunAdapter::read() {
+    _tun->check_queue(_tun->queue_for(config()));
+    if (not read_pending()) {
+        _inbox->take(_datagrams_in);
+        _next_datagram_in = 0;
+        if (_datagrams_in.empty()) {
+            return {};
+        }
+    }
+
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(move(_datagrams_in[_next_datagram_in++])) != ParseResult::NoError) {
+        return {};
+    }
+    return unwrap_tcp_in_ip(ip_dgram);
+}
+
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverMultiQueueTunAdapter::write(TCPSegment &seg) {
+    _attach();
+    InternetDatagram ip_dgram = wrap_tcp_in_ip(seg);
+    _tun->send(_tun->queue_for(config()), ip_dgram.serialize());
+}
+
+void TCPOverIPv4OverMultiQueueTunAdapter::set_listening(const bool l) {
+    TCPOverIPv4Adapter::set_listening(l);
+    if (l) {
+        _attach();
+    }
+}
@@ -0,0 +1,196 @@
+#ifndef SPONGE_LIBSPONGE_MULTI_QUEUE_TUN_HH
+#define SPONGE_LIBSPONGE_MULTI_QUEUE_TUN_HH
+
+#include "buffer.hh"
+#include "eventfd.hh"
+#include "fd_adapter.hh"
+#include "tcp_over_ip.hh"
+#include "tun.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! \brief Frames handed from one thread to another, with an EventFD that is readable while any are waiting
+//! \details Producers notify the EventFD only when the channel goes from empty to not empty, so a
+//! consumer that takes a batch at a time costs one wakeup per batch, not one per frame.
+template <typename T>
+class FrameChannel {
+  private:
+    std::mutex _mutex{};
+    std::vector<T> _frames{};
+    EventFD _ready{};
+
+  public:
+    //! \brief Add a frame (from any thread)
+    void push(T &&frame) {
+        bool was_empty = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            was_empty = _frames.empty();
+            _frames.push_back(std::move(frame));
+        }
+        if (was_empty) {
+            _ready.notify();
+        }
+    }
+
+    //! \brief Take every waiting frame (from the consuming thread), in place of the contents of `frames`
+    void take(std::vector<T> &frames) {
+        _ready.clear();
+        frames.clear();
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(frames, _frames);
+    }
+
+    //! \brief Wake the consuming thread without a frame
+    void wake() { _ready.notify(); }
+
+    //! \brief The descriptor for the consuming thread to poll
+    const EventFD &ready() const { return _ready; }
+};
+
+//! \brief A multi-queue TUN device, with a thread running an EventLoop for each queue
+//! \details Each queue's thread drains the datagrams the kernel sends on its queue, handing each one to
+//! the inbox of the connection that owns its destination TCP port, and writes the datagrams that
+//! connections send through its queue. Connections are spread across the queues by a hash of their
+//! addresses and ports (see queue_for()). The kernel sends each flow's datagrams on the queue that
+//! last carried the flow the other way, so both directions of a connection are usually served by the
+//! same thread.
+//!
+//! A datagram for a port that no connection owns is dropped. A fragment other than the first carries
+//! no port, so it goes to every inbox; only the connection it belongs to will reassemble it.
+//!
+//! If a queue's thread fails, the MultiQueueTun remembers why. From then on send() on that queue throws,
+//! and every inbox is woken so that the adapters whose connections use the queue notice and throw too.
+class MultiQueueTun {
+  public:
+    //! Datagrams for one connection
+    using Inbox = FrameChannel<Buffer>;
+
+  private:
+    //! One queue of the device, and the thread that serves it
+    struct Queue {
+        TunFD tun;
+        FrameChannel<BufferList> outbox{};  //!< Datagrams connections want sent through this queue
+        std::vector<BufferList> sending{};  //!< Datagrams taken from `outbox`, from `next_to_send` on
+        size_t next_to_send = 0;            //!< Index in `sending` of the first datagram not yet written
+        EventFD stop{};                     //!< Readable once the thread should finish
+        std::thread thread{};
+
+        std::atomic<bool> failed{false};  //!< Set (after `failure`) if the thread ended with an exception
+        std::string failure{};            //!< What went wrong, once `failed` is set
+
+        explicit Queue(TunFD &&fd) : tun(std::move(fd)) {}
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues{};
+
+    std::mutex _inboxes_mutex{};                                      //!< Guards `_inboxes`
+    std::unordered_map<uint16_t, std::shared_ptr<Inbox>> _inboxes{};  //!< By local TCP port
+
+    std::atomic<bool> _stopping{false};  //!< Tells the queue threads to finish
+
+    //! Body of a queue's thread
+    void _serve(Queue &queue);
+
+    //! Serve a queue until stopped (throws if the queue fails)
+    void _run_queue(Queue &queue);
+
+    //! Hand datagrams read from a queue to the inboxes of the connections they are for
+    void _dispatch(std::vector<Buffer> &datagrams);
+
+  public:
+    //! \brief Open `num_queues` queues of the multi-queue TUN device `devname`, and start their threads
+    MultiQueueTun(const std::string &devname, const size_t num_queues);
+
+    //! Stops and joins the queue threads
+    ~MultiQueueTun();
+
+    //! \brief Number of queues (and threads)
+    size_t num_queues() const { return _queues.size(); }
+
+    //! \brief The queue that a connection's datagrams go out on, by a hash of its addresses and ports
+    size_t queue_for(const FdAdapterConfig &config) const;
+
+    //! \brief Deliver datagrams for local TCP port `port` to `inbox`
+    //! \note Throws std::runtime_error if another inbox already has the port
+    void attach(const uint16_t port, std::shared_ptr<Inbox> inbox);
+
+    //! \brief Stop delivering datagrams for local TCP port `port`
+    void detach(const uint16_t port);
+
+    //! \brief Throw std::runtime_error if queue number `queue`'s thread has failed
+    void check_queue(const size_t queue) const;
+
+    //! \brief Send a serialized IPv4 datagram through queue number `queue` (from any thread)
+    //! \note Throws std::runtime_error if the queue's thread has failed
+    void send(const size_t queue, BufferList &&datagram) {
+        check_queue(queue);
+        _queues.at(queue)->outbox.push(std::move(datagram));
+    }
+
+    //! \name
+    //! The queue threads refer to the MultiQueueTun, so it can't be copied or moved
+
+    //!@{
+    MultiQueueTun(const MultiQueueTun &other) = delete;
+    MultiQueueTun &operator=(const MultiQueueTun &other) = delete;
+    MultiQueueTun(MultiQueueTun &&other) = delete;
+    MultiQueueTun &operator=(MultiQueueTun &&other) = delete;
+    //!@}
+};
+
+//! \brief A FD adapter for IPv4 datagrams carried through a MultiQueueTun
+//! \details The adapter's file descriptor is its inbox's EventFD, which the queue threads make readable
+//! as they hand it datagrams. The adapter owns its local TCP port on the device from its first write()
+//! (for a connection it opens) or from set_listening() (for one it accepts) until it is destroyed.
+//! read() and write() throw if the thread of the connection's queue has failed.
+class TCPOverIPv4OverMultiQueueTunAdapter : public TCPOverIPv4Adapter {
+  private:
+    std::shared_ptr<MultiQueueTun> _tun;
+
+    std::shared_ptr<MultiQueueTun::Inbox> _inbox{std::make_shared<MultiQueueTun::Inbox>()};
+
+    std::vector<Buffer> _datagrams_in{};  //!< Datagrams taken from the inbox, from `_next_datagram_in` on
+    size_t _next_datagram_in = 0;         //!< Index in `_datagrams_in` of the next one read() hands out
+
+    std::optional<uint16_t> _attached_port{};  //!< The local port the adapter owns, once it does
+
+    //! Take ownership of the configured local port, if the adapter doesn't own a port yet
+    void _attach();
+
+  public:
+    //! Construct on a MultiQueueTun that other adapters may share
+    explicit TCPOverIPv4OverMultiQueueTunAdapter(std::shared_ptr<MultiQueueTun> tun) : _tun(std::move(tun)) {}
+
+    //! Gives up the local port
+    ~TCPOverIPv4OverMultiQueueTunAdapter();
+
+    TCPOverIPv4OverMultiQueueTunAdapter(TCPOverIPv4OverMultiQueueTunAdapter &&other) = default;
+    TCPOverIPv4OverMultiQueueTunAdapter &operator=(TCPOverIPv4OverMultiQueueTunAdapter &&other) = delete;
+
+    //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
+    std::optional<TCPSegment> read();
+
+    //! Creates an IPv4 datagram from a TCP segment and sends it through the connection's queue
+    void write(TCPSegment &seg);
+
+    //! Whether datagrams already taken from the inbox are waiting for read()
+    bool read_pending() const { return _next_datagram_in < _datagrams_in.size(); }
+
+    //! Set the listening flag, taking ownership of the configured local port to listen on
+    void set_listening(const bool l);
+
+    //! Access the inbox's EventFD
+    operator const FileDescriptor &() const { return _inbox->ready(); }
+};
+
+#endif  // SPONGE_LIBSPONGE_MULTI_QUEUE_TUN_HH
@@ -20,6 +20,11 @@ class TCPConfig {
     size_t recv_capacity = DEFAULT_CAPACITY;  //!< Receive capacity, in bytes
     size_t send_capacity = DEFAULT_CAPACITY;  //!< Sender capacity, in bytes
     std::optional<WrappingInt32> fixed_isn{};
+
+    //! Largest payload the sender puts in one segment. Beyond MAX_PAYLOAD_SIZE only when the adapter
+    //! can have the segment split further down (TSO, as with TCPOverIPv4OverTunFdAdapter on a TUN
+    //! device with a virtio-net header); the segment must still fit one IPv4 datagram (at most 65495 bytes).
+    size_t max_payload_size = MAX_PAYLOAD_SIZE;
 };
 
 //! Config for classes derived from FdAdapter
@@ -30,6 +35,16 @@ class FdAdapterConfig {
 
     uint16_t loss_rate_dn = 0;  //!< Downlink loss rate (for LossyFdAdapter)
     uint16_t loss_rate_up = 0;  //!< Uplink loss rate (for LossyFdAdapter)
+
+    //! Checksum offload: the transport already guarantees integrity (e.g., UDP's own checksum, or an
+    //! in-process link), so don't verify TCP checksums on receive, and send zero or partial checksums.
+    //! \note Both peers must agree; a peer that verifies checksums will drop every segment.
+    bool checksum_offload = false;
+
+    //! UDP segmentation offload (for TCPOverUDPSocketAdapter): send each run of equal-sized segments as one
+    //! UDP GSO datagram for the kernel to split, and let the kernel coalesce received datagrams (UDP GRO).
+    //! The peer need not use it too. Takes Linux 5.0 or later.
+    bool segmentation_offload = false;
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_CONFIG_HH
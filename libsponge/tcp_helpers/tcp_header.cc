@@ -4,6 +4,22 @@
 
 using namespace std;
 
+namespace {
+//! \name Layout of the fixed part of the TCP header
+//!@{
+constexpr NetField<uint16_t, 0> sport_field{};
+constexpr NetField<uint16_t, 2> dport_field{};
+constexpr NetField<uint32_t, 4> seqno_field{};
+constexpr NetField<uint32_t, 8> ackno_field{};
+constexpr NetField<uint8_t, 12> doff_field{};
+constexpr NetField<uint8_t, 13> flags_field{};
+constexpr NetField<uint16_t, 14> win_field{};
+constexpr NetField<uint16_t, 16> cksum_field{};
+constexpr NetField<uint16_t, 18> uptr_field{};
+//!@}
+static_assert(uptr_field.end == TCPHeader::LENGTH);
+}  // namespace
+
 //! \param[in,out] p is a NetParser from which the TCP fields will be extracted
 //! \returns a ParseResult indicating success or the reason for failure
 //! \details It is important to check for (at least) the following potential errors
@@ -14,14 +30,23 @@ using namespace std;
 //! - the header's `doff` field is shorter than the minimum allowed
 //! - there is less data in the header than the `doff` field claims
 //! - the checksum is bad
+//!
+//! The length is checked once; the fields are then decoded in place from their fixed offsets.
 ParseResult TCPHeader::parse(NetParser &p) {
-    sport = p.u16();                 // source port
-    dport = p.u16();                 // destination port
-    seqno = WrappingInt32{p.u32()};  // sequence number
-    ackno = WrappingInt32{p.u32()};  // ack number
-    doff = p.u8() >> 4;              // data offset
+    const string_view data = p.str();
+    if (data.size() < TCPHeader::LENGTH) {
+        p.set_error(ParseResult::PacketTooShort);
+        return p.get_error();
+    }
+
+    const uint8_t *const raw = as_octets(data);
+    sport = sport_field.get(raw);                 // source port
+    dport = dport_field.get(raw);                 // destination port
+    seqno = WrappingInt32{seqno_field.get(raw)};  // sequence number
+    ackno = WrappingInt32{ackno_field.get(raw)};  // ack number
+    doff = doff_field.get(raw) >> 4;              // data offset
 
-    const uint8_t fl_b = p.u8();                  // byte including flags
+    const uint8_t fl_b = flags_field.get(raw);    // byte including flags
     urg = static_cast<bool>(fl_b & 0b0010'0000);  // binary literals and ' digit separator since C++14!!!
     ack = static_cast<bool>(fl_b & 0b0001'0000);
     psh = static_cast<bool>(fl_b & 0b0000'1000);
@@ -29,16 +54,16 @@ ParseResult TCPHeader::parse(NetParser &p) {
     syn = static_cast<bool>(fl_b & 0b0000'0010);
     fin = static_cast<bool>(fl_b & 0b0000'0001);
 
-    win = p.u16();    // window size
-    cksum = p.u16();  // checksum
-    uptr = p.u16();   // urgent pointer
+    win = win_field.get(raw);      // window size
+    cksum = cksum_field.get(raw);  // checksum
+    uptr = uptr_field.get(raw);    // urgent pointer
 
     if (doff < 5) {
         return ParseResult::HeaderTooShort;
     }
 
-    // skip any options or anything extra in the header
-    p.remove_prefix(doff * 4 - TCPHeader::LENGTH);
+    // consume the header, including any options or anything extra
+    p.remove_prefix(doff * 4);
 
     if (p.error()) {
         return p.get_error();
@@ -23,10 +23,13 @@ using namespace std;
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram) {
-    // is the IPv4 datagram for us?
+optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram,
+                                                          const bool checksum_verified) {
+    // is the IPv4 datagram for us? (every fragment carries the datagram's addresses and protocol, so
+    // fragments for someone else are dropped here rather than held for reassembly)
     // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
-    if (not listening() and (ip_dgram.header().dst != config().source.ipv4_numeric())) {
+    const uint32_t source = config().source.ipv4_numeric();
+    if ((not listening() or source != 0) and (ip_dgram.header().dst != source)) {
         return {};
     }
 
@@ -40,9 +43,20 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
         return {};
     }
 
+    // is the IPv4 datagram only a fragment? If so, wait for the rest
+    if (ip_dgram.header().mf or ip_dgram.header().offset != 0) {
+        const auto whole = _reassembler.push(ip_dgram);
+        if (not whole.has_value()) {
+            return {};
+        }
+        return unwrap_tcp_in_ip(whole.value(), checksum_verified);
+    }
+
     // is the payload a valid TCP segment?
     TCPSegment tcp_seg;
-    if (ParseResult::NoError != tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum())) {
+    if (ParseResult::NoError !=
+        tcp_seg.parse(
+            ip_dgram.payload(), ip_dgram.header().pseudo_cksum(), config().checksum_offload or checksum_verified)) {
         return {};
     }
 
@@ -71,8 +85,7 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 }
 
 //! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
-//! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg, const bool partial_checksum) {
     // set the port numbers in the TCP segment
     seg.header().sport = config().source.port();
     seg.header().dport = config().destination.port();
@@ -83,8 +96,9 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
     ip_dgram.header().dst = config().destination.ipv4_numeric();
     ip_dgram.header().len = ip_dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
 
-    // set payload, calculating TCP checksum using information from IP header
-    ip_dgram.payload() = seg.serialize(ip_dgram.header().pseudo_cksum());
+    // set payload, calculating TCP checksum using information from IP header (unless offloaded)
+    ip_dgram.payload() =
+        seg.serialize(ip_dgram.header().pseudo_cksum(), config().checksum_offload or partial_checksum);
 
     return ip_dgram;
 }
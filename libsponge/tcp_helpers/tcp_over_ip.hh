@@ -4,16 +4,29 @@
 #include "buffer.hh"
 #include "fd_adapter.hh"
 #include "ipv4_datagram.hh"
+#include "ipv4_fragments.hh"
 #include "tcp_segment.hh"
 
 #include <optional>
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase {
+  private:
+    IPv4Reassembler _reassembler{};  //!< Fragments of datagrams not yet complete
+
   public:
-    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram);
+    //! \note A fragment is held until its datagram is complete, and then the whole datagram is unwrapped
+    //! \param[in] ip_dgram is the datagram to unwrap
+    //! \param[in] checksum_verified is `true` if the device vouches for the TCP checksum (e.g., a TUN
+    //!                              device's checksum offload), so it isn't checked again
+    std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram, const bool checksum_verified = false);
+
+    //! \param[in] seg is the TCP segment to wrap
+    //! \param[in] partial_checksum is `true` to leave the TCP checksum for the device to complete
+    InternetDatagram wrap_tcp_in_ip(TCPSegment &seg, const bool partial_checksum = false);
 
-    InternetDatagram wrap_tcp_in_ip(TCPSegment &seg);
+    //! Called periodically when time elapses (to give up on datagrams whose fragments stopped arriving)
+    void tick(const size_t ms_since_last_tick) { _reassembler.tick(ms_since_last_tick); }
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_OVER_IP_HH
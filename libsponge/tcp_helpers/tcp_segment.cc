@@ -9,11 +9,14 @@ using namespace std;
 
 //! \param[in] buffer string/Buffer to be parsed
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum) {
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(buffer);
-    if (check.value()) {
-        return ParseResult::BadChecksum;
+//! \param[in] checksum_offload skip checksum verification (the transport has already verified integrity)
+ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum, const bool checksum_offload) {
+    if (not checksum_offload) {
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(buffer);
+        if (check.value()) {
+            return ParseResult::BadChecksum;
+        }
     }
 
     NetParser p{buffer};
@@ -27,15 +30,22 @@ size_t TCPSegment::length_in_sequence_space() const {
 }
 
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
+//! \param[in] checksum_offload don't checksum the segment; instead, write the folded `datagram_layer_checksum`
+//!                             (zero if there is none, else a "partial" checksum covering only the
+//!                             pseudo-header, for whatever completes it further down the stack)
+BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum, const bool checksum_offload) const {
     TCPHeader header_out = _header;
     header_out.cksum = 0;
 
-    // calculate checksum -- taken over entire segment
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(header_out.serialize());
-    check.add(_payload);
-    header_out.cksum = check.value();
+    if (checksum_offload) {
+        header_out.cksum = ~InternetChecksum(datagram_layer_checksum).value();
+    } else {
+        // calculate checksum -- taken over entire segment
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(header_out.serialize());
+        check.add(_payload);
+        header_out.cksum = check.value();
+    }
 
     BufferList ret;
     ret.append(header_out.serialize());
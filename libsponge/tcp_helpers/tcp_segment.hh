@@ -14,10 +14,12 @@ class TCPSegment {
 
   public:
     //! \brief Parse the segment from a string
-    ParseResult parse(const Buffer buffer, const uint32_t datagram_layer_checksum = 0);
+    ParseResult parse(const Buffer buffer,
+                      const uint32_t datagram_layer_checksum = 0,
+                      const bool checksum_offload = false);
 
     //! \brief Serialize the segment to a string
-    BufferList serialize(const uint32_t datagram_layer_checksum = 0) const;
+    BufferList serialize(const uint32_t datagram_layer_checksum = 0, const bool checksum_offload = false) const;
 
     //! \name Accessors
     //!@{
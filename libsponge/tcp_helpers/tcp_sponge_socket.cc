@@ -76,10 +76,13 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     _eventloop.add_rule(_datagram_adapter,
                         Direction::In,
                         [&] {
-                            auto seg = _datagram_adapter.read();
-                            if (seg) {
-                                _tcp->segment_received(move(seg.value()));
-                            }
+                            // an adapter may take several datagrams from one readiness event
+                            do {
+                                auto seg = _datagram_adapter.read();
+                                if (seg) {
+                                    _tcp->segment_received(move(seg.value()));
+                                }
+                            } while (_datagram_adapter.read_pending());
 
                             // debugging output:
                             if (_thread_data.eof() and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
@@ -158,6 +161,8 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
                                 _datagram_adapter.write(_tcp->segments_out().front());
                                 _tcp->segments_out().pop();
                             }
+                            // an adapter may send them all at once
+                            _datagram_adapter.flush();
                         },
                         [&] { return not _tcp->segments_out().empty(); });
 }
@@ -279,6 +284,9 @@ template class TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
 //! Specialization of TCPSpongeSocket for TCPOverIPv4OverEthernetAdapter
 template class TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
 
+//! Specialization of TCPSpongeSocket for TCPOverIPv4OverMultiQueueTunAdapter
+template class TCPSpongeSocket<TCPOverIPv4OverMultiQueueTunAdapter>;
+
 //! Specialization of TCPSpongeSocket for LossyTCPOverUDPSocketAdapter
 template class TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 
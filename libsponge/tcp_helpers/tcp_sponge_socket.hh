@@ -5,6 +5,7 @@
 #include "eventloop.hh"
 #include "fd_adapter.hh"
 #include "file_descriptor.hh"
+#include "multi_queue_tun.hh"
 #include "network_interface.hh"
 #include "tcp_config.hh"
 #include "tcp_connection.hh"
@@ -34,8 +35,10 @@ class TCPSpongeSocket : public LocalStreamSocket {
     //! TCP state machine
     std::optional<TCPConnection> _tcp{};
 
-    //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-    EventLoop _eventloop{};
+    //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes);
+    //! it waits on the same few fds for the life of the connection, so it keeps them registered with epoll,
+    //! or, if the adapter does its I/O through an IoUring, with an io_uring of its own
+    EventLoop _eventloop{_datagram_adapter.uses_io_uring() ? EventLoop::Backend::IoUring : EventLoop::Backend::Epoll};
 
     //! Process events while specified condition is true
     void _tcp_loop(const std::function<bool()> &condition);
@@ -99,6 +102,7 @@ class TCPSpongeSocket : public LocalStreamSocket {
 using TCPOverUDPSpongeSocket = TCPSpongeSocket<TCPOverUDPSocketAdapter>;
 using TCPOverIPv4SpongeSocket = TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
 using TCPOverIPv4OverEthernetSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
+using TCPOverIPv4OverMultiQueueTunSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverMultiQueueTunAdapter>;
 
 using LossyTCPOverUDPSpongeSocket = TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 using LossyTCPOverIPv4SpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAdapter>;
@@ -1,25 +1,170 @@
 #include "tuntap_adapter.hh"
 
+#include <cstring>
+#include <linux/if_tun.h>
+#include <string>
+
 using namespace std;
 
+static_assert(TunTapFD::VNET_HDR_SIZE == 10, "the virtio-net header is 10 bytes");
+
+namespace {
+
+//! \brief The virtio-net header for a datagram carrying `seg`, with its TCP checksum left partial
+//! \details A segment with more than `mss` bytes of payload is marked for TSO at `mss`.
+Buffer vnet_header(const InternetDatagram &ip_dgram, const TCPSegment &seg, const size_t mss) {
+    TunTapFD::VnetHeader vnet{};
+    vnet.flags = TunTapFD::VnetHeader::F_NEEDS_CSUM;
+    vnet.csum_start = ip_dgram.header().hlen * 4;
+    vnet.csum_offset = 16;  // the checksum's offset in the TCP header
+    if (seg.payload().size() > mss) {
+        vnet.gso_type = TunTapFD::VnetHeader::GSO_TCPV4;
+        vnet.gso_size = mss;
+        vnet.hdr_len = ip_dgram.header().hlen * 4 + seg.header().doff * 4;
+    }
+    string bytes(sizeof(vnet), 0);
+    memcpy(bytes.data(), &vnet, sizeof(vnet));
+    return Buffer(move(bytes));
+}
+
+}  // namespace
+
+//! \param[in] tun Raw network device that will be owned by the adapter
+//! \param[in] mss Largest TCP payload in a datagram on the link
+//! \param[in] use_io_uring Whether to read and write through a TunTapIoUring, if the kernel allows
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter(TunFD &&tun, const size_t mss, const bool use_io_uring)
+    : _tun(move(tun)), _mss(mss) {
+    if (_tun.vnet_hdr()) {
+        _tun.set_offload(TUN_F_CSUM | TUN_F_TSO4);
+    }
+    if (use_io_uring and IoUring::available()) {
+        // the ring's reads wait in the kernel for datagrams
+        _tun.set_blocking(true);
+        _ring = make_unique<TunTapIoUring>(_tun);
+    } else {
+        _tun.set_blocking(false);
+    }
+}
+
+TCPOverIPv4OverTunFdAdapter::operator const FileDescriptor &() const {
+    if (_ring) {
+        return _ring->ring();
+    }
+    return _tun;
+}
+
+optional<TCPSegment> TCPOverIPv4OverTunFdAdapter::read() {
+    auto frame = _ring ? _frames_in.next(*_ring) : _frames_in.next(_tun);
+    if (not frame) {
+        return {};
+    }
+
+    bool checksum_verified = false;
+    if (_tun.vnet_hdr()) {
+        if (frame->size() < TunTapFD::VNET_HDR_SIZE) {
+            return {};
+        }
+        TunTapFD::VnetHeader vnet{};
+        memcpy(&vnet, frame->str().data(), sizeof(vnet));
+        // the kernel's own datagram, with its checksum left partial, or one whose checksum it checked
+        checksum_verified = vnet.flags & (TunTapFD::VnetHeader::F_NEEDS_CSUM | TunTapFD::VnetHeader::F_DATA_VALID);
+        frame->remove_prefix(TunTapFD::VNET_HDR_SIZE);
+    }
+
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(move(frame.value())) != ParseResult::NoError) {
+        return {};
+    }
+    return unwrap_tcp_in_ip(ip_dgram, checksum_verified);
+}
+
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverTunFdAdapter::write(TCPSegment &seg) {
+    const InternetDatagram ip_dgram = wrap_tcp_in_ip(seg, _tun.vnet_hdr());
+    BufferList frame;
+    if (_tun.vnet_hdr()) {
+        frame.append(vnet_header(ip_dgram, seg, _mss));
+    }
+    frame.append(ip_dgram.serialize());
+    if (_ring) {
+        _frames_out.push_back(move(frame));
+        return;
+    }
+    if (_next_frame_out == _frames_out.size()) {
+        _frames_out.clear();
+        _next_frame_out = 0;
+    }
+    if (_frames_out.size() - _next_frame_out < MAX_PENDING_FRAMES) {
+        _frames_out.push_back(move(frame));
+    }
+    send_pending();
+}
+
+//! \details If the device would block, the datagrams it hasn't taken are retried, in order, on the
+//! next write() or tick().
+void TCPOverIPv4OverTunFdAdapter::send_pending() {
+    if (_next_frame_out < _frames_out.size()) {
+        _next_frame_out += _tun.write_frames(_frames_out, _next_frame_out);
+    }
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void TCPOverIPv4OverTunFdAdapter::tick(const size_t ms_since_last_tick) {
+    TCPOverIPv4Adapter::tick(ms_since_last_tick);
+    if (not _ring) {
+        send_pending();
+    }
+}
+
+void TCPOverIPv4OverTunFdAdapter::flush() {
+    if (_ring and not _frames_out.empty()) {
+        _ring->write_frames(_frames_out);
+        _frames_out.clear();
+    }
+}
+
 //! \param[in] tap Raw network device that will be owned by the adapter
 //! \param[in] eth_address Ethernet address (local address) of the adapter
 //! \param[in] ip_address IP address (local address) of the adapter
 //! \param[in] next_hop IP address of the next hop (typically a router or default gateway)
+//! \param[in] use_io_uring Whether to read and write through a TunTapIoUring, if the kernel allows
 TCPOverIPv4OverEthernetAdapter::TCPOverIPv4OverEthernetAdapter(TapFD &&tap,
                                                                const EthernetAddress &eth_address,
                                                                const Address &ip_address,
-                                                               const Address &next_hop)
+                                                               const Address &next_hop,
+                                                               const bool use_io_uring)
     : _tap(move(tap)), _interface(eth_address, ip_address), _next_hop(next_hop) {
     // Linux seems to ignore the first frame sent on a TAP device, so send a dummy frame to prime the pump :-(
     EthernetFrame dummy_frame;
     _tap.write(dummy_frame.serialize());
+
+    // from here on, frames are read and written in batches (through the ring, on the blocking device)
+    if (use_io_uring and IoUring::available()) {
+        _ring = make_unique<TunTapIoUring>(_tap);
+    } else {
+        _tap.set_blocking(false);
+    }
+
+    // let the neighbors know who we are
+    _interface.announce();
+    send_pending();
+}
+
+TCPOverIPv4OverEthernetAdapter::operator const FileDescriptor &() const {
+    if (_ring) {
+        return _ring->ring();
+    }
+    return _tap;
 }
 
 optional<TCPSegment> TCPOverIPv4OverEthernetAdapter::read() {
-    // Read Ethernet frame from the raw device
+    // Take the next Ethernet frame read from the raw device
+    auto raw_frame = _ring ? _frames_in.next(*_ring) : _frames_in.next(_tap);
+    if (not raw_frame) {
+        return {};
+    }
     EthernetFrame frame;
-    if (frame.parse(_tap.read()) != ParseResult::NoError) {
+    if (frame.parse(move(raw_frame.value())) != ParseResult::NoError) {
         return {};
     }
 
@@ -38,6 +183,7 @@ optional<TCPSegment> TCPOverIPv4OverEthernetAdapter::read() {
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPOverIPv4OverEthernetAdapter::tick(const size_t ms_since_last_tick) {
+    TCPOverIPv4Adapter::tick(ms_since_last_tick);
     _interface.tick(ms_since_last_tick);
     send_pending();
 }
@@ -48,11 +194,18 @@ void TCPOverIPv4OverEthernetAdapter::write(TCPSegment &seg) {
     send_pending();
 }
 
+//! \details Frames go to the TAP device in a batch. If the device would block, the rest of the batch
+//! is retried first next time, and further frames wait in the NetworkInterface's queue meanwhile.
 void TCPOverIPv4OverEthernetAdapter::send_pending() {
-    while (not _interface.frames_out().empty()) {
-        _tap.write(_interface.frames_out().front().serialize());
-        _interface.frames_out().pop();
+    if (_next_frame_out == _frames_out.size()) {
+        _frames_out.clear();
+        _next_frame_out = 0;
+        for (auto &frames = _interface.frames_out(); not frames.empty(); frames.pop()) {
+            _frames_out.push_back(frames.front().serialize());
+        }
     }
+    _next_frame_out +=
+        _ring ? _ring->write_frames(_frames_out, _next_frame_out) : _tap.write_frames(_frames_out, _next_frame_out);
 }
 
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
@@ -2,61 +2,144 @@
 #define SPONGE_LIBSPONGE_TUNFD_ADAPTER_HH
 
 #include "ethernet_header.hh"
+#include "ipv4_header.hh"
 #include "network_interface.hh"
+#include "tcp_header.hh"
 #include "tun.hh"
 
+#include <memory>
 #include <optional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+//! \brief Frames drained from a TUN or TAP device, handed out one at a time
+//! \details Once all have been handed out, next() drains the device again (up to
+//! TunTapFD::DEFAULT_BATCH_SIZE frames), or takes whatever frames a TunTapIoUring has read, so that one
+//! readiness event serves every frame that was ready.
+class FrameBatch {
+  private:
+    std::vector<Buffer> _frames{};  //!< Frames taken from the device
+    size_t _next = 0;               //!< Index in `_frames` of the next frame to hand out
+
+  public:
+    //! \brief The next frame, if one was drained or the device (a TunTapFD or a TunTapIoUring) has one ready
+    template <typename DeviceT>
+    std::optional<Buffer> next(DeviceT &device);
+
+    //! \brief Whether frames drained from the device are still to be handed out
+    bool pending() const { return _next < _frames.size(); }
+};
+
+//! \param[in] device is the TUN or TAP device (or its ring) to drain when no frame is left
+template <typename DeviceT>
+std::optional<Buffer> FrameBatch::next(DeviceT &device) {
+    if (not pending()) {
+        _frames.clear();
+        _next = 0;
+        device.read_frames(_frames);
+        if (_frames.empty()) {
+            return {};
+        }
+    }
+    return std::move(_frames[_next++]);
+}
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
+//! \details The device is made non-blocking, so that read() can drain it. A datagram that the device
+//! won't take at once is dropped, as by a congested link.
+//!
+//! If the TunFD has a virtio-net header (TunTapFD::vnet_hdr()), the adapter turns on checksum and TCP
+//! segmentation offload: TCP checksums are left for the kernel to complete or skip, a segment with
+//! more than `mss` bytes of payload goes out whole as a TSO super-segment for the kernel to split
+//! only if it has to, and the kernel may likewise hand over unsplit super-segments of up to 64 KiB.
+//! The TCPSender makes such segments when TCPConfig::max_payload_size allows.
+//!
+//! With `use_io_uring`, datagrams are read and written through a TunTapIoUring instead (on a blocking
+//! device), and those written between flush()es are submitted together; the adapter's file descriptor is
+//! then the ring's. Without io_uring in the kernel (see IoUring::available()), the adapter uses the
+//! device as it would otherwise.
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
   private:
     TunFD _tun;
 
+    std::unique_ptr<TunTapIoUring> _ring{};  //!< The device's ring, with `use_io_uring`
+
+    size_t _mss;  //!< Largest TCP payload in a datagram on the link (and the size TSO splits at)
+
+    FrameBatch _frames_in{};  //!< Datagrams read from the TUN device
+
+    //! Datagrams to write to the TUN device, from `_next_frame_out` on (or queued for flush(), with the ring)
+    std::vector<BufferList> _frames_out{};
+
+    size_t _next_frame_out = 0;  //!< Index in `_frames_out` of the first datagram the TUN device hasn't taken
+
+    void send_pending();  //!< Writes the datagrams the TUN device hasn't taken yet, without the ring
+
   public:
-    //! Construct from a TunFD
-    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun) : _tun(std::move(tun)) {}
+    //! Largest TCP payload in an Ethernet-sized datagram
+    static constexpr size_t DEFAULT_MSS = NetworkInterface::DEFAULT_MTU - IPv4Header::LENGTH - TCPHeader::LENGTH;
+
+    //! Most datagrams to hold while the TUN device would block; more are dropped, as by a full device queue
+    static constexpr size_t MAX_PENDING_FRAMES = 256;
+
+    //! Construct from a TunFD, doing I/O through an IoUring with `use_io_uring`
+    explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun, const size_t mss = DEFAULT_MSS, const bool use_io_uring = false);
 
     //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
-    std::optional<TCPSegment> read() {
-        InternetDatagram ip_dgram;
-        if (ip_dgram.parse(_tun.read()) != ParseResult::NoError) {
-            return {};
-        }
-        return unwrap_tcp_in_ip(ip_dgram);
-    }
+    std::optional<TCPSegment> read();
+
+    //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device (or queues it, with the ring)
+    void write(TCPSegment &seg);
 
-    //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-    void write(TCPSegment &seg) { _tun.write(wrap_tcp_in_ip(seg).serialize()); }
+    //! Submits the datagrams queued since the last flush(), with the ring
+    void flush();
 
-    //! Access the underlying TUN device
-    operator TunFD &() { return _tun; }
+    //! Called periodically when time elapses; retries datagrams the TUN device couldn't take
+    void tick(const size_t ms_since_last_tick);
+
+    //! Whether datagrams already read from the TUN device are waiting for read()
+    bool read_pending() const { return _frames_in.pending(); }
 
-    //! Access the underlying TUN device
-    operator const TunFD &() const { return _tun; }
+    //! Whether datagrams go through a TunTapIoUring
+    bool uses_io_uring() const { return _ring != nullptr; }
+
+    //! The file descriptor to wait on: the TUN device, or its ring
+    operator const FileDescriptor &() const;
 };
 
 //! Typedef for TCPOverIPv4OverTunFdAdapter
 using LossyTCPOverIPv4OverTunFdAdapter = LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TAP device
+//! \details With `use_io_uring`, frames are read and written through a TunTapIoUring, as for
+//! TCPOverIPv4OverTunFdAdapter.
 class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
   private:
     TapFD _tap;  //!< Raw Ethernet connection
 
+    std::unique_ptr<TunTapIoUring> _ring{};  //!< The device's ring, with `use_io_uring`
+
     NetworkInterface _interface;  //!< NIC abstraction
 
     Address _next_hop;  //!< IP address of the next hop
 
+    FrameBatch _frames_in{};  //!< Frames read from the TAP device
+
+    //! Frames taken from the NetworkInterface to write, from `_next_frame_out` on
+    std::vector<BufferList> _frames_out{};
+
+    size_t _next_frame_out = 0;  //!< Index in `_frames_out` of the first frame the TAP device hasn't taken
+
     void send_pending();  //!< Sends any pending Ethernet frames
 
   public:
-    //! Construct from a TapFD
+    //! Construct from a TapFD, doing I/O through an IoUring with `use_io_uring`
     explicit TCPOverIPv4OverEthernetAdapter(TapFD &&tap,
                                             const EthernetAddress &eth_address,
                                             const Address &ip_address,
-                                            const Address &next_hop);
+                                            const Address &next_hop,
+                                            const bool use_io_uring = false);
     //! Attempts to read and parse an Ethernet frame containing an IPv4 datagram that contains a TCP segment
     std::optional<TCPSegment> read();
 
@@ -66,11 +149,14 @@ class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
     //! Called periodically when time elapses
     void tick(const size_t ms_since_last_tick);
 
-    //! Access the underlying raw Ethernet connection
-    operator TapFD &() { return _tap; }
+    //! Whether frames already read from the TAP device are waiting for read()
+    bool read_pending() const { return _frames_in.pending(); }
+
+    //! Whether frames go through a TunTapIoUring
+    bool uses_io_uring() const { return _ring != nullptr; }
 
-    //! Access the underlying raw Ethernet connection
-    operator const TapFD &() const { return _tap; }
+    //! The file descriptor to wait on: the raw Ethernet connection, or its ring
+    operator const FileDescriptor &() const;
 };
 
 #endif  // SPONGE_LIBSPONGE_TUNFD_ADAPTER_HH
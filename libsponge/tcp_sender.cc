@@ -19,9 +19,14 @@ using namespace std;
 //! \param[in] capacity the capacity of the outgoing byte stream
 //! \param[in] retx_timeout the initial amount of time to wait before retransmitting the oldest outstanding segment
 //! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses a random ISN)
-TCPSender::TCPSender(const size_t capacity, const uint16_t retx_timeout, const std::optional<WrappingInt32> fixed_isn)
+//! \param[in] max_payload_size the largest payload to put in one segment
+TCPSender::TCPSender(const size_t capacity,
+                     const uint16_t retx_timeout,
+                     const std::optional<WrappingInt32> fixed_isn,
+                     const size_t max_payload_size)
     : _isn(fixed_isn.value_or(WrappingInt32{random_device()()}))
     , _initial_retransmission_timeout{retx_timeout}
+    , _max_payload_size{max_payload_size}
     , _stream(capacity)
     , _rto{retx_timeout} {}
 
@@ -50,7 +55,7 @@ void TCPSender::fill_window() {
             TCPSegment seg;
             size_t payload_size = min({_stream.buffer_size(),
                                        static_cast<size_t>(_receiver_free_space),
-                                       static_cast<size_t>(TCPConfig::MAX_PAYLOAD_SIZE)});
+                                       _max_payload_size});
             seg.payload() = Buffer{_stream.read(payload_size)};
             if (_stream.eof() && static_cast<size_t>(_receiver_free_space) > payload_size) {
                 seg.header().fin = true;
@@ -27,6 +27,9 @@ class TCPSender {
     //! retransmission timer for the connection
     unsigned int _initial_retransmission_timeout;
 
+    //! largest payload in a segment
+    size_t _max_payload_size;
+
     //! outgoing stream of bytes that have not yet been sent
     ByteStream _stream;
 
@@ -53,7 +56,8 @@ class TCPSender {
     //! Initialize a TCPSender
     TCPSender(const size_t capacity = TCPConfig::DEFAULT_CAPACITY,
               const uint16_t retx_timeout = TCPConfig::TIMEOUT_DFLT,
-              const std::optional<WrappingInt32> fixed_isn = {});
+              const std::optional<WrappingInt32> fixed_isn = {},
+              const size_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE);
 
     //! \name "Input" interface for the writer
     //!@{
@@ -88,6 +92,9 @@ class TCPSender {
     //! \brief Number of consecutive retransmissions that have occurred in a row
     unsigned int consecutive_retransmissions() const;
 
+    //! \brief Largest payload the TCPSender puts in one segment
+    size_t max_payload_size() const { return _max_payload_size; }
+
     //! \brief TCPSegments that the TCPSender has enqueued for transmission.
     //! \note These must be dequeued and sent by the TCPConnection,
     //! which will need to fill in the fields that are set by the TCPReceiver
@@ -1,14 +1,46 @@
 #include "buffer.hh"
 
+#include "buffer_pool.hh"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
 using namespace std;
 
+//! \details The string is moved, not copied; its bytes are freed with the last Buffer that shares them.
+Buffer::Buffer(string &&str) noexcept {
+    void *const block = BufferPool::allocate(sizeof(Storage));
+    _storage = new (block) Storage{sizeof(Storage), nullptr, 0};
+    _storage->owned = move(str);
+    _storage->data = _storage->owned.data();
+    _storage->size = _storage->owned.size();
+}
+
+Buffer Buffer::copy_of(const string_view str) {
+    const size_t block_size = sizeof(Storage) + str.size();
+    char *const block = static_cast<char *>(BufferPool::allocate(block_size));
+    char *const data = block + sizeof(Storage);
+    memcpy(data, str.data(), str.size());
+
+    Buffer ret;
+    ret._storage = new (block) Storage{block_size, data, str.size()};
+    return ret;
+}
+
+void Buffer::_free(Storage *const storage) noexcept {
+    const size_t block_size = storage->block_size;
+    storage->~Storage();
+    BufferPool::deallocate(storage, block_size);
+}
+
 void Buffer::remove_prefix(const size_t n) {
     if (n > str().size()) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
-        _storage.reset();
+    if (_storage and _starting_offset == _storage->size) {
+        _release();
     }
 }
 
@@ -1,26 +1,125 @@
 #ifndef SPONGE_LIBSPONGE_BUFFER_HH
 #define SPONGE_LIBSPONGE_BUFFER_HH
 
+#include "small_vector.hh"
+
 #include <algorithm>
-#include <deque>
-#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <numeric>
 #include <string>
 #include <string_view>
 #include <sys/uio.h>
 #include <vector>
 
+#if __has_include(<sys/single_threaded.h>)
+#include <sys/single_threaded.h>
+#endif
+
 //! \brief A reference-counted read-only string that can discard bytes from the front
 class Buffer {
   private:
-    std::shared_ptr<std::string> _storage{};
+    //! \brief The bytes shared by a Buffer and its copies, with an intrusive reference count
+    //! \details Lives in a BufferPool block. The bytes either follow it in the same block
+    //! (Buffer::copy_of) or belong to a string it has taken over (Buffer(std::string &&)).
+    struct Storage {
+        std::atomic<uint32_t> refcount{1};
+        size_t block_size;      //!< Size of the BufferPool block holding this Storage
+        std::string owned{};    //!< Adopted string, if any
+        const char *data;       //!< First byte
+        size_t size;            //!< Number of bytes
+
+        Storage(const size_t block_size_, const char *const data_, const size_t size_)
+            : block_size(block_size_), data(data_), size(size_) {}
+        Storage(const Storage &other) = delete;
+        Storage &operator=(const Storage &other) = delete;
+    };
+
+    Storage *_storage{};
     size_t _starting_offset{};
 
+    //! \brief Whether reference counts can be updated without atomic instructions
+    //! \details The same shortcut std::shared_ptr takes until a program starts a second thread.
+    static bool _single_threaded() {
+#if __has_include(<sys/single_threaded.h>)
+        return __libc_single_threaded;
+#else
+        return false;
+#endif
+    }
+
+    //! Add a reference to the Storage (if any)
+    void _acquire() noexcept {
+        if (not _storage) {
+            return;
+        }
+        if (_single_threaded()) {
+            _storage->refcount.store(_storage->refcount.load(std::memory_order_relaxed) + 1,
+                                     std::memory_order_relaxed);
+        } else {
+            _storage->refcount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //! Destroy the Storage and return its block to the BufferPool
+    static void _free(Storage *const storage) noexcept;
+
+    //! Drop this Buffer's reference, freeing the Storage if it was the last
+    void _release() noexcept {
+        if (not _storage) {
+            return;
+        }
+
+        uint32_t remaining;
+        if (_single_threaded()) {
+            remaining = _storage->refcount.load(std::memory_order_relaxed) - 1;
+            _storage->refcount.store(remaining, std::memory_order_relaxed);
+        } else {
+            remaining = _storage->refcount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        }
+
+        if (remaining == 0) {
+            _free(_storage);
+        }
+        _storage = nullptr;
+        _starting_offset = 0;
+    }
+
   public:
     Buffer() = default;
 
     //! \brief Construct by taking ownership of a string
-    Buffer(std::string &&str) noexcept : _storage(std::make_shared<std::string>(std::move(str))) {}
+    Buffer(std::string &&str) noexcept;
+
+    //! \brief Copy `str` into a single pooled allocation (no separate heap allocation for the bytes)
+    static Buffer copy_of(const std::string_view str);
+
+    //! \name Copying shares the bytes; moving leaves the source empty
+    //!@{
+    Buffer(const Buffer &other) noexcept : _storage(other._storage), _starting_offset(other._starting_offset) {
+        _acquire();
+    }
+
+    Buffer(Buffer &&other) noexcept : _storage(other._storage), _starting_offset(other._starting_offset) {
+        other._storage = nullptr;
+        other._starting_offset = 0;
+    }
+
+    Buffer &operator=(const Buffer &other) noexcept {
+        Buffer copy{other};
+        std::swap(_storage, copy._storage);
+        std::swap(_starting_offset, copy._starting_offset);
+        return *this;
+    }
+
+    Buffer &operator=(Buffer &&other) noexcept {
+        std::swap(_storage, other._storage);
+        std::swap(_starting_offset, other._starting_offset);
+        return *this;
+    }
+
+    ~Buffer() { _release(); }
+    //!@}
 
     //! \name Expose contents as a std::string_view
     //!@{
@@ -28,7 +127,7 @@ class Buffer {
         if (not _storage) {
             return {};
         }
-        return {_storage->data() + _starting_offset, _storage->size() - _starting_offset};
+        return {_storage->data + _starting_offset, _storage->size - _starting_offset};
     }
 
     operator std::string_view() const { return str(); }
@@ -54,8 +153,12 @@ class Buffer {
 //! encapsulate a TCP payload in a TCPSegment, and then encapsulate
 //! the TCPSegment in an IPv4Datagram) without copying the payload.
 class BufferList {
+  public:
+    //! \brief The Buffers themselves; a packet's headers and payload usually fit without a heap allocation
+    using Buffers = SmallVector<Buffer, 3>;
+
   private:
-    std::deque<Buffer> _buffers{};
+    Buffers _buffers{};
 
   public:
     //! \name Constructors
@@ -64,7 +167,7 @@ class BufferList {
     BufferList() = default;
 
     //! \brief Construct from a Buffer
-    BufferList(Buffer buffer) : _buffers{buffer} {}
+    BufferList(Buffer buffer) { _buffers.push_back(std::move(buffer)); }
 
     //! \brief Construct by taking ownership of a std::string
     BufferList(std::string &&str) noexcept {
@@ -74,7 +177,7 @@ class BufferList {
     //!@}
 
     //! \brief Access the underlying queue of Buffers
-    const std::deque<Buffer> &buffers() const { return _buffers; }
+    const Buffers &buffers() const { return _buffers; }
 
     //! \brief Append a BufferList
     void append(const BufferList &other);
@@ -95,7 +198,7 @@ class BufferList {
 
 //! \brief A non-owning temporary view (similar to std::string_view) of a discontiguous string
 class BufferViewList {
-    std::deque<std::string_view> _views{};
+    SmallVector<std::string_view, 3> _views{};
 
   public:
     //! \name Constructors
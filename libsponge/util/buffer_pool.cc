@@ -0,0 +1,196 @@
+#include "buffer_pool.hh"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t NUM_CLASSES = BufferPool::SIZE_CLASSES.size();
+
+//! Index of the smallest class that fits `size`, or NUM_CLASSES if none does
+constexpr size_t size_class(const size_t size) {
+    size_t i = 0;
+    while (i < NUM_CLASSES and BufferPool::SIZE_CLASSES[i] < size) {
+        i++;
+    }
+    return i;
+}
+
+static_assert(size_class(1) == 0 and size_class(65) == 1 and size_class(65537) == NUM_CLASSES);
+static_assert(BufferPool::SIZE_CLASSES.back() < BufferPool::SLAB_SIZE);
+
+//! A free block, linked through its own first bytes
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+//! The start of every slab, which links it into the list of all slabs
+struct SlabHeader {
+    SlabHeader *next;
+};
+
+//! Keeps blocks carved after the header suitably aligned
+constexpr size_t SLAB_HEADER_SIZE = alignof(max_align_t);
+
+static_assert(sizeof(SlabHeader) <= SLAB_HEADER_SIZE);
+
+//! Most blocks of class `cls` a thread keeps for itself: one slab's worth
+constexpr size_t cache_limit(const size_t cls) { return BufferPool::SLAB_SIZE / BufferPool::SIZE_CLASSES[cls]; }
+
+//! Blocks moved at once between a thread's cache and the shared pool
+constexpr size_t batch_size(const size_t cls) { return (cache_limit(cls) + 1) / 2; }
+
+static_assert(batch_size(NUM_CLASSES - 1) > 0);
+
+mutex slabs_mutex{};
+SlabHeader *slabs = nullptr;  //!< Every slab ever allocated, so they stay reachable; never freed
+atomic<size_t> num_slabs{0};
+
+//! Free blocks of a single size class that no thread is holding on to
+struct SharedPool {
+    mutex lock;
+    FreeBlock *free_list;
+};
+
+array<SharedPool, NUM_CLASSES> shared_pools{};
+
+//! One thread's blocks of a single size class
+struct ThreadCache {
+    FreeBlock *free_list;  //!< Blocks that have been returned
+    size_t free_count;     //!< Length of `free_list`
+    char *unused;          //!< Start of the part of the current slab that hasn't been carved up
+    char *unused_end;      //!< End of the current slab
+};
+
+//! Hand the chain `first`...`last` to the shared pool of class `cls`
+void give_to_shared(const size_t cls, FreeBlock *const first, FreeBlock *const last) {
+    SharedPool &pool = shared_pools[cls];
+    lock_guard<mutex> lock(pool.lock);
+    last->next = pool.free_list;
+    pool.free_list = first;
+}
+
+//! Move up to batch_size(cls) blocks from the shared pool into `cache`
+void take_from_shared(const size_t cls, ThreadCache &cache) {
+    SharedPool &pool = shared_pools[cls];
+    lock_guard<mutex> lock(pool.lock);
+    FreeBlock *const first = pool.free_list;
+    if (not first) {
+        return;
+    }
+    FreeBlock *last = first;
+    size_t count = 1;
+    while (count < batch_size(cls) and last->next) {
+        last = last->next;
+        count++;
+    }
+    pool.free_list = last->next;
+    last->next = cache.free_list;
+    cache.free_list = first;
+    cache.free_count += count;
+}
+
+//! A thread's caches, which go back to the shared pools when the thread exits
+struct ThreadCaches {
+    array<ThreadCache, NUM_CLASSES> classes{};
+
+    ThreadCaches() = default;
+    ThreadCaches(const ThreadCaches &) = delete;
+    ThreadCaches &operator=(const ThreadCaches &) = delete;
+
+    ~ThreadCaches() {
+        for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+            ThreadCache &cache = classes[cls];
+            const size_t block_size = BufferPool::SIZE_CLASSES[cls];
+            for (; size_t(cache.unused_end - cache.unused) >= block_size; cache.unused += block_size) {
+                cache.free_list = new (cache.unused) FreeBlock{cache.free_list};
+            }
+            if (cache.free_list) {
+                FreeBlock *last = cache.free_list;
+                while (last->next) {
+                    last = last->next;
+                }
+                give_to_shared(cls, cache.free_list, last);
+            }
+            cache = {};
+        }
+    }
+};
+
+thread_local ThreadCaches caches{};
+
+//! Allocate a slab and return the first byte available for blocks
+char *new_slab() {
+    char *const slab = static_cast<char *>(::operator new(BufferPool::SLAB_SIZE));
+    SlabHeader *const header = new (slab) SlabHeader{nullptr};
+
+    lock_guard<mutex> lock(slabs_mutex);
+    header->next = slabs;
+    slabs = header;
+    num_slabs++;
+
+    return slab + SLAB_HEADER_SIZE;
+}
+
+}  // namespace
+
+void *BufferPool::allocate(const size_t size) {
+    const size_t cls = size_class(size);
+    if (cls == NUM_CLASSES) {
+        return ::operator new(size);
+    }
+
+    ThreadCache &cache = caches.classes[cls];
+
+    if (not cache.free_list) {
+        take_from_shared(cls, cache);
+    }
+
+    if (cache.free_list) {
+        FreeBlock *const ret = cache.free_list;
+        cache.free_list = ret->next;
+        cache.free_count--;
+        return ret;
+    }
+
+    const size_t block_size = SIZE_CLASSES[cls];
+    if (size_t(cache.unused_end - cache.unused) < block_size) {
+        cache.unused = new_slab();
+        cache.unused_end = cache.unused + SLAB_SIZE - SLAB_HEADER_SIZE;
+    }
+
+    void *const ret = cache.unused;
+    cache.unused += block_size;
+    return ret;
+}
+
+//! \details The block joins the calling thread's free list, whichever thread allocated it. Once that
+//! list holds more than cache_limit() blocks, a batch of them moves to the shared pool, where any
+//! thread can pick them up, so blocks freed on one thread and allocated on another keep circulating.
+void BufferPool::deallocate(void *const block, const size_t size) noexcept {
+    const size_t cls = size_class(size);
+    if (cls == NUM_CLASSES) {
+        ::operator delete(block);
+        return;
+    }
+
+    ThreadCache &cache = caches.classes[cls];
+    cache.free_list = new (block) FreeBlock{cache.free_list};
+    cache.free_count++;
+
+    if (cache.free_count > cache_limit(cls)) {
+        FreeBlock *const first = cache.free_list;
+        FreeBlock *last = first;
+        for (size_t i = 1; i < batch_size(cls); i++) {
+            last = last->next;
+        }
+        cache.free_list = last->next;
+        cache.free_count -= batch_size(cls);
+        give_to_shared(cls, first, last);
+    }
+}
+
+size_t BufferPool::slab_count() { return num_slabs; }
@@ -0,0 +1,35 @@
+#ifndef SPONGE_LIBSPONGE_BUFFER_POOL_HH
+#define SPONGE_LIBSPONGE_BUFFER_POOL_HH
+
+#include <array>
+#include <cstddef>
+
+//! \brief A size-classed slab allocator for packet storage
+//! \details Requests are rounded up to one of a few size classes. Blocks of each class are carved
+//! from large slabs and recycled through per-thread free lists, so a steady stream of packets
+//! doesn't touch the heap. Each thread keeps at most a slab's worth of free blocks per class; the
+//! rest, and everything a thread holds when it exits, goes to a shared pool for other threads to
+//! reuse. Slabs are kept for the life of the program. Requests larger than the largest class go
+//! straight to the heap.
+class BufferPool {
+  public:
+    //! Block sizes, in bytes
+    static constexpr std::array<size_t, 6> SIZE_CLASSES = {64, 256, 1024, 2048, 16384, 65536};
+
+    //! Bytes in each slab (a slab of the largest class holds just a few blocks)
+    static constexpr size_t SLAB_SIZE = 256 * 1024;
+
+    //! \brief Allocate a block of at least `size` bytes, aligned for any fundamental type
+    static void *allocate(const size_t size);
+
+    //! \brief Return a block obtained from allocate()
+    //! \param[in] block is the block to free
+    //! \param[in] size must be the `size` that was passed to allocate()
+    //! \note May be called from a different thread than the one that allocated the block
+    static void deallocate(void *const block, const size_t size) noexcept;
+
+    //! \brief Number of slabs allocated so far
+    static size_t slab_count();
+};
+
+#endif  // SPONGE_LIBSPONGE_BUFFER_POOL_HH
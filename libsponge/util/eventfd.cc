@@ -0,0 +1,25 @@
+#include "eventfd.hh"
+
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+EventFD::EventFD() : FileDescriptor(SystemCall("eventfd", eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+void EventFD::notify() {
+    const uint64_t one = 1;
+    // EAGAIN means the counter is at its limit, so the descriptor is readable anyway
+    SystemCall("write", ::write(fd_num(), &one, sizeof(one)), EAGAIN);
+}
+
+void EventFD::clear() {
+    uint64_t count = 0;
+    // EAGAIN means it wasn't readable
+    SystemCall("read", ::read(fd_num(), &count, sizeof(count)), EAGAIN);
+    register_read();
+}
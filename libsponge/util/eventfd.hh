@@ -0,0 +1,22 @@
+#ifndef SPONGE_LIBSPONGE_EVENTFD_HH
+#define SPONGE_LIBSPONGE_EVENTFD_HH
+
+#include "file_descriptor.hh"
+
+//! \brief A FileDescriptor to a Linux [eventfd](\ref man2::eventfd), with which one thread wakes another's EventLoop
+//! \details The descriptor is readable from a notify() until the next clear(), however many notify()
+//! calls came in between.
+class EventFD : public FileDescriptor {
+  public:
+    //! Create a non-blocking eventfd that isn't readable yet
+    EventFD();
+
+    //! \brief Make the descriptor readable
+    //! \note Safe to call from any thread; it isn't counted in write_count(), since several threads may call it
+    void notify();
+
+    //! \brief Make the descriptor unreadable again (counted in read_count())
+    void clear();
+};
+
+#endif  // SPONGE_LIBSPONGE_EVENTFD_HH
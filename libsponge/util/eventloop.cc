@@ -2,6 +2,7 @@
 
 #include "util.hh"
 
+#include <algorithm>
 #include <cerrno>
 #include <stdexcept>
 #include <system_error>
@@ -10,10 +11,26 @@
 
 using namespace std;
 
+static_assert(POLLIN == EPOLLIN and POLLOUT == EPOLLOUT, "a Direction is both a poll and an epoll event");
+static_assert(POLLERR == EPOLLERR and POLLHUP == EPOLLHUP, "io_uring poll requests report epoll's events");
+
 unsigned int EventLoop::Rule::service_count() const {
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+//! \param[in] backend is how the EventLoop will wait for its file descriptors
+EventLoop::EventLoop(const Backend backend) : _backend(backend) {
+    if (_backend == Backend::Epoll) {
+        _epoll.emplace(SystemCall("epoll_create1", ::epoll_create1(EPOLL_CLOEXEC)));
+    } else if (_backend == Backend::IoUring) {
+        if (IoUring::available()) {
+            _ring.emplace();
+        } else {
+            _backend = Backend::Poll;
+        }
+    }
+}
+
 //! \param[in] fd is the FileDescriptor to be polled
 //! \param[in] direction indicates whether to poll for reading (Direction::In) or writing (Direction::Out)
 //! \param[in] callback is called when `fd` is ready.
@@ -26,6 +43,58 @@ void EventLoop::add_rule(const FileDescriptor &fd,
                          const InterestT &interest,
                          const CallbackT &cancel) {
     _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
+    if (_backend == Backend::Poll) {
+        return;
+    }
+
+    // register the fd (waiting for nothing, until the rule is interested), unless it already is; with
+    // io_uring, there is no poll request until then
+    const int fd_num = fd.fd_num();
+    const auto [it, inserted] = _registrations.try_emplace(fd_num);
+    Registration &registration = it->second;
+    registration.fd_num = fd_num;
+    if (inserted and _backend == Backend::Epoll) {
+        epoll_event event{};
+        event.data.ptr = &registration;
+        if (::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_ADD, fd_num, &event) < 0) {
+            // epoll won't watch a regular file or directory, which poll() always finds ready
+            SystemCall("epoll_ctl", -1, EPERM);
+            registration.watched = false;
+        }
+    }
+    registration.rules.push_back(prev(_rules.end()));
+    _rules.back().registration = &registration;
+}
+
+//! \param[in] rule is the rule to cancel
+//! \returns the rule after it
+list<EventLoop::Rule>::iterator EventLoop::_cancel(const list<Rule>::iterator rule) {
+    rule->cancel();
+    if (rule->registration) {
+        Registration &registration = *rule->registration;
+        registration.rules.erase(find(registration.rules.begin(), registration.rules.end(), rule));
+        _mark_dirty(registration);
+    }
+    return _rules.erase(rule);
+}
+
+//! \param[in] registration is the registration whose rules changed
+void EventLoop::_mark_dirty(Registration &registration) {
+    if (not registration.dirty) {
+        registration.dirty = true;
+        _dirty.push_back(&registration);
+    }
+}
+
+//! \param[in] rule is the rule whose fd is ready
+void EventLoop::_service(const Rule &rule) {
+    const auto count_before = rule.service_count();
+    rule.callback();
+
+    // only check for busy wait if we're not canceling or exiting
+    if (count_before == rule.service_count() and rule.interest()) {
+        throw runtime_error("EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+    }
 }
 
 //! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll); `wait_next_event`
@@ -59,23 +128,25 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! will result in a busy loop (poll returns on a ready file descriptor; file descriptor is not read or
 //! written, so it is still ready; the next call to poll will immediately return).
 EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
+    return _backend == Backend::Poll ? _wait_poll(timeout_ms) : _wait_registered(timeout_ms);
+}
+
+EventLoop::Result EventLoop::_wait_poll(const int timeout_ms) {
     vector<pollfd> pollfds{};
     pollfds.reserve(_rules.size());
     bool something_to_poll = false;
 
     // set up the pollfd for each rule
-    for (auto it = _rules.cbegin(); it != _rules.cend();) {  // NOTE: it gets erased or incremented in loop body
+    for (auto it = _rules.begin(); it != _rules.end();) {  // NOTE: it gets erased or incremented in loop body
         const auto &this_rule = *it;
         if (this_rule.direction == Direction::In && this_rule.fd.eof()) {
             // no more reading on this rule, it's reached eof
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel(it);
             continue;
         }
 
         if (this_rule.fd.closed()) {
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel(it);
             continue;
         }
 
@@ -121,25 +192,196 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
             //   - if it was POLLIN and nothing is readable, no more will ever be readable
             //   - if it was POLLOUT, it will not be writable again
-            this_rule.cancel();
-            it = _rules.erase(it);
+            it = _cancel(it);
             continue;
         }
 
         if (poll_ready) {
             // we only want to call callback if revents includes the event we asked for
-            const auto count_before = this_rule.service_count();
-            this_rule.callback();
+            _service(this_rule);
+        }
+
+        ++it;  // if we got here, it means we didn't call _rules.erase()
+    }
+
+    return Result::Success;
+}
+
+//! \param[in] registration is the registration to update
+void EventLoop::_update(Registration &registration) {
+    registration.dirty = false;
+    uint32_t events = 0;
+    for (const auto &rule : registration.rules) {
+        if (rule->polled) {
+            events |= static_cast<uint32_t>(rule->direction);
+        }
+    }
+
+    if (_backend == Backend::IoUring) {
+        // a request in flight for the wrong events is withdrawn (its completion will be ignored), and one
+        // for the right events, if any, takes its place
+        if (registration.request != 0 and (events != registration.events or registration.rules.empty())) {
+            _ring->prepare(IORING_OP_POLL_REMOVE, -1, 0).addr = registration.request;
+            registration.request = 0;
+        }
+        if (registration.rules.empty()) {
+            _registrations.erase(registration.fd_num);
+            return;
+        }
+        if (registration.request == 0 and events != 0) {
+            // the request's number and the fd tell its completion apart from a withdrawn one's
+            registration.request = (uint64_t(++_requests) << 32) | uint32_t(registration.fd_num);
+            _ring->prepare(IORING_OP_POLL_ADD, registration.fd_num, registration.request).poll32_events = events;
+        }
+        registration.events = events;
+        return;
+    }
+
+    if (registration.rules.empty()) {
+        // the fd may have been closed already, which removes it from the epoll instance
+        if (registration.watched) {
+            ::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_DEL, registration.fd_num, nullptr);
+        }
+        _registrations.erase(registration.fd_num);
+        return;
+    }
+    if (not registration.watched or events == registration.events) {
+        return;
+    }
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = &registration;
+    if (::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_MOD, registration.fd_num, &event) < 0) {
+        // a new fd with the number of one that was closed (and so removed) while its rules were still here
+        SystemCall("epoll_ctl", -1, ENOENT);
+        SystemCall("epoll_ctl", ::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_ADD, registration.fd_num, &event));
+    }
+    registration.events = events;
+}
+
+//! \param[in] registration is the registration of the ready fd
+//! \param[in] revents is the events epoll reported on it
+void EventLoop::_dispatch(Registration &registration, const uint32_t revents) {
+    if (revents & EPOLLERR) {
+        throw runtime_error("EventLoop: error on polled file descriptor");
+    }
 
-            // only check for busy wait if we're not canceling or exiting
-            if (count_before == this_rule.service_count() and this_rule.interest()) {
-                throw runtime_error(
-                    "EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+    // rules may be canceled along the way
+    for (size_t i = 0; i < registration.rules.size();) {
+        const auto rule = registration.rules[i];
+        const bool ready = rule->polled and (revents & static_cast<uint32_t>(rule->direction));
+        if (rule->polled and (revents & EPOLLHUP) and not ready) {
+            // a hangup, and nothing to read or room to write: the fd is defunct, as in _wait_poll()
+            _cancel(rule);
+            continue;
+        }
+        if (ready) {
+            _service(*rule);
+        }
+        i++;
+    }
+}
+
+//! \details Asks each rule whether it's interested, as _wait_poll() does, but tells the kernel what to watch
+//! for only when some rule's interest has changed, and then looks only at the rules on the fds that are ready.
+EventLoop::Result EventLoop::_wait_registered(const int timeout_ms) {
+    bool something_to_poll = false;
+    bool unwatched_ready = false;  // an interested rule on a file epoll won't watch, which is always ready
+
+    for (auto it = _rules.begin(); it != _rules.end();) {  // NOTE: it gets erased or incremented in loop body
+        auto &this_rule = *it;
+        if ((this_rule.direction == Direction::In and this_rule.fd.eof()) or this_rule.fd.closed()) {
+            it = _cancel(it);
+            continue;
+        }
+
+        const bool interested = this_rule.interest();
+        if (interested != this_rule.polled) {
+            this_rule.polled = interested;
+            _mark_dirty(*this_rule.registration);
+        }
+        something_to_poll |= interested;
+        unwatched_ready |= interested and not this_rule.registration->watched;
+        ++it;
+    }
+
+    for (auto *registration : _dirty) {
+        _update(*registration);
+    }
+    _dirty.clear();
+
+    // quit if there is nothing left to poll
+    if (not something_to_poll) {
+        return Result::Exit;
+    }
+
+    try {
+        return _backend == Backend::IoUring ? _wait_io_uring(timeout_ms) : _wait_epoll(timeout_ms, unwatched_ready);
+    } catch (unix_error const &e) {
+        if (e.code().value() == EINTR) {
+            return Result::Exit;
+        }
+        throw;
+    }
+}
+
+//! \param[in] timeout_ms is the timeout value passed to [epoll_wait(2)](\ref man2::epoll_wait)
+//! \param[in] unwatched_ready is whether a rule is interested in a file epoll won't watch, so not to wait
+EventLoop::Result EventLoop::_wait_epoll(const int timeout_ms, const bool unwatched_ready) {
+    _events.resize(max(_registrations.size(), size_t(1)));
+    const int ready_count = SystemCall(
+        "epoll_wait",
+        ::epoll_wait(_epoll->fd_num(), _events.data(), _events.size(), unwatched_ready ? 0 : timeout_ms));
+    if (ready_count == 0 and not unwatched_ready) {
+        return Result::Timeout;
+    }
+
+    for (int i = 0; i < ready_count; i++) {
+        _dispatch(*static_cast<Registration *>(_events[i].data.ptr), _events[i].events);
+    }
+    if (unwatched_ready) {
+        // gathered first, since a callback may add a rule (and so a registration)
+        vector<Registration *> unwatched;
+        for (auto &[fd_num, registration] : _registrations) {
+            if (not registration.watched) {
+                unwatched.push_back(&registration);
             }
         }
+        for (auto *registration : unwatched) {
+            _dispatch(*registration, EPOLLIN | EPOLLOUT);
+        }
+    }
 
-        ++it;  // if we got here, it means we didn't call _rules.erase()
+    return Result::Success;
+}
+
+//! \param[in] timeout_ms is the longest to wait for a poll request to complete
+//! \details The poll requests that _update() prepared are submitted by the same system call that waits.
+EventLoop::Result EventLoop::_wait_io_uring(const int timeout_ms) {
+    if (not _ring->wait(timeout_ms)) {
+        return Result::Timeout;
     }
 
+    // gathered first, since a callback may add a rule (and so a registration)
+    _ready.clear();
+    _ring->take_completions([&](const io_uring_cqe &cqe) {
+        const auto it = _registrations.find(int(uint32_t(cqe.user_data)));
+        if (cqe.user_data == 0 or it == _registrations.end() or it->second.request != cqe.user_data) {
+            return;  // a withdrawn request, or the withdrawal itself
+        }
+        Registration &registration = it->second;
+        if (cqe.res < 0) {
+            throw runtime_error("EventLoop: error on polled file descriptor");
+        }
+        // the request is done, so it's submitted again before the next wait if the rules are still interested
+        registration.request = 0;
+        registration.events = 0;
+        _mark_dirty(registration);
+        _ready.emplace_back(&registration, uint32_t(cqe.res));
+    });
+
+    for (const auto &[registration, revents] : _ready) {
+        _dispatch(*registration, revents);
+    }
     return Result::Success;
 }
@@ -2,11 +2,18 @@
 #define SPONGE_LIBSPONGE_EVENTLOOP_HH
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <list>
+#include <optional>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop {
@@ -17,10 +24,26 @@ class EventLoop {
         Out = POLLOUT  //!< Callback will be triggered when Rule::fd is writable.
     };
 
+    //! Returned by each call to EventLoop::wait_next_event.
+    enum class Result {
+        Success,  //!< At least one Rule was triggered.
+        Timeout,  //!< No rules were triggered before timeout.
+        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
+    };
+
+    //! How the EventLoop waits for its file descriptors
+    enum class Backend {
+        Poll,    //!< [poll(2)](\ref man2::poll) on every rule's fd, set up afresh on each call to wait_next_event
+        Epoll,   //!< [epoll(7)](\ref man7::epoll), with each fd registered once and updated as interest changes
+        IoUring  //!< [io_uring(7)](\ref man7::io_uring) poll requests, submitted along with each wait
+    };
+
   private:
     using CallbackT = std::function<void(void)>;  //!< Callback for ready Rule::fd
     using InterestT = std::function<bool(void)>;  //!< `true` return indicates Rule::fd should be polled.
 
+    struct Registration;
+
     //! \brief Specifies a condition and callback that an EventLoop should handle.
     //! \details Created by calling EventLoop::add_rule() or EventLoop::add_cancelable_rule().
     class Rule {
@@ -31,6 +54,9 @@ class EventLoop {
         InterestT interest;   //!< A callback that returns `true` whenever fd should be polled.
         CallbackT cancel;     //!< A callback that is called when the rule is cancelled (e.g. on hangup)
 
+        bool polled = false;                   //!< Whether Rule::interest returned `true` (epoll and io_uring)
+        Registration *registration = nullptr;  //!< The registration of Rule::fd (epoll and io_uring)
+
         //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
         //! \details This function is used internally by EventLoop; you will not need to call it
         unsigned int service_count() const;
@@ -38,14 +64,67 @@ class EventLoop {
 
     std::list<Rule> _rules{};  //!< All rules that have been added and not canceled.
 
-  public:
-    //! Returned by each call to EventLoop::wait_next_event.
-    enum class Result {
-        Success,  //!< At least one Rule was triggered.
-        Timeout,  //!< No rules were triggered before timeout.
-        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
+    //! \brief A file descriptor registered with epoll or io_uring, and the rules on it
+    //! \details A FileDescriptor's duplicates share its number, so all the rules on one fd (e.g., one to
+    //! read it and one to write it) share a registration, which watches for the events they want.
+    //!
+    //! With io_uring, the registration is a one-shot poll request, which the kernel completes as soon as
+    //! the fd is ready (at once, if it already is), so the request is submitted again after each event.
+    struct Registration {
+        int fd_num = -1;                                 //!< The file descriptor
+        uint32_t events = 0;                             //!< The events epoll or the poll request watches for
+        uint64_t request = 0;                            //!< The poll request in flight, if any (io_uring)
+        bool watched = true;                             //!< `false` for a file epoll won't watch (always ready)
+        bool dirty = false;                              //!< Whether the rules changed since it was last updated
+        std::vector<std::list<Rule>::iterator> rules{};  //!< The rules on the fd
     };
 
+    Backend _backend;
+
+    std::optional<FileDescriptor> _epoll{};                     //!< The epoll instance (epoll backend)
+    std::optional<IoUring> _ring{};                             //!< The io_uring (io_uring backend)
+    std::unordered_map<int, Registration> _registrations{};     //!< By file descriptor (epoll and io_uring)
+    std::vector<Registration *> _dirty{};                       //!< Registrations to update (epoll and io_uring)
+    std::vector<epoll_event> _events{};                         //!< Ready events (epoll backend)
+    std::vector<std::pair<Registration *, uint32_t>> _ready{};  //!< Ready fds and their events (io_uring)
+    uint32_t _requests = 0;                                     //!< Poll requests submitted (io_uring)
+
+    //! Cancel a rule and delete it, returning the next
+    std::list<Rule>::iterator _cancel(std::list<Rule>::iterator rule);
+
+    //! Call a ready rule's callback, and check that it didn't leave the rule busy waiting
+    static void _service(const Rule &rule);
+
+    //! Mark a registration to be brought up to date before the next wait
+    void _mark_dirty(Registration &registration);
+
+    //! Bring the kernel's registration of a fd up to date with its rules' interest, or remove it if it has none
+    void _update(Registration &registration);
+
+    //! Call ready rules' callbacks for the events `revents` on a registered fd
+    void _dispatch(Registration &registration, const uint32_t revents);
+
+    //! wait_next_event() with the poll backend
+    Result _wait_poll(const int timeout_ms);
+
+    //! wait_next_event() with the epoll or io_uring backend
+    Result _wait_registered(const int timeout_ms);
+
+    //! Wait for registered fds to be ready, and call their rules' callbacks (epoll backend)
+    Result _wait_epoll(const int timeout_ms, const bool unwatched_ready);
+
+    //! Wait for poll requests to complete, and call their fds' rules' callbacks (io_uring backend)
+    Result _wait_io_uring(const int timeout_ms);
+
+  public:
+    //! \brief Construct with the given backend
+    //! \details Backend::IoUring falls back to Backend::Poll where the kernel won't set up an io_uring
+    //! (see IoUring::available()).
+    explicit EventLoop(const Backend backend = Backend::Poll);
+
+    //! The backend in use
+    Backend backend() const { return _backend; }
+
     //! Add a rule whose callback will be called when `fd` is ready in the specified Direction.
     void add_rule(const FileDescriptor &fd,
                   const Direction direction,
@@ -53,8 +132,19 @@ class EventLoop {
                   const InterestT &interest = [] { return true; },
                   const CallbackT &cancel = [] {});
 
-    //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+    //! Calls [poll(2)](\ref man2::poll) or [epoll_wait(2)](\ref man2::epoll_wait) and then executes callback
+    //! for each ready fd.
     Result wait_next_event(const int timeout_ms);
+
+    //! \name
+    //! Rules refer to each other's places in the EventLoop, so it can't be copied or moved
+
+    //!@{
+    EventLoop(const EventLoop &other) = delete;
+    EventLoop &operator=(const EventLoop &other) = delete;
+    EventLoop(EventLoop &&other) = delete;
+    EventLoop &operator=(EventLoop &&other) = delete;
+    //!@}
 };
 
 using Direction = EventLoop::Direction;
@@ -72,5 +162,15 @@ using Direction = EventLoop::Direction;
 //! A Rule installed using EventLoop::add_cancelable_rule will be polled and canceled under the
 //! same conditions, with the additional condition that if Rule::callback returns `true`, the
 //! Rule will be canceled.
+//!
+//! With Backend::Epoll, the EventLoop still asks every Rule::interest on each call, since interest
+//! can depend on anything, but it keeps each fd registered with the kernel between calls and updates
+//! the registration only when interest changes, and a ready event leads straight to the rules on its
+//! fd. With Backend::Poll, each call passes every fd to the kernel and then looks at every rule.
+//!
+//! Backend::IoUring keeps each fd registered in the same way, as a poll request to the kernel through an
+//! IoUring. The requests for fds whose interest changed or that were just ready go to the kernel in the same
+//! [io_uring_enter(2)](\ref man2::io_uring_enter) call that waits, so each call to wait_next_event makes one
+//! system call however many fds change.
 
 #endif  // SPONGE_LIBSPONGE_EVENTLOOP_HH
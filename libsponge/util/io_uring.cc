@@ -0,0 +1,276 @@
+#include "io_uring.hh"
+
+#include "util.hh"
+
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+//! The features of the kernel's io_uring that IoUring relies on
+constexpr unsigned REQUIRED_FEATURES = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+//! Read a head or tail that the kernel advances
+unsigned load_acquire(const unsigned *position) { return __atomic_load_n(position, __ATOMIC_ACQUIRE); }
+
+//! Advance a head or tail that the kernel reads
+void store_release(unsigned *position, const unsigned value) { __atomic_store_n(position, value, __ATOMIC_RELEASE); }
+
+//! Call [io_uring_setup(2)](\ref man2::io_uring_setup)
+int setup(const unsigned entries, io_uring_params &params) {
+    params.flags |= IORING_SETUP_CQSIZE;
+    params.cq_entries = 4 * entries;
+    return SystemCall("io_uring_setup", int(::syscall(__NR_io_uring_setup, entries, &params)));
+}
+
+//! Call [io_uring_register(2)](\ref man2::io_uring_register)
+int register_with(const int ring_fd, const unsigned opcode, const void *arg, const unsigned nr_args) {
+    return SystemCall("io_uring_register", int(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args)));
+}
+
+//! Map memory that the kernel shares with a ring
+void *map(const int fd, const size_t size, const off_t offset) {
+    void *address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (address == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    return address;
+}
+
+}  // namespace
+
+void IoUring::Unmap::operator()(void *address) const {
+    if (::munmap(address, size) < 0) {
+        cerr << "Warning: munmap of io_uring memory failed\n";
+    }
+}
+
+//! \param[in] entries is the size of the submission queue (rounded up by the kernel to a power of two)
+IoUring::IoUring(const unsigned entries) : IoUring(entries, io_uring_params{}) {}
+
+//! \param[in] entries is the size of the submission queue
+//! \param[in] params receives the ring's parameters from [io_uring_setup(2)](\ref man2::io_uring_setup)
+IoUring::IoUring(const unsigned entries, io_uring_params &&params)
+    : FileDescriptor(setup(entries, params)), _rings(nullptr, {0}), _sqes(nullptr, {0}) {
+    if ((params.features & REQUIRED_FEATURES) != REQUIRED_FEATURES) {
+        throw runtime_error("IoUring: the kernel's io_uring lacks needed features");
+    }
+
+    // both queues' rings share one mapping
+    const size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const size_t rings_size = max(sq_ring_size, cq_ring_size);
+    _rings = Mapping(map(fd_num(), rings_size, IORING_OFF_SQ_RING), {rings_size});
+    const size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = Mapping(map(fd_num(), sqes_size, IORING_OFF_SQES), {sqes_size});
+
+    char *const rings = static_cast<char *>(_rings.get());
+    _sq_head = reinterpret_cast<unsigned *>(rings + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned *>(rings + params.sq_off.tail);
+    _sq_flags = reinterpret_cast<unsigned *>(rings + params.sq_off.flags);
+    _sq_mask = *reinterpret_cast<unsigned *>(rings + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sqe_array = static_cast<io_uring_sqe *>(_sqes.get());
+
+    _cq_head = reinterpret_cast<unsigned *>(rings + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned *>(rings + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<unsigned *>(rings + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe *>(rings + params.cq_off.cqes);
+
+    // each position in the submission queue always holds the entry of the same index
+    unsigned *const array = reinterpret_cast<unsigned *>(rings + params.sq_off.array);
+    for (unsigned i = 0; i < _sq_entries; i++) {
+        array[i] = i;
+    }
+}
+
+//! \details Sets up a small ring to see, and asks it which operations the kernel supports: the multishot
+//! receives and buffer rings that IoUring::BufferRing is for came in Linux 6.0, along with
+//! `IORING_OP_SEND_ZC`, the latest operation `<linux/io_uring.h>` may name here.
+bool IoUring::available() {
+    static const bool result = [] {
+        try {
+            const IoUring ring{1};
+            vector<char> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+            auto *const probe = reinterpret_cast<io_uring_probe *>(probe_storage.data());
+            register_with(ring.fd_num(), IORING_REGISTER_PROBE, probe, 256);
+            return probe->last_op >= IORING_OP_SEND_ZC;
+        } catch (const exception &) {
+            return false;
+        }
+    }();
+    return result;
+}
+
+//! \param[in] to_submit is the number of submissions to hand the kernel
+//! \param[in] min_complete is the number of completions to wait for
+//! \param[in] flags is the `IORING_ENTER_*` flags
+//! \param[in] arg is the io_uring_getevents_arg, with `IORING_ENTER_EXT_ARG`
+int IoUring::_enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags, const void *arg) {
+    register_write();
+    const size_t arg_size = (flags & IORING_ENTER_EXT_ARG) ? sizeof(io_uring_getevents_arg) : 0;
+    return int(::syscall(__NR_io_uring_enter, fd_num(), to_submit, min_complete, flags, arg, arg_size));
+}
+
+//! \param[in] opcode is the operation (`IORING_OP_*`)
+//! \param[in] fd is the file descriptor to operate on (-1 for none)
+//! \param[in] user_data is what the completion will carry, to say which request it completes
+io_uring_sqe &IoUring::prepare(const uint8_t opcode, const int fd, const uint64_t user_data) {
+    if (unsubmitted() == _sq_entries) {
+        submit();
+    }
+    const unsigned tail = *_sq_tail;
+    io_uring_sqe &sqe = _sqe_array[tail & _sq_mask];
+    sqe = {};
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.user_data = user_data;
+    // without a kernel thread polling the queue, the kernel looks at the tail only in io_uring_enter
+    store_release(_sq_tail, tail + 1);
+    return sqe;
+}
+
+unsigned IoUring::unsubmitted() const { return *_sq_tail - load_acquire(_sq_head); }
+
+void IoUring::submit() {
+    const unsigned count = unsubmitted();
+    if (count > 0) {
+        SystemCall("io_uring_enter", _enter(count, 0, 0, nullptr));
+    }
+}
+
+//! \param[in] timeout_ms is the longest to wait, or negative to wait until a completion arrives
+bool IoUring::wait(const int timeout_ms) {
+    if (completions_waiting()) {
+        submit();
+        return true;
+    }
+
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    }
+    // ETIME means the timeout expired first
+    SystemCall(
+        "io_uring_enter", _enter(unsubmitted(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg), ETIME);
+    return completions_waiting();
+}
+
+bool IoUring::completions_waiting() const { return load_acquire(_cq_tail) != *_cq_head; }
+
+//! \param[in] handler is called with each completion, after it has left the queue (so `handler` may prepare
+//!                    and submit more requests)
+size_t IoUring::take_completions(const function<void(const io_uring_cqe &)> &handler) {
+    register_read();
+    size_t count = 0;
+    while (true) {
+        unsigned head = *_cq_head;
+        const unsigned tail = load_acquire(_cq_tail);
+        if (head == tail) {
+            // completions that didn't fit in the queue wait in the kernel until an io_uring_enter fetches them
+            if (not(load_acquire(_sq_flags) & IORING_SQ_CQ_OVERFLOW)) {
+                break;
+            }
+            SystemCall("io_uring_enter", _enter(0, 0, IORING_ENTER_GETEVENTS, nullptr));
+            continue;
+        }
+        for (; head != tail; head++) {
+            const io_uring_cqe cqe = _cqes[head & _cq_mask];
+            store_release(_cq_head, head + 1);
+            handler(cqe);
+            count++;
+        }
+    }
+    return count;
+}
+
+//! \param[in] user_data is what the cancellation's completion will carry
+void IoUring::cancel_all(const uint64_t user_data) {
+    io_uring_sqe &sqe = prepare(IORING_OP_ASYNC_CANCEL, -1, user_data);
+    sqe.cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    submit();
+}
+
+//! \param[in] buffers are the buffers to register, in index order
+void IoUring::register_buffers(const vector<iovec> &buffers) {
+    register_with(fd_num(), IORING_REGISTER_BUFFERS, buffers.data(), buffers.size());
+}
+
+//! \param[in] ring is the IoUring to register the buffers with
+//! \param[in] group is the buffer group ID that receives will name
+//! \param[in] count is the number of buffers
+//! \param[in] buffer_size is the size of each buffer
+IoUring::BufferRing::BufferRing(const IoUring &ring,
+                                const uint16_t group,
+                                const uint16_t count,
+                                const size_t buffer_size)
+    : _ring(ring.duplicate())
+    , _entries(nullptr, {count * sizeof(io_uring_buf)})
+    , _storage(count * buffer_size, 0)
+    , _buffer_size(buffer_size)
+    , _count(count)
+    , _group(group) {
+    if (count == 0 or (count & (count - 1)) != 0 or count > 32768) {
+        throw runtime_error("IoUring::BufferRing: the number of buffers must be a power of two, up to 32768");
+    }
+
+    // the ring of descriptors must be page-aligned
+    void *const entries =
+        ::mmap(nullptr, count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (entries == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    _entries.reset(entries);
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(entries);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    register_with(_ring.fd_num(), IORING_REGISTER_PBUF_RING, &registration, 1);
+
+    for (uint16_t id = 0; id < count; id++) {
+        recycle(id);
+    }
+}
+
+IoUring::BufferRing::~BufferRing() {
+    try {
+        io_uring_buf_reg registration{};
+        registration.bgid = _group;
+        register_with(_ring.fd_num(), IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing IoUring::BufferRing: " << e.what() << endl;
+    }
+}
+
+//! \param[in] id is the buffer
+//! \param[in] length is how much of it was filled
+string_view IoUring::BufferRing::buffer(const uint16_t id, const size_t length) const {
+    if (id >= _count or length > _buffer_size) {
+        throw runtime_error("IoUring::BufferRing: no such buffer");
+    }
+    return {_storage.data() + id * _buffer_size, length};
+}
+
+//! \param[in] id is the buffer to hand back
+void IoUring::BufferRing::recycle(const uint16_t id) {
+    // not io_uring_buf_ring::bufs, which C++ places after the empty struct that <linux/io_uring.h> declares it with
+    auto *const entries = static_cast<io_uring_buf *>(_entries.get());
+    io_uring_buf &entry = entries[_tail & (_count - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(_storage.data() + id * _buffer_size);
+    entry.len = _buffer_size;
+    entry.bid = id;
+    // the tail shares the first descriptor's reserved field; the kernel reads it to find new buffers
+    _tail++;
+    __atomic_store_n(&entries[0].resv, _tail, __ATOMIC_RELEASE);
+}
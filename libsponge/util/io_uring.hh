@@ -0,0 +1,171 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <linux/io_uring.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+//! \brief An [io_uring(7)](\ref man7::io_uring): a queue of requests to the kernel and a queue of their completions,
+//! both in memory shared with the kernel
+//! \details Requests are written into the submission queue with prepare(), and handed to the kernel, as many at
+//! a time as are waiting, by submit() or wait(). The kernel posts a completion for each to the completion queue,
+//! where take_completions() finds it without a system call. The ring's file descriptor is readable while
+//! completions are waiting, so an EventLoop can wait for them as for any other file descriptor.
+//!
+//! read_count() counts the calls to take_completions(), and write_count() the calls to
+//! [io_uring_enter(2)](\ref man2::io_uring_enter), the only system call a ring makes once it is set up.
+class IoUring : public FileDescriptor {
+  public:
+    //! Submission queue entries, unless told otherwise
+    static constexpr unsigned DEFAULT_ENTRIES = 256;
+
+    class BufferRing;
+
+  private:
+    //! Unmaps memory shared with the kernel
+    struct Unmap {
+        size_t size;  //!< Size of the mapping
+
+        //! Unmap the mapping at `address`
+        void operator()(void *address) const;
+    };
+
+    //! Memory shared with the kernel
+    using Mapping = std::unique_ptr<void, Unmap>;
+
+    Mapping _rings;  //!< The submission and completion queues' heads, tails and flags, and the completions
+    Mapping _sqes;   //!< The submission queue entries
+
+    unsigned *_sq_head = nullptr;   //!< The first submission the kernel hasn't consumed (kernel's to advance)
+    unsigned *_sq_tail = nullptr;   //!< After the last submission prepared (ours to advance)
+    unsigned *_sq_flags = nullptr;  //!< The kernel's `IORING_SQ_*` flags
+    unsigned _sq_mask = 0;          //!< Maps a position in the submission queue to an index
+    unsigned _sq_entries = 0;       //!< Size of the submission queue
+
+    io_uring_sqe *_sqe_array = nullptr;  //!< The submission queue entries
+
+    unsigned *_cq_head = nullptr;   //!< The first completion not yet taken (ours to advance)
+    unsigned *_cq_tail = nullptr;   //!< After the last completion posted (kernel's to advance)
+    unsigned _cq_mask = 0;          //!< Maps a position in the completion queue to an index
+    io_uring_cqe *_cqes = nullptr;  //!< The completion queue entries
+
+    //! Set up the ring, with the parameters the kernel returns in `params`
+    IoUring(const unsigned entries, io_uring_params &&params);
+
+    //! Call [io_uring_enter(2)](\ref man2::io_uring_enter), counted in write_count()
+    int _enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags, const void *arg);
+
+  public:
+    //! \brief Set up a ring with `entries` submission queue entries (and four times as many for completions)
+    //! \note Throws unix_error if the kernel won't set one up, and std::runtime_error if it lacks a feature
+    //! the ring relies on; see available().
+    explicit IoUring(const unsigned entries = DEFAULT_ENTRIES);
+
+    //! \brief Whether the kernel will set up a ring with everything IoUring needs (Linux 6.0 or later, with
+    //! io_uring not disabled by `kernel.io_uring_disabled` or a seccomp filter)
+    static bool available();
+
+    //! \brief A cleared submission queue entry for operation `opcode` on `fd`, for the caller to fill in
+    //! \details The entry is submitted by the next submit() or wait(), or by prepare() itself if the
+    //! submission queue has filled up. The completion will carry `user_data`.
+    io_uring_sqe &prepare(const uint8_t opcode, const int fd, const uint64_t user_data);
+
+    //! \brief Submissions prepared but not yet handed to the kernel
+    unsigned unsubmitted() const;
+
+    //! \brief Hand the kernel the submissions prepared since the last submit() or wait()
+    void submit();
+
+    //! \brief Submit, then wait up to `timeout_ms` (forever, if negative) for a completion
+    //! \returns whether a completion is waiting, which it isn't only after a timeout
+    //! \note Throws unix_error on a signal (EINTR), as other waits do
+    bool wait(const int timeout_ms);
+
+    //! \brief Whether completions are waiting to be taken
+    bool completions_waiting() const;
+
+    //! \brief Take every completion waiting, in the order the kernel posted them, handing each to `handler`
+    //! \returns the number of completions taken
+    size_t take_completions(const std::function<void(const io_uring_cqe &)> &handler);
+
+    //! \brief Ask the kernel to cancel every request in flight; each still completes, most with `-ECANCELED`
+    //! \details The cancellation's own completion carries `user_data`.
+    void cancel_all(const uint64_t user_data);
+
+    //! \brief Register `buffers` with the kernel (`IORING_REGISTER_BUFFERS`), for fixed reads and writes
+    //! \details A fixed read or write (`IORING_OP_READ_FIXED`, `IORING_OP_WRITE_FIXED`) names a registered buffer
+    //! by its index, and the kernel, which has kept the buffer's pages pinned since registration, doesn't look
+    //! them up again for each operation.
+    //! \note The pages count against `RLIMIT_MEMLOCK`.
+    void register_buffers(const std::vector<iovec> &buffers);
+
+    //! \name
+    //! The kernel shares memory with the ring, so it can't be copied or moved
+
+    //!@{
+    IoUring(const IoUring &other) = delete;
+    IoUring &operator=(const IoUring &other) = delete;
+    IoUring(IoUring &&other) = delete;
+    IoUring &operator=(IoUring &&other) = delete;
+    //!@}
+};
+
+//! \brief Buffers provided to the kernel for receives to fill as data arrive (`IORING_REGISTER_PBUF_RING`)
+//! \details A receive with `IOSQE_BUFFER_SELECT` in the ring's group() picks a buffer only when data arrive,
+//! so that a multishot receive, which completes again for every datagram, needs no buffer of its own in the
+//! meantime. The completion names the buffer (see buffer_id()), which is the receiver's until recycle()
+//! hands it back to the kernel.
+class IoUring::BufferRing {
+  private:
+    FileDescriptor _ring;  //!< The IoUring the buffers are registered with
+
+    Mapping _entries;      //!< The ring of buffer descriptors the kernel takes buffers from
+    std::string _storage;  //!< The buffers, back to back
+    size_t _buffer_size;   //!< Size of each buffer
+    uint16_t _count;       //!< Number of buffers (a power of two)
+    uint16_t _group;       //!< Buffer group ID
+    uint16_t _tail = 0;    //!< After the last buffer handed to the kernel
+
+  public:
+    //! \brief Register `count` buffers of `buffer_size` bytes as group `group` of `ring`, all available to it
+    //! \note `count` must be a power of two, no more than 32768.
+    BufferRing(const IoUring &ring, const uint16_t group, const uint16_t count, const size_t buffer_size);
+
+    //! Unregisters the buffers, so that no receive fills them any more
+    ~BufferRing();
+
+    //! \brief The buffer group ID, for `io_uring_sqe::buf_group`
+    uint16_t group() const { return _group; }
+
+    //! \brief Size of each buffer
+    size_t buffer_size() const { return _buffer_size; }
+
+    //! \brief The ID of the buffer a completion filled (which must carry `IORING_CQE_F_BUFFER`)
+    static uint16_t buffer_id(const io_uring_cqe &cqe) { return cqe.flags >> IORING_CQE_BUFFER_SHIFT; }
+
+    //! \brief The first `length` bytes of buffer `id`
+    std::string_view buffer(const uint16_t id, const size_t length) const;
+
+    //! \brief Hand buffer `id` back to the kernel, to be filled again
+    void recycle(const uint16_t id);
+
+    //! \name
+    //! The kernel shares memory with the ring, so it can't be copied or moved
+
+    //!@{
+    BufferRing(const BufferRing &other) = delete;
+    BufferRing &operator=(const BufferRing &other) = delete;
+    BufferRing(BufferRing &&other) = delete;
+    BufferRing &operator=(BufferRing &&other) = delete;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
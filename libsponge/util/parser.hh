@@ -5,7 +5,11 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <endian.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 
 //! The result of parsing or unparsing an IP datagram, TCP segment, Ethernet frame, or ARP message
@@ -39,6 +43,9 @@ class NetParser {
 
     Buffer buffer() const { return _buffer; }
 
+    //! View the unparsed bytes in place (without copying the Buffer)
+    std::string_view str() const { return _buffer.str(); }
+
     //! Get the current value stored in BaseParser::_error
     ParseResult get_error() const { return _error; }
 
@@ -62,6 +69,41 @@ class NetParser {
     void remove_prefix(const size_t n);
 };
 
+//! \brief Compile-time descriptor of an integer field at a fixed offset in a header (network byte order)
+//! \details For headers with a fixed layout, check the length once and then decode each field
+//! straight from memory, rather than pulling fields one at a time through a NetParser:
+//!
+//! ~~~{.cpp}
+//! constexpr NetField<uint16_t, 2> total_length{};
+//! static_assert(total_length.end <= IPv4Header::LENGTH);
+//! ...
+//! const uint16_t len = total_length.get(data);  // caller has checked that `data` holds the header
+//! ~~~
+template <typename T, size_t Offset>
+struct NetField {
+    static_assert(std::is_same_v<T, uint8_t> or std::is_same_v<T, uint16_t> or std::is_same_v<T, uint32_t>,
+                  "NetField must be a uint8_t, uint16_t, or uint32_t");
+
+    static constexpr size_t offset = Offset;           //!< Position of the field's first byte
+    static constexpr size_t end = Offset + sizeof(T);  //!< Minimum header length that contains the field
+
+    //! Decode the field from `data`, which must hold at least `end` bytes
+    static T get(const uint8_t *data) {
+        T ret;
+        std::memcpy(&ret, data + Offset, sizeof(T));
+        if constexpr (sizeof(T) == 4) {
+            return be32toh(ret);
+        } else if constexpr (sizeof(T) == 2) {
+            return be16toh(ret);
+        } else {
+            return ret;
+        }
+    }
+};
+
+//! View the bytes of a string as unsigned octets, for use with NetField
+inline const uint8_t *as_octets(const std::string_view str) { return reinterpret_cast<const uint8_t *>(str.data()); }
+
 struct NetUnparser {
     template <typename T>
     static void _unparse_int(std::string &s, T val);
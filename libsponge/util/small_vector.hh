@@ -0,0 +1,124 @@
+#ifndef SPONGE_LIBSPONGE_SMALL_VECTOR_HH
+#define SPONGE_LIBSPONGE_SMALL_VECTOR_HH
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//! \brief A sequence that keeps up to `N` elements inline, only using the heap when it grows past that
+//! \details Supports what a queue of packet pieces needs: appending at the back, removing from the front,
+//! and iteration. Removed elements are reset to `T{}`, so `T` must be default-constructible.
+template <typename T, size_t N>
+class SmallVector {
+  private:
+    std::array<T, N> _inline{};  //!< Elements, until there are too many
+    std::vector<T> _heap{};      //!< Elements, once they've spilled out of `_inline`
+    bool _spilled = false;       //!< Whether the elements are in `_heap`
+    size_t _begin = 0;           //!< Index of the first element
+    size_t _end = 0;             //!< Index one past the last element
+
+    T *_data() { return _spilled ? _heap.data() : _inline.data(); }
+    const T *_data() const { return _spilled ? _heap.data() : _inline.data(); }
+
+    //! Move the elements down to index 0
+    void _compact() {
+        T *const data = _data();
+        for (size_t i = _begin; i < _end; i++) {
+            data[i - _begin] = std::move(data[i]);
+            data[i] = T{};
+        }
+        _end -= _begin;
+        _begin = 0;
+        if (_spilled) {
+            _heap.resize(_end);
+        }
+    }
+
+    //! Make room to append one more element
+    void _make_room() {
+        if (_spilled) {
+            if (_begin > size()) {
+                _compact();
+            }
+            return;
+        }
+        if (_end < N) {
+            return;
+        }
+        if (_begin > 0) {
+            _compact();
+            return;
+        }
+        _heap.reserve(2 * N);
+        for (auto &x : _inline) {
+            _heap.push_back(std::move(x));
+            x = T{};
+        }
+        _spilled = true;
+    }
+
+  public:
+    //! \name Size
+    //!@{
+    size_t size() const { return _end - _begin; }
+    bool empty() const { return _begin == _end; }
+    //!@}
+
+    //! \name Element access
+    //!@{
+    T &operator[](const size_t n) { return _data()[_begin + n]; }
+    const T &operator[](const size_t n) const { return _data()[_begin + n]; }
+
+    T &front() { return (*this)[0]; }
+    const T &front() const { return (*this)[0]; }
+
+    T &back() { return (*this)[size() - 1]; }
+    const T &back() const { return (*this)[size() - 1]; }
+    //!@}
+
+    //! \name Iteration
+    //!@{
+    T *begin() { return _data() + _begin; }
+    T *end() { return _data() + _end; }
+    const T *begin() const { return _data() + _begin; }
+    const T *end() const { return _data() + _end; }
+    //!@}
+
+    //! \name Modifiers
+    //!@{
+    void push_back(T value) {
+        _make_room();
+        if (_spilled) {
+            _heap.push_back(std::move(value));
+        } else {
+            _inline[_end] = std::move(value);
+        }
+        _end++;
+    }
+
+    void pop_front() {
+        if (empty()) {
+            throw std::out_of_range("SmallVector::pop_front");
+        }
+        _data()[_begin] = T{};
+        _begin++;
+        if (empty()) {
+            clear();
+        }
+    }
+
+    //! \note Keeps any heap capacity for reuse
+    void clear() {
+        for (auto &x : *this) {
+            x = T{};
+        }
+        _heap.clear();
+        _spilled = false;
+        _begin = _end = 0;
+    }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_SMALL_VECTOR_HH
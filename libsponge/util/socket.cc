@@ -2,12 +2,38 @@
 
 #include "util.hh"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <unistd.h>
 
 using namespace std;
 
+namespace {
+
+//! user_data of UDPIoUring's multishot receive, and of its cancellation (a send's is its slot's index)
+constexpr uint64_t UDP_RECEIVE = UINT64_MAX, UDP_CANCEL = UINT64_MAX - 1;
+
+//! Have the kernel split the datagram `message` sends into datagrams of `segment_size` (UDP GSO)
+void set_segment_size(msghdr &message, UDPSocket::ControlBuffer &control, const uint16_t segment_size) {
+    message.msg_control = &control;
+    message.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(uint16_t));
+}
+
+}  // namespace
+
 // default constructor for socket of (subclassed) domain and type
 //! \param[in] domain is as described in [socket(7)](\ref man7::socket), probably `AF_INET` or `AF_UNIX`
 //! \param[in] type is as described in [socket(7)](\ref man7::socket)
@@ -141,6 +167,324 @@ void UDPSocket::send(const BufferViewList &payload) {
     register_write();
 }
 
+//! \param[in] capacity is the most datagrams one recv_batch() takes
+//! \param[in] mtu is the largest datagram a slot holds
+UDPSocket::RecvRing::RecvRing(const size_t capacity, const size_t mtu)
+    : _mtu(mtu)
+    , _storage(capacity * mtu, 0)
+    , _addresses(capacity)
+    , _iovecs(capacity)
+    , _headers(capacity)
+    , _controls(capacity)
+    , _segment_sizes(capacity) {}
+
+//! \param[in] i is the index of the datagram, less than size()
+string_view UDPSocket::RecvRing::payload(const size_t i) const {
+    if (i >= _count) {
+        throw out_of_range("UDPSocket::RecvRing::payload(): no such datagram");
+    }
+    return {&_storage[i * _mtu], _headers[i].msg_len};
+}
+
+//! \param[in] i is the index of the datagram, less than size()
+Address UDPSocket::RecvRing::source_address(const size_t i) const {
+    if (i >= _count) {
+        throw out_of_range("UDPSocket::RecvRing::source_address(): no such datagram");
+    }
+    return {_addresses[i], _headers[i].msg_hdr.msg_namelen};
+}
+
+//! \param[in] i is the index of the datagram, less than size()
+size_t UDPSocket::RecvRing::segment_size(const size_t i) const {
+    if (i >= _count) {
+        throw out_of_range("UDPSocket::RecvRing::segment_size(): no such datagram");
+    }
+    return _segment_sizes[i];
+}
+
+//! \details On a blocking socket this waits only for the first datagram, then takes whichever others are
+//! already waiting. On a non-blocking socket it doesn't wait at all.
+//! \param[in] ring holds the datagrams received, in place of those of the last recv_batch() into it
+//! \returns the number of datagrams received, which is zero if none was waiting on a non-blocking socket
+//! \note If a datagram is too big for a slot of the ring, this method throws a std::runtime_error
+size_t UDPSocket::recv_batch(RecvRing &ring) {
+    ring._count = 0;
+    for (size_t i = 0; i < ring.capacity(); i++) {
+        ring._iovecs[i] = {&ring._storage[i * ring._mtu], ring._mtu};
+        ring._headers[i] = {};
+        ring._headers[i].msg_hdr.msg_name = static_cast<sockaddr *>(ring._addresses[i]);
+        ring._headers[i].msg_hdr.msg_namelen = sizeof(Address::Raw::storage);
+        ring._headers[i].msg_hdr.msg_iov = &ring._iovecs[i];
+        ring._headers[i].msg_hdr.msg_iovlen = 1;
+        ring._headers[i].msg_hdr.msg_control = &ring._controls[i];
+        ring._headers[i].msg_hdr.msg_controllen = sizeof(ControlBuffer);
+    }
+
+    // MSG_TRUNC reports each datagram's real length, so that an oversized one can be detected
+    const int received = SystemCall(
+        "recvmmsg",
+        ::recvmmsg(fd_num(), ring._headers.data(), ring.capacity(), MSG_TRUNC | MSG_WAITFORONE, nullptr),
+        EAGAIN);
+    register_read();
+    if (received < 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < received; i++) {
+        msghdr &message = ring._headers[i].msg_hdr;
+        if (ring._headers[i].msg_len > ring._mtu) {
+            throw runtime_error("recvmmsg (oversized datagram)");
+        }
+        ring._segment_sizes[i] = 0;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+                int segment_size = 0;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                ring._segment_sizes[i] = segment_size;
+            }
+        }
+    }
+    ring._count = received;
+    return ring._count;
+}
+
+//! \details A payload with a segment size goes out (if longer) as a UDP GSO datagram, which the kernel
+//! splits into datagrams of that size, the last possibly shorter. It may be split into at most
+//! MAX_GSO_SEGMENTS and must fit in MAX_PAYLOAD_SIZE.
+//! \param[in] destination is the Address to send to
+//! \param[in] payloads holds the datagram payloads to send
+//! \param[in] first is the index of the first payload to send
+//! \param[in] segment_sizes is empty, or holds the segment size of each payload (0: don't split it)
+//! \returns the number of payloads sent, which is fewer than asked for only if the socket is non-blocking
+//! and its send buffer filled up
+size_t UDPSocket::send_batch(const Address &destination,
+                             const vector<BufferList> &payloads,
+                             const size_t first,
+                             const vector<uint16_t> &segment_sizes) {
+    if (not segment_sizes.empty() and segment_sizes.size() != payloads.size()) {
+        throw runtime_error("UDPSocket::send_batch(): a segment size for some payloads but not others");
+    }
+
+    size_t sent = 0;
+    vector<iovec> iovecs;
+    vector<mmsghdr> headers;
+    vector<ControlBuffer> controls;
+    while (first + sent < payloads.size()) {
+        const size_t begin = first + sent;
+        const size_t end = min(payloads.size(), begin + UIO_MAXIOV);
+
+        iovecs.clear();
+        headers.assign(end - begin, {});
+        controls.assign(end - begin, {});
+        for (size_t i = begin; i < end; i++) {
+            for (const auto &buffer : payloads[i].buffers()) {
+                iovecs.push_back({const_cast<char *>(buffer.str().data()), buffer.size()});
+            }
+        }
+        // the iovecs are all in place, so their addresses are settled
+        size_t iovec_index = 0;
+        for (size_t i = begin; i < end; i++) {
+            msghdr &message = headers[i - begin].msg_hdr;
+            message.msg_name = const_cast<sockaddr *>(static_cast<const sockaddr *>(destination));
+            message.msg_namelen = destination.size();
+            message.msg_iov = &iovecs[iovec_index];
+            message.msg_iovlen = payloads[i].buffers().size();
+            iovec_index += message.msg_iovlen;
+
+            if (not segment_sizes.empty() and segment_sizes[i] > 0) {
+                set_segment_size(message, controls[i - begin], segment_sizes[i]);
+            }
+        }
+
+        const int count = SystemCall("sendmmsg", ::sendmmsg(fd_num(), headers.data(), headers.size(), 0), EAGAIN);
+        register_write();
+        if (count <= 0) {
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (headers[i].msg_len != payloads[begin + i].size()) {
+                throw runtime_error("datagram payload too big for sendmmsg()");
+            }
+        }
+        sent += count;
+    }
+    return sent;
+}
+
+//! \details Coalesced datagrams are received as one, of up to MAX_PAYLOAD_SIZE bytes, which
+//! RecvRing::segment_size() tells how to split. Only recv_batch() reports the segment size.
+//! \param[in] enabled is whether the kernel may coalesce datagrams
+//! \note Throws std::runtime_error if the kernel doesn't support UDP GRO (before Linux 5.0)
+void UDPSocket::set_gro(const bool enabled) { setsockopt(SOL_UDP, UDP_GRO, int(enabled)); }
+
+//! \param[in] socket is the UDP socket to receive from and send on
+//! \param[in] capacity is the number of buffers to receive into, a power of two
+//! \param[in] mtu is the largest payload a buffer holds
+UDPIoUring::UDPIoUring(const UDPSocket &socket, const uint16_t capacity, const size_t mtu)
+    : _socket(socket.duplicate())
+    , _ring()
+    , _buffers(_ring,
+               0,
+               capacity,
+               sizeof(io_uring_recvmsg_out) + sizeof(Address::Raw::storage) + sizeof(UDPSocket::ControlBuffer) + mtu) {
+    _receive_header.msg_namelen = sizeof(Address::Raw::storage);
+    _receive_header.msg_controllen = sizeof(UDPSocket::ControlBuffer);
+    _receive();
+    _ring.submit();
+}
+
+UDPIoUring::~UDPIoUring() {
+    try {
+        _ring.cancel_all(UDP_CANCEL);
+        while (_receiving or _sends_in_flight > 0) {
+            _ring.wait(-1);
+            _ring.take_completions([&](const io_uring_cqe &cqe) {
+                if (cqe.user_data == UDP_RECEIVE) {
+                    _receiving = cqe.flags & IORING_CQE_F_MORE;
+                } else if (cqe.user_data != UDP_CANCEL) {
+                    _sends_in_flight--;
+                }
+            });
+        }
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing UDPIoUring: " << e.what() << endl;
+    }
+}
+
+//! \details The receive leaves room in each buffer, before the payload, for the sender's address and the
+//! control message, and the kernel puts them there after an io_uring_recvmsg_out that gives their lengths.
+void UDPIoUring::_receive() {
+    io_uring_sqe &sqe = _ring.prepare(IORING_OP_RECVMSG, _socket.fd_num(), UDP_RECEIVE);
+    sqe.addr = reinterpret_cast<uint64_t>(&_receive_header);
+    sqe.len = 1;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = _buffers.group();
+    _receiving = true;
+}
+
+//! \param[in] cqe is the completion
+void UDPIoUring::_complete(const io_uring_cqe &cqe) {
+    if (cqe.user_data == UDP_CANCEL) {
+        return;
+    }
+
+    if (cqe.user_data != UDP_RECEIVE) {
+        const size_t index = cqe.user_data;
+        _sends.at(index).payload = {};
+        _free_sends.push_back(index);
+        _sends_in_flight--;
+        // like a full send buffer, a failure to allocate drops the datagram
+        if (cqe.res < 0 and cqe.res != -EAGAIN and cqe.res != -ENOBUFS and cqe.res != -ECANCELED) {
+            throw unix_error("io_uring sendmsg", -cqe.res);
+        }
+        return;
+    }
+
+    // a receive that completes without IORING_CQE_F_MORE is over, and recv_batch() submits it again
+    _receiving = cqe.flags & IORING_CQE_F_MORE;
+    if (cqe.res < 0) {
+        // out of buffers until recv_batch() recycles them, or cancelled
+        if (cqe.res == -ENOBUFS or cqe.res == -ECANCELED) {
+            return;
+        }
+        throw unix_error("io_uring recvmsg", -cqe.res);
+    }
+
+    const uint16_t id = IoUring::BufferRing::buffer_id(cqe);
+    const string_view buffer = _buffers.buffer(id, cqe.res);
+    io_uring_recvmsg_out out{};
+    memcpy(&out, buffer.data(), sizeof(out));
+    if (out.flags & MSG_TRUNC) {
+        _buffers.recycle(id);
+        throw runtime_error("io_uring recvmsg (oversized datagram)");
+    }
+
+    const char *const name = buffer.data() + sizeof(out);
+    const char *const control = name + _receive_header.msg_namelen;
+    const char *const payload = control + _receive_header.msg_controllen;
+
+    msghdr message{};
+    message.msg_control = const_cast<char *>(control);
+    message.msg_controllen = out.controllen;
+    size_t segment_size = 0;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+            int size = 0;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            segment_size = size;
+        }
+    }
+
+    const Address source_address{reinterpret_cast<const sockaddr *>(name),
+                                 min<size_t>(out.namelen, _receive_header.msg_namelen)};
+    _received.push_back({id, source_address, {payload, out.payloadlen}, segment_size});
+}
+
+//! \details The buffers of the datagrams the last call took go back to the kernel first. If the receive
+//! is over (the buffers ran out, say), it is submitted again, which is the only system call this makes.
+size_t UDPIoUring::recv_batch() {
+    for (const auto &datagram : _received) {
+        _buffers.recycle(datagram.buffer);
+    }
+    _received.clear();
+
+    _ring.take_completions([&](const io_uring_cqe &cqe) { _complete(cqe); });
+    if (not _receiving) {
+        _receive();
+        _ring.submit();
+    }
+    return _received.size();
+}
+
+//! \param[in] destination is the Address to send to
+//! \param[in] payloads holds the datagram payloads to send
+//! \param[in] first is the index of the first payload to send
+//! \param[in] segment_sizes is empty, or holds the segment size of each payload (0: don't split it)
+size_t UDPIoUring::send_batch(const Address &destination,
+                              const vector<BufferList> &payloads,
+                              const size_t first,
+                              const vector<uint16_t> &segment_sizes) {
+    if (not segment_sizes.empty() and segment_sizes.size() != payloads.size()) {
+        throw runtime_error("UDPIoUring::send_batch(): a segment size for some payloads but not others");
+    }
+
+    size_t queued = 0;
+    for (size_t i = first; i < payloads.size(); i++) {
+        if (_free_sends.empty()) {
+            _free_sends.push_back(_sends.size());
+            _sends.emplace_back();
+        }
+        const size_t index = _free_sends.back();
+        _free_sends.pop_back();
+        _sends_in_flight++;
+
+        Send &send = _sends[index];
+        send.payload = payloads[i];
+        send.iovecs.clear();
+        for (const auto &buffer : send.payload.buffers()) {
+            send.iovecs.push_back({const_cast<char *>(buffer.str().data()), buffer.size()});
+        }
+        memcpy(&send.destination.storage, static_cast<const sockaddr *>(destination), destination.size());
+        send.message = {};
+        send.message.msg_name = static_cast<sockaddr *>(send.destination);
+        send.message.msg_namelen = destination.size();
+        send.message.msg_iov = send.iovecs.data();
+        send.message.msg_iovlen = send.iovecs.size();
+        if (not segment_sizes.empty() and segment_sizes[i] > 0) {
+            set_segment_size(send.message, send.control.front(), segment_sizes[i]);
+        }
+
+        io_uring_sqe &sqe = _ring.prepare(IORING_OP_SENDMSG, _socket.fd_num(), index);
+        sqe.addr = reinterpret_cast<uint64_t>(&send.message);
+        sqe.len = 1;
+        queued++;
+    }
+    _ring.submit();
+    return queued;
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen(const int backlog) { SystemCall("listen", ::listen(fd_num(), backlog)); }
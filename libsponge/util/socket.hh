@@ -3,11 +3,16 @@
 
 #include "address.hh"
 #include "file_descriptor.hh"
+#include "io_uring.hh"
 
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -75,6 +80,71 @@ class UDPSocket : public Socket {
 
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
+
+    //! Most datagrams a RecvRing holds by default
+    static constexpr size_t DEFAULT_BATCH_SIZE = 32;
+
+    //! Most datagrams the kernel will split one UDP GSO datagram into
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
+
+    //! Largest UDP payload (in an IPv4 datagram without options)
+    static constexpr size_t MAX_PAYLOAD_SIZE = 65535 - 20 - 8;
+
+    //! Room for one control message carrying an `int`, as UDP_SEGMENT and UDP_GRO do
+    union ControlBuffer {
+        cmsghdr header;                       //!< For alignment
+        char bytes[CMSG_SPACE(sizeof(int))];  //!< The control message
+    };
+
+    //! \brief Preallocated buffers that recv_batch() receives a batch of datagrams into
+    //! \details The buffers are allocated once and reused by every recv_batch() into the ring, so receiving
+    //! allocates nothing. A datagram's payload stays valid until the next recv_batch() into the ring.
+    class RecvRing {
+      private:
+        friend class UDPSocket;
+
+        size_t _mtu;                           //!< Size of each slot's buffer
+        std::string _storage;                  //!< The slots' buffers, back to back
+        std::vector<Address::Raw> _addresses;  //!< Source address of each slot's datagram
+        std::vector<iovec> _iovecs;            //!< Each slot's buffer, for recvmmsg
+        std::vector<mmsghdr> _headers;         //!< Each slot's message header, for recvmmsg
+        std::vector<ControlBuffer> _controls;  //!< Each slot's control message (from UDP GRO), for recvmmsg
+        std::vector<size_t> _segment_sizes;    //!< Each slot's UDP GRO segment size (0: not coalesced)
+        size_t _count = 0;                     //!< Slots holding a datagram from the last recv_batch()
+
+      public:
+        //! \brief Allocate `capacity` slots of `mtu` bytes
+        explicit RecvRing(const size_t capacity = DEFAULT_BATCH_SIZE, const size_t mtu = 65536);
+
+        //! \brief Most datagrams one recv_batch() takes
+        size_t capacity() const { return _headers.size(); }
+
+        //! \brief Datagrams the last recv_batch() took
+        size_t size() const { return _count; }
+
+        //! \brief Payload of datagram number `i`
+        std::string_view payload(const size_t i) const;
+
+        //! \brief Address of the sender of datagram number `i`
+        Address source_address(const size_t i) const;
+
+        //! \brief If the kernel coalesced datagram number `i` from several (see set_gro()), the size of each
+        //! (but the last, which may be shorter); otherwise zero
+        size_t segment_size(const size_t i) const;
+    };
+
+    //! Receive as many waiting datagrams as fit in `ring` with one call to [recvmmsg(2)](\ref man2::recvmmsg)
+    size_t recv_batch(RecvRing &ring);
+
+    //! Send datagrams to specified Address with as few calls to [sendmmsg(2)](\ref man2::sendmmsg) as possible,
+    //! perhaps having the kernel split some (with UDP GSO) into smaller datagrams
+    size_t send_batch(const Address &destination,
+                      const std::vector<BufferList> &payloads,
+                      const size_t first = 0,
+                      const std::vector<uint16_t> &segment_sizes = {});
+
+    //! Let the kernel coalesce datagrams received from the same flow ([UDP_GRO](\ref man7::udp))
+    void set_gro(const bool enabled);
 };
 
 //! \class UDPSocket
@@ -84,6 +154,104 @@ class UDPSocket : public Socket {
 //!
 //! \include socket_example_1.cc
 
+//! \brief A UDPSocket's datagrams, received and sent through an IoUring
+//! \details One multishot receive stays in flight and completes again for each datagram that arrives, into
+//! a buffer the kernel picks from an IoUring::BufferRing, so recv_batch() takes the datagrams that have
+//! arrived without a system call of its own. send_batch() prepares a send for each datagram and submits
+//! them all with one io_uring_enter; each payload is kept until its send completes.
+//!
+//! To wait for datagrams, wait on ring() rather than on the socket: it is readable once a datagram has
+//! arrived or a send has completed, and recv_batch() takes every completion that is waiting.
+class UDPIoUring {
+  private:
+    //! A datagram received into one of the buffers
+    struct Received {
+        uint16_t buffer;           //!< The buffer holding it, the receiver's until the next recv_batch()
+        Address source_address;    //!< Address of its sender
+        std::string_view payload;  //!< Its payload, in the buffer
+        size_t segment_size;       //!< Its UDP GRO segment size (0: not coalesced)
+    };
+
+    //! A send in flight, with everything the kernel reads for it
+    struct Send {
+        BufferList payload{};         //!< The payload, kept alive until the send completes
+        std::vector<iovec> iovecs{};  //!< The payload's buffers
+        Address::Raw destination{};   //!< Where the datagram goes
+        msghdr message{};             //!< The message header, pointing at the rest
+        //! The UDP_SEGMENT control message, if any (in a vector, as a member can't end in a flexible array)
+        std::vector<UDPSocket::ControlBuffer> control = std::vector<UDPSocket::ControlBuffer>(1);
+    };
+
+    FileDescriptor _socket;  //!< The UDP socket (sharing the UDPSocket's read and write counts)
+
+    IoUring _ring;                 //!< Carries the receives and sends
+    IoUring::BufferRing _buffers;  //!< The buffers datagrams are received into
+
+    //! Tells the multishot receive how much room to leave for each sender's address and control message
+    msghdr _receive_header{};
+    bool _receiving = false;  //!< Whether the multishot receive is in flight
+
+    std::vector<Received> _received{};  //!< Datagrams taken by the last recv_batch()
+
+    std::deque<Send> _sends{};          //!< Sends in flight, and slots for more (a deque doesn't move them)
+    std::vector<size_t> _free_sends{};  //!< Indices in `_sends` of the free slots
+    size_t _sends_in_flight = 0;        //!< Slots in `_sends` in use
+
+    //! Prepare the multishot receive
+    void _receive();
+
+    //! Handle a completion of the receive or of a send
+    void _complete(const io_uring_cqe &cqe);
+
+  public:
+    //! \brief Receive into `capacity` buffers of `mtu` bytes (`capacity` a power of two) from `socket`
+    //! \details Datagrams beyond `capacity` wait in the socket until recv_batch() hands buffers back.
+    explicit UDPIoUring(const UDPSocket &socket,
+                        const uint16_t capacity = UDPSocket::DEFAULT_BATCH_SIZE,
+                        const size_t mtu = 65536);
+
+    //! Cancels the receive and waits for the sends in flight
+    ~UDPIoUring();
+
+    //! \brief The IoUring, to wait on for datagrams
+    const IoUring &ring() const { return _ring; }
+
+    //! \brief Take the datagrams that have arrived, in place of those the last call took
+    //! \returns the number of datagrams taken (0 if none has arrived)
+    //! \note If a datagram was too big for a buffer, this method throws a std::runtime_error
+    size_t recv_batch();
+
+    //! \brief Datagrams the last recv_batch() took
+    size_t size() const { return _received.size(); }
+
+    //! \brief Payload of datagram number `i`
+    std::string_view payload(const size_t i) const { return _received.at(i).payload; }
+
+    //! \brief Address of the sender of datagram number `i`
+    const Address &source_address(const size_t i) const { return _received.at(i).source_address; }
+
+    //! \brief As UDPSocket::RecvRing::segment_size(), for datagram number `i`
+    size_t segment_size(const size_t i) const { return _received.at(i).segment_size; }
+
+    //! \brief As UDPSocket::send_batch(), but with one io_uring_enter, and no waiting for the sends to complete
+    //! \returns the number of payloads queued to send, which is all of them; one that the socket's send
+    //! buffer can't take is dropped when its send completes
+    size_t send_batch(const Address &destination,
+                      const std::vector<BufferList> &payloads,
+                      const size_t first = 0,
+                      const std::vector<uint16_t> &segment_sizes = {});
+
+    //! \name
+    //! The kernel holds pointers into the buffers and the sends in flight, so it can't be copied or moved
+
+    //!@{
+    UDPIoUring(const UDPIoUring &other) = delete;
+    UDPIoUring &operator=(const UDPIoUring &other) = delete;
+    UDPIoUring(UDPIoUring &&other) = delete;
+    UDPIoUring &operator=(UDPIoUring &&other) = delete;
+    //!@}
+};
+
 //! A wrapper around [TCP sockets](\ref man7::tcp)
 class TCPSocket : public Socket {
   private:
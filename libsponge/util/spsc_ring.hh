@@ -0,0 +1,82 @@
+#ifndef SPONGE_LIBSPONGE_SPSC_RING_HH
+#define SPONGE_LIBSPONGE_SPSC_RING_HH
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+//! \brief A bounded, lock-free queue between exactly one producer thread and one consumer thread
+//! \details The producer only writes `_tail` and the consumer only writes `_head`, so neither needs a
+//! lock or a read-modify-write instruction. Each side also keeps a stale copy of the other side's index
+//! and rereads the shared one only when the copy says the ring is full (or empty), which keeps the two
+//! cache lines from bouncing between cores on every operation. `T` must be default-constructible.
+template <typename T>
+class SpscRing {
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::unique_ptr<T[]> _slots;  //!< Ring storage; the capacity is a power of two
+    size_t _mask;                 //!< Capacity minus one
+
+    //! Next slot to pop: written by the consumer
+    alignas(CACHE_LINE) std::atomic<size_t> _head{0};
+    size_t _tail_seen = 0;  //!< Consumer's copy of `_tail`
+
+    //! Next slot to push: written by the producer
+    alignas(CACHE_LINE) std::atomic<size_t> _tail{0};
+    size_t _head_seen = 0;  //!< Producer's copy of `_head`
+
+  public:
+    //! \param[in] capacity is rounded up to a power of two
+    explicit SpscRing(const size_t capacity) : _slots(), _mask(0) {
+        if (capacity == 0) {
+            throw std::runtime_error("SpscRing: capacity must be positive");
+        }
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        _slots = std::make_unique<T[]>(size);
+        _mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &other) = delete;
+    SpscRing &operator=(const SpscRing &other) = delete;
+
+    //! \brief Producer: append `item`, moving from it, unless the ring is full
+    //! \returns `false` (and leaves `item` alone) if the ring was full
+    bool try_push(T &item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head_seen > _mask) {
+            _head_seen = _head.load(std::memory_order_acquire);
+            if (tail - _head_seen > _mask) {
+                return false;
+            }
+        }
+        _slots[tail & _mask] = std::move(item);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief Consumer: move the oldest item into `item`, unless the ring is empty
+    //! \returns `false` if the ring was empty
+    bool try_pop(T &item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail_seen) {
+            _tail_seen = _tail.load(std::memory_order_acquire);
+            if (head == _tail_seen) {
+                return false;
+            }
+        }
+        item = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief Number of items the ring can hold
+    size_t capacity() const { return _mask + 1; }
+};
+
+#endif  // SPONGE_LIBSPONGE_SPSC_RING_HH
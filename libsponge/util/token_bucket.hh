@@ -0,0 +1,38 @@
+#ifndef SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
+#define SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief Rate limiter: allows `rate` events per second on average, and bursts of up to `burst`
+//! \details Time advances only through tick(), as with the rest of the stack. Tokens are counted in
+//! thousandths, so that a rate that doesn't divide 1000 still refills exactly over time.
+class TokenBucket {
+    uint64_t _rate;          //!< Tokens added per second
+    uint64_t _capacity;      //!< Most tokens held, in thousandths
+    uint64_t _milli_tokens;  //!< Tokens available, in thousandths
+
+  public:
+    //! \param[in] rate is the number of events allowed per second, on average
+    //! \param[in] burst is the number of events allowed at once (the bucket starts full)
+    TokenBucket(const uint64_t rate, const uint64_t burst)
+        : _rate(rate), _capacity(burst * 1000), _milli_tokens(_capacity) {}
+
+    //! \brief Take a token, if there is one
+    //! \returns `false` if the event should be suppressed
+    bool try_take() {
+        if (_milli_tokens < 1000) {
+            return false;
+        }
+        _milli_tokens -= 1000;
+        return true;
+    }
+
+    //! \brief Called periodically when time elapses
+    void tick(const size_t ms_since_last_tick) {
+        _milli_tokens = std::min(_capacity, _milli_tokens + _rate * ms_since_last_tick);
+    }
+};
+
+#endif  // SPONGE_LIBSPONGE_TOKEN_BUCKET_HH
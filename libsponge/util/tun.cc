@@ -2,30 +2,49 @@
 
 #include "util.hh"
 
+#include <cerrno>
 #include <cstring>
+#include <iostream>
 #include <fcntl.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#include <stdexcept>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static constexpr const char *CLONEDEV = "/dev/net/tun";
 
+//! A TunTapIoUring write's user_data is its slot's index with this bit set (a read's is its buffer's index)
+static constexpr uint64_t TUNTAP_WRITE = uint64_t(1) << 62;
+
+//! user_data of a TunTapIoUring's cancellation
+static constexpr uint64_t TUNTAP_CANCEL = UINT64_MAX;
+
 using namespace std;
 
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects Ethernet frames)
+//! \param[in] multi_queue is `true` to attach one more queue of a multi-queue device
+//! \param[in] vnet_hdr is `true` to start every frame with a virtio-net header
 //!
 //! To create a TUN device, you should already have run
 //!
 //!     ip tuntap add mode tun user `username` name `devname`
 //!
-//! as root before calling this function.
+//! (adding `multi_queue` for a multi-queue device) as root before calling this function.
 
-TunTapFD::TunTapFD(const string &devname, const bool is_tun)
-    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))) {
+TunTapFD::TunTapFD(const string &devname, const bool is_tun, const bool multi_queue, const bool vnet_hdr)
+    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))), _frame_buffer(MAX_FRAME_SIZE, 0), _vnet_hdr(vnet_hdr) {
     struct ifreq tun_req {};
 
     tun_req.ifr_flags = (is_tun ? IFF_TUN : IFF_TAP) | IFF_NO_PI;  // tun device with no packetinfo
+    if (multi_queue) {
+        tun_req.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if (vnet_hdr) {
+        tun_req.ifr_flags |= IFF_VNET_HDR;
+    }
 
     // copy devname to ifr_name, making sure to null terminate
 
@@ -34,3 +53,192 @@ TunTapFD::TunTapFD(const string &devname, const bool is_tun)
 
     SystemCall("ioctl", ioctl(fd_num(), TUNSETIFF, static_cast<void *>(&tun_req)));
 }
+
+//! \param[in] offloads is the set of `TUN_F_*` flags for the offloads to enable (0 disables them all)
+void TunTapFD::set_offload(const unsigned offloads) {
+    if (not _vnet_hdr) {
+        throw runtime_error("TunTapFD: offloads need a virtio-net header");
+    }
+    SystemCall("ioctl", ioctl(fd_num(), TUNSETOFFLOAD, static_cast<unsigned long>(offloads)));
+}
+
+//! \param[out] frames receives the frames read, each in a Buffer of its own
+//! \param[in] max_frames is the most frames to read
+size_t TunTapFD::read_frames(vector<Buffer> &frames, const size_t max_frames) {
+    size_t count = 0;
+    while (count < max_frames) {
+        const ssize_t bytes_read = ::read(fd_num(), _frame_buffer.data(), _frame_buffer.size());
+        register_read();
+        if (bytes_read < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+            break;
+        }
+        SystemCall("read", bytes_read);
+        if (bytes_read == 0) {
+            break;
+        }
+        frames.push_back(Buffer::copy_of({_frame_buffer.data(), size_t(bytes_read)}));
+        count++;
+    }
+    return count;
+}
+
+//! \param[in] frames holds the frames to write
+//! \param[in] first is the index of the first frame to write
+size_t TunTapFD::write_frames(const vector<BufferList> &frames, const size_t first) {
+    size_t count = 0;
+    for (size_t i = first; i < frames.size(); i++) {
+        const BufferViewList frame{frames[i]};
+        const auto iovecs = frame.as_iovecs();
+        const ssize_t bytes_written = ::writev(fd_num(), iovecs.data(), iovecs.size());
+        // an attempt counts as a write even if the device would block, as in read_frames(): a spurious
+        // readiness event is then not mistaken for a busy wait
+        register_write();
+        if (bytes_written < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+            break;
+        }
+        SystemCall("writev", bytes_written);
+        if (size_t(bytes_written) != frame.size()) {
+            throw runtime_error("TunTapFD: a frame was written only in part");
+        }
+        count++;
+    }
+    return count;
+}
+
+//! \details The kernel spreads the datagrams it sends among the queues, keeping each flow on the queue
+//! that last carried the flow's datagrams the other way.
+//! \param[in] devname is the name of the multi-queue TUN device
+//! \param[in] num_queues is the number of queues to open
+vector<TunFD> TunFD::open_queues(const string &devname, const size_t num_queues) {
+    vector<TunFD> queues;
+    for (size_t i = 0; i < num_queues; i++) {
+        queues.emplace_back(devname, true);
+    }
+    return queues;
+}
+
+//! \param[in] devname is the name of the multi-queue TAP device
+//! \param[in] num_queues is the number of queues to open
+vector<TapFD> TapFD::open_queues(const string &devname, const size_t num_queues) {
+    vector<TapFD> queues;
+    for (size_t i = 0; i < num_queues; i++) {
+        queues.emplace_back(devname, true);
+    }
+    return queues;
+}
+
+//! \param[in] device is the TUN or TAP device, which must be blocking
+//! \param[in] depth is the number of reads to keep in flight
+TunTapIoUring::TunTapIoUring(const TunTapFD &device, const size_t depth)
+    : _device(device.duplicate()), _ring(), _buffers(depth * TunTapFD::MAX_FRAME_SIZE, 0) {
+    vector<iovec> buffers;
+    for (size_t i = 0; i < depth; i++) {
+        buffers.push_back({&_buffers[i * TunTapFD::MAX_FRAME_SIZE], TunTapFD::MAX_FRAME_SIZE});
+    }
+    _ring.register_buffers(buffers);
+    for (size_t i = 0; i < depth; i++) {
+        _read(i);
+    }
+    _ring.submit();
+}
+
+TunTapIoUring::~TunTapIoUring() {
+    try {
+        _ring.cancel_all(TUNTAP_CANCEL);
+        while (_reads_in_flight > 0 or _writes_in_flight > 0) {
+            _ring.wait(-1);
+            _ring.take_completions([&](const io_uring_cqe &cqe) {
+                if (cqe.user_data == TUNTAP_CANCEL) {
+                    return;
+                }
+                if (cqe.user_data & TUNTAP_WRITE) {
+                    _writes_in_flight--;
+                } else {
+                    _reads_in_flight--;
+                }
+            });
+        }
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing TunTapIoUring: " << e.what() << endl;
+    }
+}
+
+//! \param[in] index is the registered buffer to read into
+void TunTapIoUring::_read(const size_t index) {
+    io_uring_sqe &sqe = _ring.prepare(IORING_OP_READ_FIXED, _device.fd_num(), index);
+    sqe.addr = reinterpret_cast<uint64_t>(&_buffers[index * TunTapFD::MAX_FRAME_SIZE]);
+    sqe.len = TunTapFD::MAX_FRAME_SIZE;
+    sqe.buf_index = index;
+    _reads_in_flight++;
+}
+
+//! \param[in] frames receives the frames read, each copied out of its buffer before the buffer is read into again
+size_t TunTapIoUring::read_frames(vector<Buffer> &frames) {
+    size_t count = 0;
+    _ring.take_completions([&](const io_uring_cqe &cqe) {
+        if (cqe.user_data == TUNTAP_CANCEL) {
+            return;
+        }
+
+        if (cqe.user_data & TUNTAP_WRITE) {
+            const size_t index = cqe.user_data & ~TUNTAP_WRITE;
+            const size_t size = _writes.at(index).frame.size();
+            _writes.at(index).frame = {};
+            _free_writes.push_back(index);
+            _writes_in_flight--;
+            if (cqe.res < 0 and cqe.res != -EAGAIN and cqe.res != -ECANCELED) {
+                throw unix_error("io_uring writev", -cqe.res);
+            }
+            if (cqe.res >= 0 and size_t(cqe.res) != size) {
+                throw runtime_error("TunTapIoUring: a frame was written only in part");
+            }
+            return;
+        }
+
+        const size_t index = cqe.user_data;
+        _reads_in_flight--;
+        if (cqe.res == -ECANCELED) {
+            return;
+        }
+        if (cqe.res < 0 and cqe.res != -EAGAIN) {
+            throw unix_error("io_uring read", -cqe.res);
+        }
+        if (cqe.res > 0) {
+            frames.push_back(Buffer::copy_of({&_buffers[index * TunTapFD::MAX_FRAME_SIZE], size_t(cqe.res)}));
+            count++;
+        }
+        _read(index);
+    });
+    _ring.submit();
+    return count;
+}
+
+//! \param[in] frames holds the frames to write
+//! \param[in] first is the index of the first frame to write
+size_t TunTapIoUring::write_frames(const vector<BufferList> &frames, const size_t first) {
+    size_t count = 0;
+    for (size_t i = first; i < frames.size(); i++) {
+        if (_free_writes.empty()) {
+            _free_writes.push_back(_writes.size());
+            _writes.emplace_back();
+        }
+        const size_t index = _free_writes.back();
+        _free_writes.pop_back();
+        _writes_in_flight++;
+
+        Write &write = _writes[index];
+        write.frame = frames[i];
+        write.iovecs.clear();
+        for (const auto &buffer : write.frame.buffers()) {
+            write.iovecs.push_back({const_cast<char *>(buffer.str().data()), buffer.size()});
+        }
+
+        io_uring_sqe &sqe = _ring.prepare(IORING_OP_WRITEV, _device.fd_num(), TUNTAP_WRITE | index);
+        sqe.addr = reinterpret_cast<uint64_t>(write.iovecs.data());
+        sqe.len = write.iovecs.size();
+        count++;
+    }
+    _ring.submit();
+    return count;
+}
@@ -2,28 +2,166 @@
 #define SPONGE_LIBSPONGE_TUN_HH
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
 
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <vector>
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
+//! \details Each read or write on a TUN/TAP device carries exactly one frame (an IP datagram for TUN, an
+//! Ethernet frame for TAP), so frames can't share a syscall. read_frames() and write_frames() instead
+//! move a batch of frames at a time on a non-blocking device: a reader drains everything that is ready
+//! after one readiness event, and a writer stops at the first frame the device can't take yet.
 class TunTapFD : public FileDescriptor {
+    //! Reused for every frame read_frames() takes, so reads don't allocate
+    std::string _frame_buffer;
+
+    bool _vnet_hdr;  //!< Does every frame start with a virtio-net header?
+
   public:
+    //! Frames read_frames() takes per call, unless told otherwise
+    static constexpr size_t DEFAULT_BATCH_SIZE = 64;
+
+    //! \brief The virtio-net header that starts each frame with vnet_hdr()
+    //! \details The same as `struct virtio_net_hdr` in `<linux/virtio_net.h>` (which C++ can't include, as
+    //! it uses `class` as a name), with fields in the host's byte order.
+    struct VnetHeader {
+        static constexpr uint8_t F_NEEDS_CSUM = 1;  //!< Checksum from `csum_start` on still to be computed
+        static constexpr uint8_t F_DATA_VALID = 2;  //!< Checksum already verified
+        static constexpr uint8_t GSO_NONE = 0;      //!< Not a super-segment
+        static constexpr uint8_t GSO_TCPV4 = 1;     //!< A TCP/IPv4 super-segment, to split every `gso_size` bytes
+
+        uint8_t flags = 0;
+        uint8_t gso_type = GSO_NONE;
+        uint16_t hdr_len = 0;      //!< Length of the headers repeated in each segment
+        uint16_t gso_size = 0;     //!< Payload per segment
+        uint16_t csum_start = 0;   //!< Where checksumming starts
+        uint16_t csum_offset = 0;  //!< Where the checksum goes, from `csum_start`
+    };
+
+    //! Size of the VnetHeader
+    static constexpr size_t VNET_HDR_SIZE = sizeof(VnetHeader);
+
+    //! Largest frame read_frames() takes: the largest IPv4 datagram, in an Ethernet frame, after a virtio-net header
+    static constexpr size_t MAX_FRAME_SIZE = VNET_HDR_SIZE + 14 + 65535;
+
     //! Open an existing persistent [TUN or TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunTapFD(const std::string &devname, const bool is_tun);
+    //! With `multi_queue`, open one more queue of a multi-queue device. With `vnet_hdr`, every frame read
+    //! or written starts with a virtio-net header (`IFF_VNET_HDR`), which carries checksum and
+    //! segmentation offload information.
+    explicit TunTapFD(const std::string &devname,
+                      const bool is_tun,
+                      const bool multi_queue = false,
+                      const bool vnet_hdr = false);
+
+    //! \brief Does every frame start with a virtio-net header?
+    bool vnet_hdr() const { return _vnet_hdr; }
+
+    //! \brief Tell the kernel which offloads the reader handles (`TUNSETOFFLOAD`)
+    //! \details `offloads` is a combination of `TUN_F_CSUM`, `TUN_F_TSO4` and the like (see
+    //! `<linux/if_tun.h>`). With `TUN_F_CSUM`, frames may arrive with only a partial checksum; with
+    //! `TUN_F_TSO4`, TCP segments may arrive as super-segments of up to 64 KiB that were never split.
+    //! \note Needs vnet_hdr()
+    void set_offload(const unsigned offloads);
+
+    //! \brief Read the frames that are ready, up to `max_frames`, appending them to `frames`
+    //! \note The device should be non-blocking (see set_blocking()); otherwise, the read after the last
+    //! ready frame waits for another one.
+    //! \returns the number of frames read (0 if none was ready)
+    size_t read_frames(std::vector<Buffer> &frames, const size_t max_frames = DEFAULT_BATCH_SIZE);
+
+    //! \brief Write `frames`, from `first` on, in order, until the device would block
+    //! \details Each frame goes out whole, in one [writev(2)](\ref man2::writev) of its buffers.
+    //! \returns the number of frames written; the rest are left to the caller to retry once the
+    //! device is writable
+    size_t write_frames(const std::vector<BufferList> &frames, const size_t first = 0);
+};
+
+//! \brief Frames read from and written to a TUN or TAP device through an IoUring
+//! \details `depth` reads stay in flight, each into a buffer registered with the kernel (see
+//! IoUring::register_buffers()). read_frames() takes the frames they have read and submits the reads
+//! again, all with one io_uring_enter; write_frames() prepares a write for each frame and submits them
+//! together, keeping each frame until its write completes.
+//!
+//! The device must be blocking (see set_blocking()): a read on a non-blocking device fails at once
+//! when no frame is ready, instead of waiting in the kernel for one. To wait for frames, wait on ring()
+//! rather than on the device; it is readable once a frame has been read or written.
+class TunTapIoUring {
+  private:
+    //! A write in flight
+    struct Write {
+        BufferList frame{};           //!< The frame, kept alive until the write completes
+        std::vector<iovec> iovecs{};  //!< The frame's buffers
+    };
+
+    FileDescriptor _device;  //!< The TUN or TAP device
+
+    IoUring _ring;                //!< Carries the reads and writes
+    std::string _buffers;         //!< Each read's registered buffer of TunTapFD::MAX_FRAME_SIZE bytes, back to back
+    size_t _reads_in_flight = 0;  //!< Reads submitted and not yet completed
+
+    std::deque<Write> _writes{};         //!< Writes in flight, and slots for more (a deque doesn't move them)
+    std::vector<size_t> _free_writes{};  //!< Indices in `_writes` of the free slots
+    size_t _writes_in_flight = 0;        //!< Slots in `_writes` in use
+
+    //! Prepare a read into buffer `index`
+    void _read(const size_t index);
+
+  public:
+    //! Reads in flight, unless told otherwise
+    static constexpr size_t DEFAULT_DEPTH = 32;
+
+    //! \brief Keep `depth` reads in flight on `device`, which must be blocking
+    explicit TunTapIoUring(const TunTapFD &device, const size_t depth = DEFAULT_DEPTH);
+
+    //! Cancels the reads and waits for the writes in flight
+    ~TunTapIoUring();
+
+    //! \brief The IoUring, to wait on for frames
+    const IoUring &ring() const { return _ring; }
+
+    //! \brief Take the frames read since the last call, appending them to `frames`
+    //! \returns the number of frames taken (0 if none has been read)
+    size_t read_frames(std::vector<Buffer> &frames);
+
+    //! \brief Queue `frames`, from `first` on, to be written in order, with one io_uring_enter
+    //! \details Each frame goes out whole, in one write of its buffers. A frame the device rejects is dropped.
+    //! \returns the number of frames queued, which is all of them
+    size_t write_frames(const std::vector<BufferList> &frames, const size_t first = 0);
+
+    //! \name
+    //! The kernel holds pointers into the buffers and the writes in flight, so it can't be copied or moved
+
+    //!@{
+    TunTapIoUring(const TunTapIoUring &other) = delete;
+    TunTapIoUring &operator=(const TunTapIoUring &other) = delete;
+    TunTapIoUring(TunTapIoUring &&other) = delete;
+    TunTapIoUring &operator=(TunTapIoUring &&other) = delete;
+    //!@}
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunFD : public TunTapFD {
   public:
     //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunFD(const std::string &devname) : TunTapFD(devname, true) {}
+    explicit TunFD(const std::string &devname, const bool multi_queue = false, const bool vnet_hdr = false)
+        : TunTapFD(devname, true, multi_queue, vnet_hdr) {}
+
+    //! Open `num_queues` queues of a multi-queue TUN device, each with its own file descriptor
+    static std::vector<TunFD> open_queues(const std::string &devname, const size_t num_queues);
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TapFD : public TunTapFD {
   public:
     //! Open an existing persistent [TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TapFD(const std::string &devname) : TunTapFD(devname, false) {}
+    explicit TapFD(const std::string &devname, const bool multi_queue = false, const bool vnet_hdr = false)
+        : TunTapFD(devname, false, multi_queue, vnet_hdr) {}
+
+    //! Open `num_queues` queues of a multi-queue TAP device, each with its own file descriptor
+    static std::vector<TapFD> open_queues(const std::string &devname, const size_t num_queues);
 };
 
 #endif  // SPONGE_LIBSPONGE_TUN_HH
@@ -1,13 +1,21 @@
 #include "util.hh"
 
 #include <array>
+#include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cstring>
+#include <endian.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <sys/socket.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 //! \returns the number of milliseconds since the program started
@@ -86,25 +94,210 @@ mt19937 get_random_generator() {
 //! on the Internet checksum, and consult the [IP](\ref rfc::rfc791) and [TCP](\ref rfc::rfc793) RFCs.
 InternetChecksum::InternetChecksum(const uint32_t initial_sum) : _sum(initial_sum) {}
 
-void InternetChecksum::add(std::string_view data) {
-    for (size_t i = 0; i < data.size(); i++) {
-        uint16_t val = uint8_t(data[i]);
-        if (not _parity) {
-            val <<= 8;
+namespace {
+
+//! 64-bit one's-complement addition (the carry out of the top bit wraps around to the bottom)
+inline uint64_t add_with_carry(const uint64_t a, const uint64_t b) {
+    const uint64_t sum = a + b;
+    return sum + (sum < a);
+}
+
+//! Fold a 64-bit one's-complement accumulator down to 16 bits (preserves zero-ness)
+inline uint16_t fold(uint64_t sum) {
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    return sum;
+}
+
+//! \details Sums `len / 8` words loaded in host byte order. The one's-complement sum is
+//! independent of byte order up to a final byte swap (RFC 1071 section 2(B)), so the
+//! result is converted back to network byte order only once, at the end.
+//! \returns the one's-complement sum of the 16-bit big-endian words in `data`, folded to 16 bits
+//! \note `len` must be even
+uint16_t sum_scalar(const uint8_t *data, const size_t len) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        sum = add_with_carry(sum, word);
+    }
+    for (; i < len; i += 2) {
+        uint16_t word;
+        memcpy(&word, data + i, sizeof(word));
+        sum = add_with_carry(sum, word);
+    }
+    return be16toh(fold(sum));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+//! Vector iterations between spills of the 32-bit lanes (each lane gains at most 2 * 0xffff per iteration)
+constexpr size_t VECTOR_ITERATIONS_PER_SPILL = 0x4000;
+
+//! \details Widens each 16-bit lane to 32 bits and accumulates; bytes are loaded little-endian,
+//! so the partial sum is byte-swapped, exactly as in sum_scalar().
+//! \note `len` must be even
+__attribute__((target("sse2"))) uint16_t sum_sse2(const uint8_t *data, const size_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t n = 0; n < VECTOR_ITERATIONS_PER_SPILL and i + 16 <= len; ++n, i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        alignas(16) std::array<uint32_t, 4> lanes{};
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), acc);
+        for (const auto lane : lanes) {
+            sum += lane;
+        }
+    }
+    const uint16_t tail = be16toh(sum_scalar(data + i, len - i));
+    return be16toh(fold(add_with_carry(sum, tail)));
+}
+
+//! \details Same approach as sum_sse2(), 32 bytes per iteration
+//! \note `len` must be even
+__attribute__((target("avx2"))) uint16_t sum_avx2(const uint8_t *data, const size_t len) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t n = 0; n < VECTOR_ITERATIONS_PER_SPILL and i + 32 <= len; ++n, i += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        alignas(32) std::array<uint32_t, 8> lanes{};
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes.data()), acc);
+        for (const auto lane : lanes) {
+            sum += lane;
         }
-        _sum += val;
-        _parity = !_parity;
     }
+    const uint16_t tail = be16toh(sum_scalar(data + i, len - i));
+    return be16toh(fold(add_with_carry(sum, tail)));
 }
+#endif
 
-uint16_t InternetChecksum::value() const {
-    uint32_t ret = _sum;
+using SumFunction = uint16_t (*)(const uint8_t *, size_t);
 
-    while (ret > 0xffff) {
-        ret = (ret >> 16) + (ret & 0xffff);
+SumFunction kernel_function(const InternetChecksum::Kernel k) {
+    switch (k) {
+#if defined(__x86_64__) || defined(__i386__)
+        case InternetChecksum::Kernel::SSE2:
+            return sum_sse2;
+        case InternetChecksum::Kernel::AVX2:
+            return sum_avx2;
+#endif
+        default:
+            return sum_scalar;
     }
+}
+
+InternetChecksum::Kernel best_kernel() {
+    for (const auto k : {InternetChecksum::Kernel::AVX2, InternetChecksum::Kernel::SSE2}) {
+        if (InternetChecksum::supported(k)) {
+            return k;
+        }
+    }
+    return InternetChecksum::Kernel::Scalar;
+}
+
+//! Kernel in use (written only by set_kernel(), so relaxed ordering is enough)
+std::atomic<InternetChecksum::Kernel> &selected_kernel() {
+    static std::atomic<InternetChecksum::Kernel> k{best_kernel()};
+    return k;
+}
+
+}  // namespace
+
+bool InternetChecksum::supported(const Kernel k) {
+    switch (k) {
+        case Kernel::Scalar:
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        case Kernel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+InternetChecksum::Kernel InternetChecksum::kernel() { return selected_kernel().load(std::memory_order_relaxed); }
+
+//! \param[in] k is the kernel to use for all subsequent calls to add()
+void InternetChecksum::set_kernel(const Kernel k) {
+    if (not supported(k)) {
+        throw runtime_error("InternetChecksum: " + as_string(k) + " kernel is not supported on this CPU");
+    }
+    selected_kernel().store(k, std::memory_order_relaxed);
+}
+
+//! \param[in] data is the next chunk of the checksummed byte stream; it may start or end
+//!                 in the middle of a 16-bit word
+void InternetChecksum::add(std::string_view data) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+    size_t len = data.size();
+    if (len == 0) {
+        return;
+    }
+
+    // finish a 16-bit word left half-done by the previous call
+    if (_parity) {
+        _sum = add_with_carry(_sum, bytes[0]);
+        ++bytes;
+        --len;
+        _parity = false;
+    }
+
+    const size_t even_len = len & ~size_t(1);
+    _sum = add_with_carry(_sum, kernel_function(kernel())(bytes, even_len));
+
+    // a trailing odd byte is the high half of the next word
+    if (len != even_len) {
+        _sum = add_with_carry(_sum, uint16_t(bytes[even_len]) << 8);
+        _parity = true;
+    }
+}
+
+uint16_t InternetChecksum::value() const { return ~fold(_sum); }
+
+//! \details Implements equation 3 of RFC 1624, `HC' = ~(~HC + ~m + m')`, which gives the same
+//! result as recomputing the checksum from scratch (the older RFC 1141 equation does not).
+//! \param[in] cksum is the checksum before the change
+//! \param[in] old_word is the 16-bit word's previous value
+//! \param[in] new_word is the 16-bit word's new value
+//! \returns the checksum after the change
+uint16_t InternetChecksum::update16(const uint16_t cksum, const uint16_t old_word, const uint16_t new_word) {
+    const uint64_t sum = uint16_t(~cksum) + uint16_t(~old_word) + uint64_t(new_word);
+    return ~fold(sum);
+}
+
+//! \param[in] cksum is the checksum before the change
+//! \param[in] old_value is the field's previous value (in host byte order)
+//! \param[in] new_value is the field's new value (in host byte order)
+//! \returns the checksum after the change
+uint16_t InternetChecksum::update32(const uint16_t cksum, const uint32_t old_value, const uint32_t new_value) {
+    return update16(update16(cksum, old_value >> 16, new_value >> 16), old_value & 0xffff, new_value & 0xffff);
+}
+
+//! \param[in] k is the InternetChecksum::Kernel to show
+//! \returns a string representation of the kernel
+string as_string(const InternetChecksum::Kernel k) {
+    static constexpr const char *_names[] = {
+        "Scalar",
+        "SSE2",
+        "AVX2",
+    };
 
-    return ~ret;
+    return _names[static_cast<size_t>(k)];
 }
 
 //! \param[in] data is a pointer to the bytes to show
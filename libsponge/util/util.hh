@@ -53,16 +53,51 @@ uint64_t timestamp_ms();
 
 //! The internet checksum algorithm
 class InternetChecksum {
+  public:
+    //! Summation kernels; the fastest one the CPU supports is selected at runtime
+    enum class Kernel {
+        Scalar,  //!< 64-bit words with end-around carry
+        SSE2,    //!< 128-bit vectors (x86 only)
+        AVX2     //!< 256-bit vectors (x86 only)
+    };
+
   private:
-    uint32_t _sum;
+    uint64_t _sum;  //!< one's-complement accumulator (end-around carry), folded by value()
     bool _parity{};
 
   public:
     InternetChecksum(const uint32_t initial_sum = 0);
     void add(std::string_view data);
     uint16_t value() const;
+
+    //! \name Incremental update (RFC 1624)
+    //! Adjust an existing checksum after one field it covers changes, without re-summing the data
+    //!@{
+
+    //! New checksum after a 16-bit word changes from `old_word` to `new_word`
+    static uint16_t update16(const uint16_t cksum, const uint16_t old_word, const uint16_t new_word);
+
+    //! New checksum after a 32-bit field (two 16-bit words, e.g. an IPv4 address) changes
+    static uint16_t update32(const uint16_t cksum, const uint32_t old_value, const uint32_t new_value);
+    //!@}
+
+    //! \name Kernel selection
+    //!@{
+
+    //! Kernel currently used by add()
+    static Kernel kernel();
+
+    //! Whether `k` can run on this CPU
+    static bool supported(const Kernel k);
+
+    //! Force add() to use `k` (e.g., for benchmarking); throws std::runtime_error if unsupported
+    static void set_kernel(const Kernel k);
+    //!@}
 };
 
+//! Output a string representation of an InternetChecksum::Kernel
+std::string as_string(const InternetChecksum::Kernel k);
+
 //! Hexdump the contents of a packet (or any other sequence of bytes)
 void hexdump(const char *data, const size_t len, const size_t indent = 0);
 
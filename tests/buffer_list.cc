@@ -0,0 +1,158 @@
+#include "buffer.hh"
+#include "buffer_pool.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void check(const bool condition, const string &description) {
+    if (not condition) {
+        throw runtime_error(description);
+    }
+}
+
+//! Buffers share their bytes: copies and prefix removal must not disturb each other
+void check_buffer(const string &contents, const bool copied) {
+    Buffer original = copied ? Buffer::copy_of(contents) : Buffer(string(contents));
+    check(original.str() == contents, "Buffer has the wrong contents");
+
+    Buffer copy = original;
+    copy.remove_prefix(contents.size() / 2);
+    check(original.str() == contents, "remove_prefix() on a copy changed the original");
+    check(copy.str() == string_view(contents).substr(contents.size() / 2), "remove_prefix() gave wrong contents");
+
+    Buffer moved = move(original);
+    check(original.size() == 0, "moved-from Buffer is not empty");
+    check(moved.str() == contents, "moved-to Buffer has the wrong contents");
+
+    moved.remove_prefix(contents.size());
+    check(moved.size() == 0, "fully consumed Buffer is not empty");
+    check(copy.str() == string_view(contents).substr(contents.size() / 2), "copy outlived by its bytes");
+
+    original = copy;
+    copy = Buffer{};
+    check(original.str() == string_view(contents).substr(contents.size() / 2), "assignment lost the contents");
+}
+
+//! A BufferList must behave the same whether its Buffers are stored inline or have spilled to the heap
+void check_buffer_list(const size_t num_buffers) {
+    auto rd = get_random_generator();
+
+    BufferList list;
+    string expected;
+    for (size_t i = 0; i < num_buffers; i++) {
+        string piece(1 + rd() % 100, 0);
+        for (auto &ch : piece) {
+            ch = rd();
+        }
+        expected += piece;
+        list.append(i % 2 ? Buffer::copy_of(piece) : Buffer(move(piece)));
+    }
+    check(list.size() == expected.size(), "BufferList has the wrong size");
+    check(list.concatenate() == expected, "BufferList has the wrong contents");
+    check(BufferViewList(list).size() == expected.size(), "BufferViewList has the wrong size");
+
+    const BufferList copy = list;
+    while (list.size() > 0) {
+        const size_t n = min(list.size(), size_t(rd() % 150));
+        list.remove_prefix(n);
+        expected.erase(0, n);
+        check(list.concatenate() == expected, "BufferList::remove_prefix() gave the wrong contents");
+
+        // appending after removal from the front reuses the freed slots
+        if (rd() % 4 == 0) {
+            list.append(Buffer(string("tail")));
+            expected += "tail";
+        }
+    }
+    check(copy.concatenate().size() == copy.size(), "copy of BufferList was disturbed");
+}
+
+//! Blocks allocated on one thread and freed on another must be reused, not pile up on the freeing thread
+void check_cross_thread_pool() {
+    constexpr size_t block_size = 2048;
+    constexpr size_t blocks_per_round = 8000;
+    constexpr size_t rounds = 50;
+
+    mutex lock;
+    condition_variable cv;
+    vector<void *> handoff;
+    bool done = false;
+
+    thread freer([&] {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            cv.wait(guard, [&] { return done or not handoff.empty(); });
+            if (handoff.empty()) {
+                return;
+            }
+            for (void *const block : handoff) {
+                BufferPool::deallocate(block, block_size);
+            }
+            handoff.clear();
+            cv.notify_all();
+        }
+    });
+
+    const size_t slabs_before = BufferPool::slab_count();
+    size_t first_round_slabs = 0;
+    for (size_t round = 0; round < rounds; round++) {
+        vector<void *> blocks;
+        for (size_t i = 0; i < blocks_per_round; i++) {
+            blocks.push_back(BufferPool::allocate(block_size));
+        }
+        if (round == 0) {
+            first_round_slabs = BufferPool::slab_count() - slabs_before;
+        }
+
+        unique_lock<mutex> guard(lock);
+        handoff = move(blocks);
+        cv.notify_all();
+        cv.wait(guard, [&] { return handoff.empty(); });
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        done = true;
+    }
+    cv.notify_all();
+    freer.join();
+
+    const size_t slabs = BufferPool::slab_count() - slabs_before;
+    check(slabs <= first_round_slabs + 2,
+          "BufferPool grew to " + to_string(slabs) + " slabs freeing across threads (" +
+              to_string(first_round_slabs) + " after the first round)");
+}
+
+int main() {
+    try {
+        for (const size_t size : {0, 1, 15, 16, 100, 1500, 70000}) {
+            string contents(size, 0);
+            for (size_t i = 0; i < size; i++) {
+                contents[i] = i * 7;
+            }
+            check_buffer(contents, false);
+            check_buffer(contents, true);
+        }
+
+        for (size_t num_buffers = 0; num_buffers < 20; num_buffers++) {
+            check_buffer_list(num_buffers);
+        }
+
+        check_cross_thread_pool();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
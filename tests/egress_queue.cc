@@ -0,0 +1,256 @@
+#include "egress_queue.hh"
+#include "ipv4_datagram.hh"
+#include "network_interface.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! A frame carrying a UDP datagram of flow `flow` (by source port), with `seq` at the start of its payload
+EthernetFrame make_frame(const uint16_t flow, const uint32_t seq, const size_t size = 1000) {
+    InternetDatagram dgram;
+    dgram.header().proto = IPv4Header::PROTO_UDP;
+    dgram.header().src = 0x0a000002;
+    dgram.header().dst = 0x0a000003;
+    const uint16_t sport = 40000 + flow;
+    string payload{char(sport >> 8), char(sport & 0xff), 0, 53, 0, 0, 0, 0};
+    payload += to_string(seq) + " ";
+    payload.resize(max(payload.size(), size), 'x');
+    dgram.payload() = move(payload);
+    dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+
+    EthernetFrame frame;
+    frame.header().type = EthernetHeader::TYPE_IPv4;
+    frame.payload() = dgram.serialize();
+    return frame;
+}
+
+//! Source port and sequence number of a frame made by make_frame()
+pair<uint16_t, uint32_t> identify(const EthernetFrame &frame) {
+    const string bytes = frame.payload().concatenate();
+    const uint16_t sport = (uint8_t(bytes.at(20)) << 8) | uint8_t(bytes.at(21));
+    return {sport - 40000, stoul(bytes.substr(28))};
+}
+
+EgressQueue::Config config_for(const EgressQueue::Discipline discipline, const size_t limit = 100) {
+    EgressQueue::Config config;
+    config.discipline = discipline;
+    config.limit = limit;
+    return config;
+}
+
+void check_drop_tail() {
+    EgressQueue q{config_for(EgressQueue::Discipline::DropTail, 10)};
+    for (uint32_t i = 0; i < 15; i++) {
+        q.push(make_frame(i % 3, i));
+        q.tick(1);
+    }
+    if (q.size() != 10 or q.stats().enqueued != 10 or q.stats().overflow_drops != 5) {
+        throw runtime_error("drop-tail queue did not stop at its limit");
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        if (q.empty() or identify(q.front()).second != i) {
+            throw runtime_error("drop-tail queue is not first in, first out");
+        }
+        q.pop();
+    }
+    if (not q.empty() or q.size() != 0) {
+        throw runtime_error("drop-tail queue not empty at the end");
+    }
+
+    // sojourn times: frame i was pushed at time i and popped at time 15
+    if (q.stats().dequeued != 10 or q.stats().max_sojourn != 15 or q.stats().total_sojourn != 15 * 10 - 45) {
+        throw runtime_error("wrong sojourn times");
+    }
+
+    bool threw = false;
+    try {
+        q.pop();
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    if (not threw) {
+        throw runtime_error("pop() of an empty queue did not throw");
+    }
+}
+
+//! A link that sends one frame per ms, fed `arrivals` frames per ms from one flow
+EgressQueue::Stats run_link(EgressQueue &q, const size_t arrivals, const size_t duration) {
+    uint32_t seq = 0;
+    for (size_t now = 0; now < duration; now++) {
+        for (size_t i = 0; i < arrivals; i++) {
+            q.push(make_frame(0, seq++));
+        }
+        q.tick(1);
+        if (not q.empty()) {
+            q.pop();
+        }
+    }
+    return q.stats();
+}
+
+void check_codel() {
+    // a link kept busy, but without a standing queue: nothing dropped
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::CoDel, 1000)};
+        const auto stats = run_link(q, 1, 2000);
+        if (stats.aqm_drops != 0 or stats.overflow_drops != 0) {
+            throw runtime_error("CoDel dropped frames without a standing queue");
+        }
+    }
+
+    // a burst that drains within the interval: nothing dropped
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::CoDel, 1000)};
+        for (uint32_t i = 0; i < 50; i++) {
+            q.push(make_frame(0, i));
+        }
+        run_link(q, 0, 100);
+        if (q.stats().aqm_drops != 0 or q.stats().dequeued != 50) {
+            throw runtime_error("CoDel dropped from a short burst");
+        }
+    }
+
+    // a standing queue: CoDel starts dropping after an interval, and drops faster as it persists
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::CoDel, 1000)};
+        for (uint32_t i = 0; i < 200; i++) {
+            q.push(make_frame(0, i));
+        }
+        run_link(q, 1, 100);
+        if (q.stats().aqm_drops != 0) {
+            throw runtime_error("CoDel dropped before an interval had passed");
+        }
+        run_link(q, 1, 400);
+        const uint64_t early = q.stats().aqm_drops;
+        run_link(q, 1, 400);
+        const uint64_t later = q.stats().aqm_drops - early;
+        if (early == 0 or later <= early) {
+            throw runtime_error("CoDel did not drop increasingly from a standing queue");
+        }
+
+        // once the backlog is gone, so is the delay, and the dropping stops
+        run_link(q, 0, 200);
+        const uint64_t before = q.stats().aqm_drops;
+        run_link(q, 1, 500);
+        if (q.stats().aqm_drops != before or not q.empty()) {
+            throw runtime_error("CoDel kept dropping after the queue drained");
+        }
+    }
+}
+
+void check_fq_codel() {
+    // two backlogged flows share the link evenly, whatever order they arrived in
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::FQCoDel, 1000)};
+        for (uint32_t i = 0; i < 100; i++) {
+            q.push(make_frame(1, i));
+        }
+        for (uint32_t i = 0; i < 100; i++) {
+            q.push(make_frame(2, i));
+        }
+        map<uint16_t, size_t> sent;
+        map<uint16_t, uint32_t> next_seq;
+        for (size_t i = 0; i < 100; i++) {
+            const auto [flow, seq] = identify(q.front());
+            if (seq != next_seq[flow]++) {
+                throw runtime_error("FQ-CoDel reordered a flow");
+            }
+            sent[flow]++;
+            q.pop();
+        }
+        if (sent[1] < 45 or sent[2] < 45) {
+            throw runtime_error("FQ-CoDel did not share the link between two flows");
+        }
+    }
+
+    // a sparse flow goes ahead of a backlogged one
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::FQCoDel, 1000)};
+        for (uint32_t i = 0; i < 100; i++) {
+            q.push(make_frame(1, i));
+        }
+        q.pop();
+        q.push(make_frame(2, 0, 64));
+        q.pop();
+        if (identify(q.front()).first != 2) {
+            throw runtime_error("FQ-CoDel made a sparse flow wait behind a backlogged one");
+        }
+    }
+
+    // when full, the flow with the longest backlog loses frames, not the newcomer
+    {
+        EgressQueue q{config_for(EgressQueue::Discipline::FQCoDel, 10)};
+        for (uint32_t i = 0; i < 10; i++) {
+            q.push(make_frame(1, i));
+        }
+        q.push(make_frame(2, 0));
+        if (q.size() != 10 or q.stats().overflow_drops != 1) {
+            throw runtime_error("FQ-CoDel exceeded its limit");
+        }
+        bool newcomer_kept = false;
+        while (not q.empty()) {
+            const auto [flow, seq] = identify(q.front());
+            if (flow == 1 and seq == 0) {
+                throw runtime_error("FQ-CoDel kept the oldest frame of the longest flow");
+            }
+            newcomer_kept |= flow == 2;
+            q.pop();
+        }
+        if (not newcomer_kept) {
+            throw runtime_error("FQ-CoDel dropped the newcomer");
+        }
+    }
+}
+
+void check_network_interface() {
+    NetworkInterface interface{{2, 0, 0, 0, 0, 1}, Address{"10.0.0.1"}};
+    interface.set_queue_discipline(config_for(EgressQueue::Discipline::CoDel, 5));
+    for (uint32_t i = 0; i < 10; i++) {
+        InternetDatagram dgram;
+        dgram.header().dst = 0x0a000002;
+        dgram.header().len = dgram.header().hlen * 4;
+        interface.send_datagram(dgram, Address{"10.0.0.2"});
+    }
+
+    // one ARP request; the datagrams wait for the reply
+    if (interface.frames_out().size() != 1 or interface.frames_out().config().limit != 5) {
+        throw runtime_error("interface did not use its queue discipline");
+    }
+    interface.tick(7);
+    interface.frames_out().pop();
+    if (interface.frames_out().stats().max_sojourn != 7) {
+        throw runtime_error("interface's tick() did not advance its queue's clock");
+    }
+
+    interface.send_datagram(InternetDatagram{}, Address{"10.0.0.3"});
+    bool threw = false;
+    try {
+        interface.set_queue_discipline(config_for(EgressQueue::Discipline::DropTail));
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    if (not threw) {
+        throw runtime_error("queue discipline changed while frames were waiting");
+    }
+}
+
+int main() {
+    try {
+        check_drop_tail();
+        check_codel();
+        check_fq_codel();
+        check_network_interface();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
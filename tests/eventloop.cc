@@ -0,0 +1,165 @@
+#include "eventloop.hh"
+#include "util.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+//! A pipe's read and write ends
+pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe2", ::pipe2(static_cast<int *>(fds), O_NONBLOCK));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+void expect(const bool condition, const string &what, const EventLoop::Backend backend) {
+    if (not condition) {
+        switch (backend) {
+            case EventLoop::Backend::Poll:
+                throw runtime_error(what + " (poll)");
+            case EventLoop::Backend::Epoll:
+                throw runtime_error(what + " (epoll)");
+            case EventLoop::Backend::IoUring:
+                throw runtime_error(what + " (io_uring)");
+        }
+    }
+}
+
+void check_read_and_timeout(const EventLoop::Backend backend) {
+    auto [reader, writer] = make_pipe();
+    EventLoop loop{backend};
+    string received;
+    loop.add_rule(reader, Direction::In, [&] { received += reader.read(); });
+
+    expect(loop.wait_next_event(0) == EventLoop::Result::Timeout, "idle pipe wasn't a timeout", backend);
+    writer.write("hello");
+    expect(loop.wait_next_event(0) == EventLoop::Result::Success and received == "hello",
+           "readable pipe wasn't read",
+           backend);
+    expect(loop.wait_next_event(0) == EventLoop::Result::Timeout, "drained pipe wasn't a timeout", backend);
+}
+
+void check_interest(const EventLoop::Backend backend) {
+    auto [reader, writer] = make_pipe();
+    EventLoop loop{backend};
+    bool interested = false;
+    size_t calls = 0;
+    loop.add_rule(
+        reader,
+        Direction::In,
+        [&] {
+            reader.read();
+            calls++;
+        },
+        [&] { return interested; });
+
+    writer.write("x");
+    expect(loop.wait_next_event(0) == EventLoop::Result::Exit, "uninterested rule was polled", backend);
+    interested = true;
+    expect(loop.wait_next_event(0) == EventLoop::Result::Success and calls == 1, "interest wasn't noticed", backend);
+    interested = false;
+    writer.write("y");
+    expect(loop.wait_next_event(0) == EventLoop::Result::Exit and calls == 1, "lost interest wasn't noticed", backend);
+    interested = true;
+    expect(loop.wait_next_event(0) == EventLoop::Result::Success and calls == 2, "interest wasn't renewed", backend);
+}
+
+void check_busy_wait(const EventLoop::Backend backend) {
+    auto [reader, writer] = make_pipe();
+    EventLoop loop{backend};
+    loop.add_rule(reader, Direction::In, [] {});
+    writer.write("x");
+    try {
+        loop.wait_next_event(0);
+    } catch (const runtime_error &) {
+        return;
+    }
+    expect(false, "busy wait wasn't detected", backend);
+}
+
+//! Rules to read and to write the same socket
+void check_shared_fd(const EventLoop::Backend backend) {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, static_cast<int *>(fds)));
+    FileDescriptor ours{fds[0]}, theirs{fds[1]};
+    EventLoop loop{backend};
+    string received, to_send = "ping";
+    loop.add_rule(ours, Direction::In, [&] { received += ours.read(); });
+    loop.add_rule(
+        ours, Direction::Out, [&] { to_send.erase(0, ours.write(to_send)); }, [&] { return not to_send.empty(); });
+
+    expect(loop.wait_next_event(0) == EventLoop::Result::Success and to_send.empty(),
+           "writable socket wasn't written",
+           backend);
+    expect(theirs.read() == "ping", "wrong bytes written", backend);
+    theirs.write("pong");
+    expect(loop.wait_next_event(0) == EventLoop::Result::Success and received == "pong",
+           "readable socket wasn't read",
+           backend);
+}
+
+void check_hangup(const EventLoop::Backend backend) {
+    auto [reader, writer] = make_pipe();
+    EventLoop loop{backend};
+    bool canceled = false;
+    loop.add_rule(
+        reader, Direction::In, [&] { reader.read(); }, [] { return true; }, [&] { canceled = true; });
+
+    writer.close();
+    loop.wait_next_event(0);  // reads EOF
+    expect(loop.wait_next_event(0) == EventLoop::Result::Exit and canceled, "rule at EOF wasn't canceled", backend);
+}
+
+//! A regular file (which epoll won't watch) is always ready, as poll() finds it
+void check_regular_file(const EventLoop::Backend backend) {
+    FILE *file = tmpfile();
+    if (file == nullptr) {
+        throw runtime_error("tmpfile failed");
+    }
+    FileDescriptor fd{SystemCall("dup", ::dup(fileno(file)))};
+    fclose(file);
+    fd.write("contents");
+    SystemCall("lseek", ::lseek(fd.fd_num(), 0, SEEK_SET));
+
+    EventLoop loop{backend};
+    string received;
+    loop.add_rule(fd, Direction::In, [&] { received += fd.read(); });
+    expect(loop.wait_next_event(-1) == EventLoop::Result::Success and received == "contents",
+           "regular file wasn't read",
+           backend);
+    loop.wait_next_event(-1);  // reads EOF
+    expect(loop.wait_next_event(-1) == EventLoop::Result::Exit, "regular file at EOF wasn't dropped", backend);
+}
+
+int main() {
+    try {
+        // where the kernel won't set up an io_uring, that backend falls back to poll
+        if (EventLoop{EventLoop::Backend::IoUring}.backend() !=
+            (IoUring::available() ? EventLoop::Backend::IoUring : EventLoop::Backend::Poll)) {
+            throw runtime_error("io_uring backend didn't fall back to poll where it should have, or did needlessly");
+        }
+
+        for (const auto backend : {EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring}) {
+            check_read_and_timeout(backend);
+            check_interest(backend);
+            check_busy_wait(backend);
+            check_shared_fd(backend);
+            check_hangup(backend);
+            check_regular_file(backend);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#include "multi_queue_tun.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! Is the channel's EventFD readable?
+bool readable(const FrameChannel<string> &channel) {
+    pollfd pfd{channel.ready().fd_num(), POLLIN, 0};
+    if (poll(&pfd, 1, 0) < 0) {
+        throw runtime_error("poll failed");
+    }
+    return pfd.revents & POLLIN;
+}
+
+void check_single_thread() {
+    FrameChannel<string> channel;
+    vector<string> frames{"stale"};
+
+    if (readable(channel)) {
+        throw runtime_error("new channel is readable");
+    }
+    channel.take(frames);
+    if (not frames.empty()) {
+        throw runtime_error("take() from an empty channel returned frames");
+    }
+
+    channel.push("a");
+    channel.push("b");
+    if (not readable(channel)) {
+        throw runtime_error("channel with frames isn't readable");
+    }
+    channel.take(frames);
+    if (frames != vector<string>{"a", "b"} or readable(channel)) {
+        throw runtime_error("take() didn't return the frames in order and clear the EventFD");
+    }
+
+    // a wake-up without a frame
+    channel.wake();
+    if (not readable(channel)) {
+        throw runtime_error("wake() didn't make the channel readable");
+    }
+    channel.take(frames);
+    if (not frames.empty() or readable(channel)) {
+        throw runtime_error("take() after wake() returned frames or left the channel readable");
+    }
+}
+
+//! Several producers, and a consumer that waits on the EventFD: every frame arrives, each producer's in order
+void check_threads() {
+    constexpr size_t num_producers = 4;
+    constexpr size_t frames_per_producer = 20000;
+    FrameChannel<string> channel;
+
+    vector<thread> producers;
+    for (size_t p = 0; p < num_producers; p++) {
+        producers.emplace_back([&channel, p] {
+            for (size_t i = 0; i < frames_per_producer; i++) {
+                channel.push(to_string(p) + ":" + to_string(i));
+            }
+        });
+    }
+
+    vector<size_t> next(num_producers, 0);
+    size_t received = 0;
+    vector<string> frames;
+    while (received < num_producers * frames_per_producer) {
+        pollfd pfd{channel.ready().fd_num(), POLLIN, 0};
+        if (poll(&pfd, 1, 5000) != 1) {
+            throw runtime_error("consumer wasn't woken with " + to_string(received) + " frames received");
+        }
+        channel.take(frames);
+        for (const auto &frame : frames) {
+            const size_t colon = frame.find(':');
+            const size_t p = stoul(frame.substr(0, colon));
+            if (stoul(frame.substr(colon + 1)) != next.at(p)++) {
+                throw runtime_error("frames from producer " + to_string(p) + " out of order");
+            }
+        }
+        received += frames.size();
+    }
+
+    for (auto &producer : producers) {
+        producer.join();
+    }
+}
+
+int main() {
+    try {
+        check_single_thread();
+        check_threads();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
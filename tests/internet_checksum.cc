@@ -0,0 +1,124 @@
+#include "ipv4_datagram.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! Byte-at-a-time reference implementation
+uint16_t reference_checksum(const string &data, const uint32_t initial_sum) {
+    uint64_t sum = initial_sum;
+    for (size_t i = 0; i < data.size(); i++) {
+        sum += (i % 2 == 0) ? uint16_t(uint8_t(data[i]) << 8) : uint8_t(data[i]);
+    }
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    return ~sum;
+}
+
+void check(const string &data, const uint32_t initial_sum, const string &description) {
+    const uint16_t expected = reference_checksum(data, initial_sum);
+    for (const auto k :
+         {InternetChecksum::Kernel::Scalar, InternetChecksum::Kernel::SSE2, InternetChecksum::Kernel::AVX2}) {
+        if (not InternetChecksum::supported(k)) {
+            continue;
+        }
+        InternetChecksum::set_kernel(k);
+
+        // in one piece, and split into three pieces at every pair of offsets near the front
+        InternetChecksum whole(initial_sum);
+        whole.add(data);
+        if (whole.value() != expected) {
+            throw runtime_error(as_string(k) + " kernel: wrong checksum for " + description);
+        }
+
+        for (size_t first = 0; first <= min(data.size(), size_t(40)); first++) {
+            for (size_t second = first; second <= min(data.size(), first + 40); second++) {
+                InternetChecksum pieces(initial_sum);
+                pieces.add(string_view(data).substr(0, first));
+                pieces.add(string_view(data).substr(first, second - first));
+                pieces.add(string_view(data).substr(second));
+                if (pieces.value() != expected) {
+                    throw runtime_error(as_string(k) + " kernel: wrong checksum for " + description + " split at " +
+                                        to_string(first) + " and " + to_string(second));
+                }
+            }
+        }
+    }
+}
+
+//! Incremental updates (RFC 1624) must match a from-scratch recomputation of the header checksum
+void check_incremental(const IPv4Header &original, const uint8_t ttl, const uint32_t src, const uint32_t dst) {
+    InternetDatagram dgram;
+    dgram.header() = original;
+    dgram.header().len = IPv4Header::LENGTH;
+    if (dgram.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+        throw runtime_error("could not parse serialized datagram");
+    }
+
+    IPv4Header updated = dgram.header();
+    updated.set_ttl(ttl);
+    updated.set_src(src);
+    updated.set_dst(dst);
+
+    InternetDatagram expected;
+    expected.header() = updated;
+    const auto expected_bytes = expected.serialize().concatenate();
+    if (updated.serialize() != expected_bytes) {
+        throw runtime_error("incremental checksum update disagrees with recomputation: " + updated.summary());
+    }
+
+    // forwarding path: decrement_ttl() on a parsed datagram reuses the incrementally-updated checksum
+    InternetDatagram forwarded;
+    if (forwarded.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+        throw runtime_error("could not parse serialized datagram");
+    }
+    forwarded.decrement_ttl();
+    InternetDatagram reference;
+    if (reference.parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+        throw runtime_error("could not parse serialized datagram");
+    }
+    reference.header().ttl--;
+    if (forwarded.serialize().concatenate() != reference.serialize().concatenate()) {
+        throw runtime_error("decrement_ttl() produced a different datagram than recomputing the checksum");
+    }
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        check("", 0, "empty input");
+        check(string(1000, '\0'), 0, "all zeros");
+        check(string(65536, '\xff'), 0, "64 KiB of 0xff");
+        check(string(70001, '\xff'), 0xffffffff, "odd-length 0xff with a large initial sum");
+
+        for (size_t size : {1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1499, 1500, 9001, 65535}) {
+            string data(size, 0);
+            for (auto &ch : data) {
+                ch = rd();
+            }
+            check(data, rd(), "random input of " + to_string(size) + " bytes");
+        }
+
+        for (unsigned int i = 0; i < 10000; i++) {
+            IPv4Header header;
+            header.id = rd();
+            header.ttl = 1 + rd() % 255;
+            header.src = rd();
+            header.dst = rd();
+            check_incremental(header, rd(), rd(), rd());
+            check_incremental(header, header.ttl - 1, header.src, header.dst);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+#include "io_uring.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+//! Wait up to `timeout_ms` for the ring's file descriptor to be readable, as an EventLoop would
+bool readable(const IoUring &ring, const int timeout_ms = 100) {
+    pollfd pfd{ring.fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, timeout_ms));
+    return pfd.revents & POLLIN;
+}
+
+void check_requests() {
+    IoUring ring{4};
+    int fds[2];
+    SystemCall("pipe", ::pipe(static_cast<int *>(fds)));
+    FileDescriptor read_end{fds[0]}, write_end{fds[1]};
+
+    // a fixed read into a registered buffer waits in the kernel until there is something to read
+    string buffer(16, 0);
+    ring.register_buffers({{buffer.data(), buffer.size()}});
+    io_uring_sqe &sqe = ring.prepare(IORING_OP_READ_FIXED, read_end.fd_num(), 7);
+    sqe.addr = reinterpret_cast<uint64_t>(buffer.data());
+    sqe.len = buffer.size();
+    sqe.buf_index = 0;
+    if (ring.unsubmitted() != 1 or ring.wait(10) or ring.unsubmitted() != 0 or ring.completions_waiting()) {
+        throw runtime_error("IoUring: a read completed with nothing to read");
+    }
+
+    write_end.write("hello");
+    if (not readable(ring, 1000) or not ring.wait(1000)) {
+        throw runtime_error("IoUring: a read didn't complete");
+    }
+    vector<io_uring_cqe> completions;
+    ring.take_completions([&](const io_uring_cqe &cqe) { completions.push_back(cqe); });
+    if (completions.size() != 1 or completions[0].user_data != 7 or completions[0].res != 5 or
+        buffer.substr(0, 5) != "hello") {
+        throw runtime_error("IoUring: wrong completion for a read");
+    }
+
+    // a cancelled read completes with ECANCELED
+    io_uring_sqe &again = ring.prepare(IORING_OP_READ, read_end.fd_num(), 8);
+    again.addr = reinterpret_cast<uint64_t>(buffer.data());
+    again.len = buffer.size();
+    ring.submit();
+    ring.cancel_all(9);
+    completions.clear();
+    while (completions.size() < 2 and ring.wait(1000)) {
+        ring.take_completions([&](const io_uring_cqe &cqe) { completions.push_back(cqe); });
+    }
+    for (const auto &cqe : completions) {
+        if (cqe.user_data == 8 and cqe.res == -ECANCELED) {
+            return;
+        }
+    }
+    throw runtime_error("IoUring: a read wasn't cancelled");
+}
+
+//! A UDP socket bound to localhost, and another receiving from it through a UDPIoUring
+struct Pair {
+    UDPSocket sender{}, receiver{};
+
+    Pair() {
+        sender.bind(Address{"127.0.0.1", 0});
+        receiver.bind(Address{"127.0.0.1", 0});
+    }
+};
+
+//! Take datagrams from `ring` until it has been idle for a moment
+vector<string> drain(UDPIoUring &ring, vector<size_t> *segment_sizes = nullptr) {
+    vector<string> received;
+    while (readable(ring.ring())) {
+        ring.recv_batch();
+        for (size_t i = 0; i < ring.size(); i++) {
+            received.emplace_back(ring.payload(i));
+            if (segment_sizes) {
+                segment_sizes->push_back(ring.segment_size(i));
+            }
+        }
+    }
+    return received;
+}
+
+void check_udp_round_trip() {
+    Pair p;
+    UDPIoUring in{p.receiver, 4, 100}, out{p.sender};
+    if (in.recv_batch() != 0) {
+        throw runtime_error("UDPIoUring: datagrams on an idle socket");
+    }
+
+    // more datagrams than buffers, which wait in the socket for buffers to be recycled
+    vector<BufferList> payloads;
+    for (const char *s : {"zero", "one", "", "three", "four", "five", "six", "seven"}) {
+        BufferList payload{string(s)};
+        payload.append(BufferList{string("!")});
+        payloads.push_back(payload);
+    }
+    if (out.send_batch(p.receiver.local_address(), payloads, 1) != payloads.size() - 1) {
+        throw runtime_error("UDPIoUring: send_batch() didn't queue every datagram");
+    }
+
+    vector<string> received;
+    while (readable(in.ring())) {
+        for (size_t i = 0, n = in.recv_batch(); i < n; i++) {
+            if (in.source_address(i) != p.sender.local_address()) {
+                throw runtime_error("UDPIoUring: wrong source address");
+            }
+            received.emplace_back(in.payload(i));
+        }
+    }
+    if (received != vector<string>{"one!", "!", "three!", "four!", "five!", "six!", "seven!"}) {
+        throw runtime_error("UDPIoUring: datagrams received out of order or changed");
+    }
+}
+
+void check_udp_oversized() {
+    Pair p;
+    UDPIoUring in{p.receiver, 4, 100};
+    p.sender.send_batch(p.receiver.local_address(), {BufferList{string(101, 'x')}});
+    try {
+        drain(in);
+    } catch (const runtime_error &) {
+        return;
+    }
+    throw runtime_error("UDPIoUring: accepted a datagram too big for a buffer");
+}
+
+void check_udp_segmentation_offload() {
+    Pair p;
+    p.receiver.set_gro(true);
+    UDPIoUring in{p.receiver}, out{p.sender};
+    const vector<BufferList> payloads{BufferList{string(100, 'a') + string(100, 'b') + string(50, 'c')}};
+
+    out.send_batch(p.receiver.local_address(), payloads, 0, {100});
+    vector<size_t> segment_sizes;
+    if (drain(in, &segment_sizes) != vector<string>{payloads.front().concatenate()} or
+        segment_sizes != vector<size_t>{100}) {
+        throw runtime_error("UDPIoUring: UDP GRO didn't deliver the segments coalesced");
+    }
+}
+
+int main() {
+    try {
+        if (not IoUring::available()) {
+            cerr << "io_uring is not available; skipping\n";
+            return EXIT_SUCCESS;
+        }
+        check_requests();
+        check_udp_round_trip();
+        check_udp_oversized();
+        check_udp_segmentation_offload();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,335 @@
+#include "arp_message.hh"
+#include "ipv4_fragments.hh"
+#include "router.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+InternetDatagram make_datagram(const size_t payload_size, const uint16_t id = 7) {
+    auto rd = get_random_generator();
+    InternetDatagram dgram;
+    dgram.header().ttl = 64;
+    dgram.header().id = id;
+    dgram.header().df = false;
+    dgram.header().src = 0x0a000002;
+    dgram.header().dst = 0x0a000003;
+    string payload(payload_size, 0);
+    for (auto &c : payload) {
+        c = rd();
+    }
+    dgram.payload() = move(payload);
+    dgram.header().len = dgram.header().hlen * 4 + payload_size;
+    return dgram;
+}
+
+//! A fragment (through the wire and back, so its checksum is checked) of `dgram`'s payload
+InternetDatagram make_fragment(const InternetDatagram &dgram, const size_t offset, const size_t size, const bool mf) {
+    InternetDatagram fragment;
+    fragment.header() = dgram.header();
+    fragment.header().offset = offset / 8;
+    fragment.header().mf = mf;
+    fragment.payload() = dgram.payload().concatenate().substr(offset, size);
+    fragment.header().len = fragment.header().hlen * 4 + size;
+
+    InternetDatagram parsed;
+    if (parsed.parse(fragment.serialize().concatenate()) != ParseResult::NoError) {
+        throw runtime_error("fragment did not parse");
+    }
+    return parsed;
+}
+
+void check_same(const InternetDatagram &expected, const optional<InternetDatagram> &actual, const string &what) {
+    if (not actual.has_value()) {
+        throw runtime_error(what + ": datagram was not reassembled");
+    }
+    if (actual->serialize().concatenate() != expected.serialize().concatenate()) {
+        throw runtime_error(what + ": reassembled datagram differs from the original");
+    }
+}
+
+//! Fragmenting for several MTUs and reassembling in shuffled order gives back the original
+void check_round_trip() {
+    auto rd = get_random_generator();
+    for (const size_t payload_size : {0, 1, 7, 8, 9, 100, 1480, 1481, 4000, 65000}) {
+        for (const size_t mtu : {28, 68, 576, 1500, 9000}) {
+            const auto dgram = make_datagram(payload_size);
+            vector<InternetDatagram> fragments;
+            if (not fragment_datagram(dgram, mtu, fragments)) {
+                throw runtime_error("fragment_datagram() refused a datagram without DF");
+            }
+            size_t expected_offset = 0;
+            for (const auto &fragment : fragments) {
+                if (fragment.header().hlen * 4 + fragment.payload().size() > mtu and fragments.size() > 1) {
+                    throw runtime_error("fragment larger than the MTU");
+                }
+                if (fragment.header().offset * 8 != expected_offset) {
+                    throw runtime_error("fragments don't follow one another");
+                }
+                expected_offset += fragment.payload().size();
+            }
+            if (fragments.back().header().mf or expected_offset != payload_size) {
+                throw runtime_error("fragments don't add up to the datagram");
+            }
+
+            shuffle(fragments.begin(), fragments.end(), rd);
+            IPv4Reassembler reassembler;
+            optional<InternetDatagram> whole;
+            for (size_t i = 0; i < fragments.size(); i++) {
+                InternetDatagram parsed;
+                if (parsed.parse(fragments[i].serialize().concatenate()) != ParseResult::NoError) {
+                    throw runtime_error("fragment did not parse");
+                }
+                whole = reassembler.push(parsed);
+                if (whole.has_value() != (i + 1 == fragments.size())) {
+                    throw runtime_error("datagram reassembled too early or not at all");
+                }
+            }
+            check_same(dgram, whole, "round trip of " + to_string(payload_size) + " bytes at MTU " + to_string(mtu));
+            if (reassembler.datagrams_pending() != 0 or reassembler.bytes_held() != 0) {
+                throw runtime_error("reassembler still holds data after reassembly");
+            }
+        }
+    }
+
+    // "don't fragment" is respected
+    auto df = make_datagram(1000);
+    df.header().df = true;
+    vector<InternetDatagram> fragments;
+    if (fragment_datagram(df, 576, fragments) or not fragments.empty()) {
+        throw runtime_error("fragment_datagram() fragmented a datagram with DF set");
+    }
+}
+
+void check_out_of_order_and_overlap() {
+    const auto dgram = make_datagram(48);
+
+    // last fragment first, then the middle, then the first (with a duplicate along the way)
+    {
+        IPv4Reassembler r;
+        if (r.push(make_fragment(dgram, 32, 16, false)) or r.push(make_fragment(dgram, 16, 16, true)) or
+            r.push(make_fragment(dgram, 16, 16, true))) {
+            throw runtime_error("incomplete datagram was returned");
+        }
+        if (r.datagrams_pending() != 1 or r.bytes_held() != 32) {
+            throw runtime_error("duplicate fragment was counted twice");
+        }
+        check_same(dgram, r.push(make_fragment(dgram, 0, 16, true)), "out of order");
+    }
+
+    // overlapping fragments with different boundaries: the whole datagram is discarded
+    {
+        IPv4Reassembler r;
+        r.push(make_fragment(dgram, 0, 24, true));
+        if (r.push(make_fragment(dgram, 16, 32, false)) or r.datagrams_pending() != 0 or r.discarded() != 1) {
+            throw runtime_error("overlapping fragments were accepted");
+        }
+        // a fresh start for the same datagram works
+        r.push(make_fragment(dgram, 24, 24, false));
+        check_same(dgram, r.push(make_fragment(dgram, 0, 24, true)), "after discarded overlap");
+    }
+
+    // a fragment at the same offset with different bytes is a conflict, too
+    {
+        IPv4Reassembler r;
+        r.push(make_fragment(dgram, 0, 16, true));
+        auto changed = make_datagram(48);
+        if (r.push(make_fragment(changed, 0, 16, true)) or r.datagrams_pending() != 0) {
+            throw runtime_error("conflicting duplicate was accepted");
+        }
+    }
+
+    // fragments past the end that the last fragment declared
+    {
+        IPv4Reassembler r;
+        r.push(make_fragment(dgram, 16, 16, false));
+        if (r.push(make_fragment(dgram, 32, 16, true)) or r.datagrams_pending() != 0) {
+            throw runtime_error("fragment past the end was accepted");
+        }
+    }
+
+    // a fragment that isn't last must carry a multiple of 8 bytes
+    {
+        IPv4Reassembler r;
+        if (r.push(make_fragment(dgram, 0, 12, true)) or r.datagrams_pending() != 0) {
+            throw runtime_error("misaligned fragment was accepted");
+        }
+    }
+
+    // fragments of different datagrams don't mix
+    {
+        IPv4Reassembler r;
+        const auto other = make_datagram(48, 8);
+        r.push(make_fragment(dgram, 0, 16, true));
+        r.push(make_fragment(other, 16, 32, false));
+        check_same(dgram, r.push(make_fragment(dgram, 16, 32, false)), "interleaved datagrams");
+        check_same(other, r.push(make_fragment(other, 0, 16, true)), "interleaved datagrams");
+        if (r.reassembled() != 2) {
+            throw runtime_error("interleaved datagrams were not both reassembled");
+        }
+    }
+}
+
+void check_limits() {
+    const auto dgram = make_datagram(48);
+
+    // an incomplete datagram is given up on after the timeout
+    {
+        IPv4Reassembler r{IPv4Reassembler::DEFAULT_CAPACITY, 1000};
+        r.push(make_fragment(dgram, 0, 16, true));
+        r.tick(999);
+        if (r.datagrams_pending() != 1) {
+            throw runtime_error("datagram discarded before the timeout");
+        }
+        r.tick(1);
+        if (r.datagrams_pending() != 0 or r.bytes_held() != 0 or r.discarded() != 1) {
+            throw runtime_error("datagram not discarded at the timeout");
+        }
+        if (r.push(make_fragment(dgram, 16, 32, false))) {
+            throw runtime_error("datagram reassembled from fragments that had timed out");
+        }
+    }
+
+    // the oldest datagrams make way when the capacity would be exceeded
+    {
+        constexpr size_t capacity = 6 * (16 + IPv4Reassembler::PARTIAL_OVERHEAD) + 10;
+        IPv4Reassembler r{capacity};
+        vector<InternetDatagram> dgrams;
+        for (uint16_t id = 0; id < 10; id++) {
+            dgrams.push_back(make_datagram(48, id));
+            r.push(make_fragment(dgrams.back(), 0, 16, true));
+            if (r.bytes_charged() > capacity) {
+                throw runtime_error("reassembler exceeded its capacity");
+            }
+        }
+        if (r.datagrams_pending() != 6 or r.discarded() != 4) {
+            throw runtime_error("wrong datagrams kept within capacity");
+        }
+
+        // the newest datagram can still be completed
+        check_same(dgrams.back(), r.push(make_fragment(dgrams.back(), 16, 32, false)), "within capacity");
+    }
+
+    // fragments without payload are dropped, not held
+    {
+        IPv4Reassembler r;
+        if (r.push(make_fragment(dgram, 48, 0, false)) or r.push(make_fragment(dgram, 8, 0, true)) or
+            r.datagrams_pending() != 0) {
+            throw runtime_error("empty fragment was accepted");
+        }
+    }
+
+    // tiny fragments of one datagram cost what its buffer holds, not a node apiece
+    {
+        const auto big = make_datagram(64000);
+        IPv4Reassembler r{64000 + 1000 + IPv4Reassembler::PARTIAL_OVERHEAD};
+        for (size_t offset = 0; offset < 64000; offset += 16) {
+            r.push(make_fragment(big, offset, 8, true));
+        }
+        if (r.datagrams_pending() != 1 or r.bytes_held() != 32000 or
+            r.bytes_charged() > 64000 + 1000 + IPv4Reassembler::PARTIAL_OVERHEAD) {
+            throw runtime_error("tiny fragments were charged more than the datagram's buffer");
+        }
+        optional<InternetDatagram> whole;
+        for (size_t offset = 8; offset < 64000; offset += 16) {
+            whole = r.push(make_fragment(big, offset, 8, offset + 8 < 64000));
+        }
+        check_same(big, whole, "from 8-byte fragments");
+    }
+
+    // tiny fragments that each start a new datagram are bounded by the datagrams' overhead, not just their payload
+    {
+        constexpr size_t capacity = 64 * 1024;
+        IPv4Reassembler r{capacity};
+        auto tiny = dgram;
+        for (uint32_t i = 0; i < 100000; i++) {
+            tiny.header().id = i;
+            tiny.header().src = dgram.header().src + (i >> 16);
+            r.push(make_fragment(tiny, 8, 8, true));
+            if (r.bytes_charged() > capacity) {
+                throw runtime_error("flood of new datagrams exceeded the capacity");
+            }
+        }
+        // each holds a buffer up to its fragment's end (16 bytes) and a byte of bitmap
+        if (r.datagrams_pending() != capacity / (16 + 1 + IPv4Reassembler::PARTIAL_OVERHEAD)) {
+            throw runtime_error("flood of new datagrams kept " + to_string(r.datagrams_pending()) + " of them");
+        }
+        r.tick(IPv4Reassembler::DEFAULT_TIMEOUT);
+        if (r.datagrams_pending() != 0 or r.bytes_charged() != 0) {
+            throw runtime_error("flood of new datagrams was not discarded at the timeout");
+        }
+    }
+}
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! A Router fragments datagrams that are too big for the outgoing interface
+void check_router() {
+    Router router;
+    const size_t in = router.add_interface({ethernet_address(1), Address{"10.0.0.1"}});
+    const size_t out = router.add_interface({ethernet_address(2), Address{"10.1.0.1"}});
+    router.interface(out).set_mtu(576);
+    router.add_route(0x0a010000, 16, {}, out);
+
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = ethernet_address(3);
+    arp.sender_ip_address = 0x0a010002;
+    arp.target_ethernet_address = ethernet_address(2);
+    arp.target_ip_address = 0x0a010001;
+    EthernetFrame frame;
+    frame.header() = {ethernet_address(2), ethernet_address(3), EthernetHeader::TYPE_ARP};
+    frame.payload() = arp.serialize();
+    router.interface(out).recv_frame(frame);
+
+    auto dgram = make_datagram(1400);
+    dgram.header().dst = 0x0a010002;
+    auto df = dgram;
+    df.header().df = true;
+    router.interface(in).datagrams_out().push(dgram);
+    router.interface(in).datagrams_out().push(df);
+    router.route();
+
+    IPv4Reassembler reassembler;
+    optional<InternetDatagram> whole;
+    size_t frames = 0;
+    auto &frames_out = router.interface(out).frames_out();
+    while (not frames_out.empty()) {
+        InternetDatagram fragment;
+        if (frames_out.front().payload().size() > 576 or
+            fragment.parse(frames_out.front().payload().concatenate()) != ParseResult::NoError) {
+            throw runtime_error("router sent a bad or oversized fragment");
+        }
+        whole = reassembler.push(fragment);
+        frames_out.pop();
+        frames++;
+    }
+    if (frames != 3) {
+        throw runtime_error("router sent " + to_string(frames) + " frames, expected 3 (and the DF datagram dropped)");
+    }
+    dgram.header().ttl--;
+    check_same(dgram, whole, "through the router");
+}
+
+int main() {
+    try {
+        check_round_trip();
+        check_out_of_order_and_overlap();
+        check_limits();
+        check_router();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+#include "arp_message.hh"
+#include "neighbor_table.hh"
+#include "network_interface.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! Check that the table holds the neighbors in a std::map of IP address to expiry time
+void check_same(const NeighborTable &table, const map<uint32_t, uint64_t> &expected, const string &what) {
+    if (table.size() != expected.size()) {
+        throw runtime_error(what + ": table has " + to_string(table.size()) + " neighbors, expected " +
+                            to_string(expected.size()));
+    }
+    for (const auto &entry : expected) {
+        const uint32_t ip = entry.first;
+        const NeighborTable::Neighbor *neighbor = table.find(ip);
+        if (not neighbor or neighbor->ip_address != ip) {
+            throw runtime_error(what + ": lost neighbor " + to_string(ip));
+        }
+    }
+}
+
+void check_basics() {
+    NeighborTable table;
+    if (table.find(1) != nullptr) {
+        throw runtime_error("found a neighbor in an empty table");
+    }
+
+    NeighborTable::Neighbor &neighbor = table.insert(1);
+    neighbor.ethernet_address = EthernetAddress{2, 0, 0, 0, 0, 1};
+    table.enqueue(neighbor, InternetDatagram{});
+    if (table.find(1) != &neighbor or table.find(2) != nullptr or table.size() != 1) {
+        throw runtime_error("insert() and find() disagree");
+    }
+
+    bool threw = false;
+    try {
+        table.insert(1);
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    if (not threw) {
+        throw runtime_error("inserted the same neighbor twice");
+    }
+
+    if (not table.erase(1) or table.erase(1) or table.find(1) != nullptr or table.size() != 0) {
+        throw runtime_error("erase() failed");
+    }
+
+    // a reused node starts out blank
+    const NeighborTable::Neighbor &again = table.insert(1);
+    if (again.ethernet_address.has_value() or table.waiting(again) != 0) {
+        throw runtime_error("reinserted neighbor remembers its past");
+    }
+}
+
+void check_expiry() {
+    NeighborTable table;
+    for (uint32_t ip = 0; ip < 10; ip++) {
+        table.set_expiry(table.insert(ip), 100 + ip * 10);
+    }
+    table.insert(10);  // never expires
+
+    // expire in order of expiry time, not of insertion
+    table.set_expiry(*table.find(0), 1000);
+    table.set_expiry(*table.find(9), 105);
+    table.clear_expiry(*table.find(5));
+
+    if (table.expire(99) != 0) {
+        throw runtime_error("expired a neighbor too early");
+    }
+    if (table.expire(110) != 2 or table.find(1) or table.find(9) or not table.find(2)) {
+        throw runtime_error("expired the wrong neighbors");
+    }
+    if (table.expire(999) != 6 or table.size() != 3 or not table.find(0) or not table.find(5)) {
+        throw runtime_error("expired the wrong neighbors (2)");
+    }
+    if (table.expire(UINT64_MAX) != 1 or table.size() != 2 or not table.find(5) or not table.find(10)) {
+        throw runtime_error("expired a neighbor with no expiry time");
+    }
+
+    // erasing takes a neighbor off the expiry list
+    table.set_expiry(*table.find(5), 2000);
+    table.erase(5);
+    if (table.expire(UINT64_MAX) != 0) {
+        throw runtime_error("erased neighbor was still listed for expiry");
+    }
+
+    // resolved, pending and negatively cached neighbors, set in turn as time goes by, still expire in order
+    NeighborTable mixed;
+    const uint64_t lifetimes[] = {30'000, 5'000, 20'000};
+    for (uint32_t ip = 0; ip < 300; ip++) {
+        mixed.set_expiry(mixed.insert(ip), ip + lifetimes[ip % 3]);
+    }
+    uint64_t last = 0;
+    for (NeighborTable::Neighbor *n = mixed.first_expired(UINT64_MAX); n; n = mixed.first_expired(UINT64_MAX)) {
+        const uint64_t expiry = mixed.expiry_time(*n);
+        if (expiry < last or expiry != n->ip_address + lifetimes[n->ip_address % 3]) {
+            throw runtime_error("neighbors with mixed lifetimes expired out of order");
+        }
+        last = expiry;
+        mixed.erase(n->ip_address);
+    }
+    if (mixed.size() != 0) {
+        throw runtime_error("neighbors with mixed lifetimes were not all expired");
+    }
+}
+
+//! A datagram of `size` bytes (header included), tagged with `id` in its identification field
+InternetDatagram make_datagram(const uint16_t id, const size_t size) {
+    InternetDatagram dgram;
+    dgram.header().id = id;
+    dgram.payload() = string(size - IPv4Header::LENGTH, 'x');
+    dgram.header().len = size;
+    return dgram;
+}
+
+void check_stats(const NeighborTable::WaitingStats &stats,
+                 const uint64_t queued,
+                 const uint64_t flushed,
+                 const uint64_t dropped,
+                 const size_t datagrams,
+                 const string &what) {
+    if (stats.queued != queued or stats.flushed != flushed or stats.dropped != dropped or
+        stats.datagrams != datagrams) {
+        throw runtime_error(what + ": wrong waiting stats (" + to_string(stats.queued) + " queued, " +
+                            to_string(stats.flushed) + " flushed, " + to_string(stats.dropped) + " dropped, " +
+                            to_string(stats.datagrams) + " waiting)");
+    }
+}
+
+void check_waiting() {
+    NeighborTable table;
+    table.set_waiting_limits({1000, 2500});
+
+    // in order, per neighbor
+    table.enqueue(table.insert(1), make_datagram(1, 100));
+    table.enqueue(table.insert(2), make_datagram(2, 100));
+    table.enqueue(*table.find(1), make_datagram(3, 100));
+    check_stats(table.waiting_stats(), 3, 0, 0, 3, "queued");
+    if (table.dequeue(*table.find(1))->header().id != 1 or table.dequeue(*table.find(1))->header().id != 3 or
+        table.dequeue(*table.find(1)).has_value()) {
+        throw runtime_error("dequeue() returned the wrong datagrams");
+    }
+    check_stats(table.waiting_stats(), 3, 2, 0, 1, "flushed");
+
+    // over the per-neighbor limit: the oldest go
+    for (uint16_t id = 10; id < 20; id++) {
+        table.enqueue(*table.find(1), make_datagram(id, 300));
+    }
+    if (table.waiting(*table.find(1)) != 3 or table.dequeue(*table.find(1))->header().id != 17) {
+        throw runtime_error("per-neighbor limit did not drop the oldest datagrams");
+    }
+    check_stats(table.waiting_stats(), 13, 3, 7, 3, "per-neighbor limit");
+
+    // too big to wait at all
+    table.enqueue(*table.find(1), make_datagram(99, 1001));
+    if (table.waiting(*table.find(1)) != 2) {
+        throw runtime_error("datagram over the per-neighbor limit was queued");
+    }
+
+    // over the total limit: the oldest of any neighbor go (neighbor 2's, then neighbor 1's)
+    for (uint32_t ip = 100; ip < 105; ip++) {
+        table.enqueue(table.insert(ip), make_datagram(ip, 500));
+    }
+    const auto &stats = table.waiting_stats();
+    if (stats.bytes > 2500 or table.waiting(*table.find(2)) != 0 or table.waiting(*table.find(1)) != 0 or
+        table.waiting(*table.find(100)) != 1) {
+        throw runtime_error("total limit did not drop the oldest datagrams");
+    }
+    check_stats(stats, 18, 3, 11, 5, "total limit");
+
+    // lowering the limits drops right away; erasing a neighbor drops what waits for it
+    table.set_waiting_limits({1000, 1000});
+    check_stats(stats, 18, 3, 14, 2, "lower limits");
+    table.erase(104);
+    check_stats(stats, 18, 3, 15, 1, "erased neighbor");
+    if (stats.bytes != 500 or table.dequeue(*table.find(103))->header().id != 103) {
+        throw runtime_error("wrong datagram left waiting");
+    }
+}
+
+//! A burst toward a neighbor that never answers holds no more than the limit
+void check_network_interface() {
+    NetworkInterface interface{{2, 0, 0, 0, 0, 1}, Address{"10.0.0.1"}};
+    const size_t per_neighbor = NeighborTable::WaitingLimits{}.per_neighbor_bytes;
+    for (uint16_t id = 0; id < 10000; id++) {
+        interface.send_datagram(make_datagram(id, 1000), Address{"10.0.0.2"});
+    }
+    const auto &stats = interface.waiting_stats();
+    if (stats.bytes > per_neighbor or stats.datagrams != per_neighbor / 1000 or stats.queued != 10000 or
+        stats.dropped != 10000 - stats.datagrams) {
+        throw runtime_error("burst toward a dead neighbor was not bounded");
+    }
+
+    // the reply flushes the newest datagrams, in order
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = {2, 0, 0, 0, 0, 2};
+    arp.sender_ip_address = Address{"10.0.0.2"}.ipv4_numeric();
+    arp.target_ethernet_address = {2, 0, 0, 0, 0, 1};
+    arp.target_ip_address = Address{"10.0.0.1"}.ipv4_numeric();
+    EthernetFrame frame;
+    frame.header() = {arp.target_ethernet_address, arp.sender_ethernet_address, EthernetHeader::TYPE_ARP};
+    frame.payload() = arp.serialize();
+    interface.recv_frame(frame);
+
+    auto &frames = interface.frames_out();
+    frames.pop();  // the ARP request
+    for (uint16_t id = 10000 - per_neighbor / 1000; id < 10000; id++) {
+        InternetDatagram dgram;
+        if (frames.empty() or dgram.parse(frames.front().payload().concatenate()) != ParseResult::NoError or
+            dgram.header().id != id) {
+            throw runtime_error("waiting datagrams were not sent in order after the reply");
+        }
+        frames.pop();
+    }
+    if (not frames.empty() or stats.flushed != per_neighbor / 1000 or stats.datagrams != 0) {
+        throw runtime_error("wrong datagrams sent after the reply");
+    }
+}
+
+//! Random operations, with addresses drawn from a small range so that probe runs collide and wrap
+void check_random() {
+    mt19937 rd{1};
+    NeighborTable table;
+    map<uint32_t, uint64_t> expected;
+    uint64_t now = 0;
+
+    for (size_t round = 0; round < 200000; round++) {
+        const uint32_t ip = rd() % 2048 * 0x10000;
+        switch (rd() % 8) {
+            case 0:
+            case 1:
+            case 2:
+                if (expected.count(ip) == 0) {
+                    table.insert(ip);
+                    expected[ip] = UINT64_MAX;
+                }
+                break;
+            case 3:
+            case 4:
+                if (table.erase(ip) != (expected.erase(ip) == 1)) {
+                    throw runtime_error("erase() disagrees with std::map");
+                }
+                break;
+            case 5:
+                if (expected.count(ip)) {
+                    expected[ip] = now + rd() % 3000;
+                    table.set_expiry(*table.find(ip), expected[ip]);
+                }
+                break;
+            case 6:
+                if (table.find(ip) != nullptr) {
+                    table.clear_expiry(*table.find(ip));
+                    expected[ip] = UINT64_MAX;
+                }
+                break;
+            default: {
+                now += rd() % 50;
+                size_t removed = 0;
+                for (auto it = expected.begin(); it != expected.end();) {
+                    if (it->second <= now) {
+                        it = expected.erase(it);
+                        removed++;
+                    } else {
+                        ++it;
+                    }
+                }
+                if (table.expire(now) != removed) {
+                    throw runtime_error("expire() removed the wrong number of neighbors");
+                }
+            } break;
+        }
+        if (round % 1000 == 0) {
+            check_same(table, expected, "round " + to_string(round));
+        }
+    }
+    check_same(table, expected, "end");
+}
+
+int main() {
+    try {
+        check_basics();
+        check_expiry();
+        check_random();
+        check_waiting();
+        check_network_interface();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
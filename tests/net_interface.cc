@@ -313,6 +313,175 @@ int main() {
                            make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5").serialize())});
             test.execute(ExpectNoFrame{});
         }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "every datagram waiting for a reply is sent", local_eth, Address("4.3.2.1", 0)};
+            const auto arp_request =
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "10.0.0.1").serialize());
+
+            const auto datagram = make_datagram("5.6.7.8", "13.12.11.10");
+            const auto datagram2 = make_datagram("5.6.7.8", "13.12.11.11");
+            const auto datagram3 = make_datagram("5.6.7.8", "13.12.11.12");
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(Tick{3000});
+            test.execute(SendDatagram{datagram2, Address("10.0.0.1", 0)});
+            test.execute(ExpectNoFrame{});
+
+            // a second request five seconds after the first, and the next only five seconds after that
+            test.execute(Tick{2000});
+            test.execute(SendDatagram{datagram3, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(Tick{4000});
+            test.execute(SendDatagram{datagram3, Address("10.0.0.1", 0)});
+            test.execute(ExpectNoFrame{});
+
+            const auto arp_reply = make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.1", local_eth, "4.3.2.1");
+            test.execute(
+                ReceiveFrame{make_frame(remote_eth, local_eth, EthernetHeader::TYPE_ARP, arp_reply.serialize()), {}});
+            for (const auto &dgram : {datagram, datagram2, datagram3, datagram3}) {
+                test.execute(
+                    ExpectFrame{make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, dgram.serialize())});
+            }
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            const EthernetAddress new_remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "a neighbor's new address is used at once", local_eth, Address("4.3.2.1", 0)};
+
+            for (const auto &eth : {remote_eth, new_remote_eth}) {
+                const auto arp = make_arp(ARPMessage::OPCODE_REPLY, eth, "10.0.0.1", local_eth, "4.3.2.1");
+                test.execute(ReceiveFrame{make_frame(eth, local_eth, EthernetHeader::TYPE_ARP, arp.serialize()), {}});
+                const auto datagram = make_datagram("4.3.2.1", "13.12.11.10");
+                test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+                test.execute(ExpectFrame{make_frame(local_eth, eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+                test.execute(ExpectNoFrame{});
+            }
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"gratuitous ARP on start", local_eth, Address("4.3.2.1", 0)};
+            test.execute(ExpectNoFrame{});
+            test.execute(Announce{});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "4.3.2.1").serialize())});
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"mappings in use are refreshed", local_eth, Address("4.3.2.1", 0)};
+            const auto arp_reply = make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.1", local_eth, "4.3.2.1");
+            const auto refresh = make_frame(local_eth,
+                                            remote_eth,
+                                            EthernetHeader::TYPE_ARP,
+                                            make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "10.0.0.1")
+                                                .serialize());
+            const auto datagram = make_datagram("4.3.2.1", "13.12.11.10");
+            const auto datagram_frame =
+                make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagram.serialize());
+
+            test.execute(
+                ReceiveFrame{make_frame(remote_eth, local_eth, EthernetHeader::TYPE_ARP, arp_reply.serialize()), {}});
+
+            // no refresh while the mapping has plenty of time left
+            test.execute(Tick{25000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectNoFrame{});
+
+            // close to the end, using the mapping asks the neighbor directly (once) to confirm it
+            test.execute(Tick{1000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectFrame{refresh});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectNoFrame{});
+
+            // the reply keeps the mapping, so there is no stall when the original 30 seconds are up
+            test.execute(
+                ReceiveFrame{make_frame(remote_eth, local_eth, EthernetHeader::TYPE_ARP, arp_reply.serialize()), {}});
+            test.execute(Tick{10000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectNoFrame{});
+
+            // a mapping that isn't used isn't refreshed, and expires
+            test.execute(Tick{25000});
+            test.execute(ExpectNoFrame{});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "10.0.0.1").serialize())});
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "neighbors that never answer are negatively cached", local_eth, Address("4.3.2.1", 0)};
+            const auto arp_request =
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "10.0.0.1").serialize());
+            const auto datagram = make_datagram("4.3.2.1", "13.12.11.10");
+
+            // three requests, five seconds apart
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(Tick{5000});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(Tick{5000});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(ExpectNoFrame{});
+
+            // then no more for 20 seconds, and datagrams aren't kept for the neighbor
+            test.execute(Tick{5000});
+            test.execute(ExpectNoFrame{});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(Tick{19999});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectNoFrame{});
+
+            // after which it's asked about again
+            test.execute(Tick{1});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectFrame{arp_request});
+            test.execute(ExpectNoFrame{});
+
+            // when the neighbor turns up, it gets the datagrams sent since, but not those dropped before
+            test.execute(Tick{3000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.1", 0)});
+            test.execute(ExpectNoFrame{});
+            const auto arp = make_arp(ARPMessage::OPCODE_REQUEST, remote_eth, "10.0.0.1", {}, "4.3.2.2");
+            test.execute(ReceiveFrame{
+                make_frame(remote_eth, ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, arp.serialize()), {}});
+            const auto datagram_frame =
+                make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagram.serialize());
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectFrame{datagram_frame});
+            test.execute(ExpectNoFrame{});
+        }
     } catch (const exception &e) {
         cerr << e.what() << endl;
         return EXIT_FAILURE;
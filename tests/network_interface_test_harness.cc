@@ -170,3 +170,7 @@ void ExpectNoFrame::execute(NetworkInterface &interface) const {
 string Tick::description() const { return to_string(_ms) + " ms pass"; }
 
 void Tick::execute(NetworkInterface &interface) const { interface.tick(_ms); }
+
+string Announce::description() const { return "interface starts"; }
+
+void Announce::execute(NetworkInterface &interface) const { interface.announce(); }
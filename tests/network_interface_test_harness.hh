@@ -78,6 +78,11 @@ struct Tick : public NetworkInterfaceAction {
     Tick(const size_t ms) : _ms(ms) {}
 };
 
+struct Announce : public NetworkInterfaceAction {
+    std::string description() const override;
+    void execute(NetworkInterface &interface) const override;
+};
+
 class NetworkInterfaceTestHarness {
     std::string _test_name;
     NetworkInterface _interface;
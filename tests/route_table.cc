@@ -0,0 +1,213 @@
+#include "route_table.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! The straightforward longest-prefix match: scan every route
+struct LinearTable {
+    struct Route {
+        uint32_t prefix;
+        uint8_t length;
+        RouteTable::Value value;
+    };
+    vector<Route> routes{};
+
+    bool insert(const uint32_t prefix, const uint8_t length, const RouteTable::Value value) {
+        for (const auto &r : routes) {
+            if (r.length == length and r.prefix == (prefix & RouteTable::mask(length))) {
+                return false;
+            }
+        }
+        routes.push_back({prefix & RouteTable::mask(length), length, value});
+        return true;
+    }
+
+    bool erase(const uint32_t prefix, const uint8_t length) {
+        for (auto it = routes.begin(); it != routes.end(); it++) {
+            if (it->length == length and it->prefix == (prefix & RouteTable::mask(length))) {
+                routes.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    optional<RouteTable::Value> lookup(const uint32_t address) const {
+        optional<RouteTable::Value> ret;
+        int longest = -1;
+        for (const auto &r : routes) {
+            if ((address & RouteTable::mask(r.length)) == r.prefix and r.length > longest) {
+                ret = r.value;
+                longest = r.length;
+            }
+        }
+        return ret;
+    }
+};
+
+string describe(const optional<RouteTable::Value> v) { return v.has_value() ? to_string(v.value()) : "(none)"; }
+
+void check_lookup(const RouteTable &table, const LinearTable &reference, const uint32_t address) {
+    const auto expected = reference.lookup(address);
+    const auto actual = table.lookup(address);
+    if (expected != actual) {
+        throw runtime_error("lookup of " + to_string(address) + " gave " + describe(actual) + ", expected " +
+                            describe(expected));
+    }
+}
+
+//! Fill both tables with the same random routes and check that they always agree
+void check_random_table(const size_t num_routes, const uint8_t min_length) {
+    auto rd = get_random_generator();
+    RouteTable table;
+    LinearTable reference;
+
+    // draw prefixes from a few clusters so that routes nest and share long prefixes
+    vector<uint32_t> clusters;
+    for (size_t i = 0; i < 4; i++) {
+        clusters.push_back(rd());
+    }
+
+    for (RouteTable::Value value = 0; value < num_routes; value++) {
+        const uint8_t length = min_length + rd() % (33 - min_length);
+        const uint32_t prefix = clusters[rd() % clusters.size()] ^ (rd() & (rd() | rd()) >> (rd() % 32));
+        if (table.insert(prefix, length, value) != reference.insert(prefix, length, value)) {
+            throw runtime_error("insert() disagrees about whether a prefix is new");
+        }
+        if (table.size() != reference.routes.size()) {
+            throw runtime_error("wrong size");
+        }
+    }
+
+    for (size_t i = 0; i < 20000; i++) {
+        const uint32_t near_route = clusters[rd() % clusters.size()] ^ (rd() >> (rd() % 32));
+        check_lookup(table, reference, near_route);
+        check_lookup(table, reference, rd());
+    }
+    for (const auto &r : reference.routes) {
+        check_lookup(table, reference, r.prefix);
+        check_lookup(table, reference, r.prefix | ~RouteTable::mask(r.length));
+    }
+
+    // remove about half of the routes (and try to remove some that aren't there), then add some back
+    const auto before = reference.routes;
+    for (const auto &r : before) {
+        if (rd() % 2) {
+            const uint8_t length = (rd() % 4) ? r.length : rd() % 33;
+            if (table.erase(r.prefix, length) != reference.erase(r.prefix, length)) {
+                throw runtime_error("erase() disagrees about whether a prefix was present");
+            }
+            if (table.size() != reference.routes.size() or table.find(r.prefix, length).has_value()) {
+                throw runtime_error("prefix still present after erase()");
+            }
+        }
+    }
+    for (const auto &r : before) {
+        if (rd() % 4 == 0 and table.insert(r.prefix, r.length, r.value + num_routes) !=
+                                  reference.insert(r.prefix, r.length, r.value + num_routes)) {
+            throw runtime_error("insert() after erase() disagrees about whether a prefix is new");
+        }
+    }
+    for (const auto &r : before) {
+        check_lookup(table, reference, r.prefix);
+        check_lookup(table, reference, r.prefix | ~RouteTable::mask(r.length));
+        check_lookup(table, reference, r.prefix ^ (rd() >> (rd() % 32)));
+    }
+}
+
+//! Lookups through a RouteCache must match the table, including after the table changes
+void check_route_cache(const size_t cache_entries) {
+    auto rd = get_random_generator();
+    RouteTable table;
+    LinearTable reference;
+    RouteCache cache{cache_entries};
+
+    // a small working set of destinations, so most lookups should hit
+    vector<uint32_t> destinations;
+    for (size_t i = 0; i < 32; i++) {
+        destinations.push_back(rd());
+    }
+
+    for (RouteTable::Value value = 0; value < 200; value++) {
+        const uint8_t length = rd() % 33;
+        const uint32_t prefix = destinations[rd() % destinations.size()];
+        if (table.insert(prefix, length, value)) {
+            reference.insert(prefix, length, value);
+            cache.invalidate();
+        }
+
+        for (size_t i = 0; i < 64; i++) {
+            const uint32_t address = destinations[rd() % destinations.size()];
+            if (cache.lookup(table, address) != reference.lookup(address)) {
+                throw runtime_error("RouteCache returned a stale or wrong result");
+            }
+        }
+    }
+
+    const uint64_t lookups = 200 * 64;
+    if (cache.hits() + cache.misses() != (cache_entries ? lookups : 0)) {
+        throw runtime_error("RouteCache counted " + to_string(cache.hits() + cache.misses()) + " lookups");
+    }
+    if (cache_entries >= destinations.size() and cache.hits() < lookups / 2) {
+        throw runtime_error("RouteCache hit only " + to_string(cache.hits()) + " times");
+    }
+}
+
+int main() {
+    try {
+        RouteTable empty;
+        if (empty.lookup(0x01020304).has_value()) {
+            throw runtime_error("empty table matched");
+        }
+
+        RouteTable table;
+        table.insert(0x0a000000, 8, 1);   // 10.0.0.0/8
+        table.insert(0x0a0100ff, 24, 2);  // 10.1.0.0/24 (host bits are ignored)
+        table.insert(0x0a010001, 32, 3);  // 10.1.0.1/32
+        if (table.insert(0x0a000000, 8, 4)) {
+            throw runtime_error("duplicate prefix was added");
+        }
+        if (table.lookup(0x0a010001) != 3 or table.lookup(0x0a010002) != 2 or table.lookup(0x0a020000) != 1 or
+            table.lookup(0x0b000000).has_value()) {
+            throw runtime_error("wrong longest-prefix match in small table");
+        }
+        table.insert(0, 0, 5);  // default route
+        if (table.lookup(0x0b000000) != 5) {
+            throw runtime_error("default route not matched");
+        }
+        if (table.find(0x0a010000, 24) != 2 or table.find(0x0a010000, 23).has_value()) {
+            throw runtime_error("find() does not match exactly one prefix");
+        }
+        if (not table.erase(0x0a010000, 24) or table.erase(0x0a010000, 24) or table.size() != 3 or
+            table.lookup(0x0a010002) != 1 or table.lookup(0x0a010001) != 3) {
+            throw runtime_error("erase() of a /24 did not fall back to the /8");
+        }
+        if (not table.erase(0x0a000000, 8) or table.lookup(0x0a020000) != 5) {
+            throw runtime_error("erase() of a /8 did not fall back to the default route");
+        }
+
+        for (const uint8_t min_length : {0, 8, 16, 28}) {
+            for (const size_t num_routes : {1, 2, 10, 100, 2000}) {
+                check_random_table(num_routes, min_length);
+            }
+        }
+
+        for (const size_t cache_entries : {0, 1, 4, 16, 1024}) {
+            check_route_cache(cache_entries);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,314 @@
+#include "arp_message.hh"
+#include "icmp_message.hh"
+#include "router.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr uint32_t host_ip = 0x0a000002;     // 10.0.0.2, behind the ingress interface
+constexpr uint32_t ingress_ip = 0x0a000001;  // 10.0.0.1
+constexpr uint32_t gateway_ip = 0xac100002;  // 172.16.0.2, behind the egress interface
+constexpr size_t egress_mtu = 576;
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! Teach `interface` (with Ethernet address `own`) the Ethernet address `id` of `ip`
+void learn(
+    AsyncNetworkInterface &interface, const uint8_t own, const uint32_t own_ip, const uint8_t id, const uint32_t ip) {
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = ethernet_address(id);
+    arp.sender_ip_address = ip;
+    arp.target_ethernet_address = ethernet_address(own);
+    arp.target_ip_address = own_ip;
+    EthernetFrame frame;
+    frame.header() = {ethernet_address(own), ethernet_address(id), EthernetHeader::TYPE_ARP};
+    frame.payload() = arp.serialize();
+    interface.recv_frame(frame);
+}
+
+//! A router between a host's network (10/8) and a gateway on a small-MTU link to 100/8
+class Setup {
+  public:
+    Router router;
+    size_t ingress;
+    size_t egress;
+
+    explicit Setup(const size_t num_threads = 1,
+                   const size_t icmp_rate = Router::DEFAULT_ICMP_RATE,
+                   const size_t icmp_burst = Router::DEFAULT_ICMP_BURST)
+        : router(Router::DEFAULT_ROUTE_CACHE_ENTRIES, num_threads, icmp_rate, icmp_burst)
+        , ingress(router.add_interface({ethernet_address(1), Address::from_ipv4_numeric(ingress_ip)}))
+        , egress(router.add_interface({ethernet_address(2), Address::from_ipv4_numeric(gateway_ip - 1)})) {
+        learn(router.interface(ingress), 1, ingress_ip, 100, host_ip);
+        learn(router.interface(egress), 2, gateway_ip - 1, 101, gateway_ip);
+        router.interface(egress).set_mtu(egress_mtu);
+        router.add_route(0x0a000000, 8, {}, ingress);
+        router.add_route(0x64000000, 8, Address::from_ipv4_numeric(gateway_ip), egress);
+    }
+
+    //! Datagrams the router sent out of an interface
+    vector<InternetDatagram> sent(const size_t interface_num) {
+        vector<InternetDatagram> ret;
+        auto &frames = router.interface(interface_num).frames_out();
+        while (not frames.empty()) {
+            InternetDatagram dgram;
+            if (dgram.parse(frames.front().payload().concatenate()) != ParseResult::NoError) {
+                throw runtime_error("router sent a bad datagram");
+            }
+            ret.push_back(move(dgram));
+            frames.pop();
+        }
+        return ret;
+    }
+
+    //! Hand the router a datagram from the host, route it, and return the ICMP errors sent back
+    vector<ICMPMessage> send(const InternetDatagram &dgram) {
+        router.interface(ingress).datagrams_out().push(dgram);
+        router.route();
+
+        vector<ICMPMessage> ret;
+        for (const auto &reply : sent(ingress)) {
+            const IPv4Header &header = reply.header();
+            ICMPMessage message;
+            if (header.proto != IPv4Header::PROTO_ICMP or header.src != ingress_ip or header.dst != host_ip or
+                message.parse(reply.payload().concatenate()) != ParseResult::NoError) {
+                throw runtime_error("router sent back something other than an ICMP error from its own address");
+            }
+            ret.push_back(message);
+        }
+        return ret;
+    }
+};
+
+InternetDatagram make_datagram(const uint32_t dst, const uint8_t ttl, const size_t payload_size = 20) {
+    InternetDatagram dgram;
+    dgram.header().ttl = ttl;
+    dgram.header().src = host_ip;
+    dgram.header().dst = dst;
+    dgram.header().df = false;
+    string payload(payload_size, 'x');
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = char(i);
+    }
+    dgram.payload() = move(payload);
+    dgram.header().len = dgram.header().hlen * 4 + payload_size;
+    return dgram;
+}
+
+//! Check that exactly one ICMP error of the given kind came back, quoting the start of `original`
+void expect_error(const vector<ICMPMessage> &replies,
+                  const InternetDatagram &original,
+                  const uint8_t type,
+                  const uint8_t code,
+                  const uint32_t rest_of_header,
+                  const string &what) {
+    if (replies.size() != 1) {
+        throw runtime_error(what + ": expected one ICMP error, got " + to_string(replies.size()));
+    }
+    const ICMPMessage &message = replies.front();
+    if (message.type != type or message.code != code or message.rest_of_header != rest_of_header) {
+        throw runtime_error(what + ": wrong ICMP error " + message.to_string());
+    }
+    const string quoted = original.serialize().concatenate().substr(0, IPv4Header::LENGTH + 8);
+    if (message.payload != quoted) {
+        throw runtime_error(what + ": ICMP error doesn't quote the original header and first 8 payload bytes");
+    }
+}
+
+void expect_none(const vector<ICMPMessage> &replies, const string &what) {
+    if (not replies.empty()) {
+        throw runtime_error(what + ": unexpected ICMP error " + replies.front().to_string());
+    }
+}
+
+void check_errors(const size_t num_threads) {
+    Setup s{num_threads};
+
+    // TTL runs out
+    for (const uint8_t ttl : {0, 1}) {
+        const auto dgram = make_datagram(0x64000001, ttl);
+        expect_error(s.send(dgram),
+                     dgram,
+                     ICMPMessage::TYPE_TIME_EXCEEDED,
+                     ICMPMessage::CODE_TTL_EXCEEDED,
+                     0,
+                     "TTL " + to_string(ttl));
+    }
+
+    // no route
+    {
+        const auto dgram = make_datagram(0x0b000001, 64);
+        expect_error(s.send(dgram),
+                     dgram,
+                     ICMPMessage::TYPE_DESTINATION_UNREACHABLE,
+                     ICMPMessage::CODE_NET_UNREACHABLE,
+                     0,
+                     "no route");
+    }
+
+    // too big for the egress link: fragmented, unless DF is set
+    {
+        auto dgram = make_datagram(0x64000001, 64, 1000);
+        expect_none(s.send(dgram), "fragmented");
+        if (s.sent(s.egress).size() != 2) {
+            throw runtime_error("datagram too big for the link was not fragmented");
+        }
+
+        dgram.header().df = true;
+        expect_error(s.send(dgram),
+                     dgram,
+                     ICMPMessage::TYPE_DESTINATION_UNREACHABLE,
+                     ICMPMessage::CODE_FRAGMENTATION_NEEDED,
+                     egress_mtu,
+                     "DF set");
+        if (not s.sent(s.egress).empty()) {
+            throw runtime_error("datagram with DF set was sent on a link too small for it");
+        }
+    }
+
+    // a datagram that fits is forwarded without any error
+    {
+        expect_none(s.send(make_datagram(0x64000001, 64, egress_mtu - IPv4Header::LENGTH)), "fits");
+        if (s.sent(s.egress).size() != 1) {
+            throw runtime_error("datagram was not forwarded");
+        }
+    }
+
+    // never an error about an ICMP error, or about a fragment other than the first
+    {
+        const auto original = make_datagram(0x64000001, 1);
+        auto error = make_icmp_error(original, host_ip, ICMPMessage::TYPE_TIME_EXCEEDED, 0);
+        error.header().dst = 0x64000001;
+        error.header().ttl = 1;
+        expect_none(s.send(error), "ICMP error");
+
+        ICMPMessage echo;
+        echo.type = ICMPMessage::TYPE_ECHO_REQUEST;
+        echo.payload = "ping";
+        InternetDatagram ping = make_datagram(0x64000001, 1);
+        ping.header().proto = IPv4Header::PROTO_ICMP;
+        ping.payload() = echo.serialize();
+        ping.header().len = ping.header().hlen * 4 + ping.payload().size();
+        expect_error(s.send(ping),
+                     ping,
+                     ICMPMessage::TYPE_TIME_EXCEEDED,
+                     ICMPMessage::CODE_TTL_EXCEEDED,
+                     0,
+                     "ICMP echo request");
+
+        auto fragment = make_datagram(0x64000001, 1, 16);
+        fragment.header().offset = 2;
+        expect_none(s.send(fragment), "non-first fragment");
+        fragment.header().offset = 0;
+        fragment.header().mf = true;
+        expect_error(s.send(fragment), fragment, ICMPMessage::TYPE_TIME_EXCEEDED, 0, 0, "first fragment");
+
+        auto multicast = make_datagram(0x64000001, 1);
+        multicast.header().src = 0xe0000001;
+        expect_none(s.send(multicast), "multicast source");
+    }
+
+    // never an error about a datagram sent to many hosts: IP broadcast or multicast, or a link-layer broadcast
+    {
+        expect_none(s.send(make_datagram(0xffffffff, 1)), "limited broadcast destination");
+        expect_none(s.send(make_datagram(0xe0000005, 1)), "multicast destination");
+
+        const auto expired = make_datagram(0x64000001, 1);
+        EthernetFrame frame;
+        frame.header() = {ETHERNET_BROADCAST, ethernet_address(100), EthernetHeader::TYPE_IPv4};
+        frame.payload() = expired.serialize().concatenate();
+        s.router.interface(s.ingress).recv_frame(frame);
+        s.router.route();
+        if (not s.sent(s.ingress).empty() or not s.sent(s.egress).empty()) {
+            throw runtime_error("router answered or forwarded a datagram from a link-layer broadcast");
+        }
+
+        frame.header().dst = ethernet_address(1);
+        s.router.interface(s.ingress).recv_frame(frame);
+        s.router.route();
+        if (s.sent(s.ingress).size() != 1) {
+            throw runtime_error("no ICMP error about a datagram sent to the router's own Ethernet address");
+        }
+    }
+
+    if (s.router.icmp_sent() != 7 or s.router.icmp_rate_limited() != 0) {
+        throw runtime_error("wrong ICMP statistics: " + to_string(s.router.icmp_sent()) + " sent");
+    }
+}
+
+//! The error quotes only the header and first 8 payload bytes, however the payload is split up
+void check_quote() {
+    auto dgram = make_datagram(0x64000001, 1, 0);
+    dgram.payload() = string("abc");
+    dgram.payload().append(string("defghijkl"));
+    dgram.payload().append(string("mnop"));
+    dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+
+    const auto error = make_icmp_error(dgram, ingress_ip, ICMPMessage::TYPE_TIME_EXCEEDED, 0);
+    ICMPMessage message;
+    if (message.parse(error.payload().concatenate()) != ParseResult::NoError or
+        message.payload != dgram.serialize().concatenate().substr(0, IPv4Header::LENGTH) + "abcdefgh") {
+        throw runtime_error("ICMP error quoted the wrong bytes of a datagram whose payload is in pieces");
+    }
+}
+
+void check_rate_limit() {
+    Setup s{1, 10, 5};  // 10 per second, in bursts of up to 5
+    const auto expired = make_datagram(0x64000001, 1);
+
+    for (size_t i = 0; i < 20; i++) {
+        s.router.interface(s.ingress).datagrams_out().push(expired);
+    }
+    s.router.route();
+    if (s.sent(s.ingress).size() != 5 or s.router.icmp_rate_limited() != 15) {
+        throw runtime_error("burst was not limited");
+    }
+
+    // a token every 100 ms
+    s.router.tick(250);
+    for (size_t i = 0; i < 20; i++) {
+        s.router.interface(s.ingress).datagrams_out().push(expired);
+    }
+    s.router.route();
+    if (s.sent(s.ingress).size() != 2) {
+        throw runtime_error("rate limit refilled at the wrong rate");
+    }
+
+    // the bucket holds no more than a burst
+    s.router.tick(60000);
+    for (size_t i = 0; i < 20; i++) {
+        s.router.interface(s.ingress).datagrams_out().push(expired);
+    }
+    s.router.route();
+    if (s.sent(s.ingress).size() != 5 or s.router.icmp_sent() != 12) {
+        throw runtime_error("rate limit allowed more than a burst");
+    }
+
+    // a burst of 0 turns ICMP errors off
+    Setup off{1, 10, 0};
+    expect_none(off.send(expired), "ICMP off");
+}
+
+int main() {
+    try {
+        for (const size_t num_threads : {1, 2}) {
+            check_errors(num_threads);
+        }
+        check_quote();
+        check_rate_limit();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
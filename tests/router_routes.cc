@@ -0,0 +1,239 @@
+#include "arp_message.hh"
+#include "router.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t num_egress = 3;
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! Address of the gateway on egress interface `i` (172.16.i.2)
+uint32_t gateway_ip(const size_t i) { return 0xac100002 + (i << 8); }
+
+//! A router with one ingress interface and `num_egress` egress interfaces, each with a known gateway
+class Setup {
+  public:
+    Router router{};
+    size_t ingress;
+    vector<size_t> egress{};
+
+    Setup() : ingress(router.add_interface({ethernet_address(1), Address{"10.0.0.1"}})) {
+        for (uint8_t i = 0; i < num_egress; i++) {
+            const uint32_t router_ip = gateway_ip(i) - 1;
+            egress.push_back(router.add_interface({ethernet_address(2 + i), Address::from_ipv4_numeric(router_ip)}));
+
+            ARPMessage arp;
+            arp.opcode = ARPMessage::OPCODE_REPLY;
+            arp.sender_ethernet_address = ethernet_address(100 + i);
+            arp.sender_ip_address = gateway_ip(i);
+            arp.target_ethernet_address = ethernet_address(2 + i);
+            arp.target_ip_address = router_ip;
+            EthernetFrame frame;
+            frame.header() = {ethernet_address(2 + i), ethernet_address(100 + i), EthernetHeader::TYPE_ARP};
+            frame.payload() = arp.serialize();
+            router.interface(egress.back()).recv_frame(frame);
+        }
+    }
+
+    Route route_via(const uint32_t prefix, const uint8_t length, const size_t i) const {
+        return {prefix, length, Address::from_ipv4_numeric(gateway_ip(i)), egress[i]};
+    }
+
+    //! Route a datagram to `dst`, and return which egress interface (by position) it left through
+    optional<size_t> forward(const uint32_t dst, const uint16_t src_port = 0, const uint8_t proto = 0) {
+        InternetDatagram dgram;
+        dgram.header().ttl = 64;
+        dgram.header().proto = proto;
+        dgram.header().src = 0x0a000002;
+        dgram.header().dst = dst;
+        // enough of a TCP or UDP header for the ports
+        dgram.payload() = string{char(src_port >> 8), char(src_port & 0xff), 0, 80, 'h', 'e', 'l', 'l', 'o'};
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        router.interface(ingress).datagrams_out().push(dgram);
+        router.route();
+
+        optional<size_t> ret;
+        for (size_t i = 0; i < num_egress; i++) {
+            auto &frames = router.interface(egress[i]).frames_out();
+            while (not frames.empty()) {
+                if (ret.has_value() or frames.front().header().dst != ethernet_address(100 + i)) {
+                    throw runtime_error("unexpected frame from egress interface " + to_string(i));
+                }
+                ret = i;
+                frames.pop();
+            }
+        }
+        return ret;
+    }
+
+    void expect(const uint32_t dst, const optional<size_t> expected, const string &what) {
+        const auto actual = forward(dst);
+        if (actual != expected) {
+            throw runtime_error(what + ": datagram went to " + (actual ? to_string(*actual) : "(dropped)") +
+                                ", expected " + (expected ? to_string(*expected) : "(dropped)"));
+        }
+    }
+};
+
+void check_add_remove_replace() {
+    Setup s;
+    s.router.add_route(0x64000000, 8, Address::from_ipv4_numeric(gateway_ip(0)), s.egress[0]);   // 100/8
+    s.router.add_route(0x64010000, 16, Address::from_ipv4_numeric(gateway_ip(1)), s.egress[1]);  // 100.1/16
+    s.expect(0x64010203, 1, "longest prefix");
+    s.expect(0x64020203, 0, "shorter prefix");
+
+    // the first route for a prefix wins
+    s.router.add_route(0x64010000, 16, Address::from_ipv4_numeric(gateway_ip(2)), s.egress[2]);
+    s.expect(0x64010203, 1, "add_route() of an existing prefix");
+
+    s.router.replace_route(0x64010000, 16, Address::from_ipv4_numeric(gateway_ip(2)), s.egress[2]);
+    s.expect(0x64010203, 2, "replace_route()");
+
+    if (not s.router.remove_route(0x64010000, 16) or s.router.remove_route(0x64010000, 16)) {
+        throw runtime_error("remove_route() reported the wrong result");
+    }
+    s.expect(0x64010203, 0, "after remove_route() of the longer prefix");
+    s.router.remove_route(0x64000000, 8);
+    s.expect(0x64010203, {}, "after removing every route");
+
+    // replace_route() of a new prefix adds it, reusing a removed route's slot
+    s.router.replace_route(0, 0, Address::from_ipv4_numeric(gateway_ip(1)), s.egress[1]);
+    s.router.add_route(0x64000000, 8, Address::from_ipv4_numeric(gateway_ip(2)), s.egress[2]);
+    s.expect(0x64010203, 2, "re-added /8");
+    s.expect(0x0b000000, 1, "default route");
+    if (s.router.route_count() != 2) {
+        throw runtime_error("wrong route count");
+    }
+}
+
+void check_load_routes() {
+    Setup s;
+    s.router.add_route(0, 0, Address::from_ipv4_numeric(gateway_ip(0)), s.egress[0]);
+    s.expect(0x64010203, 0, "before load_routes()");
+
+    s.router.load_routes({s.route_via(0x64000000, 8, 1), s.route_via(0x64010000, 16, 2)});
+    s.expect(0x64010203, 2, "loaded /16");
+    s.expect(0x64020203, 1, "loaded /8");
+    s.expect(0x0b000000, {}, "old default route is gone");
+
+    // an invalid route rejects the whole load
+    bool threw = false;
+    try {
+        s.router.load_routes({s.route_via(0, 0, 0), {0x0b000000, 8, {}, 99}});
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    if (not threw or s.router.route_count() != 2) {
+        throw runtime_error("load_routes() with an invalid route changed the table");
+    }
+    s.expect(0x0b000000, {}, "after rejected load_routes()");
+    s.expect(0x64010203, 2, "after rejected load_routes()");
+
+    // a large table loads quickly
+    vector<Route> routes;
+    for (uint32_t i = 0; i < 100'000; i++) {
+        routes.push_back(s.route_via(0x40000000 + (i << 8), 24, i % num_egress));
+    }
+    const auto start = chrono::steady_clock::now();
+    s.router.load_routes(routes);
+    const auto elapsed = chrono::steady_clock::now() - start;
+    if (s.router.route_count() != routes.size()) {
+        throw runtime_error("load_routes() lost routes");
+    }
+    if (elapsed > chrono::seconds(1)) {
+        throw runtime_error("load_routes() of 100k routes took more than a second");
+    }
+    s.expect(0x40000000 + (12345 << 8) + 7, 12345 % num_egress, "route from large table");
+}
+
+void check_equal_cost_paths() {
+    Setup s;
+    const vector<NextHop> paths{{Address::from_ipv4_numeric(gateway_ip(0)), s.egress[0]},
+                                {Address::from_ipv4_numeric(gateway_ip(1)), s.egress[1]}};
+    s.router.add_route(0x64000000, 8, paths);
+
+    // each flow stays on one path, and the flows spread over both
+    for (const uint8_t proto : {IPv4Header::PROTO_TCP, IPv4Header::PROTO_UDP}) {
+        size_t per_path[num_egress] = {};
+        for (uint16_t port = 1000; port < 1200; port++) {
+            const auto first = s.forward(0x64010203, port, proto);
+            if (not first.has_value()) {
+                throw runtime_error("datagram on an equal-cost route was dropped");
+            }
+            for (size_t i = 0; i < 3; i++) {
+                if (s.forward(0x64010203, port, proto) != first) {
+                    throw runtime_error("flow changed paths");
+                }
+            }
+            per_path[*first]++;
+        }
+        if (per_path[0] < 70 or per_path[1] < 70 or per_path[2] != 0) {
+            throw runtime_error("200 flows split " + to_string(per_path[0]) + "/" + to_string(per_path[1]) +
+                                " over two equal-cost paths");
+        }
+    }
+
+    // replacing the route can change the number of paths
+    s.router.replace_route(0x64000000, 8, {{Address::from_ipv4_numeric(gateway_ip(2)), s.egress[2]}});
+    s.expect(0x64010203, 2, "single path after replace_route()");
+
+    bool threw = false;
+    try {
+        s.router.add_route(0x65000000, 8, vector<NextHop>{});
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    if (not threw) {
+        throw runtime_error("route without next hops was accepted");
+    }
+}
+
+//! Router::announce() sends a gratuitous ARP request out of every interface
+void check_announce() {
+    Setup s;
+    s.router.announce();
+    for (size_t i = 0; i <= num_egress; i++) {
+        auto &interface = s.router.interface(i);
+        auto &frames = interface.frames_out();
+        if (frames.empty()) {
+            throw runtime_error("interface " + to_string(i) + " did not announce itself");
+        }
+        const EthernetFrame &frame = frames.front();
+        ARPMessage arp;
+        if (frame.header().dst != ETHERNET_BROADCAST or frame.header().type != EthernetHeader::TYPE_ARP or
+            arp.parse(frame.payload().concatenate()) != ParseResult::NoError or
+            arp.opcode != ARPMessage::OPCODE_REQUEST or arp.sender_ethernet_address != frame.header().src or
+            arp.sender_ip_address != interface.ip_address().ipv4_numeric() or
+            arp.target_ip_address != arp.sender_ip_address) {
+            throw runtime_error("interface " + to_string(i) + " sent something other than a gratuitous ARP");
+        }
+        frames.pop();
+        if (not frames.empty()) {
+            throw runtime_error("interface " + to_string(i) + " announced itself more than once");
+        }
+    }
+}
+
+int main() {
+    try {
+        check_add_remove_replace();
+        check_load_routes();
+        check_equal_cost_paths();
+        check_announce();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
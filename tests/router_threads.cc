@@ -0,0 +1,187 @@
+#include "arp_message.hh"
+#include "router.hh"
+#include "spsc_ring.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t num_interfaces = 6;
+constexpr size_t datagrams_per_interface = 3000;
+
+EthernetAddress ethernet_address(const uint8_t id) { return {0x02, 0, 0, 0, 0, id}; }
+
+//! Address of the gateway on interface `i` (172.16.i.2)
+uint32_t gateway_ip(const size_t i) { return 0xac100002 + (i << 8); }
+
+//! Destination network reached through interface `i` (100.i.0.0/16)
+uint32_t network(const size_t i) { return 0x64000000 + (i << 16); }
+
+//! Every item pushed by one thread comes out of the other, in order
+void check_spsc_ring() {
+    constexpr uint64_t count = 1'000'000;
+    SpscRing<uint64_t> ring{100};
+    if (ring.capacity() != 128) {
+        throw runtime_error("SpscRing capacity was not rounded up to a power of two");
+    }
+
+    thread producer([&] {
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t item = i;
+            while (not ring.try_push(item)) {
+                this_thread::yield();
+            }
+        }
+    });
+
+    for (uint64_t expected = 0; expected < count; expected++) {
+        uint64_t item = 0;
+        while (not ring.try_pop(item)) {
+            this_thread::yield();
+        }
+        if (item != expected) {
+            producer.join();
+            throw runtime_error("SpscRing gave " + to_string(item) + ", expected " + to_string(expected));
+        }
+    }
+    producer.join();
+
+    uint64_t item = 0;
+    if (ring.try_pop(item)) {
+        throw runtime_error("SpscRing not empty at the end");
+    }
+}
+
+//! A router whose every interface both receives traffic and sends it to a known gateway
+void setup(Router &router) {
+    for (uint8_t i = 0; i < num_interfaces; i++) {
+        const uint32_t router_ip = gateway_ip(i) - 1;
+        router.add_interface({ethernet_address(1 + i), Address::from_ipv4_numeric(router_ip)});
+
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = ethernet_address(100 + i);
+        arp.sender_ip_address = gateway_ip(i);
+        arp.target_ethernet_address = ethernet_address(1 + i);
+        arp.target_ip_address = router_ip;
+        EthernetFrame frame;
+        frame.header() = {ethernet_address(1 + i), ethernet_address(100 + i), EthernetHeader::TYPE_ARP};
+        frame.payload() = arp.serialize();
+        router.interface(i).recv_frame(frame);
+
+        router.add_route(network(i), 16, Address::from_ipv4_numeric(gateway_ip(i)), i);
+    }
+}
+
+//! Give every interface datagrams for every network; the source address says which interface
+//! received it, and the payload holds a sequence number
+void receive_traffic(Router &router, const uint32_t pass) {
+    for (size_t i = 0; i < num_interfaces; i++) {
+        for (uint32_t seq = 0; seq < datagrams_per_interface; seq++) {
+            InternetDatagram dgram;
+            dgram.header().ttl = 64;
+            dgram.header().src = 0x0a000000 + (i << 8) + pass;
+            dgram.header().dst = network((seq * 7 + i) % num_interfaces) + seq;
+            dgram.payload() = to_string(seq);
+            dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+            router.interface(i).datagrams_out().push(dgram);
+        }
+    }
+}
+
+//! Check that each interface sent exactly the datagrams for its network, in order per source
+//! \returns the number of datagrams each interface sent
+vector<size_t> check_sent(Router &router, const vector<size_t> &expected_interface_of_network) {
+    vector<size_t> sent(num_interfaces);
+    for (size_t j = 0; j < num_interfaces; j++) {
+        map<uint32_t, int64_t> last_seq;
+        auto &frames = router.interface(j).frames_out();
+        while (not frames.empty()) {
+            const EthernetFrame &frame = frames.front();
+            InternetDatagram dgram;
+            if (frame.header().dst != ethernet_address(100 + j) or
+                dgram.parse(frame.payload().concatenate()) != ParseResult::NoError) {
+                throw runtime_error("bad frame from interface " + to_string(j));
+            }
+            const size_t destination_network = (dgram.header().dst >> 16) & 0xff;
+            if (expected_interface_of_network.at(destination_network) != j or dgram.header().ttl != 63) {
+                throw runtime_error("datagram for network " + to_string(destination_network) +
+                                    " left through interface " + to_string(j));
+            }
+            const int64_t seq = stoll(dgram.payload().concatenate());
+            auto it = last_seq.find(dgram.header().src);
+            if (it != last_seq.end() and it->second >= seq) {
+                throw runtime_error("datagrams from one interface to one next hop were reordered");
+            }
+            last_seq[dgram.header().src] = seq;
+            sent[j]++;
+            frames.pop();
+        }
+    }
+    return sent;
+}
+
+void check_threads(const size_t num_threads) {
+    Router router{Router::DEFAULT_ROUTE_CACHE_ENTRIES, num_threads};
+    if (router.num_threads() != max(num_threads, size_t(1))) {
+        throw runtime_error("wrong number of threads");
+    }
+    setup(router);
+
+    vector<size_t> interface_of_network(num_interfaces);
+    for (size_t i = 0; i < num_interfaces; i++) {
+        interface_of_network[i] = i;
+    }
+
+    for (uint32_t pass = 0; pass < 3; pass++) {
+        if (pass == 2) {
+            // route changes between passes take effect in the next one
+            router.replace_route(network(0), 16, Address::from_ipv4_numeric(gateway_ip(1)), 1);
+            interface_of_network[0] = 1;
+        }
+
+        receive_traffic(router, pass);
+        router.route(pass == 1 ? 1 : Router::DEFAULT_BATCH_SIZE);
+        const auto sent = check_sent(router, interface_of_network);
+
+        size_t total = 0;
+        for (const size_t n : sent) {
+            total += n;
+        }
+        if (total != num_interfaces * datagrams_per_interface) {
+            throw runtime_error(to_string(num_threads) + " threads forwarded " + to_string(total) +
+                                " datagrams, expected " + to_string(num_interfaces * datagrams_per_interface));
+        }
+        for (size_t i = 0; i < num_interfaces; i++) {
+            if (not router.interface(i).datagrams_out().empty()) {
+                throw runtime_error("route() returned with datagrams left to route");
+            }
+        }
+    }
+
+    if (router.route_cache_hits() + router.route_cache_misses() != 3 * num_interfaces * datagrams_per_interface) {
+        throw runtime_error("route cache statistics don't add up");
+    }
+}
+
+int main() {
+    try {
+        check_spsc_ring();
+        for (const size_t num_threads : {0, 1, 2, 3, 4, 8}) {
+            check_threads(num_threads);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
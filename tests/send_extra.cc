@@ -298,6 +298,40 @@ int main() {
             test.execute(ExpectState{TCPSenderStateSummary::FIN_ACKED});
         }
 
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            const size_t rto = uniform_int_distribution<uint16_t>{30, 10000}(rd);
+            cfg.fixed_isn = isn;
+            cfg.rt_timeout = rto;
+            cfg.max_payload_size = 30000;
+
+            const string nicechars = "abcdefghijklmnopqrstuvwxyz";
+            string bigstring;
+            for (unsigned int i = 0; i < 40000; i++) {
+                bigstring.push_back(nicechars.at(rd() % nicechars.size()));
+            }
+
+            TCPSenderTestHarness test{"max_payload_size allows super-segments (for TSO)", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(WriteBytes{string(bigstring)}.with_end_input(true));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(50000));
+            test.execute(
+                ExpectSegment{}.with_payload_size(30000).with_data(bigstring.substr(0, 30000)).with_seqno(isn + 1));
+            test.execute(ExpectSegment{}
+                             .with_payload_size(10000)
+                             .with_data(bigstring.substr(30000))
+                             .with_seqno(isn + 30001)
+                             .with_fin(true));
+            test.execute(ExpectNoSegment{});
+
+            // a retransmission resends the whole super-segment
+            test.execute(Tick{rto});
+            test.execute(ExpectSegment{}.with_payload_size(30000).with_seqno(isn + 1));
+            test.execute(AckReceived(isn + 2 + 40000));
+            test.execute(ExpectState{TCPSenderStateSummary::FIN_ACKED});
+        }
+
         {
             TCPConfig cfg;
             WrappingInt32 isn(rd());
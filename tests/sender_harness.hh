@@ -336,7 +336,7 @@ struct ExpectSegment : public SenderExpectation {
 
     virtual std::string description() const { return "segment sent with " + segment_description(); }
 
-    void execute(TCPSender &, std::queue<TCPSegment> &segments) const {
+    void execute(TCPSender &sender, std::queue<TCPSegment> &segments) const {
         if (segments.empty()) {
             throw SegmentExpectationViolation::violated_verb("existed");
         }
@@ -367,7 +367,7 @@ struct ExpectSegment : public SenderExpectation {
             throw SegmentExpectationViolation::violated_field(
                 "payload_size", payload_size.value(), seg.payload().size());
         }
-        if (seg.payload().size() > TCPConfig::MAX_PAYLOAD_SIZE) {
+        if (seg.payload().size() > sender.max_payload_size()) {
             throw SegmentExpectationViolation("packet has length (" + std::to_string(seg.payload().size()) +
                                               ") greater than the maximum");
         }
@@ -394,7 +394,7 @@ class TCPSenderTestHarness {
   public:
     TCPSenderTestHarness(const std::string &name_, TCPConfig config)
         : outbound_segments()
-        , sender(config.send_capacity, config.rt_timeout, config.fixed_isn)
+        , sender(config.send_capacity, config.rt_timeout, config.fixed_isn, config.max_payload_size)
         , steps_executed()
         , name(name_) {
         sender.fill_window();
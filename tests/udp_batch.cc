@@ -0,0 +1,115 @@
+#include "socket.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! A pair of UDP sockets bound to localhost, the receiver non-blocking
+struct Pair {
+    UDPSocket sender{}, receiver{};
+
+    Pair() {
+        sender.bind(Address{"127.0.0.1", 0});
+        receiver.bind(Address{"127.0.0.1", 0});
+        receiver.set_blocking(false);
+    }
+};
+
+void check_round_trip() {
+    Pair p;
+    UDPSocket::RecvRing ring{4, 100};
+    if (p.receiver.recv_batch(ring) != 0 or ring.size() != 0) {
+        throw runtime_error("recv_batch() found datagrams on an idle socket");
+    }
+
+    // payloads of several buffers, and an empty one
+    vector<BufferList> payloads;
+    for (const char *s : {"zero", "one", "", "three", "four", "five"}) {
+        BufferList payload{string(s)};
+        payload.append(BufferList{string("!")});
+        payloads.push_back(payload);
+    }
+    payloads.push_back(BufferList{});
+
+    // skip the first, as if it had already been sent
+    if (p.sender.send_batch(p.receiver.local_address(), payloads, 1) != payloads.size() - 1) {
+        throw runtime_error("send_batch() didn't send every datagram");
+    }
+
+    vector<string> received;
+    for (size_t n = p.receiver.recv_batch(ring); n > 0; n = p.receiver.recv_batch(ring)) {
+        if (n > ring.capacity() or n != ring.size()) {
+            throw runtime_error("recv_batch() returned more than the ring holds");
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (ring.source_address(i) != p.sender.local_address()) {
+                throw runtime_error("wrong source address");
+            }
+            received.emplace_back(ring.payload(i));
+        }
+    }
+    if (received != vector<string>{"one!", "!", "three!", "four!", "five!", ""}) {
+        throw runtime_error("datagrams received out of order or changed");
+    }
+}
+
+void check_oversized() {
+    Pair p;
+    p.sender.send_batch(p.receiver.local_address(), {BufferList{string(101, 'x')}});
+    UDPSocket::RecvRing ring{4, 100};
+    try {
+        p.receiver.recv_batch(ring);
+    } catch (const runtime_error &) {
+        return;
+    }
+    throw runtime_error("recv_batch() accepted a datagram too big for the ring");
+}
+
+void check_segmentation_offload() {
+    Pair p;
+    UDPSocket::RecvRing ring{4};
+    const vector<BufferList> payloads{BufferList{string(100, 'a') + string(100, 'b') + string(50, 'c')}};
+
+    // without UDP GRO, the kernel delivers the datagrams it split the GSO datagram into
+    if (p.sender.send_batch(p.receiver.local_address(), payloads, 0, {100}) != 1) {
+        throw runtime_error("send_batch() didn't send the GSO datagram");
+    }
+    vector<string> received;
+    while (p.receiver.recv_batch(ring) > 0) {
+        for (size_t i = 0; i < ring.size(); i++) {
+            if (ring.segment_size(i) != 0) {
+                throw runtime_error("datagram coalesced without UDP GRO");
+            }
+            received.emplace_back(ring.payload(i));
+        }
+    }
+    if (received != vector<string>{string(100, 'a'), string(100, 'b'), string(50, 'c')}) {
+        throw runtime_error("GSO datagram split wrongly");
+    }
+
+    // with it, they arrive as one, with the segment size to split it by
+    p.receiver.set_gro(true);
+    p.sender.send_batch(p.receiver.local_address(), payloads, 0, {100});
+    if (p.receiver.recv_batch(ring) != 1 or ring.payload(0) != payloads.front().concatenate() or
+        ring.segment_size(0) != 100) {
+        throw runtime_error("UDP GRO didn't deliver the segments coalesced");
+    }
+}
+
+int main() {
+    try {
+        check_round_trip();
+        check_oversized();
+        check_segmentation_offload();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}